@@ -0,0 +1,90 @@
+/*  Hex dump benchmark.
+ *
+ *  Measures the throughput of hexdump_write_data() and hexdump_flush_data(),
+ *  by showing a large block of random binary data in ring-buffer-sized chunks,
+ *  with console output sent to `/dev/null`, and compares it with the data rate
+ *  of a serial port at 4 Mbaud.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "buffer.h"
+#include "hexdump.h"
+
+#define DATA_SIZE   (64 * 1024 * 1024)      // Size of random data.
+#define CHUNK_SIZE  (64 * 1024)             // Size of shown chunks.
+#define LINE_RATE   400000.0                // Bytes per second at 4 Mbaud.
+
+// Get monotonic time in seconds.
+double now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Measure hex dump throughput, in MB/s of data shown.
+double measure (const char * data, size_t size, bool color) {
+    buffer_t chunk;     // Chunk of data.
+    hexdump_dir_t dir;  // Direction of chunk.
+    double start;       // Start time.
+    double end;         // End time.
+
+    if (hexdump_open(color, CHUNK_SIZE) < 0) {
+        return 0.0;
+    }
+    start = now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE) {
+        chunk.data = (char *)data + i;
+        chunk.count = (size - i < CHUNK_SIZE) ? size - i : CHUNK_SIZE;
+        chunk.size = 0;
+        dir = ((i / CHUNK_SIZE) % 2) ? HEXDUMP_TX : HEXDUMP_RX;
+        hexdump_write_data(dir, &chunk);
+        hexdump_flush_data();
+    }
+    end = now();
+    hexdump_close();
+    return size / (end - start) / 1e6;
+}
+
+int main (void) {
+    char * data;        // Random data.
+    int out, null;      // Standard output, and `/dev/null`.
+    double plain, rgb;  // Throughputs.
+
+    data = (char *)malloc(DATA_SIZE * sizeof(char));
+    if (data == NULL) {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = rand();
+    }
+
+    // Send console output to `/dev/null` while measuring.
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    if (out < 0 || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Failed to open '/dev/null'\n");
+        return EXIT_FAILURE;
+    }
+    plain = measure(data, DATA_SIZE, false);
+    rgb = measure(data, DATA_SIZE, true);
+    dup2(out, STDOUT_FILENO);
+
+    printf("%-6s %12s %12s\n", "mode", "data (MB/s)", "x 4 Mbaud");
+    printf("%-6s %12.1f %12.1f\n", "hex", plain, plain * 1e6 / LINE_RATE);
+    printf("%-6s %12.1f %12.1f\n", "color", rgb, rgb * 1e6 / LINE_RATE);
+    printf("Hex dump of random data, in %d KiB chunks.\n", CHUNK_SIZE / 1024);
+
+    free(data);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,230 @@
+/*  Round-trip latency benchmark.
+ *
+ *  Runs the real program with its serial port looped back, and measures the
+ *  time from typing a short request on the console until it comes back on
+ *  screen, once with default settings, once with `-n`, and once with `-c` on
+ *  a raw console, whose input is a pseudo-terminal. Without arguments,
+ *  the serial port is a pseudo-terminal whose other side echoes everything
+ *  back. Given a serial port with TX wired to RX, and optionally a baud rate,
+ *  the real driver and adapter are measured, e.g.
+ *  `bin/bench-latency /dev/ttyUSB0 3000000`.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/wait.h>
+
+#define PROG        "./bin/serial-terminal" // Program to be benchmarked.
+#define COUNT       2000                    // Number of requests.
+#define TIMEOUT     1.0                     // Request timeout in seconds.
+
+// Get monotonic time in seconds.
+double now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Compare latencies for sorting.
+int compare (const void * a, const void * b) {
+    double x = *(const double *)a;  // First latency.
+    double y = *(const double *)b;  // Second latency.
+
+    return (x > y) - (x < y);
+}
+
+// Run program on a serial port, or on a pseudo-terminal echoing its data if
+// none is specified, and print the round-trip latencies.
+int run (const char * mode, const char * port, const char * baud) {
+    int master = -1, slave = -1;    // Pseudo-terminal pair.
+    int in[2], out[2];              // Console input and output pipes.
+    int con = -1, tty = -1;         // Console pseudo-terminal pair.
+    int key;                        // Console input to type into.
+    char * args[16];                // Program arguments.
+    int n = 0;                      // Number of program arguments.
+    pid_t pid;                      // Program process.
+    struct termios cnf;             // Pseudo-terminal configuration.
+    struct pollfd evt[2];           // Event structures.
+    double lat[COUNT];              // Latency of each request.
+    char req[16], buf[256];         // Request and received data.
+    size_t len, got;                // Request and received lengths.
+    ssize_t status;                 // Return status for API calls.
+    double start;                   // Time at which request was typed.
+    int done = 0;                   // Number of requests answered.
+
+    if (port == NULL) {
+        if (openpty(&master, &slave, NULL, NULL, NULL) < 0) {
+            fprintf(
+                stderr, "Failed to open pseudo-terminal (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+        port = ttyname(slave);
+    }
+    if (pipe(in) < 0 || pipe(out) < 0) {
+        fprintf(
+            stderr, "Failed to open benchmark pipes (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+    if (mode != NULL && strcmp(mode, "-c") == 0) {
+        if (openpty(&con, &tty, NULL, NULL, NULL) < 0) {
+            fprintf(
+                stderr, "Failed to open pseudo-terminal (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+    }
+    key = (con >= 0) ? con : in[1];
+
+    // Start program with LF line terminations, so data comes back unchanged.
+    args[n++] = PROG;
+    args[n++] = "-p";
+    args[n++] = (char *)port;
+    args[n++] = "-b";
+    args[n++] = (char *)baud;
+    args[n++] = "-i";
+    args[n++] = "lf";
+    args[n++] = "-o";
+    args[n++] = "lf";
+    if (mode != NULL) {
+        args[n++] = (char *)mode;
+    }
+    args[n] = NULL;
+    pid = fork();
+    if (pid == 0) {
+        dup2((tty >= 0) ? tty : in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        if (master >= 0) {
+            close(master);
+            close(slave);
+        }
+        if (con >= 0) {
+            close(con);
+            close(tty);
+        }
+        execv(PROG, args);
+        fprintf(stderr, "Failed to run '%s' (%s)\n", PROG, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    // Wait until the program has configured the serial port, and the console
+    // if it is raw.
+    start = now();
+    do {
+        usleep(1000);
+        if (master >= 0) {
+            tcgetattr(master, &cnf);
+        }
+        if (con >= 0) {
+            tcgetattr(con, &cnf);
+        }
+    } while (
+        (master >= 0 || con >= 0) && (cnf.c_lflag & ICANON) &&
+        now() < start + 5.0
+    );
+    usleep(200000);
+
+    // Type one request at a time, and wait for it to come back on screen,
+    // echoing it on the far side of the pseudo-terminal.
+    evt[0].fd = out[0];
+    evt[0].events = POLLIN;
+    evt[1].fd = master;
+    evt[1].events = POLLIN;
+    for (done = 0; done < COUNT; done++) {
+        len = snprintf(req, sizeof(req), "ping %05d\n", done);
+        start = now();
+        if (write(key, req, len) != (ssize_t)len) {
+            break;
+        }
+        for (got = 0; got < len && now() < start + TIMEOUT; ) {
+            poll(evt, (master >= 0) ? 2 : 1, (int)(TIMEOUT * 1e3));
+            if (master >= 0 && (evt[1].revents & POLLIN)) {
+                status = read(master, buf, sizeof(buf));
+                if (status > 0 && write(master, buf, status) != status) {
+                    break;
+                }
+            }
+            if (evt[0].revents & POLLIN) {
+                status = read(out[0], buf + got, sizeof(buf) - got);
+                if (status <= 0) {
+                    break;
+                }
+                got += status;
+            }
+        }
+        if (got != len || memcmp(buf, req, len) != 0) {
+            break;
+        }
+        lat[done] = (now() - start) * 1e6;
+    }
+
+    // Stop program.
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+    if (master >= 0) {
+        close(master);
+        close(slave);
+    }
+    if (con >= 0) {
+        close(con);
+        close(tty);
+    }
+    close(in[1]);
+    close(out[0]);
+
+    // Print results.
+    if (done < COUNT) {
+        printf("%-8s request %d not echoed\n", mode ? mode : "default", done);
+    } else {
+        qsort(lat, COUNT, sizeof(double), compare);
+        printf(
+            "%-8s %8.0f %8.0f %8.0f %8.0f\n", mode ? mode : "default",
+            lat[COUNT / 2], lat[COUNT * 99 / 100], lat[COUNT * 999 / 1000],
+            lat[COUNT - 1]
+        );
+    }
+    fflush(stdout);
+
+    return 0;
+}
+
+int main (int argc, char ** argv) {
+    const char * port = (argc > 1) ? argv[1] : NULL;        // Serial port.
+    const char * baud = (argc > 2) ? argv[2] : "115200";    // Baud rate.
+
+    printf(
+        "%-8s %8s %8s %8s %8s\n", "mode", "p50 us", "p99 us", "p999 us",
+        "max us"
+    );
+    if (
+        run(NULL, port, baud) < 0 || run("-n", port, baud) < 0 ||
+        run("-c", port, baud) < 0
+    ) {
+        return EXIT_FAILURE;
+    }
+    printf("Round trip from console input through serial loopback.\n");
+
+    return EXIT_SUCCESS;
+}
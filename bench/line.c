@@ -0,0 +1,102 @@
+/*  Line termination translation benchmark.
+ *
+ *  Measures the throughput of line_process_input_data() and
+ *  line_process_output_data() for every line termination, by translating a
+ *  large block of synthetic text in ring-buffer-sized chunks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "line.h"
+
+#define TEXT_SIZE   (256 * 1024 * 1024)     // Size of synthetic text.
+#define CHUNK_SIZE  (64 * 1024)             // Size of translated chunks.
+#define LINE_SIZE   64                      // Average line length.
+
+// Get monotonic time in seconds.
+double now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fill text with printable characters and line terminations.
+void fill (char * text, size_t size, const char * term) {
+    size_t len = strlen(term);  // Line termination length.
+
+    srand(1);
+    for (size_t i = 0; i < size; ) {
+        if (rand() % LINE_SIZE == 0 && i + len <= size) {
+            memcpy(text + i, term, len);
+            i += len;
+        } else {
+            text[i++] = ' ' + rand() % 95;
+        }
+    }
+}
+
+// Measure translation throughput in one direction, in GB/s.
+double measure (char * text, size_t size, buffer_t * buf, bool input) {
+    buffer_t data;      // Chunk of text.
+    line_state_t state; // Input translation state.
+    double start;       // Start time.
+
+    line_reset_state(&state);
+    start = now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE) {
+        data.data = text + i;
+        data.count = (size - i < CHUNK_SIZE) ? size - i : CHUNK_SIZE;
+        data.size = 0;
+        if (input) {
+            line_process_input_data(&state, &data, buf);
+        } else {
+            line_process_output_data(&data, buf);
+        }
+    }
+    return size / (now() - start) / 1e9;
+}
+
+int main (void) {
+    const char * terms[] = {"cr", "lf", "crlf"};            // Terminations.
+    const char * seqs[] = {"\r", "\n", "\r\n"};             // Their bytes.
+    char * text;                                            // Synthetic text.
+    buffer_t buf;                                           // Translation.
+    double in, out;                                         // Throughputs.
+
+    text = (char *)malloc(TEXT_SIZE * sizeof(char));
+    if (text == NULL || buffer_alloc(&buf, line_get_buffer_size(CHUNK_SIZE))) {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-6s %14s %14s\n", "term", "input (GB/s)", "output (GB/s)");
+    for (int i = 0; i < 3; i++) {
+        line_set_term(terms[i], terms[i]);
+
+        // Input text is terminated as received from the device, output text
+        // is LF-terminated as typed on the console.
+        fill(text, TEXT_SIZE, seqs[i]);
+        in = measure(text, TEXT_SIZE, &buf, true);
+        fill(text, TEXT_SIZE, "\n");
+        out = measure(text, TEXT_SIZE, &buf, false);
+
+        // LF-terminated data passes through untouched, so its throughput is
+        // not meaningful.
+        if (strcmp(terms[i], "lf") == 0) {
+            printf("%-6s %14s %14s\n", terms[i], "passthrough", "passthrough");
+        } else {
+            printf("%-6s %14.2f %14.2f\n", terms[i], in, out);
+        }
+    }
+
+    buffer_free(&buf);
+    free(text);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,604 @@
+/*  End-to-end pseudo-terminal benchmark.
+ *
+ *  Runs the real program on a pseudo-terminal pair standing in for a UART,
+ *  with pipes for its console input and output, and drives synthetic traffic
+ *  through both directions at once: as fast as possible, at a fixed rate, and
+ *  in bursts, for every pair of line terminations. Every byte received is
+ *  checked against the expected translation. Reports sustained throughput,
+ *  the p50/p99/p999 latency from writing a chunk to receiving its last byte,
+ *  and the CPU time the program used per MB moved.
+ *
+ *  Then runs the program with `-P` on 1 and on 64 pseudo-terminal pairs, each
+ *  receiving lines at the rate of a 115200 baud port, and reports the latency
+ *  from writing a line to receiving it tagged, over all ports and for the
+ *  worst port, to show that the latency of a port does not grow with the
+ *  number of ports.
+ *
+ *  Arguments are passed on to the program, e.g. `bin/bench-pty -t`. As most
+ *  options cannot be combined with `-P`, the multi-port runs are only made
+ *  without arguments.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "buffer.h"
+#include "line.h"
+
+#define PROG        "./bin/serial-terminal" // Program to be benchmarked.
+#define LINE_SIZE   64                      // Average line length.
+#define TIMEOUT     60.0                    // Run timeout in seconds.
+#define MAX_ARGS    32                      // Maximum program arguments.
+#define PORT_LINES  400                     // Lines sent to every port.
+#define PORT_RATE   11520.0                 // Bytes per second of a port.
+
+// Traffic pattern. Chunks are due in groups, one group per period.
+typedef struct {
+    const char * name;  // Pattern name.
+    size_t chunk;       // Chunk size.
+    size_t count;       // Number of chunks.
+    size_t group;       // Number of chunks due at once.
+    double period;      // Time between groups in seconds.
+} pattern_t;
+
+// Traffic in one direction.
+typedef struct {
+    int out;            // Descriptor written to.
+    int in;             // Descriptor read from.
+    char * data;        // Data written.
+    char * expect;      // Data expected to be read.
+    size_t total;       // Number of bytes expected to be read.
+    size_t * end;       // Number of bytes expected after each chunk.
+    double * sent;      // Time at which each chunk was written.
+    double * lat;       // Latency of each chunk.
+    size_t next;        // Next chunk to be written.
+    size_t pos;         // Number of bytes of next chunk written.
+    size_t done;        // Number of chunks received.
+    size_t got;         // Number of bytes received.
+    double last;        // Time at which last byte was received.
+    bool bad;           // Flag indicating if unexpected data was received.
+} stream_t;
+
+static const pattern_t patterns[] = {
+    {"flood", 4096, 4096, 1, 0.0},      // 16 MB as fast as possible.
+    {"rate", 256, 4000, 1, 250e-6},     // 1 MB/s in 256 byte chunks.
+    {"burst", 4096, 800, 16, 20e-3},    // 64 KB bursts every 20 ms.
+};
+
+// Get monotonic time in seconds.
+double now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fill text with printable characters and line terminations. No chunk ends
+// in a line termination, so that none is held back at the end of a chunk.
+void fill (char * text, size_t size, size_t chunk, const char * term) {
+    size_t len = strlen(term);  // Line termination length.
+
+    srand(1);
+    for (size_t i = 0; i < size; ) {
+        if (rand() % LINE_SIZE == 0 && i + len <= size) {
+            memcpy(text + i, term, len);
+            i += len;
+        } else {
+            text[i++] = ' ' + rand() % 95;
+        }
+    }
+    for (size_t i = chunk - 1; i < size; i += chunk) {
+        text[i] = 'x';
+    }
+}
+
+// Prepare traffic in one direction, computing the expected data with the
+// line translation of the program.
+int prepare (
+    stream_t * s, const pattern_t * p, const char * term, bool input
+) {
+    size_t size = p->chunk * p->count;  // Number of bytes written.
+    buffer_t buf;                       // Translation buffer.
+    buffer_t data;                      // Translated chunk.
+    line_state_t state;                 // Input translation state.
+
+    memset(s, 0, sizeof(stream_t));
+    s->data = (char *)malloc(size);
+    s->expect = (char *)malloc(line_get_buffer_size(size));
+    s->end = (size_t *)malloc(p->count * sizeof(size_t));
+    s->sent = (double *)malloc(p->count * sizeof(double));
+    s->lat = (double *)malloc(p->count * sizeof(double));
+    if (
+        s->data == NULL || s->expect == NULL || s->end == NULL ||
+        s->sent == NULL || s->lat == NULL ||
+        buffer_alloc(&buf, line_get_buffer_size(p->chunk)) < 0
+    ) {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        return -1;
+    }
+
+    // Serial input is terminated as received from the device, console input
+    // is LF-terminated as typed on the console. Chunks are translated in a
+    // copy, as translation may happen in-place.
+    fill(s->data, size, p->chunk, term);
+    line_reset_state(&state);
+    for (size_t i = 0; i < p->count; i++) {
+        data.data = s->expect + s->total;
+        data.count = p->chunk;
+        data.size = 0;
+        memcpy(data.data, s->data + i * p->chunk, p->chunk);
+        if (input) {
+            line_process_input_data(&state, &data, &buf);
+        } else {
+            line_process_output_data(&data, &buf);
+        }
+        memmove(s->expect + s->total, data.data, data.count);
+        s->total += data.count;
+        s->end[i] = s->total;
+    }
+    buffer_free(&buf);
+
+    return 0;
+}
+
+// Free traffic in one direction.
+void release (stream_t * s) {
+    free(s->data);
+    free(s->expect);
+    free(s->end);
+    free(s->sent);
+    free(s->lat);
+}
+
+// Write as much of the due chunks as possible without blocking. Returns the
+// time at which the next chunk is due, or zero if one is waiting for space.
+double transmit (stream_t * s, const pattern_t * p, double start) {
+    ssize_t status; // Return status for API calls.
+    double due;     // Time at which next chunk is due.
+
+    while (s->next < p->count) {
+        due = start + (s->next / p->group) * p->period;
+        if (now() < due) {
+            return due;
+        }
+        status = write(
+            s->out, s->data + s->next * p->chunk + s->pos, p->chunk - s->pos
+        );
+        if (status < 0) {
+            return 0.0;
+        }
+        s->pos += status;
+        if (s->pos == p->chunk) {
+            s->sent[s->next++] = now();
+            s->pos = 0;
+        }
+    }
+
+    return TIMEOUT + start;
+}
+
+// Read available data, checking it, and record the latency of every chunk
+// received completely.
+void receive (stream_t * s) {
+    char buf[65536];    // Data read.
+    ssize_t status;     // Return status for API calls.
+    double t;           // Time of read.
+
+    status = read(s->in, buf, sizeof(buf));
+    if (status <= 0) {
+        return;
+    }
+    t = now();
+    if (
+        s->got + status > s->total ||
+        memcmp(s->expect + s->got, buf, status) != 0
+    ) {
+        s->bad = true;
+    }
+    s->got += status;
+    s->last = t;
+    while (s->done < s->next && s->got >= s->end[s->done]) {
+        s->lat[s->done] = t - s->sent[s->done];
+        s->done++;
+    }
+}
+
+// Compare latencies for sorting.
+int compare (const void * a, const void * b) {
+    double x = *(const double *)a;  // First latency.
+    double y = *(const double *)b;  // Second latency.
+
+    return (x > y) - (x < y);
+}
+
+// Get a latency percentile in microseconds.
+double percentile (stream_t * s, double p) {
+    return s->lat[(size_t)(p * (s->done - 1))] * 1e6;
+}
+
+// Run program with one traffic pattern and pair of line terminations, and
+// print the results.
+int run (
+    const pattern_t * p, const char * iterm, const char * oterm,
+    const char * seq, int argc, char ** argv
+) {
+    stream_t rx, tx;            // Serial and console input traffic.
+    int master, slave;          // Pseudo-terminal pair.
+    int in[2], out[2];          // Console input and output pipes.
+    char * args[MAX_ARGS];      // Program arguments.
+    int n = 0;                  // Number of program arguments.
+    pid_t pid;                  // Program process.
+    struct termios cnf;         // Pseudo-terminal configuration.
+    struct pollfd evt[4];       // Event structures.
+    struct rusage use;          // Program resource usage.
+    double start, due, wait;    // Start, next due and poll timeout times.
+    double cpu, mb;             // CPU time and megabytes moved.
+    struct timespec ts;         // Poll timeout.
+
+    line_set_term(iterm, oterm);
+    if (prepare(&rx, p, seq, true) < 0 || prepare(&tx, p, "\n", false) < 0) {
+        return -1;
+    }
+    if (
+        openpty(&master, &slave, NULL, NULL, NULL) < 0 || pipe(in) < 0 ||
+        pipe(out) < 0
+    ) {
+        fprintf(
+            stderr, "Failed to open benchmark pipes (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+
+    // Start program on the slave side of the pseudo-terminal pair.
+    args[n++] = PROG;
+    args[n++] = "-p";
+    args[n++] = ttyname(slave);
+    args[n++] = "-b";
+    args[n++] = "115200";
+    args[n++] = "-i";
+    args[n++] = (char *)iterm;
+    args[n++] = "-o";
+    args[n++] = (char *)oterm;
+    for (int i = 1; i < argc && n < MAX_ARGS - 1; i++) {
+        args[n++] = argv[i];
+    }
+    args[n] = NULL;
+    pid = fork();
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        close(master);
+        close(slave);
+        execv(PROG, args);
+        fprintf(stderr, "Failed to run '%s' (%s)\n", PROG, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    // Wait until the program has configured the serial port, which flushes
+    // pending input, and give it a moment to enter its loop.
+    start = now();
+    do {
+        usleep(1000);
+        tcgetattr(master, &cnf);
+    } while ((cnf.c_lflag & ICANON) && now() < start + 5.0);
+    usleep(100000);
+
+    // Serial input is written to the master and read from console output.
+    // Console input is written to console input and read from the master.
+    rx.out = master;
+    rx.in = out[0];
+    tx.out = in[1];
+    tx.in = master;
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+    start = now();
+    while (
+        (rx.done < p->count || tx.done < p->count) && now() < start + TIMEOUT
+    ) {
+        // Write due chunks, and wait for space or for the next due chunk.
+        due = transmit(&rx, p, start);
+        wait = transmit(&tx, p, start);
+        evt[0].fd = master;
+        evt[0].events = POLLIN | ((due == 0.0) ? POLLOUT : 0);
+        evt[1].fd = out[0];
+        evt[1].events = POLLIN;
+        evt[2].fd = in[1];
+        evt[2].events = (wait == 0.0) ? POLLOUT : 0;
+        if (due == 0.0 || (wait != 0.0 && wait < due)) {
+            due = wait;
+        }
+        wait = (due == 0.0) ? 1.0 : due - now();
+        wait = (wait < 0.0) ? 0.0 : wait;
+        ts.tv_sec = (time_t)wait;
+        ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+        ppoll(evt, 3, &ts, NULL);
+
+        // Read and check received data.
+        if (evt[0].revents & POLLIN) {
+            receive(&tx);
+        }
+        if (evt[1].revents & POLLIN) {
+            receive(&rx);
+        }
+    }
+
+    // Stop program and collect its CPU time.
+    kill(pid, SIGINT);
+    wait4(pid, NULL, 0, &use);
+    close(master);
+    close(slave);
+    close(in[1]);
+    close(out[0]);
+    cpu = use.ru_utime.tv_sec + use.ru_utime.tv_usec * 1e-6 +
+        use.ru_stime.tv_sec + use.ru_stime.tv_usec * 1e-6;
+    mb = (rx.got + tx.got) / (1024.0 * 1024.0);
+
+    // Print results.
+    if (rx.done < p->count || tx.done < p->count || rx.bad || tx.bad) {
+        printf(
+            "%-5s %-5s %-6s %s\n", iterm, oterm, p->name,
+            (rx.bad || tx.bad) ? "unexpected data" : "timed out"
+        );
+    } else {
+        qsort(rx.lat, rx.done, sizeof(double), compare);
+        qsort(tx.lat, tx.done, sizeof(double), compare);
+        printf(
+            "%-5s %-5s %-6s %7.2f %7.0f %7.0f %7.0f %7.2f %7.0f %7.2f\n",
+            iterm, oterm, p->name, rx.got / (rx.last - start) / 1e6,
+            percentile(&rx, 0.5), percentile(&rx, 0.99),
+            percentile(&rx, 0.999), tx.got / (tx.last - start) / 1e6,
+            percentile(&tx, 0.99), cpu * 1e3 / mb
+        );
+    }
+    fflush(stdout);
+    release(&rx);
+    release(&tx);
+
+    return 0;
+}
+
+// Run program on the specified number of pseudo-terminal pairs behind one
+// port list, sending lines to every port at its baud rate, and print the
+// latency of receiving them.
+int multi (int count) {
+    int * master;               // Master sides of pseudo-terminal pairs.
+    int * slave;                // Slave sides of pseudo-terminal pairs.
+    double * sent;              // Time at which each line was written.
+    double * lat;               // Latency of each line, by port.
+    size_t * done;              // Number of lines received, by port.
+    double * worst;             // Latency percentile of each port.
+    char list[] = "/tmp/bench-pty-XXXXXX";  // Port list file.
+    FILE * file;                // Port list stream.
+    int in[2], out[2];          // Console input and output pipes.
+    pid_t pid;                  // Program process.
+    struct termios cnf;         // Pseudo-terminal configuration.
+    struct pollfd evt;          // Event structure.
+    char line[LINE_SIZE + 1];   // Line written.
+    char buf[65536];            // Console output not yet parsed.
+    size_t fill = 0;            // Number of bytes in buffer.
+    size_t total = 0;           // Number of lines received.
+    size_t next = 0;            // Next line to be written, over all ports.
+    double period = LINE_SIZE / PORT_RATE;  // Time between lines of a port.
+    double start, due, wait;    // Start, next due and poll timeout times.
+    struct timespec ts;         // Poll timeout.
+    ssize_t status;             // Return status for API calls.
+    char * end, * tag;          // End of received line, and end of its tag.
+    int port;                   // Port of received line.
+    size_t seq;                 // Sequence number of received line.
+    int fd;                     // Port list file descriptor.
+
+    master = (int *)malloc(count * sizeof(int));
+    slave = (int *)malloc(count * sizeof(int));
+    sent = (double *)malloc(count * PORT_LINES * sizeof(double));
+    lat = (double *)malloc(count * PORT_LINES * sizeof(double));
+    done = (size_t *)calloc(count, sizeof(size_t));
+    worst = (double *)malloc(count * sizeof(double));
+    fd = mkstemp(list);
+    file = (fd < 0) ? NULL : fdopen(fd, "w");
+    if (
+        master == NULL || slave == NULL || sent == NULL || lat == NULL ||
+        done == NULL || worst == NULL || file == NULL || pipe(in) < 0 ||
+        pipe(out) < 0
+    ) {
+        fprintf(
+            stderr, "Failed to allocate benchmark ports (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Open pseudo-terminal pairs, and list their slave sides.
+    for (int i = 0; i < count; i++) {
+        if (openpty(&master[i], &slave[i], NULL, NULL, NULL) < 0) {
+            fprintf(
+                stderr, "Failed to open benchmark ports (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+        fcntl(master[i], F_SETFL, O_NONBLOCK);
+        fprintf(file, "%s\n", ttyname(slave[i]));
+    }
+    fclose(file);
+
+    // Start program on the port list.
+    pid = fork();
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        execl(
+            PROG, PROG, "-P", list, "-b", "115200", "-i", "lf", "-o", "lf",
+            (char *)NULL
+        );
+        fprintf(stderr, "Failed to run '%s' (%s)\n", PROG, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    // Wait until the program has configured every port.
+    start = now();
+    for (int i = 0; i < count; i++) {
+        do {
+            usleep(1000);
+            tcgetattr(master[i], &cnf);
+        } while ((cnf.c_lflag & ICANON) && now() < start + 5.0);
+    }
+    usleep(100000);
+
+    // Send lines to every port at its rate, staggering the ports over the
+    // period as independent devices would be, and receive tagged lines.
+    start = now();
+    while (total < (size_t)count * PORT_LINES && now() < start + TIMEOUT) {
+        due = TIMEOUT + start;
+        while (next < (size_t)count * PORT_LINES) {
+            port = next % count;
+            seq = next / count;
+            due = start + (seq + (double)port / count) * period;
+            if (now() < due) {
+                break;
+            }
+            snprintf(line, sizeof(line), "%04d %06zu ", port, seq);
+            memset(line + 12, 'x', LINE_SIZE - 13);
+            line[LINE_SIZE - 1] = '\n';
+            sent[port * PORT_LINES + seq] = now();
+            write(master[port], line, LINE_SIZE);
+            next++;
+        }
+
+        // Wait for console output or the next due line.
+        wait = due - now();
+        wait = (wait < 0.0) ? 0.0 : wait;
+        ts.tv_sec = (time_t)wait;
+        ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+        evt.fd = out[0];
+        evt.events = POLLIN;
+        if (ppoll(&evt, 1, &ts, NULL) <= 0) {
+            continue;
+        }
+        status = read(out[0], buf + fill, sizeof(buf) - fill);
+        if (status <= 0) {
+            break;
+        }
+        fill += status;
+
+        // Record the latency of every complete line received.
+        while ((end = memchr(buf, '\n', fill)) != NULL) {
+            *end = '\0';
+            tag = strstr(buf, "] ");
+            if (
+                tag != NULL && sscanf(tag + 2, "%d %zu", &port, &seq) == 2 &&
+                port >= 0 && port < count && seq < PORT_LINES &&
+                done[port] < PORT_LINES
+            ) {
+                lat[port * PORT_LINES + done[port]++] =
+                    now() - sent[port * PORT_LINES + seq];
+                total++;
+            }
+            fill -= end + 1 - buf;
+            memmove(buf, end + 1, fill);
+        }
+    }
+
+    // Stop program.
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+    unlink(list);
+    close(in[1]);
+    close(out[0]);
+    for (int i = 0; i < count; i++) {
+        close(master[i]);
+        close(slave[i]);
+    }
+
+    // Print latency percentiles over all lines, and the worst p99 of a port.
+    if (total < (size_t)count * PORT_LINES) {
+        printf("%5d %s\n", count, "timed out");
+    } else {
+        for (int i = 0; i < count; i++) {
+            qsort(&lat[i * PORT_LINES], PORT_LINES, sizeof(double), compare);
+            worst[i] = lat[i * PORT_LINES + (size_t)(0.99 * (PORT_LINES - 1))];
+        }
+        qsort(worst, count, sizeof(double), compare);
+        qsort(lat, total, sizeof(double), compare);
+        printf(
+            "%5d %7zu %7.0f %7.0f %7.0f %7.0f\n", count, total,
+            lat[(size_t)(0.5 * (total - 1))] * 1e6,
+            lat[(size_t)(0.99 * (total - 1))] * 1e6,
+            lat[(size_t)(0.999 * (total - 1))] * 1e6, worst[count - 1] * 1e6
+        );
+    }
+    fflush(stdout);
+    free(master);
+    free(slave);
+    free(sent);
+    free(lat);
+    free(done);
+    free(worst);
+
+    return 0;
+}
+
+int main (int argc, char ** argv) {
+    const char * terms[] = {"cr", "lf", "crlf"};    // Terminations.
+    const char * seqs[] = {"\r", "\n", "\r\n"};     // Their bytes.
+    int status;                                     // Return status.
+
+    printf(
+        "%-5s %-5s %-6s %7s %7s %7s %7s %7s %7s %7s\n", "iterm", "oterm",
+        "kind", "RX MB/s", "p50 us", "p99 us", "p999 us", "TX MB/s",
+        "p99 us", "CPU ms"
+    );
+    for (size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); k++) {
+        for (int i = 0; i < 3; i++) {
+            for (int o = 0; o < 3; o++) {
+                status = run(
+                    &patterns[k], terms[i], terms[o], seqs[i], argc, argv
+                );
+                if (status < 0) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+    printf("CPU ms is per MB moved in both directions.\n");
+
+    // Run multi-port mode on few and many ports.
+    if (argc == 1) {
+        printf(
+            "\n%5s %7s %7s %7s %7s %7s\n", "ports", "lines", "p50 us",
+            "p99 us", "p999 us", "max p99"
+        );
+        if (multi(1) < 0 || multi(64) < 0) {
+            return EXIT_FAILURE;
+        }
+        printf("Max p99 is the p99 latency of the slowest port.\n");
+    }
+
+    return EXIT_SUCCESS;
+}
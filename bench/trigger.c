@@ -0,0 +1,134 @@
+/*  Pattern trigger benchmark.
+ *
+ *  Measures the throughput of trigger_process_data() with growing numbers of
+ *  patterns, by searching a large block of synthetic log text in
+ *  ring-buffer-sized chunks, with and without highlighting, and compares it
+ *  with the data rate of a serial port at 4 Mbaud.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "trigger.h"
+
+#define TEXT_SIZE   (64 * 1024 * 1024)      // Size of synthetic text.
+#define CHUNK_SIZE  (64 * 1024)             // Size of searched chunks.
+#define LINE_SIZE   64                      // Average line length.
+#define WORD_SIZE   12                      // Length of patterns.
+#define LINE_RATE   400000.0                // Bytes per second at 4 Mbaud.
+
+// Get monotonic time in seconds.
+double now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fill text with lowercase words and line terminations.
+void fill (char * text, size_t size) {
+    srand(1);
+    for (size_t i = 0; i < size; i++) {
+        if (rand() % LINE_SIZE == 0) {
+            text[i] = '\n';
+        } else if (rand() % 6 == 0) {
+            text[i] = ' ';
+        } else {
+            text[i] = 'a' + rand() % 26;
+        }
+    }
+}
+
+// Write pattern file with the specified number of random lowercase words,
+// about one in ten of which is also found in the text.
+int write_patterns (const char * path, int count, const char * text) {
+    FILE * file;        // Pattern file.
+    size_t pos;         // Position of word found in text.
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    for (int p = 0; p < count; p++) {
+        fprintf(file, "%s ", (p % 2) ? "count" : "color,count");
+        if (p % 10 == 0) {
+            do {
+                pos = (size_t)rand() % (TEXT_SIZE - WORD_SIZE);
+            } while (
+                memchr(text + pos, ' ', 4) || memchr(text + pos, '\n', 4)
+            );
+            fprintf(file, "%.*s\n", 4, text + pos);
+            continue;
+        }
+        for (int i = 0; i < WORD_SIZE; i++) {
+            fputc('a' + rand() % 26, file);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file);
+}
+
+// Measure search throughput, in MB/s.
+double measure (const char * text, size_t size, bool color) {
+    buffer_t data;      // Chunk of text.
+    double start;       // Start time.
+
+    start = now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE) {
+        data.data = (char *)text + i;
+        data.count = (size - i < CHUNK_SIZE) ? size - i : CHUNK_SIZE;
+        data.size = 0;
+        if (trigger_process_data(&data, color) < 0) {
+            return 0.0;
+        }
+    }
+    return size / (now() - start) / 1e6;
+}
+
+int main (void) {
+    const int counts[] = {1, 10, 100, 500, 1000};   // Numbers of patterns.
+    char path[] = "/tmp/bench-trigger-XXXXXX";      // Pattern file.
+    char * text;                                    // Synthetic text.
+    double plain, rgb;                              // Throughputs.
+    int fd;                                         // Pattern file.
+
+    text = (char *)malloc(TEXT_SIZE * sizeof(char));
+    fd = mkstemp(path);
+    if (text == NULL || fd < 0) {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    fill(text, TEXT_SIZE);
+
+    printf(
+        "%-9s %12s %12s %12s\n", "patterns", "count (MB/s)", "color (MB/s)",
+        "x 4 Mbaud"
+    );
+    for (int i = 0; i < 5; i++) {
+        if (
+            write_patterns(path, counts[i], text) < 0 ||
+            trigger_open(path, NULL) < 0
+        ) {
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+        plain = measure(text, TEXT_SIZE, false);
+        rgb = measure(text, TEXT_SIZE, true);
+        trigger_close();
+        printf(
+            "%-9d %12.1f %12.1f %12.0f\n", counts[i], plain, rgb,
+            rgb * 1e6 / LINE_RATE
+        );
+    }
+    printf("Search of log text, in %d KiB chunks.\n", CHUNK_SIZE / 1024);
+
+    unlink(path);
+    free(text);
+    return EXIT_SUCCESS;
+}
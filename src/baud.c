@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "baud.h"
+
+int baud_set_rate (int fd, unsigned long rate) {
+    int status;             // Return status for API calls.
+    struct termios2 cnf;    // Serial port configuration.
+
+    // Get serial port configuration.
+    status = ioctl(fd, TCGETS2, &cnf);
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to obtain serial port configuration (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Replace baud rate, using the same rate for input and output.
+    cnf.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    cnf.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    cnf.c_ispeed = rate;
+    cnf.c_ospeed = rate;
+
+    // Set serial port configuration.
+    status = ioctl(fd, TCSETS2, &cnf);
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to set baud rate %lu (%s)\n",
+            rate, strerror(errno)
+        );
+        return -1;
+    }
+
+    return 0;
+}
+
+int baud_get_rate (int fd, unsigned long * rate) {
+    int status;             // Return status for API calls.
+    struct termios2 cnf;    // Serial port configuration.
+
+    status = ioctl(fd, TCGETS2, &cnf);
+    if (status < 0) {
+        return -1;
+    }
+    *rate = cnf.c_ospeed;
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+/** @defgroup   baud    Baud
+ *
+ *  @brief      Arbitrary baud rates.
+ *
+ *  This module contains functions to set and get the baud rate of a serial
+ *  port as a plain number of bits per second, through the `termios2` interface
+ *  of the kernel. Unlike the `Bxxx` constants of `termios`, this supports any
+ *  baud rate the serial driver can generate, such as 6, 8 or 12 Mbaud.
+ *
+ *  The `termios2` definitions conflict with those of `<termios.h>`, so they are
+ *  kept out of every other module.
+ */
+
+#ifndef __BAUD_H__
+#define __BAUD_H__
+
+/** @ingroup    baud
+ *
+ *  @brief      Set baud rate.
+ *
+ *  Sets the input and output baud rate of the specified serial port, leaving
+ *  the rest of its configuration unchanged. The serial driver may round the
+ *  baud rate to the nearest one it can generate.
+ *
+ *  @param      fd      Serial port file descriptor.
+ *  @param      rate    Baud rate in bits per second.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int baud_set_rate (int fd, unsigned long rate);
+
+/** @ingroup    baud
+ *
+ *  @brief      Get baud rate.
+ *
+ *  Gets the output baud rate that the specified serial port actually runs at.
+ *
+ *  @param      fd      Serial port file descriptor.
+ *  @param      rate    Pointer to baud rate in bits per second to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as the serial port has no `termios2` interface.
+ */
+
+int baud_get_rate (int fd, unsigned long * rate);
+
+#endif
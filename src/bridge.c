@@ -0,0 +1,891 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "buffer.h"
+#include "ring.h"
+#include "serial.h"
+#include "event.h"
+#include "bridge.h"
+
+// Maximum number of clients connected at once. Further clients are refused.
+enum {BRIDGE_CLIENT_COUNT = 16};
+
+// Time in ms for which the client that last sent data holds serial output.
+enum {BRIDGE_LEASE = 1000};
+
+// Largest number of bytes read from a client at once.
+enum {BRIDGE_READ_SIZE = 4096};
+
+// Largest number of bytes of a Telnet subnegotiation kept.
+enum {BRIDGE_SUB_SIZE = 64};
+
+// Client queue space kept for Telnet negotiation and answers, at most an eighth
+// of the queue.
+enum {BRIDGE_RESERVE = 1024};
+
+// Telnet commands.
+enum {
+    BRIDGE_SE = 240,        // End of subnegotiation.
+    BRIDGE_SB = 250,        // Start of subnegotiation.
+    BRIDGE_WILL = 251,      // Sender will use option.
+    BRIDGE_WONT = 252,      // Sender will not use option.
+    BRIDGE_DO = 253,        // Receiver must use option.
+    BRIDGE_DONT = 254,      // Receiver must not use option.
+    BRIDGE_IAC = 255        // Interpret as command.
+};
+
+// Telnet options.
+enum {
+    BRIDGE_BINARY = 0,      // Binary transmission.
+    BRIDGE_SGA = 3,         // Suppress go ahead.
+    BRIDGE_COM_PORT = 44    // Com port control, RFC 2217.
+};
+
+// Com port control commands sent by clients. The server answers each with
+// the command number plus 100.
+enum {
+    BRIDGE_SIGNATURE = 0,           // Get or set signature.
+    BRIDGE_SET_BAUDRATE = 1,        // Set baud rate.
+    BRIDGE_SET_DATASIZE = 2,        // Set data bits.
+    BRIDGE_SET_PARITY = 3,          // Set parity.
+    BRIDGE_SET_STOPSIZE = 4,        // Set stop bits.
+    BRIDGE_SET_CONTROL = 5,         // Set flow control, break, DTR or RTS.
+    BRIDGE_NOTIFY_LINESTATE = 6,    // Get line state.
+    BRIDGE_NOTIFY_MODEMSTATE = 7,   // Get modem state.
+    BRIDGE_FLOW_SUSPEND = 8,        // Stop sending data to client.
+    BRIDGE_FLOW_RESUME = 9,         // Resume sending data to client.
+    BRIDGE_LINESTATE_MASK = 10,     // Set line state mask.
+    BRIDGE_MODEMSTATE_MASK = 11,    // Set modem state mask.
+    BRIDGE_PURGE_DATA = 12,         // Discard data held by the driver.
+    BRIDGE_REPLY = 100              // Offset of server answers.
+};
+
+// Signature sent to clients that ask for it.
+static const char _signature[] = "serial-terminal";
+
+// Telnet input parser state.
+typedef enum {
+    BRIDGE_STATE_DATA,      // Data.
+    BRIDGE_STATE_CMD,       // Command, after `IAC`.
+    BRIDGE_STATE_OPT,       // Option, after `WILL`, `WONT`, `DO` or `DONT`.
+    BRIDGE_STATE_SUB,       // Subnegotiation.
+    BRIDGE_STATE_SUB_IAC    // Command within subnegotiation.
+} bridge_state_t;
+
+// Client.
+typedef struct {
+    int fd;                     // Socket.
+    bool telnet;                // Flag indicating if client uses RFC 2217.
+    char name[64];              // Address of client.
+    ring_t queue;               // Serial input not sent yet.
+    bool armed;                 // Flag indicating if waiting for space.
+    bool paused;                // Flag indicating if reading is paused.
+    bool suspended;             // Flag indicating if client stopped data.
+    bool failed;                // Flag indicating if socket failed.
+    int error;                  // Error number of failure.
+    bridge_state_t state;       // Telnet input parser state.
+    uint8_t cmd;                // Telnet command awaiting option.
+    uint8_t sub[BRIDGE_SUB_SIZE];   // Subnegotiation.
+    size_t subs;                // Number of subnegotiation bytes.
+    int will;                   // Options offered with `WILL`, as bits.
+    int does;                   // Options requested with `DO`, as bits.
+    unsigned long dropped;      // Bytes dropped, as queue was full.
+} bridge_client_t;
+
+static int _listen_fd[2] = {-1, -1};    // Raw and RFC 2217 listening sockets.
+static serial_t * _serial;              // Serial port.
+static size_t _size;                    // Size of client queues.
+static bridge_writer_t _writer;         // Writer of serial output.
+static bridge_space_t _space;           // Getter of free serial output space.
+
+static bridge_client_t * _client[BRIDGE_CLIENT_COUNT];  // Clients.
+static int _telnets;                    // Number of RFC 2217 clients.
+static bridge_client_t * _owner;        // Client holding serial output.
+static uint64_t _owned;                 // Time owner last sent data in ms.
+static bool _break;                     // Flag indicating if break is sent.
+static buffer_t _esc;                   // Serial input with `IAC` escaped.
+static uint8_t _in[BRIDGE_READ_SIZE];   // Client input.
+
+static unsigned long _clients;          // Number of clients served.
+static unsigned long _refused;          // Number of clients refused.
+static unsigned long _fanned;           // Bytes of serial input fanned out.
+static unsigned long _dropped;          // Bytes dropped for slow clients.
+static unsigned long _received;         // Bytes of serial output received.
+static unsigned long _ignored;          // Bytes discarded by arbitration.
+
+// Get monotonic time in ms.
+static uint64_t _now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Listen on address given as `[<host>:]<port>`.
+static int _listen (const char * addr) {
+    char host[256];             // Host, or empty for all interfaces.
+    const char * port;          // Port.
+    const char * sep;           // Separator of host and port.
+    const char * start = addr;  // Start of host.
+    size_t len;                 // Length of host.
+    struct addrinfo hints;      // Address criteria.
+    struct addrinfo * list;     // Matching addresses.
+    int status;                 // Return status for API calls.
+    int fd = -1;                // Listening socket.
+    int on = 1;                 // Socket option value.
+
+    // Split host from port, removing the brackets of an IPv6 host.
+    sep = strrchr(addr, ':');
+    port = (sep != NULL) ? sep + 1 : addr;
+    len = (sep != NULL) ? (size_t)(sep - addr) : 0;
+    if (len >= 2 && addr[0] == '[' && addr[len - 1] == ']') {
+        start++;
+        len -= 2;
+    }
+    if (len >= sizeof(host) || *port == '\0') {
+        fprintf(stderr, "Invalid bridge address '%s'\n", addr);
+        return -1;
+    }
+    memcpy(host, start, len);
+    host[len] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    status = getaddrinfo((len > 0) ? host : NULL, port, &hints, &list);
+    if (status != 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to resolve bridge address '%s' (%s)\n",
+            addr, gai_strerror(status)
+        );
+        return -1;
+    }
+
+    // Listen on first address that works.
+    errno = 0;
+    for (struct addrinfo * ai = list; ai != NULL; ai = ai->ai_next) {
+        fd = socket(
+            ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            ai->ai_protocol
+        );
+        if (fd < 0) {
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (
+            bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+            listen(fd, BRIDGE_CLIENT_COUNT) == 0
+        ) {
+            break;
+        }
+        status = errno;
+        close(fd);
+        errno = status;
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    if (fd < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to listen on '%s' (%s)\n", addr, strerror(errno)
+        );
+        return -1;
+    }
+    return fd;
+}
+
+// Watch client for input unless paused, and for output space while data is
+// queued.
+static int _watch (bridge_client_t * c) {
+    return event_modify_handler(
+        c->fd, (c->paused ? 0 : EPOLLIN) | (c->armed ? EPOLLOUT : 0)
+    );
+}
+
+// Disconnect client, discarding the data queued for it.
+static void _drop (bridge_client_t * c, const char * reason) {
+    fprintf(stderr, "Client %s disconnected (%s)", c->name, reason);
+    if (c->dropped > 0) {
+        fprintf(stderr, ", %lu bytes dropped", c->dropped);
+    }
+    fprintf(stderr, "\n");
+
+    event_remove_handler(c->fd);
+    close(c->fd);
+    ring_free(&c->queue);
+    for (int i = 0; i < BRIDGE_CLIENT_COUNT; i++) {
+        if (_client[i] == c) {
+            _client[i] = NULL;
+        }
+    }
+    if (_owner == c) {
+        _owner = NULL;
+    }
+    _telnets -= c->telnet;
+    free(c);
+}
+
+// Write queued data, and then the specified data, to client with a single
+// vectored write, and queue what the client does not take at once. Data that
+// does not fit into the queue is dropped, but never part of the Telnet stream
+// of an RFC 2217 client, which would leave a broken escape or message: its
+// serial data is dropped whole unless it fits beside the space kept for
+// control messages, which are never dropped. Marks the client as failed if
+// its socket fails, or if a control message does not fit.
+static void _send (
+    bridge_client_t * c, const uint8_t * data, size_t count, bool control
+) {
+    struct iovec iov[3];    // Data to be written.
+    struct msghdr msg;      // Message to be sent.
+    int num = 0;            // Number of buffers.
+    size_t part;            // Bytes before end of queue storage.
+    size_t room;            // Queue space data may take.
+    size_t keep;            // Queue space kept for control messages.
+    ssize_t sent = 0;       // Bytes written.
+    buffer_t rest;          // Data left to be queued.
+
+    if (c->failed) {
+        return;
+    }
+
+    // Decide before writing whether data of an RFC 2217 client fits, as what
+    // is left of it once written must be queued whole.
+    if (c->telnet) {
+        room = c->queue.size - c->queue.count;
+        keep = (c->queue.size / 8 < BRIDGE_RESERVE) ?
+            c->queue.size / 8 : BRIDGE_RESERVE;
+        if (!control) {
+            room = (room > keep) ? room - keep : 0;
+        }
+        if (count > room && control) {
+            c->failed = true;
+            c->error = ENOBUFS;
+            return;
+        } else if (count > room) {
+            c->dropped += count;
+            _dropped += count;
+            count = 0;
+        }
+    }
+
+    // Unless waiting for space, write queued data, which may wrap around the
+    // end of its storage, and new data at once.
+    if (!c->armed && !c->suspended) {
+        part = c->queue.size - c->queue.tail;
+        part = (c->queue.count < part) ? c->queue.count : part;
+        if (part > 0) {
+            iov[num].iov_base = c->queue.buf + c->queue.tail;
+            iov[num++].iov_len = part;
+        }
+        if (c->queue.count > part) {
+            iov[num].iov_base = c->queue.buf;
+            iov[num++].iov_len = c->queue.count - part;
+        }
+        if (count > 0) {
+            iov[num].iov_base = (void *)data;
+            iov[num++].iov_len = count;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = num;
+        sent = (num > 0) ? sendmsg(c->fd, &msg, MSG_NOSIGNAL) : 0;
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            c->failed = true;
+            c->error = errno;
+            return;
+        }
+        sent = (sent < 0) ? 0 : sent;
+        part = ((size_t)sent < c->queue.count) ? (size_t)sent : c->queue.count;
+        ring_drop_data(&c->queue, part);
+        sent -= part;
+    }
+
+    // Queue rest of data, dropping what does not fit.
+    rest.data = (char *)data + sent;
+    rest.count = count - sent;
+    rest.size = 0;
+    if (rest.count > c->queue.size - c->queue.count) {
+        c->dropped += rest.count - (c->queue.size - c->queue.count);
+        _dropped += rest.count - (c->queue.size - c->queue.count);
+        rest.count = c->queue.size - c->queue.count;
+    }
+    ring_put_data(&c->queue, &rest);
+
+    // Wait for space while data is queued.
+    if (c->queue.count > 0 && !c->armed && !c->suspended) {
+        c->armed = true;
+        if (_watch(c) < 0) {
+            c->failed = true;
+            c->error = errno;
+        }
+    }
+}
+
+// Send Telnet option negotiation to client.
+static void _negotiate (bridge_client_t * c, uint8_t cmd, uint8_t opt) {
+    uint8_t msg[3] = {BRIDGE_IAC, cmd, opt};    // Negotiation.
+
+    _send(c, msg, sizeof(msg), true);
+}
+
+// Send com port control answer to client, with `IAC` bytes of its value
+// escaped.
+static void _answer (
+    bridge_client_t * c, uint8_t cmd, const uint8_t * value, size_t len
+) {
+    uint8_t msg[2 * BRIDGE_SUB_SIZE + 6];   // Subnegotiation.
+    size_t n = 0;                           // Length of subnegotiation.
+
+    msg[n++] = BRIDGE_IAC;
+    msg[n++] = BRIDGE_SB;
+    msg[n++] = BRIDGE_COM_PORT;
+    msg[n++] = cmd + BRIDGE_REPLY;
+    for (size_t i = 0; i < len && i < BRIDGE_SUB_SIZE; i++) {
+        if (value[i] == BRIDGE_IAC) {
+            msg[n++] = BRIDGE_IAC;
+        }
+        msg[n++] = value[i];
+    }
+    msg[n++] = BRIDGE_IAC;
+    msg[n++] = BRIDGE_SE;
+    _send(c, msg, n, true);
+}
+
+// Answer com port control command with a single byte.
+static void _answer_byte (bridge_client_t * c, uint8_t cmd, uint8_t value) {
+    _answer(c, cmd, &value, 1);
+}
+
+// Get bit of Telnet option that clients may use, or 0 for other options.
+static int _option_bit (uint8_t opt) {
+    switch (opt) {
+        case BRIDGE_BINARY:
+            return 1;
+        case BRIDGE_SGA:
+            return 2;
+        case BRIDGE_COM_PORT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Answer Telnet option negotiation. Binary transmission, suppressed go ahead
+// and com port control are agreed to once, and other options refused.
+static void _handle_option (bridge_client_t * c, uint8_t cmd, uint8_t opt) {
+    int bit = _option_bit(opt);     // Bit of option, or 0.
+
+    if (cmd == BRIDGE_DO && bit == 0) {
+        _negotiate(c, BRIDGE_WONT, opt);
+    } else if (cmd == BRIDGE_DO && !(c->will & bit)) {
+        c->will |= bit;
+        _negotiate(c, BRIDGE_WILL, opt);
+    } else if (cmd == BRIDGE_WILL && bit == 0) {
+        _negotiate(c, BRIDGE_DONT, opt);
+    } else if (cmd == BRIDGE_WILL && !(c->does & bit)) {
+        c->does |= bit;
+        _negotiate(c, BRIDGE_DO, opt);
+    }
+}
+
+// Set serial port control, and answer with the resulting state.
+static void _set_control (bridge_client_t * c, uint8_t value) {
+    int lines = 0;  // Modem lines set.
+
+    switch (value) {
+        case 1:
+            serial_set_flow(_serial, SERIAL_FLOW_NONE);
+            break;
+        case 2:
+            serial_set_flow(_serial, SERIAL_FLOW_XONXOFF);
+            break;
+        case 3:
+            serial_set_flow(_serial, SERIAL_FLOW_RTSCTS);
+            break;
+        case 5:
+        case 6:
+            if (serial_set_break(_serial, value == 5) == 0) {
+                _break = (value == 5);
+            }
+            break;
+        case 8:
+            serial_set_lines(_serial, TIOCM_DTR, 0);
+            break;
+        case 9:
+            serial_set_lines(_serial, 0, TIOCM_DTR);
+            break;
+        case 11:
+            serial_set_lines(_serial, TIOCM_RTS, 0);
+            break;
+        case 12:
+            serial_set_lines(_serial, 0, TIOCM_RTS);
+            break;
+        default:
+            break;
+    }
+
+    // Answer with the state of what was set or asked for.
+    serial_get_lines(_serial, &lines);
+    if (value <= 3) {
+        value = (_serial->flow == SERIAL_FLOW_RTSCTS) ? 3 :
+            (_serial->flow == SERIAL_FLOW_XONXOFF) ? 2 : 1;
+    } else if (value <= 6) {
+        value = _break ? 5 : 6;
+    } else if (value <= 9) {
+        value = (lines & TIOCM_DTR) ? 8 : 9;
+    } else if (value <= 12) {
+        value = (lines & TIOCM_RTS) ? 11 : 12;
+    }
+    _answer_byte(c, BRIDGE_SET_CONTROL, value);
+}
+
+// Get modem state as sent to clients.
+static uint8_t _modem_state (void) {
+    int lines = 0;  // Modem lines set.
+
+    serial_get_lines(_serial, &lines);
+    return ((lines & TIOCM_CAR) ? 0x80 : 0) | ((lines & TIOCM_RNG) ? 0x40 : 0) |
+        ((lines & TIOCM_DSR) ? 0x20 : 0) | ((lines & TIOCM_CTS) ? 0x10 : 0);
+}
+
+// Handle com port control command. Values of 0 ask for the current state.
+static void _handle_command (bridge_client_t * c) {
+    uint8_t cmd = c->sub[1];        // Command.
+    const uint8_t * v = c->sub + 2; // Value.
+    size_t len = c->subs - 2;       // Length of value.
+    serial_frame_t frame;           // Character frame.
+    unsigned long rate;             // Baud rate.
+    uint8_t msg[4];                 // Baud rate as sent to clients.
+
+    serial_get_frame(_serial, &frame);
+    switch (cmd) {
+        case BRIDGE_SIGNATURE:
+            if (len == 0) {
+                _answer(
+                    c, cmd, (const uint8_t *)_signature,
+                    sizeof(_signature) - 1
+                );
+            }
+            break;
+        case BRIDGE_SET_BAUDRATE:
+            rate = (len == 4) ? (unsigned long)v[0] << 24 | v[1] << 16 |
+                v[2] << 8 | v[3] : 0;
+            if (rate > 0) {
+                serial_set_rate(_serial, rate);
+            }
+            if (serial_get_rate(_serial, &rate) < 0) {
+                rate = 0;
+            }
+            msg[0] = rate >> 24;
+            msg[1] = rate >> 16;
+            msg[2] = rate >> 8;
+            msg[3] = rate;
+            _answer(c, cmd, msg, sizeof(msg));
+            break;
+        case BRIDGE_SET_DATASIZE:
+            if (len == 1 && v[0] >= 5 && v[0] <= 8) {
+                frame.bits = v[0];
+                serial_set_frame(_serial, &frame);
+                serial_get_frame(_serial, &frame);
+            }
+            _answer_byte(c, cmd, frame.bits);
+            break;
+        case BRIDGE_SET_PARITY:
+            if (len == 1 && v[0] >= 1 && v[0] <= 5) {
+                frame.parity = (serial_parity_t)(v[0] - 1);
+                serial_set_frame(_serial, &frame);
+                serial_get_frame(_serial, &frame);
+            }
+            _answer_byte(c, cmd, frame.parity + 1);
+            break;
+        case BRIDGE_SET_STOPSIZE:
+            if (len == 1 && (v[0] == 1 || v[0] == 2)) {
+                frame.stop = v[0];
+                serial_set_frame(_serial, &frame);
+                serial_get_frame(_serial, &frame);
+            }
+            _answer_byte(c, cmd, frame.stop);
+            break;
+        case BRIDGE_SET_CONTROL:
+            _set_control(c, (len == 1) ? v[0] : 0);
+            break;
+        case BRIDGE_NOTIFY_LINESTATE:
+            _answer_byte(c, cmd, 0);
+            break;
+        case BRIDGE_NOTIFY_MODEMSTATE:
+            _answer_byte(c, cmd, _modem_state());
+            break;
+        case BRIDGE_FLOW_SUSPEND:
+            c->suspended = true;
+            break;
+        case BRIDGE_FLOW_RESUME:
+            c->suspended = false;
+            _send(c, NULL, 0, false);
+            break;
+        case BRIDGE_LINESTATE_MASK:
+        case BRIDGE_MODEMSTATE_MASK:
+            _answer(c, cmd, v, len);
+            break;
+        case BRIDGE_PURGE_DATA:
+            if (len == 1 && v[0] >= 1 && v[0] <= 3) {
+                serial_purge_data(
+                    _serial, (v[0] == 1) ? TCIFLUSH :
+                    (v[0] == 2) ? TCOFLUSH : TCIOFLUSH
+                );
+            }
+            _answer(c, cmd, v, len);
+            break;
+        default:
+            break;
+    }
+}
+
+// Remove Telnet commands from client input in place, and handle them.
+// Returns the number of data bytes left.
+static size_t _parse (bridge_client_t * c, uint8_t * buf, size_t count) {
+    size_t len = 0; // Number of data bytes.
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t b = buf[i];     // Input byte.
+
+        switch (c->state) {
+            case BRIDGE_STATE_DATA:
+                if (b == BRIDGE_IAC) {
+                    c->state = BRIDGE_STATE_CMD;
+                } else {
+                    buf[len++] = b;
+                }
+                break;
+            case BRIDGE_STATE_CMD:
+                c->state = BRIDGE_STATE_DATA;
+                if (b == BRIDGE_IAC) {
+                    buf[len++] = b;
+                } else if (b >= BRIDGE_WILL && b <= BRIDGE_DONT) {
+                    c->cmd = b;
+                    c->state = BRIDGE_STATE_OPT;
+                } else if (b == BRIDGE_SB) {
+                    c->subs = 0;
+                    c->state = BRIDGE_STATE_SUB;
+                }
+                break;
+            case BRIDGE_STATE_OPT:
+                _handle_option(c, c->cmd, b);
+                c->state = BRIDGE_STATE_DATA;
+                break;
+            case BRIDGE_STATE_SUB:
+                if (b == BRIDGE_IAC) {
+                    c->state = BRIDGE_STATE_SUB_IAC;
+                } else if (c->subs < BRIDGE_SUB_SIZE) {
+                    c->sub[c->subs++] = b;
+                }
+                break;
+            case BRIDGE_STATE_SUB_IAC:
+                if (b == BRIDGE_IAC) {
+                    if (c->subs < BRIDGE_SUB_SIZE) {
+                        c->sub[c->subs++] = b;
+                    }
+                    c->state = BRIDGE_STATE_SUB;
+                    break;
+                }
+                if (
+                    b == BRIDGE_SE && c->subs >= 2 &&
+                    c->sub[0] == BRIDGE_COM_PORT
+                ) {
+                    _handle_command(c);
+                }
+                c->state = BRIDGE_STATE_DATA;
+                break;
+        }
+    }
+    return len;
+}
+
+// Read client input, and write its data to serial output if the client holds
+// it. Reading is paused while the serial output queue is full.
+static int _receive (bridge_client_t * c) {
+    size_t space;       // Free serial output space.
+    ssize_t count;      // Bytes read.
+    size_t len;         // Data bytes read.
+    buffer_t data;      // Data to be written.
+    uint64_t now;       // Current time.
+
+    space = _space();
+    if (space == 0) {
+        c->paused = true;
+        return _watch(c);
+    }
+    space = (space < sizeof(_in)) ? space : sizeof(_in);
+    count = recv(c->fd, _in, space, 0);
+    if (count == 0) {
+        _drop(c, "closed");
+        return 0;
+    } else if (count < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            _drop(c, strerror(errno));
+        }
+        return 0;
+    }
+    len = c->telnet ? _parse(c, _in, count) : (size_t)count;
+    if (c->failed) {
+        _drop(c, strerror(c->error));
+        return 0;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // Discard data while another client holds serial output.
+    _received += len;
+    now = _now();
+    if (_owner != NULL && _owner != c && now - _owned < BRIDGE_LEASE) {
+        _ignored += len;
+        return 0;
+    }
+    _owner = c;
+    _owned = now;
+    data.data = (char *)_in;
+    data.count = len;
+    data.size = 0;
+    return _writer(&data);
+}
+
+// Client event handler.
+static int _handle_client (int fd, uint32_t events, void * arg) {
+    bridge_client_t * c = (bridge_client_t *)arg;   // Client.
+
+    // Write queued data once there is space for it.
+    if (events & EPOLLOUT) {
+        c->armed = false;
+        _send(c, NULL, 0, false);
+        if (c->failed) {
+            _drop(c, strerror(c->error));
+            return 0;
+        }
+        if (!c->armed && _watch(c) < 0) {
+            return -1;
+        }
+    }
+    // A client that hung up while paused has nothing left worth waiting for.
+    if (c->paused && (events & (EPOLLHUP | EPOLLERR))) {
+        _drop(c, "closed");
+        return 0;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        return _receive(c);
+    }
+    return 0;
+}
+
+// Listening socket event handler. Accepts a client, and offers RFC 2217
+// clients binary transmission and com port control.
+static int _handle_listen (int fd, uint32_t events, void * arg) {
+    struct sockaddr_storage addr;   // Client address.
+    socklen_t len = sizeof(addr);   // Length of client address.
+    char host[48], port[8];         // Client host and port.
+    bridge_client_t * c;            // Client.
+    int cfd;                        // Client socket.
+    int slot = -1;                  // Free client slot.
+    int on = 1;                     // Socket option value.
+
+    cfd = accept4(
+        fd, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC
+    );
+    if (cfd < 0) {
+        return 0;
+    }
+    if (
+        getnameinfo(
+            (struct sockaddr *)&addr, len, host, sizeof(host), port,
+            sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV
+        ) != 0
+    ) {
+        strcpy(host, "?");
+        strcpy(port, "?");
+    }
+    for (int i = 0; i < BRIDGE_CLIENT_COUNT && slot < 0; i++) {
+        slot = (_client[i] == NULL) ? i : -1;
+    }
+    if (slot < 0) {
+        fprintf(
+            stderr, "Refused client %s:%s, as %d are connected\n",
+            host, port, BRIDGE_CLIENT_COUNT
+        );
+        _refused++;
+        close(cfd);
+        return 0;
+    }
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    // Set up client.
+    c = (bridge_client_t *)calloc(1, sizeof(bridge_client_t));
+    if (c == NULL || ring_alloc(&c->queue, _size) < 0) {
+        fprintf(stderr, "Failed to accept client (%s)\n", strerror(errno));
+        free(c);
+        close(cfd);
+        return 0;
+    }
+    c->fd = cfd;
+    c->telnet = (fd == _listen_fd[1]);
+    snprintf(c->name, sizeof(c->name), "%s:%s", host, port);
+    if (
+        event_register_handler(cfd, EPOLLIN, false, _handle_client, c) < 0
+    ) {
+        ring_free(&c->queue);
+        free(c);
+        close(cfd);
+        return 0;
+    }
+    _client[slot] = c;
+    _telnets += c->telnet;
+    _clients++;
+    fprintf(
+        stderr, "Client %s connected (%s)\n", c->name,
+        c->telnet ? "RFC 2217" : "raw"
+    );
+    if (c->telnet) {
+        c->will = _option_bit(BRIDGE_BINARY) | _option_bit(BRIDGE_SGA);
+        c->does = _option_bit(BRIDGE_BINARY) | _option_bit(BRIDGE_COM_PORT);
+        _negotiate(c, BRIDGE_WILL, BRIDGE_BINARY);
+        _negotiate(c, BRIDGE_DO, BRIDGE_BINARY);
+        _negotiate(c, BRIDGE_WILL, BRIDGE_SGA);
+        _negotiate(c, BRIDGE_DO, BRIDGE_COM_PORT);
+        if (c->failed) {
+            _drop(c, strerror(c->error));
+        }
+    }
+    return 0;
+}
+
+int bridge_open (
+    const char * raw, const char * telnet, serial_t * serial, size_t size,
+    bridge_writer_t writer, bridge_space_t space
+) {
+    const char * addr[2] = {raw, telnet};   // Listening addresses.
+
+    _serial = serial;
+    _size = size;
+    _writer = writer;
+    _space = space;
+    _owner = NULL;
+    _break = false;
+    _telnets = 0;
+
+    for (int i = 0; i < 2; i++) {
+        if (addr[i] == NULL) {
+            continue;
+        }
+        _listen_fd[i] = _listen(addr[i]);
+        if (
+            _listen_fd[i] < 0 || event_register_handler(
+                _listen_fd[i], EPOLLIN, false, _handle_listen, NULL
+            ) < 0
+        ) {
+            // On error, stop listening and exit with failure.
+            bridge_close();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void bridge_close (void) {
+    for (int i = 0; i < BRIDGE_CLIENT_COUNT; i++) {
+        if (_client[i] != NULL) {
+            _drop(_client[i], "bridge closed");
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (_listen_fd[i] >= 0) {
+            event_remove_handler(_listen_fd[i]);
+            close(_listen_fd[i]);
+            _listen_fd[i] = -1;
+        }
+    }
+    buffer_free(&_esc);
+}
+
+int bridge_write_data (const buffer_t * data) {
+    const char * src = data->data;  // Data not escaped yet.
+    const char * end;               // End of data.
+    const char * iac;               // Next `IAC` byte.
+
+    // Escape `IAC` bytes once for every RFC 2217 client.
+    if (_telnets > 0) {
+        if (buffer_reserve(&_esc, 2 * data->count) < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+        _esc.count = 0;
+        end = data->data + data->count;
+        while (src < end) {
+            iac = memchr(src, BRIDGE_IAC, end - src);
+            iac = (iac != NULL) ? iac + 1 : end;
+            memcpy(_esc.data + _esc.count, src, iac - src);
+            _esc.count += iac - src;
+            if (iac[-1] == (char)BRIDGE_IAC) {
+                _esc.data[_esc.count++] = (char)BRIDGE_IAC;
+            }
+            src = iac;
+        }
+    }
+
+    // Fan data out to every client.
+    for (int i = 0; i < BRIDGE_CLIENT_COUNT; i++) {
+        bridge_client_t * c = _client[i];   // Client.
+
+        if (c == NULL) {
+            continue;
+        }
+        if (c->telnet) {
+            _send(c, (const uint8_t *)_esc.data, _esc.count, false);
+        } else {
+            _send(c, (const uint8_t *)data->data, data->count, false);
+        }
+        if (c->failed) {
+            _drop(c, strerror(c->error));
+        }
+    }
+    _fanned += data->count;
+
+    return 0;
+}
+
+int bridge_resume_data (void) {
+    for (int i = 0; i < BRIDGE_CLIENT_COUNT; i++) {
+        if (_client[i] != NULL && _client[i]->paused) {
+            _client[i]->paused = false;
+            if (_watch(_client[i]) < 0) {
+                // On error, exit with failure.
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void bridge_report (void) {
+    fprintf(
+        stderr, "Bridge: %lu clients, %lu refused, %lu bytes fanned out, %lu "
+        "bytes dropped, %lu bytes received, %lu bytes discarded\n", _clients,
+        _refused, _fanned, _dropped, _received, _ignored
+    );
+}
@@ -0,0 +1,132 @@
+/** @defgroup   bridge  Bridge
+ *
+ *  @brief      TCP and RFC 2217 network bridge.
+ *
+ *  This module contains functions to share the open serial port with clients
+ *  over TCP, so that remote machines, such as CI runners, reach it without a
+ *  cable of their own. Clients connect either raw, exchanging plain serial
+ *  data, or with the Telnet Com Port Control Option of RFC 2217, which also
+ *  lets them set the baud rate, character frame, flow control, modem control
+ *  lines and break of the serial port, and read its modem lines.
+ *
+ *  Serial input is fanned out to every client. Each client has its own
+ *  bounded queue, written with vectored writes that never block, so that a
+ *  slow client only loses data itself, and never stalls the serial port or
+ *  the other clients. Serial output is arbitrated: the client that last sent
+ *  data holds the serial port for one second after, and data from other
+ *  clients is discarded meanwhile. Clients are only read while the serial
+ *  output queue has room for their data.
+ */
+
+#ifndef __BRIDGE_H__
+#define __BRIDGE_H__
+
+#include <stddef.h>
+
+#include "buffer.h"
+#include "serial.h"
+
+/** @ingroup    bridge
+ *
+ *  @brief      Bridge writer.
+ *
+ *  Writes client data to the serial port without blocking, queueing what
+ *  cannot be written at once.
+ *
+ *  @param      data    Pointer to buffer to be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+typedef int (* bridge_writer_t) (const buffer_t * data);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Bridge output space getter.
+ *
+ *  Gets the number of bytes the writer takes without dropping any.
+ *
+ *  @return     Free output space in bytes.
+ */
+
+typedef size_t (* bridge_space_t) (void);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Start network bridge.
+ *
+ *  Listens for raw clients, RFC 2217 clients, or both, on the specified
+ *  addresses, each given as `[<host>:]<port>`, all interfaces being listened
+ *  on without host, and registers their event handlers.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @param      raw     Address for raw clients, or `NULL`.
+ *  @param      telnet  Address for RFC 2217 clients, or `NULL`.
+ *  @param      serial  Pointer to open serial port, which clients configure.
+ *  @param      size    Size of the queue of every client in bytes.
+ *  @param      writer  Writer of serial output.
+ *  @param      space   Getter of free serial output space.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int bridge_open (
+    const char * raw, const char * telnet, serial_t * serial, size_t size,
+    bridge_writer_t writer, bridge_space_t space
+);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Stop network bridge.
+ *
+ *  Disconnects every client, discarding the data queued for it, and stops
+ *  listening.
+ */
+
+void bridge_close (void);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Fan out serial input.
+ *
+ *  Writes the specified serial input data to every client, or queues it for
+ *  clients that cannot take it at once. Data that does not fit into the queue
+ *  of a client is dropped for that client.
+ *
+ *  @param      data    Pointer to serial input data.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int bridge_write_data (const buffer_t * data);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Resume reading clients.
+ *
+ *  Resumes reading clients that were paused for lack of serial output space.
+ *  This function must be called whenever the serial output queue drains.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int bridge_resume_data (void);
+
+/** @ingroup    bridge
+ *
+ *  @brief      Print bridge statistics.
+ *
+ *  Writes the number of clients served, and of bytes fanned out, dropped for
+ *  slow clients, received from clients and discarded by arbitration to
+ *  `stderr`.
+ */
+
+void bridge_report (void);
+
+#endif
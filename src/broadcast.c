@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+#include "broadcast.h"
+
+// Minimum size of records area.
+enum {BROADCAST_MIN_SIZE = 65536};
+
+// Longest time in ms a reader sleeps before checking whether to stop.
+enum {BROADCAST_WAIT = 1000};
+
+static int _fd = -1;                    // Ring file descriptor.
+static shmring_header_t * _ring;        // Mapped ring.
+static char * _base;                    // Records area.
+static size_t _length;                  // Length of mapping.
+static uint64_t _head;                  // Write cursor.
+static char * _path;                    // Path at which ring is published.
+static struct timespec _start;          // Monotonic start time.
+
+static unsigned long _records;          // Number of records published.
+static unsigned long _bytes;            // Number of data bytes published.
+static unsigned long _wakes;            // Number of `FUTEX_WAKE` calls.
+
+static volatile sig_atomic_t _stop;     // Flag indicating if reader stops.
+
+// Make room for the specified number of bytes at the write cursor, by
+// advancing the oldest intact record past the records about to be overwritten.
+// Readers check it after copying a record, so it is advanced before they can
+// see any overwritten byte.
+static void _reserve (size_t len) {
+    uint64_t tail;              // Oldest intact record.
+    shmring_record_t rec;       // Record about to be overwritten.
+
+    tail = atomic_load_explicit(&_ring->tail, memory_order_relaxed);
+    if (_head + len - tail <= _ring->size) {
+        return;
+    }
+    while (_head + len - tail > _ring->size) {
+        memcpy(&rec, _base + (tail & (_ring->size - 1)), sizeof(rec));
+        tail += (sizeof(rec) + rec.count + 15) / 16 * 16;
+    }
+    atomic_store_explicit(&_ring->tail, tail, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Append a record to the ring, after padding the ring up to its end if the
+// record would wrap around it. The write cursor is not published.
+static void _append (const shmring_record_t * rec, const char * data) {
+    shmring_record_t pad = {0};     // Padding record.
+    size_t len;                     // Length of record.
+    size_t pos;                     // Position of record in records area.
+
+    len = (sizeof(*rec) + rec->count + 15) / 16 * 16;
+    pos = _head & (_ring->size - 1);
+    if (pos + len > _ring->size) {
+        pad.count = _ring->size - pos - sizeof(pad);
+        pad.dir = SHMRING_PAD;
+        _reserve(_ring->size - pos);
+        memcpy(_base + pos, &pad, sizeof(pad));
+        _head += _ring->size - pos;
+        pos = 0;
+    }
+    _reserve(len);
+    memcpy(_base + pos, rec, sizeof(*rec));
+    memcpy(_base + pos + sizeof(*rec), data, rec->count);
+    _head += len;
+}
+
+int broadcast_open (const char * path, size_t size) {
+    char link[64];      // Path to ring descriptor in `/proc`.
+    struct stat st;     // Status of existing file at path.
+    size_t pow = BROADCAST_MIN_SIZE;    // Size of records area.
+
+    while (pow < size) {
+        pow *= 2;
+    }
+    _length = SHMRING_OFFSET + pow;
+
+    // Create ring, sealed against resizing, so that readers may map it safely.
+    _fd = memfd_create("serial-terminal", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (
+        _fd < 0 || ftruncate(_fd, _length) < 0 ||
+        fcntl(
+            _fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL
+        ) < 0
+    ) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to create broadcast ring (%s)\n", strerror(errno)
+        );
+        if (_fd >= 0) {
+            close(_fd);
+            _fd = -1;
+        }
+        return -1;
+    }
+    _ring = (shmring_header_t *)mmap(
+        NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0
+    );
+    if (_ring == MAP_FAILED) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to map broadcast ring (%s)\n", strerror(errno)
+        );
+        close(_fd);
+        _fd = -1;
+        return -1;
+    }
+    _base = (char *)_ring + SHMRING_OFFSET;
+    _ring->magic = SHMRING_MAGIC;
+    _ring->version = SHMRING_VERSION;
+    _ring->size = pow;
+    _ring->offset = SHMRING_OFFSET;
+    _head = 0;
+    clock_gettime(CLOCK_MONOTONIC, &_start);
+
+    // Publish ring as a link to its descriptor, replacing a stale link.
+    snprintf(link, sizeof(link), "/proc/%d/fd/%d", (int)getpid(), _fd);
+    if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) {
+        unlink(path);
+    }
+    _path = strdup(path);
+    if (_path == NULL || symlink(link, path) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to publish broadcast ring at '%s' (%s)\n", path,
+            strerror(errno)
+        );
+        free(_path);
+        _path = NULL;
+        broadcast_close();
+        return -1;
+    }
+
+    return 0;
+}
+
+void broadcast_close (void) {
+    if (_fd < 0) {
+        return;
+    }
+
+    // Wake readers, so that they find the ring closed.
+    atomic_store_explicit(&_ring->closed, 1, memory_order_release);
+    atomic_fetch_add_explicit(&_ring->wake, 1, memory_order_release);
+    syscall(SYS_futex, &_ring->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+    if (_path != NULL) {
+        unlink(_path);
+        free(_path);
+        _path = NULL;
+    }
+    munmap(_ring, _length);
+    close(_fd);
+    _fd = -1;
+}
+
+void broadcast_write_record (
+    shmring_dir_t dir, unsigned short port, const char * data, size_t count
+) {
+    shmring_record_t rec = {0}; // Record header.
+    struct timespec now;        // Current monotonic time.
+
+    if (_fd < 0 || count == 0) {
+        return;
+    }
+
+    // Stamp records with time since start.
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rec.time = (uint64_t)(now.tv_sec - _start.tv_sec) * 1000000000 +
+        now.tv_nsec - _start.tv_nsec;
+    rec.port = port;
+    rec.dir = (uint8_t)dir;
+
+    // Append data in records of at most a quarter of the ring.
+    _bytes += count;
+    while (count > 0) {
+        rec.count = (count < _ring->size / 4) ? count : _ring->size / 4;
+        _append(&rec, data);
+        data += rec.count;
+        count -= rec.count;
+        _records++;
+    }
+
+    // Publish write cursor, and wake readers if any are sleeping. The wakeup
+    // counter is bumped before the sleeper count is checked, and readers count
+    // themselves before checking the wakeup counter in `FUTEX_WAIT`, so that
+    // either the writer sees a sleeper or the sleeper sees the new counter.
+    atomic_store_explicit(&_ring->head, _head, memory_order_release);
+    atomic_fetch_add_explicit(&_ring->wake, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&_ring->sleepers, memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, &_ring->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        _wakes++;
+    }
+}
+
+// Reader signal handler.
+static void _handle_signal (int sig) {
+    _stop = 1;
+}
+
+// Write data to `stdout`, unless the reader stops.
+static int _write_all (const char * data, size_t count) {
+    ssize_t status; // Return status for API calls.
+
+    while (count > 0 && !_stop) {
+        status = write(STDOUT_FILENO, data, count);
+        if (status < 0 && errno == EINTR) {
+            continue;
+        } else if (status < 0) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to write console data (%s)\n", strerror(errno)
+            );
+            return -1;
+        }
+        data += status;
+        count -= status;
+    }
+    return 0;
+}
+
+int broadcast_attach (const char * path, bool stats) {
+    int fd;                         // Ring file descriptor.
+    const shmring_header_t * ring;  // Mapped ring.
+    shmring_header_t * ctl;         // Writable mapping of ring header.
+    shmring_header_t hdr;           // Ring header.
+    size_t length;                  // Length of mapping.
+    shmring_record_t rec;           // Record read.
+    char * data;                    // Data of record read.
+    uint64_t pos;                   // Position of reader.
+    uint32_t wake;                  // Wakeup counter before reading.
+    struct timespec wait = {BROADCAST_WAIT / 1000, 0};  // Longest sleep.
+    struct sigaction sa;            // Signal action.
+    long status;                    // Return status for API calls.
+    unsigned long records = 0;      // Number of records read.
+    unsigned long bytes = 0;        // Number of data bytes written.
+    unsigned long skipped = 0;      // Number of ring bytes skipped.
+    unsigned long lags = 0;         // Number of times reader fell behind.
+
+    // Open ring, and check its header. Only the sleeper count in the header is
+    // ever written.
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open broadcast ring '%s' (%s)\n", path,
+            strerror(errno)
+        );
+        return -1;
+    }
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        hdr.magic = 0;
+    }
+    if (
+        hdr.magic != SHMRING_MAGIC || hdr.version != SHMRING_VERSION ||
+        hdr.size < BROADCAST_MIN_SIZE || (hdr.size & (hdr.size - 1)) != 0 ||
+        hdr.offset < sizeof(hdr)
+    ) {
+        // On error, exit with failure.
+        fprintf(stderr, "Invalid broadcast ring '%s'\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Map ring read-only and its header writable, and allocate room for the
+    // largest record.
+    length = hdr.offset + hdr.size;
+    ring = (const shmring_header_t *)mmap(
+        NULL, length, PROT_READ, MAP_SHARED, fd, 0
+    );
+    ctl = (shmring_header_t *)mmap(
+        NULL, hdr.offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+    );
+    close(fd);
+    if (ring == MAP_FAILED || ctl == MAP_FAILED) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to map broadcast ring (%s)\n", strerror(errno)
+        );
+        if (ring != MAP_FAILED) {
+            munmap((void *)ring, length);
+        }
+        if (ctl != MAP_FAILED) {
+            munmap(ctl, hdr.offset);
+        }
+        return -1;
+    }
+    data = (char *)malloc(hdr.size / 4);
+    if (data == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to allocate data buffer (%s)\n", strerror(errno)
+        );
+        munmap(ctl, hdr.offset);
+        munmap((void *)ring, length);
+        return -1;
+    }
+
+    // Stop on `SIGINT` or `SIGTERM`, interrupting the wait for data.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Write received data as it is published, starting with the next record,
+    // and sleep while there is none.
+    status = 0;
+    pos = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (!_stop && status >= 0) {
+        wake = atomic_load_explicit(&ring->wake, memory_order_acquire);
+        status = shmring_read_record(ring, &pos, &rec, data);
+        if (status > 0) {
+            records++;
+            if (rec.dir == SHMRING_RX) {
+                status = _write_all(data, rec.count);
+                bytes += rec.count;
+            }
+        } else if (status < 0) {
+            fprintf(stderr, "Fell behind, %ld bytes skipped\n", -status);
+            skipped += -status;
+            lags++;
+            status = 0;
+        } else if (atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+            break;
+        } else {
+            // Count reader as sleeping while it waits, so that the writer
+            // wakes it.
+            atomic_fetch_add_explicit(&ctl->sleepers, 1, memory_order_seq_cst);
+            syscall(
+                SYS_futex, &ring->wake, FUTEX_WAIT, wake, &wait, NULL, 0
+            );
+            atomic_fetch_sub_explicit(&ctl->sleepers, 1, memory_order_relaxed);
+        }
+    }
+
+    if (stats) {
+        fprintf(
+            stderr, "Broadcast reader: %lu records, %lu bytes written, %lu "
+            "bytes skipped, behind %lu times\n", records, bytes, skipped, lags
+        );
+    }
+    free(data);
+    munmap(ctl, hdr.offset);
+    munmap((void *)ring, length);
+
+    return (status < 0) ? -1 : 0;
+}
+
+void broadcast_report (void) {
+    fprintf(
+        stderr, "Broadcast ring: %lu records, %lu bytes, %lu reader wakeups, "
+        "ring of %zu bytes\n", _records, _bytes, _wakes,
+        _length - SHMRING_OFFSET
+    );
+}
@@ -0,0 +1,102 @@
+/** @defgroup   broadcast   Broadcast
+ *
+ *  @brief      Shared memory broadcast of serial data to local readers.
+ *
+ *  This module contains functions to publish the data read from and written
+ *  to the serial ports into a broadcast ring in shared memory, and to attach
+ *  to the ring of another serial terminal as a reader. The ring is a sealed
+ *  `memfd`, published as a symbolic link to its descriptor in `/proc`, so that
+ *  readers open it by path. Its layout is described in shmring.h.
+ *
+ *  The writer never waits for readers: a reader that falls behind by more than
+ *  the size of the ring detects that the records it was about to read were
+ *  overwritten, and carries on from the oldest intact record.
+ */
+
+#ifndef __BROADCAST_H__
+#define __BROADCAST_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "shmring.h"
+
+/** @ingroup    broadcast
+ *
+ *  @brief      Open broadcast ring.
+ *
+ *  Creates a broadcast ring whose records area is the specified size rounded
+ *  up to a power of two, and publishes it at the specified path, replacing a
+ *  symbolic link left there by an earlier session.
+ *
+ *  @param      path    Path at which the ring is published.
+ *  @param      size    Minimum size of records area in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int broadcast_open (const char * path, size_t size);
+
+/** @ingroup    broadcast
+ *
+ *  @brief      Close broadcast ring.
+ *
+ *  Marks the ring as closed, wakes its readers and removes its path. Readers
+ *  that mapped the ring keep it until they unmap it. Does nothing if the ring
+ *  is not open.
+ */
+
+void broadcast_close (void);
+
+/** @ingroup    broadcast
+ *
+ *  @brief      Publish data in broadcast ring.
+ *
+ *  Appends the specified data to the ring, stamped with the current monotonic
+ *  time, overwriting the oldest records if needed, and wakes readers sleeping
+ *  until data arrives, if there are any. Data larger than a quarter of the
+ *  ring is split into several records. Does nothing if the ring is not open.
+ *  May only be called by one thread at a time.
+ *
+ *  @param      dir     Record kind, #SHMRING_RX or #SHMRING_TX.
+ *  @param      port    Port ID of serial port.
+ *  @param      data    Pointer to data to be published.
+ *  @param      count   Number of bytes to be published.
+ */
+
+void broadcast_write_record (
+    shmring_dir_t dir, unsigned short port, const char * data, size_t count
+);
+
+/** @ingroup    broadcast
+ *
+ *  @brief      Attach to broadcast ring.
+ *
+ *  Maps the ring published at the specified path read-only, apart from its
+ *  sleeper count, and writes the data received by its serial ports to `stdout`
+ *  as it is published, until the ring is closed or `SIGINT` or `SIGTERM` is
+ *  received. Whenever the reader
+ *  falls behind, the number of bytes skipped is written to `stderr`.
+ *
+ *  @param      path    Path at which the ring is published.
+ *  @param      stats   Flag indicating if statistics are written to `stderr`
+ *                      on exit.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int broadcast_attach (const char * path, bool stats);
+
+/** @ingroup    broadcast
+ *
+ *  @brief      Print broadcast statistics.
+ *
+ *  Writes the number of records and bytes published, and the number of times
+ *  sleeping readers were woken, to `stderr`.
+ */
+
+void broadcast_report (void);
+
+#endif
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "buffer.h"
+#include "metrics.h"
+
+int buffer_alloc (buffer_t * buf, size_t size) {
+    // Allocate memory.
+    buf->data = (char *)malloc(size * sizeof(char));
+    if (buf->data == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to allocate data buffer (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Count allocation, and empty data buffer.
+    metrics_add_count(METRICS_ALLOCS, 1);
+    buf->count = 0;
+    buf->size = size;
+
+    return 0;
+}
+
+int buffer_reserve (buffer_t * buf, size_t size) {
+    char * data;    // Reallocated memory.
+
+    // If capacity is sufficient, exit with success.
+    if (size <= buf->size) {
+        return 0;
+    }
+
+    // Reallocate memory.
+    data = (char *)realloc(buf->data, size * sizeof(char));
+    if (data == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to allocate data buffer (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    metrics_add_count(METRICS_ALLOCS, 1);
+    buf->data = data;
+    buf->size = size;
+
+    return 0;
+}
+
+void buffer_free (buffer_t * buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->count = 0;
+    buf->size = 0;
+}
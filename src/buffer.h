@@ -0,0 +1,73 @@
+/** @defgroup   buffer  Buffer
+ *
+ *  @brief      Length-delimited data buffers.
+ *
+ *  This module contains functions for managing length-delimited data buffers,
+ *  which are passed between the serial, line and console modules. Since the
+ *  length of the data is carried alongside it, the data may contain any byte
+ *  value, including null bytes.
+ */
+
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
+
+#include <stddef.h>
+
+/** @ingroup    buffer
+ *
+ *  @brief      Data buffer.
+ *
+ *  Refers to a run of bytes, either held in memory owned by the buffer itself
+ *  or in memory owned elsewhere, such as a ring buffer.
+ */
+
+typedef struct {
+    char * data;    /**< Pointer to first byte. */
+    size_t count;   /**< Number of bytes. */
+    size_t size;    /**< Capacity in bytes if memory is owned, or zero. */
+} buffer_t;
+
+/** @ingroup    buffer
+ *
+ *  @brief      Allocate data buffer.
+ *
+ *  Allocates memory for a data buffer of the specified capacity and empties it.
+ *
+ *  @param      buf     Pointer to data buffer to be allocated.
+ *  @param      size    Capacity of data buffer in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int buffer_alloc (buffer_t * buf, size_t size);
+
+/** @ingroup    buffer
+ *
+ *  @brief      Reserve space in data buffer.
+ *
+ *  Ensures that a data buffer allocated with buffer_alloc() has a capacity of
+ *  at least the specified size, reallocating it if necessary. Data held in the
+ *  buffer is preserved.
+ *
+ *  @param      buf     Pointer to data buffer.
+ *  @param      size    Required capacity in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int buffer_reserve (buffer_t * buf, size_t size);
+
+/** @ingroup    buffer
+ *
+ *  @brief      Free data buffer.
+ *
+ *  Frees the memory allocated to a data buffer with buffer_alloc().
+ *
+ *  @param      buf     Pointer to data buffer to be freed.
+ */
+
+void buffer_free (buffer_t * buf);
+
+#endif
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#include "buffer.h"
+#include "capture.h"
+
+// Number of capture blocks. One block is filled while up to two full blocks
+// wait to be written.
+enum {CAPTURE_BLOCK_COUNT = 3};
+
+// Number of capture blocks worth of file space preallocated at a time.
+static const size_t _prealloc = 64;
+
+// Alignment of capture blocks in memory and of their sizes.
+static const size_t _align = 4096;
+
+static int _fd = -1;                // Capture file descriptor.
+static char * _block[CAPTURE_BLOCK_COUNT]; // Capture blocks.
+static size_t _size;                // Capture block size.
+static size_t _fill;                // Number of bytes in block being filled.
+
+static atomic_size_t _head;         // Number of blocks handed to writer.
+static atomic_size_t _tail;         // Number of blocks written by writer.
+static atomic_bool _stop;           // Flag to stop writer thread.
+static atomic_int _error;           // Error number of failed write, or zero.
+static int _wake_fd = -1;           // Signalled to wake up writer thread.
+static pthread_t _thread;           // Writer thread.
+static bool _running = false;       // Flag indicating if writer is running.
+
+static off_t _reserved;             // Number of bytes preallocated in file.
+static bool _falloc;                // Flag indicating if preallocation works.
+
+static unsigned long _blocks;       // Number of blocks written.
+static unsigned long _bytes;        // Number of bytes written.
+static unsigned long _dropped;      // Number of blocks dropped.
+
+// Write data to capture file.
+static int _write (const char * data, size_t count) {
+    ssize_t status; // Return status for API calls.
+
+    while (count > 0) {
+        status = write(_fd, data, count);
+        if (status < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += status;
+        count -= status;
+        _bytes += status;
+    }
+
+    return 0;
+}
+
+// Preallocate file space for data up to the specified file size, without
+// changing the file size. Preallocation is given up if the file system does
+// not support it.
+static void _reserve (off_t size) {
+    int status; // Return status for API calls.
+    off_t len;  // Number of bytes to preallocate.
+
+    if (!_falloc || size <= _reserved) {
+        return;
+    }
+
+    len = (off_t)(_prealloc * _size);
+    status = fallocate(_fd, FALLOC_FL_KEEP_SIZE, _reserved, len);
+    if (status < 0) {
+        _falloc = false;
+        return;
+    }
+    _reserved += len;
+}
+
+// Writer thread. Writes out every block handed to it, in order.
+static void * _run (void * arg) {
+    int status;     // Return status for API calls.
+    uint64_t val;   // Value of event counter.
+    size_t head;    // Number of blocks handed to writer.
+    size_t tail;    // Number of blocks written.
+
+    tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+    while (true) {
+        // Write out all blocks handed over so far. After a failed write, keep
+        // releasing blocks, so that they are counted as dropped.
+        head = atomic_load_explicit(&_head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            if (atomic_load_explicit(&_error, memory_order_relaxed) == 0) {
+                _reserve(_bytes + _size);
+                status = _write(_block[tail % CAPTURE_BLOCK_COUNT], _size);
+                if (status < 0) {
+                    atomic_store_explicit(
+                        &_error, errno, memory_order_relaxed
+                    );
+                } else {
+                    _blocks++;
+                }
+            }
+            atomic_store_explicit(&_tail, tail + 1, memory_order_release);
+        }
+
+        // Once all blocks are written out after a stop request, exit.
+        if (atomic_load(&_stop)) {
+            if (tail == atomic_load_explicit(&_head, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+
+        // Sleep until another block is handed over, or until stopped.
+        read(_wake_fd, &val, sizeof(val));
+    }
+
+    return NULL;
+}
+
+int capture_open (const char * path, size_t size) {
+    int status; // Return status for API calls.
+
+    // Round block size up to a whole number of pages, so that every write
+    // covers whole pages at a page-aligned file offset.
+    _size = (size + _align - 1) / _align * _align;
+
+    // Allocate page-aligned capture blocks.
+    for (size_t i = 0; i < CAPTURE_BLOCK_COUNT; i++) {
+        status = posix_memalign((void **)&_block[i], _align, _size);
+        if (status != 0) {
+            // On error, free blocks and exit with failure.
+            fprintf(
+                stderr, "Failed to allocate capture block (%s)\n",
+                strerror(status)
+            );
+            capture_close();
+            return -1;
+        }
+    }
+
+    // Open capture file.
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (_fd < 0) {
+        // On error, free blocks and exit with failure.
+        fprintf(
+            stderr, "Failed to open capture file '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        capture_close();
+        return -1;
+    }
+
+    // Create wakeup descriptor. Reads from it block the writer thread.
+    _wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (_wake_fd < 0) {
+        // On error, close capture file and exit with failure.
+        fprintf(
+            stderr, "Failed to create capture wakeup descriptor (%s)\n",
+            strerror(errno)
+        );
+        capture_close();
+        return -1;
+    }
+
+    // Reset state and counters, and preallocate initial file space.
+    _fill = 0;
+    atomic_init(&_head, 0);
+    atomic_init(&_tail, 0);
+    atomic_init(&_stop, false);
+    atomic_init(&_error, 0);
+    _reserved = 0;
+    _falloc = true;
+    _blocks = 0;
+    _bytes = 0;
+    _dropped = 0;
+    _reserve(_size);
+
+    // Start writer thread.
+    status = pthread_create(&_thread, NULL, _run, NULL);
+    if (status != 0) {
+        // On error, close capture file and exit with failure.
+        fprintf(
+            stderr, "Failed to start capture writer thread (%s)\n",
+            strerror(status)
+        );
+        capture_close();
+        return -1;
+    }
+    _running = true;
+
+    return 0;
+}
+
+int capture_close (void) {
+    int status = 0;     // Return status for API calls.
+    uint64_t val = 1;   // Value added to event counter.
+    int error;          // Error number of failed write.
+    char * block;       // Partly filled block.
+
+    // Stop writer thread once it has written out all full blocks.
+    if (_running) {
+        atomic_store(&_stop, true);
+        write(_wake_fd, &val, sizeof(val));
+        pthread_join(_thread, NULL);
+        _running = false;
+
+        // Write out partly filled block.
+        error = atomic_load(&_error);
+        if (error == 0 && _fill > 0) {
+            block = _block[atomic_load(&_head) % CAPTURE_BLOCK_COUNT];
+            if (_write(block, _fill) < 0) {
+                error = errno;
+            }
+        }
+        if (error != 0) {
+            fprintf(
+                stderr, "Failed to write capture file (%s)\n",
+                strerror(error)
+            );
+            status = -1;
+        }
+        if (_dropped > 0) {
+            fprintf(
+                stderr, "Capture dropped %lu blocks of %zu bytes\n",
+                _dropped, _size
+            );
+        }
+    }
+
+    // Close descriptors and free blocks.
+    if (_wake_fd >= 0) {
+        close(_wake_fd);
+        _wake_fd = -1;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    for (size_t i = 0; i < CAPTURE_BLOCK_COUNT; i++) {
+        free(_block[i]);
+        _block[i] = NULL;
+    }
+
+    return status;
+}
+
+void capture_write_data (const buffer_t * data) {
+    uint64_t val = 1;   // Value added to event counter.
+    size_t head;        // Number of blocks handed to writer.
+    size_t tail;        // Number of blocks written by writer.
+    size_t pos = 0;     // Number of bytes captured.
+    size_t len;         // Number of bytes copied into block.
+    char * block;       // Block being filled.
+
+    if (!_running) {
+        return;
+    }
+
+    head = atomic_load_explicit(&_head, memory_order_relaxed);
+    while (pos < data->count) {
+        // Copy as much data as fits into block being filled.
+        len = _size - _fill;
+        if (len > data->count - pos) {
+            len = data->count - pos;
+        }
+        block = _block[head % CAPTURE_BLOCK_COUNT];
+        memcpy(block + _fill, data->data + pos, len);
+        _fill += len;
+        pos += len;
+        if (_fill < _size) {
+            break;
+        }
+
+        // Hand full block to writer thread if another block is free to fill
+        // next. Otherwise, drop the full block and fill it again, rather than
+        // waiting for the writer to catch up.
+        tail = atomic_load_explicit(&_tail, memory_order_acquire);
+        if (head - tail < CAPTURE_BLOCK_COUNT - 1) {
+            head++;
+            atomic_store_explicit(&_head, head, memory_order_release);
+            write(_wake_fd, &val, sizeof(val));
+        } else {
+            _dropped++;
+        }
+        _fill = 0;
+    }
+}
+
+void capture_report (void) {
+    fprintf(
+        stderr, "Capture: %lu bytes, %lu blocks of %zu bytes, %lu dropped\n",
+        _bytes, _blocks, _size, _dropped
+    );
+}
@@ -0,0 +1,80 @@
+/** @defgroup   capture Capture
+ *
+ *  @brief      Capture to file.
+ *
+ *  This module contains functions to capture serial input data to a file
+ *  without ever waiting for the disk. Captured data is collected in a small
+ *  number of aligned blocks, and full blocks are handed to a background writer
+ *  thread that writes them out in one piece. If the writer falls behind so far
+ *  that no block is free, the block being filled is dropped and counted,
+ *  instead of holding up the caller.
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** @ingroup    capture
+ *
+ *  @brief      Open capture file.
+ *
+ *  Creates or truncates the specified capture file, allocates the capture
+ *  blocks and starts the writer thread. Space is preallocated in the capture
+ *  file ahead of the data where the file system supports it.
+ *
+ *  @param      path    Path to capture file.
+ *  @param      size    Desired size of each capture block in bytes, which is
+ *                      rounded up to a whole number of pages.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int capture_open (const char * path, size_t size);
+
+/** @ingroup    capture
+ *
+ *  @brief      Close capture file.
+ *
+ *  Waits for the writer thread to write out all full blocks and stops it,
+ *  writes out the partly filled block, and closes the capture file.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure to write capture file. Error message is written
+ *                      to `stderr`.
+ */
+
+int capture_close (void);
+
+/** @ingroup    capture
+ *
+ *  @brief      Capture data.
+ *
+ *  Appends the specified data to the capture blocks, handing each block that
+ *  is filled up to the writer thread. This function never blocks. Does nothing
+ *  if no capture file is open.
+ *
+ *  @note       This function must only ever be called from one thread at a
+ *              time.
+ *
+ *  @param      data    Pointer to data to be captured.
+ */
+
+void capture_write_data (const buffer_t * data);
+
+/** @ingroup    capture
+ *
+ *  @brief      Print capture statistics.
+ *
+ *  Writes the number of bytes and blocks written to the capture file, and the
+ *  number of blocks dropped because the writer fell behind, to `stderr`.
+ *
+ *  @note       This function must be called after capture_close().
+ */
+
+void capture_report (void);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "buffer.h"
+#include "event.h"
+#include "coalesce.h"
+
+static buffer_t _batch;                 // Batch buffer.
+static size_t _size;                    // Size threshold of a batch.
+static unsigned long _delay;            // Maximum delay in microseconds.
+static coalesce_writer_t _writer;       // Writer of batches.
+static int _timer_fd = -1;              // Delay timer.
+
+static unsigned long _bytes;            // Number of bytes written.
+static unsigned long _writes;           // Number of batches written.
+static unsigned long _full;             // Batches written as full.
+static unsigned long _lines;            // Batches written on newline.
+static unsigned long _timeouts;         // Batches written on delay timer.
+
+// Write batch, if not empty.
+static int _flush (void) {
+    int status; // Return status for API calls.
+
+    if (_batch.count == 0) {
+        return 0;
+    }
+    status = _writer(&_batch);
+    _bytes += _batch.count;
+    _writes++;
+    _batch.count = 0;
+    return status;
+}
+
+// Delay timer event handler. Writes the batch once its first byte has waited
+// for the maximum delay. The timer is not stopped when a batch is written
+// early, so an expiry may find no batch. The first byte of a new batch re-arms
+// the timer, which clears any pending expiry, so an expiry never writes a newer
+// batch early.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    uint64_t count; // Number of expirations.
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    if (_batch.count > 0) {
+        _timeouts++;
+    }
+    return _flush();
+}
+
+int coalesce_parse_delay (const char * str, unsigned long * delay) {
+    char * end;             // End of parsed number.
+    unsigned long val;      // Parsed number.
+
+    // Parse number and optional unit suffix.
+    errno = 0;
+    val = strtoul(str, &end, 10);
+    if (errno == 0 && end != str && str[0] != '-') {
+        if (strcmp(end, "ms") == 0) {
+            val *= 1000;
+            end += 2;
+        } else if (strcmp(end, "us") == 0) {
+            end += 2;
+        }
+    }
+
+    // If delay is malformed or out of range, exit with failure.
+    if (
+        errno != 0 || end == str || str[0] == '-' || *end != '\0' ||
+        val == 0 || val > 1000000
+    ) {
+        fprintf(stderr, "Invalid coalescing delay '%s'\n", str);
+        return -1;
+    }
+
+    *delay = val;
+
+    return 0;
+}
+
+int coalesce_open (size_t size, unsigned long delay, coalesce_writer_t writer) {
+    int status; // Return status for API calls.
+
+    // Allocate batch buffer.
+    status = buffer_alloc(&_batch, size);
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _size = size;
+    _delay = delay;
+    _writer = writer;
+
+    // Create delay timer, and register its handler.
+    _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timer_fd < 0) {
+        // On error, free batch buffer and exit with failure.
+        fprintf(stderr, "Failed to create timer (%s)\n", strerror(errno));
+        buffer_free(&_batch);
+        return -1;
+    }
+    status = event_register_handler(
+        _timer_fd, EPOLLIN, false, _handle_timer, NULL
+    );
+    if (status < 0) {
+        // On error, close timer, free batch buffer and exit with failure.
+        coalesce_close();
+        return -1;
+    }
+
+    return 0;
+}
+
+void coalesce_close (void) {
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        close(_timer_fd);
+        _timer_fd = -1;
+    }
+    buffer_free(&_batch);
+}
+
+int coalesce_write_data (const buffer_t * data, bool flush) {
+    int status;                 // Return status for API calls.
+    struct itimerspec spec;     // Timer expiration.
+    bool full = false;          // Flag indicating if batch was written full.
+
+    // Write batch first if data does not fit, and write large data directly.
+    // Both writes count as one full batch.
+    if (_batch.count > 0 && _batch.count + data->count > _size) {
+        _full++;
+        full = true;
+        status = _flush();
+        if (status < 0) {
+            return -1;
+        }
+    }
+    if (data->count >= _size) {
+        _full += full ? 0 : 1;
+        _bytes += data->count;
+        _writes++;
+        return _writer(data);
+    }
+
+    // Add data to batch. Start delay timer for the first byte of a batch.
+    if (_batch.count == 0 && data->count > 0 && !flush) {
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = _delay / 1000000;
+        spec.it_value.tv_nsec = (_delay % 1000000) * 1000;
+        status = timerfd_settime(_timer_fd, 0, &spec, NULL);
+        if (status < 0) {
+            // On error, exit with failure.
+            fprintf(stderr, "Failed to set timer (%s)\n", strerror(errno));
+            return -1;
+        }
+    }
+    memcpy(_batch.data + _batch.count, data->data, data->count);
+    _batch.count += data->count;
+
+    // If requested, write batch at once.
+    if (flush && _batch.count > 0) {
+        _lines++;
+        return _flush();
+    }
+
+    return 0;
+}
+
+int coalesce_flush_data (void) {
+    return _flush();
+}
+
+size_t coalesce_get_count (void) {
+    return _batch.count;
+}
+
+void coalesce_report (void) {
+    fprintf(
+        stderr, "Coalesced output: %lu bytes in %lu writes (%.1f per write), "
+        "%lu full, %lu on newline, %lu on delay\n",
+        _bytes, _writes, _writes ? (double)_bytes / _writes : 0.0,
+        _full, _lines, _timeouts
+    );
+}
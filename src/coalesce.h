@@ -0,0 +1,130 @@
+/** @defgroup   coalesce Coalesce
+ *
+ *  @brief      Serial output write coalescing.
+ *
+ *  This module contains functions to batch serial output data into fewer,
+ *  larger writes. Data is collected until the batch reaches a size threshold,
+ *  until a newline asks for it to be sent at once, or until a maximum delay
+ *  has passed since its first byte, whichever comes first. The delay is kept
+ *  by a one-shot timer in the event loop, so that the latency of a single
+ *  keystroke stays bounded while bulk data goes out in large writes.
+ */
+
+#ifndef __COALESCE_H__
+#define __COALESCE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Batch writer.
+ *
+ *  Writes a batch of serial output data.
+ *
+ *  @param      data    Pointer to buffer to be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+typedef int (* coalesce_writer_t) (const buffer_t * data);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Parse coalescing delay.
+ *
+ *  Parses a delay given in microseconds, or in milliseconds with suffix `ms`,
+ *  such as `500` or `1ms`.
+ *
+ *  @param      str     String representation of delay.
+ *  @param      delay   Pointer to delay in microseconds to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int coalesce_parse_delay (const char * str, unsigned long * delay);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Start coalescing.
+ *
+ *  Allocates the batch buffer, and registers the delay timer in the event
+ *  loop.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @param      size    Size threshold of a batch in bytes.
+ *  @param      delay   Maximum delay of a byte in microseconds.
+ *  @param      writer  Writer of full batches.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int coalesce_open (size_t size, unsigned long delay, coalesce_writer_t writer);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Stop coalescing.
+ *
+ *  Frees the batch buffer, and closes the delay timer. Data still held must be
+ *  written with coalesce_flush_data() first.
+ */
+
+void coalesce_close (void);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Add data to batch.
+ *
+ *  Adds the specified data to the batch, writing the batch first if the data
+ *  does not fit. Data at least as large as the size threshold is written
+ *  directly. Starts the delay timer when the batch becomes non-empty.
+ *
+ *  @param      data    Pointer to buffer to be added.
+ *  @param      flush   Flag indicating if batch is written at once, e.g. as
+ *                      data ends a line.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int coalesce_write_data (const buffer_t * data, bool flush);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Write batch.
+ *
+ *  Writes all data held in the batch, if any.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int coalesce_flush_data (void);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Get batch size.
+ *
+ *  @return     Number of bytes held in the batch.
+ */
+
+size_t coalesce_get_count (void);
+
+/** @ingroup    coalesce
+ *
+ *  @brief      Print coalescing statistics.
+ *
+ *  Writes the number of bytes and writes, and what caused the writes, to
+ *  `stderr`.
+ */
+
+void coalesce_report (void);
+
+#endif
@@ -1,75 +1,366 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
 #include <sys/types.h>
-#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <poll.h>
 
-void console_get_wakeup_evt (struct pollfd * evt) {
-    // Initialize wakeup event structure with zeros.
-    memset(evt, 0, sizeof(struct pollfd));
+#include "buffer.h"
+#include "ring.h"
+#include "metrics.h"
+#include "console.h"
 
-    // Configure wakeup event to trigger when input arrives on standard input.
-    evt->fd = fileno(stdin);
-    evt->events = POLLIN;
-}
+// Size of buffer raw console input is read through.
+enum {CONSOLE_RAW_SIZE = 4096};
 
-int console_read_data (char ** data) {
-    ssize_t status; // Return status for API calls.
-    char * buf;     // Pointer to current location in buffer.
-    int count;      // Number of characters to read.
+// Maximum number of buffers written with one vectored write.
+enum {CONSOLE_VECTOR_SIZE = 4};
+
+// Escape character of raw console, Ctrl-].
+enum {CONSOLE_ESCAPE = 0x1d};
+
+static int _flags_old;          // Old standard input file status flags.
+static bool _raw = false;       // Flag indicating if console is raw.
+static bool _escape = false;    // Flag indicating if escape was typed last.
+static struct termios _cnf_old; // Old terminal configuration.
+
+int console_open_stdio (bool raw) {
+    int status;             // Return status for API calls.
+    struct termios cnf_new; // New terminal configuration.
+
+    // Get old standard input file status flags.
+    _flags_old = fcntl(fileno(stdin), F_GETFL);
+    if (_flags_old < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to obtain console configuration (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
 
-    // Get console input queue size.
-    status = ioctl(fileno(stdin), FIONREAD, &count);
+    // Make standard input non-blocking, so that it can be read until empty.
+    status = fcntl(fileno(stdin), F_SETFL, _flags_old | O_NONBLOCK);
     if (status < 0) {
         // On error, exit with failure.
         fprintf(
-            stderr, "Failed to obtain console input queue size (%s)\n",
+            stderr, "Failed to apply console configuration (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // If requested, and if standard input is a terminal, make it pass every
+    // keystroke on at once, rather than lines, and without echoing it or
+    // generating signals. Enter is still read as a newline, and output is
+    // still post-processed.
+    _raw = raw && isatty(fileno(stdin));
+    _escape = false;
+    if (!_raw) {
+        return 0;
+    }
+    status = tcgetattr(fileno(stdin), &_cnf_old);
+    if (status == 0) {
+        cnf_new = _cnf_old;
+        cnf_new.c_iflag &= ~(IXON | IXOFF | ISTRIP | INLCR | IGNCR);
+        cnf_new.c_lflag &= ~(ICANON | ECHO | ECHONL | ISIG | IEXTEN);
+        cnf_new.c_cc[VMIN] = 1;
+        cnf_new.c_cc[VTIME] = 0;
+        status = tcsetattr(fileno(stdin), TCSANOW, &cnf_new);
+    }
+    if (status < 0) {
+        // On error, restore file status flags and exit with failure.
+        fprintf(
+            stderr, "Failed to apply console configuration (%s)\n",
             strerror(errno)
         );
+        fcntl(fileno(stdin), F_SETFL, _flags_old);
+        _raw = false;
         return -1;
     }
+    if (isatty(fileno(stderr))) {
+        fprintf(stderr, "Raw console, type Ctrl-] q to quit\r\n");
+    }
 
-    // Allocate buffer to fit input data and terminating null byte.
-    *data = (char *)realloc(*data, (count + 1) * sizeof(char));
-    (*data)[count] = '\0';
+    return 0;
+}
 
-    // Read input recursively until buffer is full.
-    buf = *data;
-    while (count > 0) {
-        // Read input.
-        status = read(fileno(stdin), buf, count);
+void console_close_stdio (void) {
+    int status; // Return status for API calls.
+
+    // Set old terminal configuration, discarding unread keystrokes.
+    if (_raw) {
+        status = tcsetattr(fileno(stdin), TCSAFLUSH, &_cnf_old);
         if (status < 0) {
-            // On error, exit with failure.
             fprintf(
-                stderr, "Failed to read console data (%s)\n",
+                stderr, "Failed to revert console configuration (%s)\n",
                 strerror(errno)
             );
+        }
+        _raw = false;
+    }
+
+    // Set old standard input file status flags.
+    status = fcntl(fileno(stdin), F_SETFL, _flags_old);
+    if (status < 0) {
+        fprintf(
+            stderr, "Failed to revert console configuration (%s)\n",
+            strerror(errno)
+        );
+    }
+}
+
+void console_scan_input (buffer_t * data) {
+    size_t n = 0;   // Number of bytes kept.
+    char c;         // Input byte.
+
+    if (!_raw) {
+        return;
+    }
+
+    // Remove escape sequences in place. The escape character followed by
+    // itself stands for the escape character, and followed by any other byte
+    // than a command, for that byte alone. A sequence may span calls.
+    for (size_t i = 0; i < data->count; i++) {
+        c = data->data[i];
+        if (!_escape && c == CONSOLE_ESCAPE) {
+            _escape = true;
+            continue;
+        } else if (_escape && (c == 'q' || c == '.')) {
+            // Quit as if interrupted, which the event loop waits for in every
+            // mode, and drop the rest of the input.
+            _escape = false;
+            kill(getpid(), SIGINT);
+            break;
+        } else if (_escape && c == 's') {
+            // Start or cancel sending a file, in the event loop.
+            _escape = false;
+            kill(getpid(), SIGUSR2);
+            continue;
+        }
+        _escape = false;
+        data->data[n++] = c;
+    }
+    data->count = n;
+}
+
+int console_get_fd (void) {
+    return fileno(stdin);
+}
+
+int console_get_output_fd (void) {
+    return fileno(stdout);
+}
+
+// Read available raw console input into ring buffer through a small buffer,
+// in which escape sequences are removed, until none is left or the ring buffer
+// is full.
+static int _fill_raw (ring_t * ring) {
+    ssize_t status;                 // Return status for API calls.
+    char buf[CONSOLE_RAW_SIZE];     // Input buffer.
+    buffer_t data;                  // Input held in buffer.
+    size_t space;                   // Free space of ring buffer.
+
+    while (ring->count < ring->size) {
+        // Read input.
+        space = ring->size - ring->count;
+        space = (space < sizeof(buf)) ? space : sizeof(buf);
+        status = read(fileno(stdin), buf, space);
+        ring->reads++;
+        if (status < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // If no input is left, exit with success.
+                break;
+            } else if (errno == EINTR) {
+                // If interrupted, try again.
+                continue;
+            }
+            // On other errors, exit with failure.
             return -1;
+        } else if (status == 0) {
+            // On end of file, exit with success, indicating end of file.
+            return 1;
         }
-        // Update current location in buffer, and number of remaining input
-        // characters to read.
-        buf += status;
-        count -= status;
+
+        // Remove escape sequences, and copy the rest into ring buffer.
+        data.data = buf;
+        data.count = status;
+        data.size = sizeof(buf);
+        console_scan_input(&data);
+        ring_put_data(ring, &data);
+
+        // If read came up short, no input is left.
+        if ((size_t)status < space) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int console_read_data (ring_t * ring) {
+    int status;             // Return status for API calls.
+    unsigned long bytes;    // Number of bytes read before reading.
+
+    // Read available input into ring buffer, directly unless the console is
+    // raw, and count it.
+    bytes = ring->bytes;
+    status = _raw ? _fill_raw(ring) : ring_fill(ring, fileno(stdin));
+    metrics_add_count(METRICS_CONSOLE_IN, ring->bytes - bytes);
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to read console data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    return status;
+}
+
+int console_read_buffer (buffer_t * buf) {
+    ssize_t status; // Return status for API calls.
+    buffer_t data;  // Data read.
+
+    // Read available input into free space of buffer.
+    do {
+        status = read(
+            fileno(stdin), buf->data + buf->count, buf->size - buf->count
+        );
+    } while (status < 0 && errno == EINTR);
+    if (status < 0) {
+        // If no input is available, exit with success.
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to read console data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    } else if (status == 0) {
+        // On end of file, exit with success, indicating end of file.
+        return 1;
     }
 
+    // Remove escape sequences, count input, and update buffer size.
+    data.data = buf->data + buf->count;
+    data.count = status;
+    data.size = buf->size - buf->count;
+    console_scan_input(&data);
+    metrics_add_count(METRICS_CONSOLE_IN, data.count);
+    buf->count += data.count;
+
     return 0;
 }
 
-int console_write_data (const char * data) {
+int console_try_write_data (const buffer_t * data, size_t * count) {
     ssize_t status; // Return status for API calls.
-    size_t count;   // Number of characters to write.
 
-    // Get buffer size.
-    count = strlen(data);
+    // Write as much output as possible without blocking.
+    do {
+        status = write(fileno(stdout), data->data, data->count);
+        metrics_add_count(METRICS_CONSOLE_WRITES, 1);
+    } while (status < 0 && errno == EINTR);
+    if (status < 0) {
+        // If no output space is available, exit with success.
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            metrics_add_count(METRICS_CONSOLE_STALLS, 1);
+            *count = 0;
+            return 0;
+        }
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to write console data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    metrics_add_count(METRICS_CONSOLE_OUT, status);
+    *count = status;
+
+    return 0;
+}
+
+int console_try_write_vector (const buffer_t * data, int num, size_t * count) {
+    struct iovec iov[CONSOLE_VECTOR_SIZE];  // Buffers to be written.
+    ssize_t status;                         // Return status for API calls.
+
+    num = (num < CONSOLE_VECTOR_SIZE) ? num : CONSOLE_VECTOR_SIZE;
+    for (int i = 0; i < num; i++) {
+        iov[i].iov_base = data[i].data;
+        iov[i].iov_len = data[i].count;
+    }
+
+    // Write as much output as possible without blocking.
+    do {
+        status = writev(fileno(stdout), iov, num);
+        metrics_add_count(METRICS_CONSOLE_WRITES, 1);
+    } while (status < 0 && errno == EINTR);
+    if (status < 0) {
+        // If no output space is available, exit with success.
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            metrics_add_count(METRICS_CONSOLE_STALLS, 1);
+            *count = 0;
+            return 0;
+        }
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to write console data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    metrics_add_count(METRICS_CONSOLE_OUT, status);
+    *count = status;
+
+    return 0;
+}
+
+int console_write_data (const buffer_t * data) {
+    ssize_t status;     // Return status for API calls.
+    const char * buf;   // Pointer to current location in buffer.
+    size_t count;       // Number of characters to write.
+    struct pollfd evt;  // Output space event structure.
+    uint64_t start;     // Start time of stall.
+
+    // Start at beginning of buffer.
+    buf = data->data;
+    count = data->count;
 
     // Write output recursively until buffer is empty.
     while (count > 0) {
         // Write output.
-        status = write(fileno(stdout), data, count);
+        status = write(fileno(stdout), buf, count);
+        metrics_add_count(METRICS_CONSOLE_WRITES, 1);
         if (status < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Standard output may share its file status flags with
+                // non-blocking standard input. If it is full, wait until there
+                // is space, timing the stall.
+                metrics_add_count(METRICS_CONSOLE_STALLS, 1);
+                start = metrics_get_time();
+                evt.fd = fileno(stdout);
+                evt.events = POLLOUT;
+                poll(&evt, 1, -1);
+                metrics_add_sample(
+                    METRICS_STALL_TIME, metrics_get_time() - start
+                );
+                continue;
+            } else if (errno == EINTR) {
+                // If interrupted, try again.
+                continue;
+            }
             // On error, exit with failure.
             fprintf(
                 stderr, "Failed to write console data (%s)\n",
@@ -77,9 +368,10 @@ int console_write_data (const char * data) {
             );
             return -1;
         }
-        // Update current location in buffer, and number of remaining output
-        // characters to write.
-        data += status;
+        // Count output, and update current location in buffer, and number of
+        // remaining output characters to write.
+        metrics_add_count(METRICS_CONSOLE_OUT, status);
+        buf += status;
         count -= status;
     }
 
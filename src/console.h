@@ -3,58 +3,182 @@
  *  @brief      Console I/O.
  *
  *  This module contains functions for reading and writing console data.
+ *
+ *  A console on a terminal can be made raw, so that every keystroke is read
+ *  as soon as it is typed. As the terminal then no longer turns Ctrl-C into
+ *  an interrupt, typing the escape character Ctrl-] followed by `q` or `.`
+ *  quits instead, and followed by `s` starts or cancels sending a file. Typing
+ *  it twice enters it once.
  */
 
 #ifndef __CONSOLE_H__
 #define __CONSOLE_H__
 
-#include <poll.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+#include "ring.h"
+
+/** @ingroup    console
+ *
+ *  @brief      Prepare console I/O.
+ *
+ *  Makes standard input non-blocking, so that console input can be read
+ *  until none is left without probing for its size beforehand.
+ *
+ *  If requested, and if standard input is a terminal, the terminal is also
+ *  made raw: input is read per keystroke rather than per line, without echo,
+ *  signals or XON/XOFF flow control, while Enter is still read as a newline.
+ *  The original terminal configuration is saved, to be restored later.
+ *
+ *  @param      raw     Flag indicating if console is made raw.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int console_open_stdio (bool raw);
+
+/** @ingroup    console
+ *
+ *  @brief      Restore console I/O.
+ *
+ *  Restores the original configuration of standard input, and that of the
+ *  terminal if it was made raw.
+ */
+
+void console_close_stdio (void);
+
+/** @ingroup    console
+ *
+ *  @brief      Remove escape sequences from console input.
+ *
+ *  If the console is raw, removes the escape sequences from the specified
+ *  console input data in place, and sends `SIGINT` to the process to quit on
+ *  the quit sequence, dropping the rest of the data, and `SIGUSR2` to send a
+ *  file. An escape character at
+ *  the end of the data is remembered for the next call. Console input read
+ *  with console_read_data() and console_read_buffer() has already been
+ *  scanned.
+ *
+ *  @param      data    Pointer to console input data. Its byte count is
+ *                      decreased by the number of bytes removed.
+ */
+
+void console_scan_input (buffer_t * data);
+
+/** @ingroup    console
+ *
+ *  @brief      Get console input file descriptor.
+ *
+ *  Gets the file descriptor of standard input. Its handler can be registered
+ *  with event_register_handler() to wake up the program from a sleep when
+ *  input becomes available on the console.
+ *
+ *  @return     Console input file descriptor.
+ */
+
+int console_get_fd (void);
 
 /** @ingroup    console
  *
- *  @brief      Get wakeup event structure.
+ *  @brief      Get console output file descriptor.
  *
- *  Writes the console wakeup event into the specified buffer. This event can be
- *  registered with sleep_register_wakeup_evt() to wake up the program from a
- *  sleep when input becomes available on the console.
+ *  Gets the file descriptor of standard output.
  *
- *  @param      evt     Pointer to wakeup event structure to be filled in.
+ *  @return     Console output file descriptor.
  */
 
-void console_get_wakeup_evt (struct pollfd * evt);
+int console_get_output_fd (void);
 
 /** @ingroup    console
  *
  *  @brief      Read console input data.
  *
- *  Reads the available console input data into the specified buffer. The size
- *  of the buffer is reallocated to exactly fit all the available input data and
- *  a terminating null byte. Thus, it is recommended to initialize the buffer to
- *  `NULL` and subsequently pass a pointer to this buffer to read console input.
- *  The buffer need not be freed before the next call to this function.
+ *  Reads the available console input data directly into the free space of the
+ *  specified ring buffer, with as few `read()` calls as possible. Reading stops
+ *  when no more input is available or when the ring buffer is full, in which
+ *  case the remaining input is left for the next call to this function.
+ *
+ *  @note       Console I/O must be prepared with a successful call to
+ *              console_open_stdio() before calling this function.
+ *
+ *  @param      ring    Pointer to ring buffer to be filled in with available
+ *                      console input data.
+ *
+ *  @retval     0       Success.
+ *  @retval     1       Success, and end of console input was reached.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int console_read_data (ring_t * ring);
+
+/** @ingroup    console
+ *
+ *  @brief      Read console input data into buffer.
+ *
+ *  Reads the available console input data into the free space of the specified
+ *  buffer, between its byte count and its capacity, with a single `read()`
+ *  call. If no input is available, the buffer is left unchanged.
+ *
+ *  @param      buf     Pointer to buffer to be filled in. Its byte count is
+ *                      increased by the number of bytes read.
+ *
+ *  @retval     0       Success.
+ *  @retval     1       Success, and end of console input was reached.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int console_read_buffer (buffer_t * buf);
+
+/** @ingroup    console
+ *
+ *  @brief      Write console output data without blocking.
+ *
+ *  Writes as much of the specified buffer to console output as is possible
+ *  without blocking, with a single `write()` call.
+ *
+ *  @param      data    Pointer to buffer to be written to console output.
+ *  @param      count   Pointer to variable into which the number of bytes
+ *                      written will be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int console_try_write_data (const buffer_t * data, size_t * count);
+
+/** @ingroup    console
+ *
+ *  @brief      Write several console output buffers without blocking.
+ *
+ *  Writes as much of the specified buffers, in order, to console output as is
+ *  possible without blocking, with a single `writev()` call.
  *
- *  @param      data    Pointer to buffer that must be reallocated and filled in
- *                      with available console input data.
+ *  @param      data    Array of buffers to be written to console output.
+ *  @param      num     Number of buffers, at most 4.
+ *  @param      count   Pointer to variable into which the number of bytes
+ *                      written will be written.
  *
  *  @retval     0       Success.
  *  @retval     -1      Failure. Error message is written to `stderr`.
  */
 
-int console_read_data (char ** data);
+int console_try_write_vector (const buffer_t * data, int num, size_t * count);
 
 /** @ingroup    console
  *
  *  @brief      Write console output data.
  *
- *  Writes the specified buffer to console output. The buffer must be a
- *  null-terminated string.
+ *  Writes the specified buffer to console output. The buffer may contain any
+ *  byte value, including null bytes.
  *
- *  @param      data    Null-terminated buffer to be written to console output.
+ *  @param      data    Pointer to buffer to be written to console output.
  *
  *  @retval     0       Success.
  *  @retval     -1      Failure. Error message is written to `stderr`.
  */
 
-int console_write_data (const char * data);
+int console_write_data (const buffer_t * data);
 
 #endif
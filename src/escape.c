@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "escape.h"
+
+int escape_parse_text (char * str, size_t * len) {
+    char * dst = str;   // Current position in result.
+    char hex[3] = "";   // Hexadecimal byte value.
+
+    for (char * src = str; *src != '\0'; ) {
+        if (*src != '\\') {
+            *dst++ = *src++;
+            continue;
+        }
+        switch (src[1]) {
+            case 't':
+                *dst++ = '\t';
+                break;
+            case 'r':
+                *dst++ = '\r';
+                break;
+            case 'n':
+                *dst++ = '\n';
+                break;
+            case '\\':
+                *dst++ = '\\';
+                break;
+            case 'x':
+                if (
+                    !isxdigit((unsigned char)src[2]) ||
+                    !isxdigit((unsigned char)src[3])
+                ) {
+                    return -1;
+                }
+                hex[0] = src[2];
+                hex[1] = src[3];
+                *dst++ = (char)strtol(hex, NULL, 16);
+                src += 2;
+                break;
+            default:
+                return -1;
+        }
+        src += 2;
+    }
+    *len = dst - str;
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+/** @defgroup   escape  Escape
+ *
+ *  @brief      Escape sequences in text.
+ *
+ *  This module contains functions to turn text written in a file, such as a
+ *  pattern or a script step, into the bytes it stands for, so that control
+ *  characters and binary data can be written as escape sequences.
+ */
+
+#ifndef __ESCAPE_H__
+#define __ESCAPE_H__
+
+#include <stddef.h>
+
+/** @ingroup    escape
+ *
+ *  @brief      Replace escape sequences.
+ *
+ *  Replaces the escape sequences `\t`, `\r`, `\n`, `\\` and `\xHH` in the
+ *  specified text in place, by the bytes they stand for. The result may hold
+ *  null bytes, so its length is returned.
+ *
+ *  @param      str     Text, which is overwritten with the result.
+ *  @param      len     Pointer to length of result to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as an escape sequence is invalid.
+ */
+
+int escape_parse_text (char * str, size_t * len);
+
+#endif
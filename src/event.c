@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "event.h"
+#include "metrics.h"
+
+// Registered event handler.
+typedef struct {
+    int fd;                     // File descriptor, or -1 if removed.
+    uint32_t events;            // Bit mask of events watched for.
+    bool edge;                  // Flag indicating if edge-triggered.
+    bool always;                // Flag indicating if always ready.
+    bool timer;                 // Flag indicating if owned timer.
+    event_handler_t handler;    // Handler to be called.
+    void * arg;                 // Argument to be passed to the handler.
+    unsigned long round;        // Dispatch round in which it was removed.
+} event_entry_t;
+
+// Registered signal handler.
+typedef struct {
+    int signum;                 // Signal number.
+    event_handler_t handler;    // Handler to be called.
+    void * arg;                 // Argument to be passed to the handler.
+} event_signal_t;
+
+static int _epfd = -1;                  // `epoll` instance.
+static int _sigfd = -1;                 // `signalfd` receiving `SIGINT`.
+static sigset_t _mask;                  // Signals received by `signalfd`.
+static sigset_t _mask_old;              // Old signal mask.
+
+static int _signals = 0;                // Registered signal handler count.
+static event_signal_t * _signal = NULL; // Registered signal handlers.
+
+static int _count = 0;                  // Registered handler count.
+static event_entry_t * _entry = NULL;   // Registered handlers.
+static int _always = 0;                 // Always ready handler count.
+static unsigned long _round = 0;        // Dispatch round.
+
+static bool _stop = false;              // Flag indicating if loop must stop.
+
+// Signal handler. Stops the event loop on `SIGINT`, and calls the registered
+// handlers of other signals.
+static int _handle_signal (int fd, uint32_t events, void * arg) {
+    int status;                     // Return status for API calls.
+    struct signalfd_siginfo info;   // Received signal information.
+
+    // Consume all pending signals.
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGINT) {
+            _stop = true;
+            continue;
+        }
+        for (int i = 0; i < _signals; i++) {
+            if ((uint32_t)_signal[i].signum != info.ssi_signo) {
+                continue;
+            }
+            status = _signal[i].handler(fd, events, _signal[i].arg);
+            if (status < 0) {
+                // On error, exit with failure.
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Timer handler. Consumes the expirations of the timer, and calls its handler.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    event_entry_t * entry = (event_entry_t *)arg;   // Timer handler.
+    uint64_t count;                                 // Number of expirations.
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return entry->handler(fd, events, entry->arg);
+}
+
+int event_open_loop (void) {
+    int status; // Return status for API calls.
+
+    // Create `epoll` instance.
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epfd < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to create event loop (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Block `SIGINT`, so that it is only received through the `signalfd`.
+    sigemptyset(&_mask);
+    sigaddset(&_mask, SIGINT);
+    status = sigprocmask(SIG_BLOCK, &_mask, &_mask_old);
+    if (status < 0) {
+        // On error, close `epoll` instance and exit with failure.
+        fprintf(
+            stderr, "Failed to block interrupt signal (%s)\n",
+            strerror(errno)
+        );
+        close(_epfd);
+        _epfd = -1;
+        return -1;
+    }
+
+    // Create `signalfd` and register its handler.
+    _sigfd = signalfd(-1, &_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (_sigfd < 0) {
+        // On error, close event loop and exit with failure.
+        fprintf(
+            stderr, "Failed to create interrupt signal descriptor (%s)\n",
+            strerror(errno)
+        );
+        event_close_loop();
+        return -1;
+    }
+    status = event_register_handler(
+        _sigfd, EPOLLIN, false, _handle_signal, NULL
+    );
+    if (status < 0) {
+        // On error, close event loop and exit with failure.
+        event_close_loop();
+        return -1;
+    }
+
+    return 0;
+}
+
+void event_close_loop (void) {
+    struct signalfd_siginfo info;   // Received signal information.
+
+    // Close timers, and remove all registered handlers.
+    for (int i = 0; i < _count; i++) {
+        if (_entry[i].fd >= 0 && _entry[i].timer) {
+            free(_entry[i].arg);
+            close(_entry[i].fd);
+        }
+    }
+    free(_entry);
+    _entry = NULL;
+    _count = 0;
+    _always = 0;
+    free(_signal);
+    _signal = NULL;
+    _signals = 0;
+
+    // Close `epoll` instance.
+    if (_epfd >= 0) {
+        close(_epfd);
+        _epfd = -1;
+    }
+
+    // Consume any pending signals, so that they are not delivered once
+    // unblocked, and close `signalfd`.
+    if (_sigfd >= 0) {
+        while (read(_sigfd, &info, sizeof(info)) == sizeof(info));
+        close(_sigfd);
+        _sigfd = -1;
+    }
+
+    // Restore old signal mask.
+    sigprocmask(SIG_SETMASK, &_mask_old, NULL);
+}
+
+int event_register_handler (
+    int fd, uint32_t events, bool edge, event_handler_t handler, void * arg
+) {
+    int status;                 // Return status for API calls.
+    struct epoll_event evt;     // `epoll` event structure.
+    event_entry_t * entry;      // Reallocated handlers.
+    int pos;                    // Position of new handler.
+
+    // Reuse the position of a handler removed before the current dispatch
+    // round, whose events can no longer be pending, or allocate space for new
+    // handler.
+    for (pos = 0; pos < _count; pos++) {
+        if (_entry[pos].fd < 0 && _entry[pos].round != _round) {
+            break;
+        }
+    }
+    if (pos == _count) {
+        entry = (event_entry_t *)realloc(
+            _entry, (_count + 1) * sizeof(event_entry_t)
+        );
+        if (entry == NULL) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to register event handler (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+        _entry = entry;
+    }
+
+    // Add file descriptor to `epoll` instance, identifying it by the position
+    // of its handler.
+    memset(&evt, 0, sizeof(struct epoll_event));
+    evt.events = events | (edge ? EPOLLET : 0);
+    evt.data.u32 = pos;
+    status = epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &evt);
+    if (status < 0 && errno != EPERM) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to register event handler (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Add new handler to list of registered handlers. File descriptors
+    // rejected by `epoll` do not support it, and are always ready.
+    _entry[pos].fd = fd;
+    _entry[pos].events = events;
+    _entry[pos].edge = edge;
+    _entry[pos].always = (status < 0);
+    _entry[pos].timer = false;
+    _entry[pos].handler = handler;
+    _entry[pos].arg = arg;
+    if (_entry[pos].always) {
+        _always++;
+    }
+    if (pos == _count) {
+        _count++;
+    }
+
+    return 0;
+}
+
+int event_register_signal (int signum, event_handler_t handler, void * arg) {
+    int status;                 // Return status for API calls.
+    event_signal_t * signal;    // Reallocated signal handlers.
+
+    // Allocate space for new signal handler.
+    signal = (event_signal_t *)realloc(
+        _signal, (_signals + 1) * sizeof(event_signal_t)
+    );
+    if (signal == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to register signal handler (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+    _signal = signal;
+
+    // Block signal, and receive it through the `signalfd` as well.
+    sigaddset(&_mask, signum);
+    status = sigprocmask(SIG_BLOCK, &_mask, NULL);
+    if (status == 0) {
+        status = signalfd(_sigfd, &_mask, 0);
+    }
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to register signal handler (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Append new signal handler.
+    _signal[_signals].signum = signum;
+    _signal[_signals].handler = handler;
+    _signal[_signals].arg = arg;
+    _signals++;
+
+    return 0;
+}
+
+int event_register_timer (
+    unsigned long ms, event_handler_t handler, void * arg
+) {
+    int status;                 // Return status for API calls.
+    int fd;                     // Timer file descriptor.
+    struct itimerspec spec;     // Timer period.
+    event_entry_t * entry;      // Handler called on expiration.
+
+    // Create periodic timer.
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        // On error, exit with failure.
+        fprintf(stderr, "Failed to create timer (%s)\n", strerror(errno));
+        return -1;
+    }
+    spec.it_interval.tv_sec = ms / 1000;
+    spec.it_interval.tv_nsec = (ms % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    status = timerfd_settime(fd, 0, &spec, NULL);
+    if (status < 0) {
+        // On error, close timer and exit with failure.
+        fprintf(stderr, "Failed to start timer (%s)\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // Register timer, with a handler that consumes its expirations before
+    // calling the specified handler.
+    entry = (event_entry_t *)malloc(sizeof(event_entry_t));
+    if (entry == NULL) {
+        // On error, close timer and exit with failure.
+        fprintf(stderr, "Failed to create timer (%s)\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    entry->handler = handler;
+    entry->arg = arg;
+    status = event_register_handler(fd, EPOLLIN, false, _handle_timer, entry);
+    if (status < 0) {
+        // On error, close timer and exit with failure.
+        free(entry);
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < _count; i++) {
+        if (_entry[i].fd == fd) {
+            _entry[i].timer = true;
+        }
+    }
+
+    return fd;
+}
+
+int event_modify_handler (int fd, uint32_t events) {
+    int status;                 // Return status for API calls.
+    struct epoll_event evt;     // `epoll` event structure.
+    int op;                     // `epoll` operation.
+
+    for (int i = 0; i < _count; i++) {
+        if (_entry[i].fd != fd || _entry[i].events == events) {
+            continue;
+        }
+
+        // Always ready file descriptors are simply skipped while paused.
+        if (_entry[i].always) {
+            _always += (events != 0) - (_entry[i].events != 0);
+            _entry[i].events = events;
+            continue;
+        }
+
+        // Remove paused file descriptor from `epoll` instance, so that not even
+        // hang-ups are reported, and add it back once resumed.
+        if (events == 0) {
+            op = EPOLL_CTL_DEL;
+        } else if (_entry[i].events == 0) {
+            op = EPOLL_CTL_ADD;
+        } else {
+            op = EPOLL_CTL_MOD;
+        }
+        memset(&evt, 0, sizeof(struct epoll_event));
+        evt.events = events | (_entry[i].edge ? EPOLLET : 0);
+        evt.data.u32 = i;
+        status = epoll_ctl(_epfd, op, fd, &evt);
+        if (status < 0) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to modify event handler (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+        _entry[i].events = events;
+    }
+
+    return 0;
+}
+
+void event_remove_handler (int fd) {
+    // Find matching handler if any, and mark it as removed. Its position is
+    // only reused after the current dispatch round, so that events already
+    // received for it are ignored.
+    for (int i = 0; i < _count; i++) {
+        if (_entry[i].fd == fd) {
+            if (_entry[i].always) {
+                _always -= (_entry[i].events != 0);
+            } else if (_entry[i].events != 0) {
+                epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL);
+            }
+            if (_entry[i].timer) {
+                free(_entry[i].arg);
+                close(fd);
+                _entry[i].timer = false;
+            }
+            _entry[i].fd = -1;
+            _entry[i].round = _round;
+        }
+    }
+}
+
+// Wait for registered file descriptors to become ready for up to the specified
+// timeout, and call their handlers.
+static int _dispatch (int timeout) {
+    int status;                     // Return status for API calls.
+    int count;                      // Number of ready file descriptors.
+    struct epoll_event evt[64];     // Ready `epoll` event structures.
+    event_entry_t * entry;          // Handler of ready file descriptor.
+
+    // Wait for registered file descriptors to become ready. If any are always
+    // ready, only poll them.
+    _round++;
+    count = epoll_wait(_epfd, evt, 64, (_always > 0) ? 0 : timeout);
+    metrics_add_count(METRICS_WAKEUPS, 1);
+    if (count < 0) {
+        // On errors other than interruption, exit with failure.
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(
+            stderr, "Failed to wait for events (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Call handlers of ready file descriptors.
+    for (int i = 0; i < count; i++) {
+        entry = &_entry[evt[i].data.u32];
+        if (entry->fd < 0) {
+            continue;
+        }
+        status = entry->handler(entry->fd, evt[i].events, entry->arg);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    // Call handlers of always ready file descriptors.
+    for (int i = 0; i < _count && _always > 0; i++) {
+        entry = &_entry[i];
+        if (entry->fd < 0 || !entry->always || entry->events == 0) {
+            continue;
+        }
+        status = entry->handler(entry->fd, entry->events, entry->arg);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int event_run_loop (void) {
+    int status; // Return status for API calls.
+
+    // Run until stopped.
+    _stop = false;
+    while (!_stop) {
+        status = _dispatch(-1);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int event_poll_loop (void) {
+    int status; // Return status for API calls.
+
+    status = _dispatch(0);
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+
+    return _stop ? 1 : 0;
+}
+
+int event_get_fd (void) {
+    return _epfd;
+}
+
+void event_stop_loop (void) {
+    _stop = true;
+}
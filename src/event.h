@@ -0,0 +1,222 @@
+/** @defgroup   event   Event
+ *
+ *  @brief      Event loop.
+ *
+ *  This module contains functions to run an `epoll`-based event loop, which
+ *  puts the program to sleep until one or more registered file descriptors
+ *  become ready, and then dispatches only the handlers of those that did. The
+ *  loop is stopped by a `SIGINT` signal, which is received through a
+ *  `signalfd`, along with any other signals handled by the loop. Periodic
+ *  timers are handled through `timerfd`s.
+ */
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/** @ingroup    event
+ *
+ *  @brief      Event handler.
+ *
+ *  Function called by the event loop when a registered file descriptor becomes
+ *  ready.
+ *
+ *  @param      fd      File descriptor that became ready.
+ *  @param      events  Bit mask of `epoll` events that occurred.
+ *  @param      arg     Argument passed on registration.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. The event loop is stopped with failure.
+ */
+
+typedef int (* event_handler_t) (int fd, uint32_t events, void * arg);
+
+/** @ingroup    event
+ *
+ *  @brief      Open event loop.
+ *
+ *  Creates the `epoll` instance of the event loop, and redirects `SIGINT` to a
+ *  `signalfd` which stops the event loop when the signal is received.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_open_loop (void);
+
+/** @ingroup    event
+ *
+ *  @brief      Close event loop.
+ *
+ *  Closes the event loop, removing all registered handlers and restoring the
+ *  original disposition of `SIGINT`.
+ */
+
+void event_close_loop (void);
+
+/** @ingroup    event
+ *
+ *  @brief      Register event handler.
+ *
+ *  Registers a handler to be called whenever the specified file descriptor
+ *  becomes ready for any of the specified `epoll` events. File descriptors that
+ *  do not support `epoll`, such as regular files, are considered to be always
+ *  ready.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @param      fd      File descriptor to watch.
+ *  @param      events  Bit mask of `epoll` events to watch for, such as
+ *                      `EPOLLIN`.
+ *  @param      edge    Flag indicating if readiness is edge-triggered. If so,
+ *                      the handler is only called when the file descriptor
+ *                      becomes ready anew, and must consume all available
+ *                      input every time.
+ *  @param      handler Handler to be called.
+ *  @param      arg     Argument to be passed to the handler.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_register_handler (
+    int fd, uint32_t events, bool edge, event_handler_t handler, void * arg
+);
+
+/** @ingroup    event
+ *
+ *  @brief      Register signal handler.
+ *
+ *  Registers a handler to be called by the event loop whenever the specified
+ *  signal is received. The signal is blocked, and received through the
+ *  `signalfd` of the event loop.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function. As the signal
+ *              is only blocked for the calling thread and threads it starts
+ *              afterwards, this function must be called before starting any
+ *              threads.
+ *
+ *  @param      signum  Signal number, other than `SIGINT`.
+ *  @param      handler Handler to be called, with the `signalfd`.
+ *  @param      arg     Argument to be passed to the handler.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_register_signal (int signum, event_handler_t handler, void * arg);
+
+/** @ingroup    event
+ *
+ *  @brief      Register timer.
+ *
+ *  Creates a periodic timer, and registers a handler to be called by the event
+ *  loop every time it expires. Expirations missed while the loop was busy are
+ *  merged into one call. The timer is closed when its handler is removed with
+ *  event_remove_handler(), or when the event loop is closed.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @param      ms      Timer period in milliseconds.
+ *  @param      handler Handler to be called, with the timer file descriptor.
+ *  @param      arg     Argument to be passed to the handler.
+ *
+ *  @return     Timer file descriptor on success, or -1 on failure. Error
+ *              message is written to `stderr`.
+ */
+
+int event_register_timer (
+    unsigned long ms, event_handler_t handler, void * arg
+);
+
+/** @ingroup    event
+ *
+ *  @brief      Modify watched events.
+ *
+ *  Changes the `epoll` events watched for on the specified file descriptor,
+ *  keeping its handler and edge-triggering. With no events, the file
+ *  descriptor is paused, and its handler is not called at all, not even on
+ *  hang-up, until events are watched for again. This function may be called
+ *  from within a handler.
+ *
+ *  @param      fd      File descriptor whose events must be changed.
+ *  @param      events  Bit mask of `epoll` events to watch for, or 0 to pause.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_modify_handler (int fd, uint32_t events);
+
+/** @ingroup    event
+ *
+ *  @brief      Remove event handler.
+ *
+ *  Removes the handler registered for the specified file descriptor. This
+ *  function may be called from within a handler.
+ *
+ *  @param      fd      File descriptor whose handler must be removed.
+ */
+
+void event_remove_handler (int fd);
+
+/** @ingroup    event
+ *
+ *  @brief      Run event loop.
+ *
+ *  Sleeps until registered file descriptors become ready, and calls their
+ *  handlers, until the event loop is stopped with event_stop_loop() or by a
+ *  `SIGINT` signal, or until a handler fails.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_run_loop (void);
+
+/** @ingroup    event
+ *
+ *  @brief      Poll event loop.
+ *
+ *  Calls the handlers of registered file descriptors that are ready, without
+ *  sleeping. This allows another loop that sleeps on the event loop file
+ *  descriptor to drive the event loop.
+ *
+ *  @retval     0       Success.
+ *  @retval     1       Success, and the event loop was stopped with
+ *                      event_stop_loop() or by a `SIGINT` signal.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int event_poll_loop (void);
+
+/** @ingroup    event
+ *
+ *  @brief      Get event loop file descriptor.
+ *
+ *  Gets a file descriptor that becomes readable when any registered file
+ *  descriptor is ready, so that the event loop can be polled with
+ *  event_poll_loop() from another loop.
+ *
+ *  @return     Event loop file descriptor.
+ */
+
+int event_get_fd (void);
+
+/** @ingroup    event
+ *
+ *  @brief      Stop event loop.
+ *
+ *  Makes event_run_loop() return with success once the handlers of the
+ *  current iteration have been called.
+ */
+
+void event_stop_loop (void);
+
+#endif
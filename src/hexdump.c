@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "buffer.h"
+#include "event.h"
+#include "console.h"
+#include "hexdump.h"
+
+// Number of bytes per line.
+enum {HEXDUMP_WIDTH = 16};
+
+// Length of hexadecimal and ASCII columns of a full line.
+enum {HEXDUMP_BODY_SIZE = 68};
+
+// Maximum length of an encoded line, with redraw, colors and newline.
+enum {HEXDUMP_LINE_SIZE = 96};
+
+// Period of output timer in milliseconds, at which data is shown while the
+// console is behind.
+enum {HEXDUMP_PERIOD = 100};
+
+// Hexadecimal digits.
+static const char _digits[] = "0123456789abcdef";
+
+// Line tags and colors by direction.
+static const char _tags[2][4] = {"RX ", "TX "};
+static const char _colors[2][6] = {"\033[32m", "\033[33m"};
+
+// Line encoding kernel. Encodes the hexadecimal and ASCII columns of a full
+// line.
+static void (* _encode) (char * dst, const char * src);
+
+static bool _color;                     // Flag indicating if lines are colored.
+static buffer_t _out;                   // Output buffer.
+static size_t _pos;                     // Bytes of output buffer written.
+static int _flags_old;                  // Old console output status flags.
+static int _timer_fd = -1;              // Output timer.
+static bool _behind;                    // Flag indicating if console is behind.
+
+static unsigned long _offset[2];        // Offset of next byte by direction.
+static char _line[HEXDUMP_WIDTH];       // Bytes of line shown so far.
+static size_t _fill;                    // Number of bytes of line shown so far.
+static hexdump_dir_t _open;             // Direction of line shown so far.
+static unsigned long _start;            // Offset of line shown so far.
+
+static unsigned long _hidden[2];        // Bytes not shown by direction.
+static unsigned long _from[2];          // Offset of first byte not shown.
+static char _tail[2][HEXDUMP_WIDTH];    // Latest bytes not shown.
+static size_t _tails[2];                // Number of latest bytes not shown.
+
+static unsigned long _shown;            // Number of bytes shown.
+static unsigned long _lost;             // Number of bytes not shown.
+static unsigned long _lags;             // Number of times console fell behind.
+
+// Encode the hexadecimal and ASCII columns of a line of up to full width,
+// padding the hexadecimal column of a short line. Returns encoded length.
+static size_t _encode_part (char * dst, const char * src, size_t n) {
+    char * p = dst;     // Current position in encoded line.
+    unsigned char c;    // Byte to be encoded.
+
+    for (size_t i = 0; i < HEXDUMP_WIDTH; i++) {
+        if (i == HEXDUMP_WIDTH / 2) {
+            *p++ = ' ';
+        }
+        if (i < n) {
+            c = src[i];
+            *p++ = _digits[c >> 4];
+            *p++ = _digits[c & 0x0f];
+        } else {
+            *p++ = ' ';
+            *p++ = ' ';
+        }
+        *p++ = ' ';
+    }
+    *p++ = ' ';
+    *p++ = '|';
+    for (size_t i = 0; i < n; i++) {
+        c = src[i];
+        *p++ = (c >= 0x20 && c < 0x7f) ? c : '.';
+    }
+    *p++ = '|';
+
+    return p - dst;
+}
+
+// Scalar line encoding kernel.
+static void _encode_scalar (char * dst, const char * src) {
+    _encode_part(dst, src, HEXDUMP_WIDTH);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// SSSE3 line encoding kernel. Looks up the digits of all 32 nibbles at once,
+// and shuffles them into groups of three characters, filling the gaps with
+// spaces.
+__attribute__((target("ssse3")))
+static void _encode_ssse3 (char * dst, const char * src) {
+    const __m128i digits = _mm_setr_epi8(
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+    );                                          // Hexadecimal digits.
+    const __m128i first = _mm_setr_epi8(
+        0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10
+    );                                          // First 16 characters.
+    const __m128i second = _mm_setr_epi8(
+        11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    );                                          // Last 9 characters.
+    const __m128i space = _mm_set1_epi8(' ');   // Spaces in every lane.
+    const __m128i nibble = _mm_set1_epi8(0x0f); // Nibble mask in every lane.
+    __m128i blk;                                // Bytes of line.
+    __m128i hi, lo;                             // Digits of high, low nibbles.
+    __m128i pairs;                              // Digit pairs of half a line.
+    __m128i ok;                                 // Mask of printable bytes.
+
+    // Look up digits of high and low nibbles.
+    blk = _mm_loadu_si128((const __m128i *)src);
+    hi = _mm_shuffle_epi8(
+        digits, _mm_and_si128(_mm_srli_epi16(blk, 4), nibble)
+    );
+    lo = _mm_shuffle_epi8(digits, _mm_and_si128(blk, nibble));
+
+    // Spread digit pairs of each half line over 25 characters. Shuffle
+    // indices of gaps have all bits set, so ANDing them with spaces yields
+    // spaces in the gaps, and zeros elsewhere. Later stores overwrite the
+    // excess characters of earlier ones.
+    pairs = _mm_unpacklo_epi8(hi, lo);
+    _mm_storeu_si128(
+        (__m128i *)dst, _mm_or_si128(
+            _mm_shuffle_epi8(pairs, first), _mm_and_si128(first, space)
+        )
+    );
+    _mm_storeu_si128(
+        (__m128i *)(dst + 16), _mm_or_si128(
+            _mm_shuffle_epi8(pairs, second), _mm_and_si128(second, space)
+        )
+    );
+    pairs = _mm_unpackhi_epi8(hi, lo);
+    _mm_storeu_si128(
+        (__m128i *)(dst + 25), _mm_or_si128(
+            _mm_shuffle_epi8(pairs, first), _mm_and_si128(first, space)
+        )
+    );
+    _mm_storeu_si128(
+        (__m128i *)(dst + 41), _mm_or_si128(
+            _mm_shuffle_epi8(pairs, second), _mm_and_si128(second, space)
+        )
+    );
+
+    // Replace bytes outside the printable ASCII range with dots. Bytes from
+    // 0x80 are negative, and fail the lower bound.
+    ok = _mm_and_si128(
+        _mm_cmpgt_epi8(blk, _mm_set1_epi8(0x1f)),
+        _mm_cmplt_epi8(blk, _mm_set1_epi8(0x7f))
+    );
+    dst[49] = ' ';
+    dst[50] = '|';
+    _mm_storeu_si128(
+        (__m128i *)(dst + 51), _mm_or_si128(
+            _mm_and_si128(ok, blk), _mm_andnot_si128(ok, _mm_set1_epi8('.'))
+        )
+    );
+    dst[67] = '|';
+}
+
+#endif
+
+// Get free space of output buffer, keeping room to end the line shown.
+static size_t _space (void) {
+    if (_out.count + HEXDUMP_LINE_SIZE > _out.size) {
+        return 0;
+    }
+    return _out.size - _out.count - HEXDUMP_LINE_SIZE;
+}
+
+// Make room in output buffer, moving output not written yet to its front.
+static void _compact (void) {
+    if (_pos > 0) {
+        memmove(_out.data, _out.data + _pos, _out.count - _pos);
+        _out.count -= _pos;
+        _pos = 0;
+    }
+}
+
+// Encode line of bytes at the specified offset into output buffer, ended with
+// a newline if requested.
+static void _render (
+    hexdump_dir_t dir, const char * src, size_t n, unsigned long off,
+    bool end
+) {
+    char * p = _out.data + _out.count;  // Current position in output buffer.
+
+    if (_color) {
+        memcpy(p, _colors[dir], 5);
+        p += 5;
+    }
+    memcpy(p, _tags[dir], 3);
+    p += 3;
+    for (int i = 7; i >= 0; i--) {
+        *p++ = _digits[(off >> (4 * i)) & 0x0f];
+    }
+    *p++ = ' ';
+    *p++ = ' ';
+    if (n == HEXDUMP_WIDTH) {
+        _encode(p, src);
+        p += HEXDUMP_BODY_SIZE;
+    } else {
+        p += _encode_part(p, src, n);
+    }
+    if (_color) {
+        memcpy(p, "\033[0m", 4);
+        p += 4;
+    }
+    if (end) {
+        *p++ = '\n';
+    }
+    _out.count = p - _out.data;
+}
+
+// Stop showing data in full, ending the line shown so far.
+static void _lag (void) {
+    if (_fill > 0) {
+        _out.data[_out.count++] = '\n';
+        _fill = 0;
+    }
+    _behind = true;
+    _lags++;
+}
+
+// Count bytes not shown, keeping the latest line of them.
+static void _hide (hexdump_dir_t dir, const char * src, size_t n) {
+    size_t keep;    // Number of latest bytes kept.
+
+    if (_hidden[dir] == 0) {
+        _from[dir] = _offset[dir];
+    }
+    _hidden[dir] += n;
+    _lost += n;
+    if (n >= HEXDUMP_WIDTH) {
+        memcpy(_tail[dir], src + n - HEXDUMP_WIDTH, HEXDUMP_WIDTH);
+        _tails[dir] = HEXDUMP_WIDTH;
+    } else {
+        keep = (_tails[dir] < HEXDUMP_WIDTH - n) ?
+            _tails[dir] : HEXDUMP_WIDTH - n;
+        memmove(_tail[dir], _tail[dir] + _tails[dir] - keep, keep);
+        memcpy(_tail[dir] + keep, src, n);
+        _tails[dir] = keep + n;
+    }
+}
+
+// Show bytes not shown since the last call, as their number, followed by the
+// latest line of them.
+static void _sample (void) {
+    unsigned long n;    // Number of bytes not shown before latest line.
+
+    _compact();
+    for (int dir = HEXDUMP_RX; dir <= HEXDUMP_TX; dir++) {
+        if (_hidden[dir] == 0) {
+            continue;
+        } else if (_space() < 2 * HEXDUMP_LINE_SIZE) {
+            return;
+        }
+        n = _hidden[dir] - _tails[dir];
+        if (n > 0) {
+            _out.count += snprintf(
+                _out.data + _out.count, HEXDUMP_LINE_SIZE,
+                "%s%s%08lx  ... %lu bytes not shown%s\n",
+                _color ? _colors[dir] : "", _tags[dir],
+                _from[dir] & 0xffffffff, n, _color ? "\033[0m" : ""
+            );
+        }
+        _render(
+            dir, _tail[dir], _tails[dir], _offset[dir] - _tails[dir], true
+        );
+        _shown += _tails[dir];
+        _lost -= _tails[dir];
+        _hidden[dir] = 0;
+        _tails[dir] = 0;
+    }
+}
+
+// Output timer event handler. Writes output left, and while the console is
+// behind, shows the latest data. Once all output has been written, the
+// console has caught up, and data is shown in full again.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    bool done;  // Flag indicating if all output was written.
+    int status; // Return status for API calls.
+
+    if (_behind) {
+        done = (_pos == _out.count);
+        _sample();
+        _behind = !done;
+    }
+    status = hexdump_flush_data();
+    if (status == 0 && _out.count == 0 && !_behind) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+    return status;
+}
+
+int hexdump_parse_mode (const char * str, bool * color) {
+    if (strcmp(str, "hex") == 0) {
+        *color = false;
+    } else if (strcmp(str, "color") == 0) {
+        *color = true;
+    } else {
+        // If display mode is invalid, exit with failure.
+        fprintf(stderr, "Unrecognized display mode '%s'\n", str);
+        return -1;
+    }
+
+    return 0;
+}
+
+int hexdump_open (bool color, size_t size) {
+    int status; // Return status for API calls.
+
+    // Allocate output buffer for the lines of twice the largest write, and
+    // room to end the line shown and to show the data not shown.
+    _color = color;
+    status = buffer_alloc(
+        &_out, (2 * (size / HEXDUMP_WIDTH) + 8) * HEXDUMP_LINE_SIZE
+    );
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _pos = 0;
+    _behind = false;
+    _fill = 0;
+    memset(_offset, 0, sizeof(_offset));
+    memset(_hidden, 0, sizeof(_hidden));
+    memset(_tails, 0, sizeof(_tails));
+
+    // Make console output non-blocking, so that a slow console never holds up
+    // serial input.
+    _flags_old = fcntl(console_get_output_fd(), F_GETFL);
+    status = (_flags_old < 0) ? -1 : fcntl(
+        console_get_output_fd(), F_SETFL, _flags_old | O_NONBLOCK
+    );
+    if (status < 0) {
+        // On error, free output buffer and exit with failure.
+        fprintf(
+            stderr, "Failed to apply console configuration (%s)\n",
+            strerror(errno)
+        );
+        buffer_free(&_out);
+        return -1;
+    }
+
+    // Select fastest line encoding kernel supported by CPU.
+    _encode = _encode_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        _encode = _encode_ssse3;
+    }
+#endif
+
+    return 0;
+}
+
+int hexdump_close (void) {
+    int status;     // Return status for API calls.
+    buffer_t data;  // Output not written yet.
+
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+
+    // Write output left, show the data not shown, and end the line shown,
+    // waiting for the console.
+    data.data = _out.data + _pos;
+    data.count = _out.count - _pos;
+    data.size = 0;
+    status = console_write_data(&data);
+    _out.count = 0;
+    _pos = 0;
+    _sample();
+    if (_fill > 0) {
+        _out.data[_out.count++] = '\n';
+        _fill = 0;
+    }
+    if (status == 0) {
+        status = console_write_data(&_out);
+    }
+
+    // Set old console output file status flags, and free output buffer.
+    if (fcntl(console_get_output_fd(), F_SETFL, _flags_old) < 0) {
+        fprintf(
+            stderr, "Failed to revert console configuration (%s)\n",
+            strerror(errno)
+        );
+    }
+    buffer_free(&_out);
+
+    return status;
+}
+
+void hexdump_write_data (hexdump_dir_t dir, const buffer_t * data) {
+    const char * src = data->data;  // Data not processed yet.
+    size_t count = data->count;     // Number of bytes not processed yet.
+    size_t n;                       // Number of bytes of line.
+
+    // End line shown so far of the other direction.
+    if (_fill > 0 && _open != dir) {
+        _out.data[_out.count++] = '\n';
+        _fill = 0;
+    }
+
+    // Encode full lines, and the beginning of a line, which is drawn again
+    // once more bytes arrive. If output does not fit, the console is behind.
+    while (count > 0 && !_behind) {
+        if (_space() < HEXDUMP_LINE_SIZE) {
+            _compact();
+        }
+        if (_space() < HEXDUMP_LINE_SIZE) {
+            _lag();
+            break;
+        }
+        if (_fill > 0) {
+            n = HEXDUMP_WIDTH - _fill;
+            n = (count < n) ? count : n;
+            memcpy(_line + _fill, src, n);
+            _fill += n;
+            _out.data[_out.count++] = '\r';
+            _render(dir, _line, _fill, _start, _fill == HEXDUMP_WIDTH);
+            _fill = (_fill == HEXDUMP_WIDTH) ? 0 : _fill;
+        } else if (count >= HEXDUMP_WIDTH) {
+            n = HEXDUMP_WIDTH;
+            _render(dir, src, n, _offset[dir], true);
+        } else {
+            n = count;
+            memcpy(_line, src, n);
+            _fill = n;
+            _open = dir;
+            _start = _offset[dir];
+            _render(dir, _line, n, _start, false);
+        }
+        _offset[dir] += n;
+        _shown += n;
+        src += n;
+        count -= n;
+    }
+
+    // Count the rest, while the console is behind.
+    if (count > 0) {
+        _hide(dir, src, count);
+        _offset[dir] += count;
+    }
+}
+
+int hexdump_flush_data (void) {
+    int status;     // Return status for API calls.
+    buffer_t data;  // Output not written yet.
+    size_t count;   // Number of bytes written.
+
+    // Write as much output as the console takes at once.
+    if (_pos < _out.count) {
+        data.data = _out.data + _pos;
+        data.count = _out.count - _pos;
+        data.size = 0;
+        status = console_try_write_data(&data, &count);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+        _pos += count;
+        if (_pos == _out.count) {
+            _out.count = 0;
+            _pos = 0;
+        }
+    }
+
+    // Write output left, and show data while behind, on timer.
+    if ((_out.count > 0 || _behind) && _timer_fd < 0) {
+        _timer_fd = event_register_timer(HEXDUMP_PERIOD, _handle_timer, NULL);
+        if (_timer_fd < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void hexdump_report (void) {
+    fprintf(
+        stderr, "Hex dump: %lu bytes shown, %lu bytes not shown, console "
+        "behind %lu times\n", _shown, _lost, _lags
+    );
+}
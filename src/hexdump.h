@@ -0,0 +1,127 @@
+/** @defgroup   hexdump Hexdump
+ *
+ *  @brief      Hex dump display.
+ *
+ *  This module contains functions to show serial data as a hex dump, with the
+ *  offset, hexadecimal and ASCII columns of `hexdump -C`, for devices sending
+ *  binary data. Data received and sent are shown on their own lines, tagged
+ *  `RX` and `TX`, and optionally colored, each with its own offset. A line not
+ *  yet filled is shown at once, and redrawn as more data arrives.
+ *
+ *  Lines are encoded 16 bytes at a time with the fastest kernel supported by
+ *  the CPU, into one large buffer, which is written to the console with a
+ *  single write that never blocks. If the console falls so far behind that
+ *  the buffer fills up, data is no longer shown in full, but only the latest
+ *  line of each direction, and the number of bytes not shown, ten times per
+ *  second, until the console has caught up.
+ */
+
+#ifndef __HEXDUMP_H__
+#define __HEXDUMP_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Data direction.
+ */
+
+typedef enum {
+    HEXDUMP_RX,     /**< Data received from serial port. */
+    HEXDUMP_TX      /**< Data sent to serial port. */
+} hexdump_dir_t;
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Parse display mode.
+ *
+ *  Parses a hex dump display mode, `hex` for plain lines, or `color` for
+ *  lines colored by direction.
+ *
+ *  @param      str     Display mode.
+ *  @param      color   Pointer to flag indicating if lines are colored.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int hexdump_parse_mode (const char * str, bool * color);
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Start hex dump display.
+ *
+ *  Allocates the output buffer, large enough for the hex dump of twice the
+ *  specified amount of data, and makes console output non-blocking.
+ *
+ *  @note       The console must be opened with a successful call to
+ *              console_open_stdio() before calling this function.
+ *
+ *  @param      color   Flag indicating if lines are colored.
+ *  @param      size    Largest amount of data written at once, in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int hexdump_open (bool color, size_t size);
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Stop hex dump display.
+ *
+ *  Shows the number of bytes not shown, ends the last line, and writes all
+ *  output left, waiting for the console if necessary. Console output is made
+ *  blocking again, and the output buffer is freed.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int hexdump_close (void);
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Show data as hex dump.
+ *
+ *  Encodes the specified data as hex dump lines into the output buffer, or
+ *  only counts it while the console is behind. Nothing is written to the
+ *  console until hexdump_flush_data() is called.
+ *
+ *  @param      dir     Data direction.
+ *  @param      data    Pointer to data to be shown.
+ */
+
+void hexdump_write_data (hexdump_dir_t dir, const buffer_t * data);
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Write hex dump output.
+ *
+ *  Writes as much of the output buffer to the console as it takes without
+ *  blocking. While output is left, or the console is behind, a timer is
+ *  registered in the event loop to write it.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int hexdump_flush_data (void);
+
+/** @ingroup    hexdump
+ *
+ *  @brief      Print hex dump statistics.
+ *
+ *  Writes the number of bytes shown and not shown, and the number of times
+ *  the console fell behind, to `stderr`.
+ */
+
+void hexdump_report (void);
+
+#endif
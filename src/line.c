@@ -1,7 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "buffer.h"
+#include "line.h"
+#include "metrics.h"
+
 // Line termination type.
 typedef enum {
     LINE_TERM_LF,           // LF termination.
@@ -12,6 +21,113 @@ typedef enum {
 static line_term_t _iterm;  // Input line termination.
 static line_term_t _oterm;  // Output line termination.
 
+// Byte search kernel. Returns position of first occurrence of a byte, or the
+// byte count if there is none.
+static size_t (* _find) (const char * data, size_t count, char c);
+
+// Byte replacement kernel. Copies bytes, replacing every occurrence of a byte
+// with another.
+static void (* _replace) (
+    char * dst, const char * src, size_t count, char from, char to
+);
+
+// Scalar byte search kernel.
+static size_t _find_scalar (const char * data, size_t count, char c) {
+    for (size_t i = 0; i < count; i++) {
+        if (data[i] == c) {
+            return i;
+        }
+    }
+    return count;
+}
+
+// Scalar byte replacement kernel.
+static void _replace_scalar (
+    char * dst, const char * src, size_t count, char from, char to
+) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (src[i] == from) ? to : src[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// SSE2 byte search kernel. Compares 16 bytes at a time.
+__attribute__((target("sse2")))
+static size_t _find_sse2 (const char * data, size_t count, char c) {
+    __m128i key = _mm_set1_epi8(c); // Byte to search for, in every lane.
+    __m128i blk;                    // Block of data.
+    int mask;                       // Bit mask of matching bytes in block.
+    size_t i = 0;                   // Current position.
+
+    for (; i + 16 <= count; i += 16) {
+        blk = _mm_loadu_si128((const __m128i *)(data + i));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(blk, key));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + _find_scalar(data + i, count - i, c);
+}
+
+// SSE2 byte replacement kernel. Replaces 16 bytes at a time.
+__attribute__((target("sse2")))
+static void _replace_sse2 (
+    char * dst, const char * src, size_t count, char from, char to
+) {
+    __m128i key = _mm_set1_epi8(from);  // Byte to replace, in every lane.
+    __m128i val = _mm_set1_epi8(to);    // Replacement byte, in every lane.
+    __m128i blk;                        // Block of data.
+    __m128i hit;                        // Mask of matching bytes in block.
+    size_t i = 0;                       // Current position.
+
+    for (; i + 16 <= count; i += 16) {
+        blk = _mm_loadu_si128((const __m128i *)(src + i));
+        hit = _mm_cmpeq_epi8(blk, key);
+        blk = _mm_or_si128(_mm_andnot_si128(hit, blk), _mm_and_si128(hit, val));
+        _mm_storeu_si128((__m128i *)(dst + i), blk);
+    }
+    _replace_scalar(dst + i, src + i, count - i, from, to);
+}
+
+// AVX2 byte search kernel. Compares 32 bytes at a time.
+__attribute__((target("avx2")))
+static size_t _find_avx2 (const char * data, size_t count, char c) {
+    __m256i key = _mm256_set1_epi8(c);  // Byte to search for, in every lane.
+    __m256i blk;                        // Block of data.
+    unsigned int mask;                  // Bit mask of matching bytes in block.
+    size_t i = 0;                       // Current position.
+
+    for (; i + 32 <= count; i += 32) {
+        blk = _mm256_loadu_si256((const __m256i *)(data + i));
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(blk, key));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + _find_sse2(data + i, count - i, c);
+}
+
+// AVX2 byte replacement kernel. Replaces 32 bytes at a time.
+__attribute__((target("avx2")))
+static void _replace_avx2 (
+    char * dst, const char * src, size_t count, char from, char to
+) {
+    __m256i key = _mm256_set1_epi8(from);   // Byte to replace, in every lane.
+    __m256i val = _mm256_set1_epi8(to);     // Replacement byte, in every lane.
+    __m256i blk;                            // Block of data.
+    size_t i = 0;                           // Current position.
+
+    for (; i + 32 <= count; i += 32) {
+        blk = _mm256_loadu_si256((const __m256i *)(src + i));
+        blk = _mm256_blendv_epi8(blk, val, _mm256_cmpeq_epi8(blk, key));
+        _mm256_storeu_si256((__m256i *)(dst + i), blk);
+    }
+    _replace_sse2(dst + i, src + i, count - i, from, to);
+}
+
+#endif
+
 int line_set_term (const char * iterm, const char * oterm) {
     // Set input line termination.
     if (strcmp(iterm, "lf") == 0) {
@@ -39,89 +155,139 @@ int line_set_term (const char * iterm, const char * oterm) {
         return -1;
     }
 
+    // Select fastest byte search and replacement kernels supported by CPU.
+    _find = _find_scalar;
+    _replace = _replace_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        _find = _find_avx2;
+        _replace = _replace_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        _find = _find_sse2;
+        _replace = _replace_sse2;
+    }
+#endif
+
     return 0;
 }
 
-void line_process_input_data (char ** data) {
-    int count = 0;      // Character count in tepmorary buffer.
-    char * proc = NULL; // Temporary buffer for processed serial input data.
+void line_reset_state (line_state_t * state) {
+    state->cr = false;
+}
+
+size_t line_get_buffer_size (size_t count) {
+    // Translated serial output is at most twice as long as the original, and
+    // translated serial input may be preceded by a CR held back from the last
+    // call.
+    return 2 * count + 1;
+}
+
+bool line_translates_input (void) {
+    return _iterm != LINE_TERM_LF;
+}
+
+bool line_translates_output (void) {
+    return _oterm != LINE_TERM_LF;
+}
+
+void line_process_input_data (
+    line_state_t * state, buffer_t * data, buffer_t * buf
+) {
+    size_t pos = 0;     // Current position in serial input data.
+    size_t next;        // Position of next CR in serial input data.
+    uint64_t start;     // Start time of translation.
+
+    // No processing is required for LF-terminated input.
+    if (_iterm == LINE_TERM_LF) {
+        return;
+    }
 
-    // Process serial input data in-place. No processing is required for
-    // LF-terminated input.
+    // Process serial input data, timing its translation.
+    start = metrics_get_time();
     if (_iterm == LINE_TERM_CR) {
-        // For CR termination, replace CR by LF. Temporary buffer is not
-        // required for this operation.
-        for (int i = 0; i < strlen(*data); i++) {
-            if ((*data)[i] == '\r') {
-                (*data)[i] = '\n';
-            }
-        }
+        // For CR termination, replace CR by LF in-place.
+        _replace(data->data, data->data, data->count, '\r', '\n');
     } else if (_iterm == LINE_TERM_CRLF) {
-        // For CR+LF termination, append all characters from serial input data
-        // except CR, one by one into temporary buffer.
-        for (int i = 0; i < strlen(*data); i++) {
-            if ((*data)[i] != '\r') {
-                count++;
-                proc = (char *)realloc(proc, count * sizeof(char));
-                proc[count - 1] = (*data)[i];
+        // For CR+LF termination, copy all characters into the translation
+        // buffer, replacing CR+LF by LF and keeping any other CR.
+        buf->count = 0;
+
+        // If the last call ended with a CR, it is only kept if this data does
+        // not begin with LF.
+        if (state->cr && data->count > 0) {
+            if (data->data[0] != '\n') {
+                buf->data[buf->count++] = '\r';
             }
+            state->cr = false;
         }
 
-        // Append null byte to temporary buffer.
-        count++;
-        proc = (char *)realloc(proc, count * sizeof(char));
-        proc[count - 1] = '\0';
+        // Copy runs of characters between CRs.
+        while (pos < data->count) {
+            next = pos + _find(data->data + pos, data->count - pos, '\r');
+            memcpy(buf->data + buf->count, data->data + pos, next - pos);
+            buf->count += next - pos;
+            if (next == data->count) {
+                break;
+            }
 
-        // Replace serial input data with contents of temporary buffer.
-        *data = (char *)realloc(*data, count * sizeof(char));
-        strcpy(*data, proc);
+            if (next + 1 == data->count) {
+                // If data ends with CR, hold it back until the next call, as
+                // it may be followed by LF.
+                state->cr = true;
+            } else if (data->data[next + 1] != '\n') {
+                // Keep CR which is not followed by LF.
+                buf->data[buf->count++] = '\r';
+            }
+            pos = next + 1;
+        }
 
-        // Free up space allocated to temporary buffer.
-        free(proc);
+        // Point serial input data at the translation buffer.
+        data->data = buf->data;
+        data->count = buf->count;
+        data->size = 0;
     }
+    metrics_add_sample(METRICS_TRANSLATE_TIME, metrics_get_time() - start);
 }
 
-void line_process_output_data (char ** data) {
-    int count = 0;      // Character count in temporary buffer.
-    char * proc = NULL; // Temporary buffer for processed serial output data.
+void line_process_output_data (buffer_t * data, buffer_t * buf) {
+    size_t pos = 0;     // Current position in serial output data.
+    size_t next;        // Position of next LF in serial output data.
+    uint64_t start;     // Start time of translation.
+
+    // No processing is required for LF-terminated output.
+    if (_oterm == LINE_TERM_LF) {
+        return;
+    }
 
-    // Process serial output data in-place. No processing is required for
-    // LF-terminated output.
+    // Process serial output data, timing its translation.
+    start = metrics_get_time();
     if (_oterm == LINE_TERM_CR) {
-        // For CR termination, replace LF by CR. Temporary buffer is not
-        // required for this operation.
-        for (int i = 0; i < strlen(*data); i++) {
-            if ((*data)[i] == '\n') {
-                (*data)[i] = '\r';
-            }
-        }
+        // For CR termination, replace LF by CR in-place.
+        _replace(data->data, data->data, data->count, '\n', '\r');
     } else if (_oterm == LINE_TERM_CRLF) {
-        // For CR+LF termination, append all characters from serial output data,
-        // one by one into temporary buffer, appending an additional CR before
-        // each LF character.
-        for (int i = 0; i < strlen(*data); i++) {
-            if ((*data)[i] == '\n') {
-                count += 2;
-                proc = (char *)realloc(proc, count * sizeof(char));
-                proc[count - 2] = '\r';
-                proc[count - 1] = '\n';
-            } else {
-                count++;
-                proc = (char *)realloc(proc, count * sizeof(char));
-                proc[count - 1] = (*data)[i];
-            }
-        }
+        // For CR+LF termination, copy all characters into the translation
+        // buffer, inserting CR before every LF.
+        buf->count = 0;
 
-        // Append null byte to temporary buffer.
-        count++;
-        proc = (char *)realloc(proc, count * sizeof(char));
-        proc[count - 1] = '\0';
+        // Copy runs of characters between LFs.
+        while (pos < data->count) {
+            next = pos + _find(data->data + pos, data->count - pos, '\n');
+            memcpy(buf->data + buf->count, data->data + pos, next - pos);
+            buf->count += next - pos;
+            if (next == data->count) {
+                break;
+            }
 
-        // Replace serial output data with contents of temporary buffer.
-        *data = (char *)realloc(*data, count * sizeof(char));
-        strcpy(*data, proc);
+            buf->data[buf->count++] = '\r';
+            buf->data[buf->count++] = '\n';
+            pos = next + 1;
+        }
 
-        // Free up space allocated to temporary buffer.
-        free(proc);
+        // Point serial output data at the translation buffer.
+        data->data = buf->data;
+        data->count = buf->count;
+        data->size = 0;
     }
+    metrics_add_sample(METRICS_TRANSLATE_TIME, metrics_get_time() - start);
 }
@@ -9,6 +9,23 @@
 #ifndef __LINE_H__
 #define __LINE_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** @ingroup    line
+ *
+ *  @brief      Serial input translation state.
+ *
+ *  Holds the translation state carried over between chunks of one serial input
+ *  stream. Every serial port must have its own translation state.
+ */
+
+typedef struct {
+    bool cr;    /**< Flag indicating if a CR was held back. */
+} line_state_t;
+
 /** @ingroup    line
  *
  *  @brief      Configure line termination characters.
@@ -28,36 +45,112 @@
 
 int line_set_term (const char * iterm, const char * oterm);
 
+/** @ingroup    line
+ *
+ *  @brief      Reset translation state.
+ *
+ *  Resets the translation state of a serial input stream to that of a stream
+ *  that has not received any data yet.
+ *
+ *  @param      state   Pointer to translation state to be reset.
+ */
+
+void line_reset_state (line_state_t * state);
+
+/** @ingroup    line
+ *
+ *  @brief      Get translation buffer size.
+ *
+ *  Gets the capacity that a translation buffer passed to
+ *  line_process_input_data() or line_process_output_data() must have, in order
+ *  to translate data of the specified size. Translation buffers should be
+ *  allocated once with this capacity, so that no memory is allocated while
+ *  translating.
+ *
+ *  @param      count   Maximum number of bytes to be translated at once.
+ *
+ *  @return     Required capacity of translation buffer in bytes.
+ */
+
+size_t line_get_buffer_size (size_t count);
+
+/** @ingroup    line
+ *
+ *  @brief      Check if serial input is translated.
+ *
+ *  @note       This function must not be called before the line terminations
+ *              are configured with line_set_term().
+ *
+ *  @return     `true` if line_process_input_data() changes serial input data,
+ *              and `false` if serial input data may be passed through as is.
+ */
+
+bool line_translates_input (void);
+
+/** @ingroup    line
+ *
+ *  @brief      Check if serial output is translated.
+ *
+ *  @note       This function must not be called before the line terminations
+ *              are configured with line_set_term().
+ *
+ *  @return     `true` if line_process_output_data() changes serial output
+ *              data, and `false` if serial output data may be passed through
+ *              as is.
+ */
+
+bool line_translates_output (void);
+
 /** @ingroup    line
  *
  *  @brief      Translate serial input data.
  *
- *  Processes the specified serial input buffer and replaces it in-place with a
- *  translated one, reallocating the buffer if necessary. All line terminations
- *  are replaced by line feed characters.
+ *  Processes the specified serial input buffer in a single pass. All line
+ *  terminations are replaced by line feed characters. Where translation cannot
+ *  be done in-place, the translated data is written into the specified
+ *  translation buffer, and the serial input buffer is redirected to it.
+ *
+ *  Translation state is carried over between calls, so that serial input may
+ *  be split into chunks at arbitrary points. With CR+LF termination, a CR at
+ *  the end of one chunk is held back, and is dropped if the next chunk begins
+ *  with LF. Any other CR is kept.
  *
  *  @note       This function must not be called before the line terminations
  *              are configured with line_set_term().
  *
- *  @param      data    Pointer to serial input buffer to be translated.
+ *  @param      state   Pointer to translation state of the serial input
+ *                      stream, which must be reset with line_reset_state()
+ *                      before the first call.
+ *  @param      data    Pointer to serial input buffer to be translated, which
+ *                      may be redirected to the translated data.
+ *  @param      buf     Pointer to translation buffer, whose capacity must be
+ *                      at least line_get_buffer_size() of the byte count of
+ *                      the serial input buffer.
  */
 
-void line_process_input_data (char ** data);
+void line_process_input_data (
+    line_state_t * state, buffer_t * data, buffer_t * buf
+);
 
 /** @ingroup    line
  *
  *  @brief      Translate serial output data.
  *
- *  Processes the specified serial output buffer and replaces it in-place with a
- *  translated one, reallocating the buffer if necessary. All line feed
- *  characters are replaced with line terminations.
+ *  Processes the specified serial output buffer in a single pass. All line
+ *  feed characters are replaced with line terminations. Where translation
+ *  cannot be done in-place, the translated data is written into the specified
+ *  translation buffer, and the serial output buffer is redirected to it.
  *
  *  @note       This function must not be called before the line terminations
  *              are configured with line_set_term().
  *
- *  @param      data    Pointer to serial output buffer to be translated.
+ *  @param      data    Pointer to serial output buffer to be translated, which
+ *                      may be redirected to the translated data.
+ *  @param      buf     Pointer to translation buffer, whose capacity must be
+ *                      at least line_get_buffer_size() of the byte count of
+ *                      the serial output buffer.
  */
 
-void line_process_output_data (char ** data);
+void line_process_output_data (buffer_t * data, buffer_t * buf);
 
 #endif
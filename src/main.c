@@ -12,38 +12,571 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <signal.h>
 #include <poll.h>
 
 #include "option.h"
+#include "buffer.h"
+#include "ring.h"
 #include "line.h"
 #include "serial.h"
 #include "console.h"
-#include "sleep.h"
+#include "event.h"
+#include "pipeline.h"
+#include "zerocopy.h"
+#include "capture.h"
+#include "uring.h"
+#include "mux.h"
+#include "session.h"
+#include "metrics.h"
+#include "coalesce.h"
+#include "outq.h"
+#include "transfer.h"
+#include "hexdump.h"
+#include "trigger.h"
+#include "script.h"
+#include "bridge.h"
+#include "broadcast.h"
+#include "render.h"
 
-volatile bool intr = false; // Flag indicating if user interrupt was received.
+static serial_t _serial;        // Serial port.
+static ring_t _rx, _tx;         // Serial and console input rings.
+static line_state_t _rxline;    // Serial input translation state.
+static bool _multi;             // Flag indicating if ports are multiplexed.
+static bool _coalesce;          // Flag indicating if writes are coalesced.
+static bool _newline;           // Flag indicating if newlines flush writes.
+static bool _hexdump;           // Flag indicating if data is shown in hex.
+static bool _triggers;          // Flag indicating if patterns are matched.
+static bool _script;            // Flag indicating if a script is run.
+static bool _render;            // Flag indicating if output is adaptive.
+static bool _bridge;            // Flag indicating if port is bridged.
+static outq_t _txq;             // Serial output queue.
+static bool _paused;            // Flag indicating if console input is paused.
+static bool _ended;             // Flag indicating if console input has ended.
+static buffer_t _rxbuf, _txbuf; // Translation buffers.
+static zerocopy_t _rxzc;        // Serial pass-through channel.
 
-// Interrupt signal handler.
-void handler (int signum) {
-    // If interrupt signal was received, set flag to `true`.
-    if (signum == SIGINT) {
-        intr = true;
+// Serial input event handler.
+int handle_serial (int fd, uint32_t events, void * arg) {
+    int status;     // Return status for API calls.
+    bool full;      // Flag indicating if ring buffer was filled up.
+    buffer_t data;  // Data buffer.
+    size_t count;   // Data buffer size.
+
+    // Write queued serial output once there is space for it.
+    if (events & EPOLLOUT) {
+        status = outq_flush_data(&_txq);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+        if (!(events & ~EPOLLOUT)) {
+            return 0;
+        }
+    }
+
+    // If possible, pass serial data through to console without copying it.
+    if (_rxzc.enabled) {
+        status = zerocopy_transfer(
+            &_rxzc, serial_get_fd(&_serial), console_get_output_fd()
+        );
+        if (status < 0) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to pass serial data through (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        } else if (status > 0) {
+            // If serial port was hung up, exit with failure.
+            fprintf(stderr, "Serial port was hung up\n");
+            return -1;
+        }
+        if (_rxzc.enabled) {
+            return 0;
+        }
+    }
+
+    // Read and process serial data until the ring buffer is no longer filled
+    // up entirely, so that all available serial data is consumed. This is
+    // required for edge-triggered wakeups.
+    do {
+        // Read serial data.
+        status = serial_read_data(&_serial, &_rx);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+        full = (_rx.count == _rx.size);
+
+        // Process all serial data held in ring buffer.
+        for (
+            ring_get_data(&_rx, &data); data.count > 0;
+            ring_get_data(&_rx, &data)
+        ) {
+            count = data.count;
+
+            // While a file is sent, pass serial data to the transfer instead.
+            if (transfer_is_active()) {
+                status = transfer_process_data(&data);
+                ring_drop_data(&_rx, count);
+                if (status < 0) {
+                    // On error, exit with failure.
+                    return -1;
+                }
+                continue;
+            }
+
+            // Fan serial data out to bridge clients, as received.
+            if (_bridge && bridge_write_data(&data) < 0) {
+                // On error, exit with failure.
+                return -1;
+            }
+
+            // Translate line terminations, unless data is shown in hex.
+            if (!_hexdump) {
+                line_process_input_data(&_rxline, &data, &_rxbuf);
+            }
+
+            // Capture data to file.
+            capture_write_data(&data);
+
+            // Match data against the text a script waits for.
+            if (_script) {
+                status = script_process_data(&data);
+                if (status < 0) {
+                    // On error, exit with failure.
+                    return -1;
+                }
+            }
+
+            // Find patterns, highlighting matches in a copy of the data,
+            // unless it is shown in hex.
+            if (_triggers) {
+                status = trigger_process_data(&data, !_hexdump);
+                if (status < 0) {
+                    // On error, exit with failure.
+                    return -1;
+                }
+            }
+
+            // Write data to console, or encode it as hex dump or buffer it,
+            // to be written once all data is processed.
+            if (_hexdump) {
+                hexdump_write_data(HEXDUMP_RX, &data);
+                status = 0;
+            } else if (_render) {
+                render_write_data(&data);
+                status = 0;
+            } else {
+                status = console_write_data(&data);
+            }
+            if (status < 0) {
+                // On error, exit with failure.
+                return -1;
+            }
+
+            // Release processed data.
+            ring_drop_data(&_rx, count);
+        }
+    } while (full);
+
+    // Write hex dump or buffered output of all serial data read at once.
+    if (_hexdump) {
+        return hexdump_flush_data();
+    } else if (_render) {
+        return render_flush_data();
+    }
+
+    return 0;
+}
+
+// Write serial output data to serial port, or to every multiplexed serial
+// port.
+int write_serial (const buffer_t * data) {
+    if (_multi) {
+        mux_write_data(data);
+        return 0;
+    }
+    return outq_write_data(&_txq, data);
+}
+
+// Translate serial output data, show it in hex, and write it to serial port,
+// or to every multiplexed serial port, directly or in batches.
+int write_output (buffer_t * data) {
+    bool flush;     // Flag indicating if coalesced data is written at once.
+
+    flush = _newline && memchr(data->data, '\n', data->count) != NULL;
+    line_process_output_data(data, &_txbuf);
+    if (_hexdump) {
+        hexdump_write_data(HEXDUMP_TX, data);
+    }
+    if (_coalesce) {
+        return coalesce_write_data(data, flush);
+    }
+    return write_serial(data);
+}
+
+// Translate and write console data held in ring buffer to serial output. With
+// the block policy, only as much is taken as surely fits into the output
+// queues, counting data held for coalescing, and the rest is left in the ring
+// buffer. Returns 1 if data was left, as the output queues are full.
+int process_console (void) {
+    int status;     // Return status for API calls.
+    buffer_t data;  // Data buffer.
+    size_t count;   // Data buffer size.
+    size_t space;   // Console data that fits into output queues.
+    size_t held;    // Data held for coalescing.
+
+    // While a file is sent, drop console input.
+    if (transfer_is_active()) {
+        ring_drop_data(&_tx, _tx.count);
+        return 0;
+    }
+
+    for (
+        ring_get_data(&_tx, &data); data.count > 0; ring_get_data(&_tx, &data)
+    ) {
+        // Limit data to free space, which translation may take twice of.
+        if (outq_get_policy() == OUTQ_BLOCK) {
+            space = _multi ? mux_get_space() : outq_get_space(&_txq);
+            held = _coalesce ? coalesce_get_count() : 0;
+            space = (space > held) ? space - held : 0;
+            space = line_translates_output() ? space / 2 : space;
+            if (space == 0) {
+                return 1;
+            }
+            data.count = (data.count < space) ? data.count : space;
+        }
+        count = data.count;
+
+        // Translate line terminations, show the result in hex, and write it.
+        status = write_output(&data);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+
+        // Release processed data.
+        ring_drop_data(&_tx, count);
+    }
+
+    return 0;
+}
+
+// Output queue drain handler. Resumes reading bridge clients, and a file
+// transfer, a script, or paused console input once the data left in its ring
+// buffer has been written.
+int resume_console (void) {
+    int status; // Return status for API calls.
+
+    if (_bridge && bridge_resume_data() < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    if (transfer_is_active()) {
+        return transfer_resume_data();
+    } else if (_script) {
+        return script_resume_data();
+    } else if (!_paused) {
+        return 0;
+    }
+    status = process_console();
+    if (status >= 0 && _hexdump && hexdump_flush_data() < 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        return (status < 0) ? -1 : 0;
+    }
+    _paused = false;
+    if (_ended) {
+        event_remove_handler(console_get_fd());
+        return 0;
+    }
+    return event_modify_handler(console_get_fd(), EPOLLIN);
+}
+
+// Console input event handler.
+int handle_console (int fd, uint32_t events, void * arg) {
+    int status;     // Return status for API calls.
+    bool eof;       // Flag indicating if end of console input was reached.
+
+    // Read console data. It is never passed through to the serial port, so
+    // that it is queued like all serial output.
+    status = console_read_data(&_tx);
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    eof = (status > 0);
+
+    // Process all console data held in ring buffer, and write its hex dump.
+    // If the output queues are full, pause console input until they drain.
+    status = process_console();
+    if (status >= 0 && _hexdump && hexdump_flush_data() < 0) {
+        status = -1;
+    }
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _paused = (status > 0);
+
+    // Once console input has ended for good, stop watching it. A terminal
+    // reports end of input each time the user enters an end-of-file character,
+    // but is only hung up when it is closed.
+    _ended = (eof && !isatty(fd)) || (events & EPOLLHUP);
+    if (_paused) {
+        return event_modify_handler(fd, 0);
+    } else if (_ended) {
+        event_remove_handler(fd);
+    }
+
+    return 0;
+}
+
+// Pipeline failure event handler.
+int handle_pipeline (int fd, uint32_t events, void * arg) {
+    // A pipeline thread failed, and has written an error message.
+    return -1;
+}
+
+// Metrics dump signal handler.
+int handle_dump (int fd, uint32_t events, void * arg) {
+    metrics_print_stats();
+    return 0;
+}
+
+// Metrics file timer event handler.
+int handle_metrics (int fd, uint32_t events, void * arg) {
+    // On error, stop writing metrics file, but keep serial terminal running.
+    if (metrics_write_file((const char *)arg) < 0) {
+        event_remove_handler(fd);
     }
+    return 0;
+}
+
+// Hook command exit signal handler.
+int handle_hooks (int fd, uint32_t events, void * arg) {
+    trigger_reap_hooks();
+    return 0;
+}
+
+// Write file transfer data to serial output queue.
+int write_transfer (const buffer_t * data) {
+    return outq_write_data(&_txq, data);
+}
+
+// Get free space of serial output queue for file transfer.
+size_t get_transfer_space (void) {
+    return outq_get_space(&_txq);
+}
+
+// Write bridge client data to serial output queue, as received.
+int write_bridge (const buffer_t * data) {
+    if (_hexdump) {
+        hexdump_write_data(HEXDUMP_TX, data);
+    }
+    if (outq_write_data(&_txq, data) < 0) {
+        return -1;
+    }
+    return _hexdump ? hexdump_flush_data() : 0;
+}
+
+// Get free space of serial output queue for bridge client data.
+size_t get_bridge_space (void) {
+    return outq_get_space(&_txq);
+}
+
+// Write script data to serial output, translated and shown as console data is.
+int write_script (const buffer_t * data) {
+    buffer_t out = *data;   // Data to be translated.
+
+    if (write_output(&out) < 0) {
+        return -1;
+    }
+    return _hexdump ? hexdump_flush_data() : 0;
+}
+
+// Get free space of serial output for script data, counting data held for
+// coalescing, and translation, which may take twice the space, limited to the
+// translation buffer.
+size_t get_script_space (void) {
+    size_t space;   // Free space in serial output queue.
+    size_t held;    // Data held for coalescing.
+
+    space = outq_get_space(&_txq);
+    held = _coalesce ? coalesce_get_count() : 0;
+    space = (space > held) ? space - held : 0;
+    space = line_translates_output() ? space / 2 : space;
+    return (space < _tx.size) ? space : _tx.size;
+}
+
+// Write serial output still queued once the event loop has stopped, waiting
+// up to a second at a time for output space, so that the last steps of a
+// script are sent before exit.
+int drain_serial (void) {
+    struct pollfd pfd;  // Serial port to wait for.
+    int status;         // Return status for API calls.
+
+    pfd.fd = serial_get_fd(&_serial);
+    pfd.events = POLLOUT;
+    while (_txq.ring.count > 0) {
+        status = poll(&pfd, 1, 1000);
+        if (status <= 0) {
+            // On error or timeout, exit with failure.
+            fprintf(
+                stderr, "Failed to write serial output (%s)\n",
+                (status < 0) ? strerror(errno) : "timed out"
+            );
+            return -1;
+        }
+        if (outq_flush_data(&_txq) < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// File transfer signal handler. Starts sending the file, or cancels the
+// transfer running. A file that cannot be sent leaves the session running.
+int handle_transfer (int fd, uint32_t events, void * arg) {
+    if (arg == NULL) {
+        fprintf(stderr, "No file to send, see option '-x'\n");
+        return 0;
+    } else if (transfer_is_active()) {
+        return transfer_cancel();
+    }
+
+    // Write held output first, so that it goes out before the transfer.
+    if (_coalesce && coalesce_flush_data() < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    transfer_start();
+    return 0;
+}
+
+// Close serial port, or every multiplexed serial port, and the session log and
+// broadcast ring recording its data.
+void close_serial (void) {
+    metrics_clear_ports();
+    if (_multi) {
+        mux_close_ports();
+    } else {
+        serial_close_port(&_serial);
+    }
+    session_close_log();
+    broadcast_close();
+}
+
+// Stop hex dump display or adaptive output, writing the output left, and
+// restore console I/O.
+int close_console (void) {
+    int status = 0; // Return status for API calls.
+
+    if (_hexdump) {
+        status = hexdump_close();
+    } else if (_render) {
+        status = render_close();
+    }
+    console_close_stdio();
+    return status;
+}
+
+// Print I/O statistics for a ring buffer.
+void report (const char * name, const ring_t * ring) {
+    double mb = ring->bytes / (1024.0 * 1024.0);    // Megabytes read.
+
+    fprintf(
+        stderr, "%s: %lu bytes, %lu reads (%.1f per MB)\n",
+        name, ring->bytes, ring->reads, mb > 0 ? ring->reads / mb : 0.0
+    );
+}
+
+// Print write statistics for an output stream, given its byte and `write()`
+// call counters.
+void report_writes (
+    const char * name, metrics_count_t bytes, metrics_count_t writes
+) {
+    unsigned long total = metrics_get_count(bytes);     // Bytes written.
+    unsigned long count = metrics_get_count(writes);    // Writes made.
+    double mb = total / (1024.0 * 1024.0);              // Megabytes written.
+
+    fprintf(
+        stderr, "%s: %lu bytes, %lu writes (%.1f per MB)\n",
+        name, total, count, mb > 0 ? count / mb : 0.0
+    );
+}
+
+// Print I/O statistics for a pass-through channel.
+void report_zerocopy (const char * name, const zerocopy_t * zc) {
+    double mb = zc->bytes / (1024.0 * 1024.0);  // Megabytes passed through.
+
+    fprintf(
+        stderr, "%s: %lu bytes, %lu splices (%.1f per MB)%s\n",
+        name, zc->bytes, zc->calls, mb > 0 ? zc->calls / mb : 0.0,
+        zc->enabled ? "" : ", fell back to buffered I/O"
+    );
 }
 
 void main (int argc, char ** argv) {
     int status;                             // Return status for API calls.
-    bool help;                              // Command line boolean flags.
+    bool help, stats, edge, threads, zero;  // Command line boolean flags.
+    bool uring, low, raw, color;            // Command line boolean flags.
+    bool adaptive;                          // Command line boolean flags.
     char * port, * baud, * iterm, * oterm;  // Command line string parameters.
-    struct pollfd evt;                      // Wakeup event structure.
-    char * data = NULL;                     // Data buffer.
+    char * bufsize, * cpus, * capfile;      // Command line string parameters.
+    char * ports, * logfile, * range;       // Command line string parameters.
+    char * metfile, * delay, * policy;      // Command line string parameters.
+    char * flowctl, * sendfile, * proto;    // Command line string parameters.
+    char * display, * patfile, * hook;      // Command line string parameters.
+    char * scrfile, * rawaddr, * rfcaddr;   // Command line string parameters.
+    char * shmpath, * attach;               // Command line string parameters.
+    size_t size = 65536;                    // Ring buffer size.
+    unsigned long usec;                     // Coalescing delay.
+    unsigned long rate;                     // Baud rate in bits per second.
+    unsigned long allocs;                   // Allocations made at startup.
+    serial_flow_t flow = SERIAL_FLOW_NONE;  // Flow control.
 
     // Register command line options.
     option_register_flag('h', &help);       // Help page.
     option_register_param('p', &port);      // Path to serial port.
+    option_register_param('P', &ports);     // Path to port list file.
     option_register_param('b', &baud);      // Baud rate for communication.
     option_register_param('i', &iterm);     // Input line termination.
     option_register_param('o', &oterm);     // Output line termination.
+    option_register_param('r', &bufsize);   // Ring buffer size.
+    option_register_flag('s', &stats);      // I/O statistics.
+    option_register_flag('e', &edge);       // Edge-triggered serial wakeups.
+    option_register_flag('t', &threads);    // Threaded pipeline.
+    option_register_param('a', &cpus);      // CPUs to pin threads to.
+    option_register_flag('z', &zero);       // Zero-copy pass-through.
+    option_register_param('l', &capfile);   // Path to capture file.
+    option_register_flag('u', &uring);      // `io_uring` backend.
+    option_register_param('L', &logfile);   // Path to session log.
+    option_register_param('R', &range);     // Session log time range.
+    option_register_param('m', &metfile);   // Path to metrics file.
+    option_register_flag('n', &low);        // Low latency serial port.
+    option_register_param('w', &delay);     // Write coalescing delay.
+    option_register_flag('f', &_newline);   // Newlines flush writes.
+    option_register_param('q', &policy);    // Output queue overflow policy.
+    option_register_param('F', &flowctl);   // Flow control.
+    option_register_flag('c', &raw);        // Raw console.
+    option_register_param('x', &sendfile);  // Path to file to send.
+    option_register_param('X', &proto);     // File transfer protocol.
+    option_register_param('d', &display);   // Display mode.
+    option_register_param('T', &patfile);   // Path to pattern file.
+    option_register_param('k', &hook);      // Hook command.
+    option_register_param('S', &scrfile);   // Path to script file.
+    option_register_flag('A', &adaptive);   // Adaptive console output.
+    option_register_param('B', &rawaddr);   // Raw bridge address.
+    option_register_param('N', &rfcaddr);   // RFC 2217 bridge address.
+    option_register_param('M', &shmpath);   // Path to broadcast ring.
+    option_register_param('W', &attach);    // Path to ring to attach to.
 
     // Parse command line arguments.
     status = option_parse_args(argc, argv);
@@ -57,7 +590,15 @@ void main (int argc, char ** argv) {
     if (help) {
         printf(
             "\n"
-            "Usage: %s [-h] [-p <port>] [-b <baud>] [-i <iterm>] [-o <oterm>]\n"
+            "Usage: %s [-h] [-p <port> | -P <list>] [-b <baud>] [-i <iterm>]\n"
+            "       [-o <oterm>]\n"
+            "       [-r <size>] [-s] [-e] [-t] [-a <cpus>] [-z] [-l <file>]\n"
+            "       [-u] [-L <log>] [-m <file>] [-n] [-w <delay>] [-f]\n"
+            "       [-q <policy>] [-F <flow>] [-c] [-x <file>] [-X <proto>]\n"
+            "       [-d <mode>] [-T <file>] [-k <hook>] [-S <file>] [-A]\n"
+            "       [-B <addr>] [-N <addr>] [-M <path>]\n"
+            "       %s -L <log> -R <range>\n"
+            "       %s -W <path> [-s]\n"
             "\n"
             "Options:\n"
             "\n"
@@ -66,8 +607,15 @@ void main (int argc, char ** argv) {
             "  -p <port>    Path to serial port. Here, <port> must be a valid\n"
             "               device path corresponding to a serial port.\n"
             "\n"
-            "  -b <baud>    Baud rate for communication. Here, <baud> must be\n"
-            "               a baud rate supported by Linux.\n"
+            "  -P <list>    Path to port list file, listing one serial port\n"
+            "               per line. Every listed port is opened, and each\n"
+            "               received line is tagged with its port name.\n"
+            "               Console input is sent to every port. Cannot be\n"
+            "               combined with -p, -t, -z or -u.\n"
+            "\n"
+            "  -b <baud>    Baud rate for communication. Here, <baud> is any\n"
+            "               baud rate in bits per second supported by the\n"
+            "               serial driver, such as 115200 or 12000000.\n"
             "\n"
             "  -i <iterm>   Input line termination. Here, <iterm> must be\n"
             "               'cr', 'lf', or 'crlf', whichever correctly\n"
@@ -76,14 +624,198 @@ void main (int argc, char ** argv) {
             "  -o <oterm>   Output line termination. Here, <oterm> must be\n"
             "               'cr', 'lf', or 'crlf', whichever correctly\n"
             "               represents the output line termination character.\n"
+            "\n"
+            "  -r <size>    Ring buffer size. Here, <size> is the number of\n"
+            "               bytes buffered in each direction, optionally\n"
+            "               suffixed with 'k' or 'M'. Defaults to 64k, or to\n"
+            "               about 100 ms of data above 6.5 Mbaud.\n"
+            "\n"
+            "  -s           Print I/O statistics on exit.\n"
+            "\n"
+            "  -e           Use edge-triggered wakeups for the serial port.\n"
+            "\n"
+            "  -t           Run serial I/O, line translation and console I/O\n"
+            "               in separate threads, connected by queues of\n"
+            "               <size> bytes.\n"
+            "\n"
+            "  -a <cpus>    CPUs to pin threads to. Here, <cpus> is a comma-\n"
+            "               separated list of CPU numbers for the serial,\n"
+            "               translation and console threads. Requires -t.\n"
+            "\n"
+            "  -z           Pass serial input through to the console\n"
+            "               without copying it, if its line termination\n"
+            "               is 'lf'. Cannot be combined with -t.\n"
+            "\n"
+            "  -l <file>    Capture received data to a file. Here, <file> is\n"
+            "               the path to the capture file, which is written\n"
+            "               in the background, in blocks of <size> bytes.\n"
+            "               Serial input is not passed through with -z.\n"
+            "\n"
+            "  -u           Use io_uring for serial and console I/O, falling\n"
+            "               back to the event loop where it is unsupported.\n"
+            "               Cannot be combined with -t or -z.\n"
+            "\n"
+            "  -L <log>     Record all serial data to a binary session log.\n"
+            "               Here, <log> is the path to the session log,\n"
+            "               which holds timestamped records of received\n"
+            "               and transmitted data, and a time index.\n"
+            "               Cannot be combined with -z.\n"
+            "\n"
+            "  -R <range>   Print the records of the session log <log>\n"
+            "               within a time range, and exit. Here, <range> is\n"
+            "               '<from>,<to>', where each end is empty, or\n"
+            "               '+<seconds>' since the start of the session, or\n"
+            "               a local time '[YYYY-MM-DD ]HH:MM[:SS]'.\n"
+            "\n"
+            "  -M <path>    Publish all serial data to a broadcast ring in\n"
+            "               shared memory, at <path>, so that any number of\n"
+            "               local readers follow the session at their own\n"
+            "               pace. The ring holds 64 * <size> bytes of\n"
+            "               records, and readers that fall further behind\n"
+            "               skip the records overwritten meanwhile. Cannot\n"
+            "               be combined with -z.\n"
+            "\n"
+            "  -W <path>    Attach to the broadcast ring published at <path>\n"
+            "               by another serial terminal, and write the data\n"
+            "               its serial ports receive to stdout, until it\n"
+            "               exits.\n"
+            "\n"
+            "  -m <file>    Write runtime metrics to <file> every second, in\n"
+            "               the Prometheus text format. Metrics are also\n"
+            "               written to stderr on SIGUSR1.\n"
+            "\n"
+            "  -n           Tune serial ports for low latency rather than\n"
+            "               throughput: wake up on every byte, set the\n"
+            "               driver's low latency flag, and set the latency\n"
+            "               timer of USB serial adapters to 1 ms.\n"
+            "\n"
+            "  -w <delay>   Coalesce serial output into fewer, larger writes.\n"
+            "               Here, <delay> is the longest time a byte is held\n"
+            "               back, in microseconds, or in milliseconds with\n"
+            "               suffix 'ms', e.g. '1ms'. Output is also written\n"
+            "               once <size> bytes are held. Cannot be combined\n"
+            "               with -t, -z or -u.\n"
+            "\n"
+            "  -f           With -w, write held output at once on newline.\n"
+            "\n"
+            "  -q <policy>  What to do when serial output does not fit into\n"
+            "               its queue of 2 * <size> bytes. Here, <policy> is\n"
+            "               'block' to pause console input until the queue\n"
+            "               drains (default), 'drop' to drop the excess, or\n"
+            "               'report' to exit with an error. Cannot be\n"
+            "               combined with -t or -u.\n"
+            "\n"
+            "  -F <flow>    Flow control. Here, <flow> is 'none' (default),\n"
+            "               'rtscts' for hardware flow control, or 'xonxoff'\n"
+            "               for software flow control, in which case the\n"
+            "               driver consumes XON and XOFF bytes. Overruns and\n"
+            "               framing and parity errors counted by the driver\n"
+            "               are printed on exit if there were any.\n"
+            "\n"
+            "  -c           Raw console: send every keystroke at once rather\n"
+            "               than every line, without local echo, and pass\n"
+            "               Ctrl-C and other control keys to the device.\n"
+            "               Type Ctrl-] q to quit, or Ctrl-] Ctrl-] to send\n"
+            "               Ctrl-]. Console input is not passed through\n"
+            "               with -z.\n"
+            "\n"
+            "  -x <file>    File to send during the session, each time\n"
+            "               Ctrl-] s is typed on a raw console, or SIGUSR2\n"
+            "               is received. Doing so again cancels a running\n"
+            "               transfer. Serial input goes to the transfer and\n"
+            "               console input is dropped until it ends. Cannot\n"
+            "               be combined with -P, -t, -z or -u.\n"
+            "\n"
+            "  -X <proto>   File transfer protocol. Here, <proto> is\n"
+            "               'xmodem' for XMODEM-1K, 'ymodem', or 'zmodem'\n"
+            "               (default) for streaming transfers.\n"
+            "\n"
+            "  -d <mode>    Show serial data as a hex dump, with offset, hex\n"
+            "               and ASCII columns, received and sent data tagged\n"
+            "               RX and TX. Here, <mode> is 'hex', or 'color' to\n"
+            "               color lines by direction. Serial input is not\n"
+            "               translated. If the console falls behind, only\n"
+            "               the latest line is shown ten times per second\n"
+            "               until it catches up. Cannot be combined with -P,\n"
+            "               -t, -z or -u.\n"
+            "\n"
+            "  -T <file>    Pattern file. Every line holds actions, 'color',\n"
+            "               'count', 'time' or 'exec', separated by commas,\n"
+            "               a space and a pattern to find in serial input,\n"
+            "               e.g. 'color,count panic'. Matches are\n"
+            "               highlighted, counted on exit, printed with the\n"
+            "               time, or run the hook command. Cannot be combined\n"
+            "               with -P, -t, -z or -u.\n"
+            "\n"
+            "  -k <hook>    Hook command run by /bin/sh on 'exec' matches,\n"
+            "               without waiting for it, with the pattern and the\n"
+            "               byte offset of the match in the variables\n"
+            "               SERIAL_TERMINAL_PATTERN and\n"
+            "               SERIAL_TERMINAL_OFFSET.\n"
+            "\n"
+            "  -S <file>    Run the send/expect script <file> instead of\n"
+            "               reading console input, and exit once it ends,\n"
+            "               with failure if it timed out. Every line holds\n"
+            "               a step, 'send <text>', 'expect <text>',\n"
+            "               'timeout <seconds>' for the following expect\n"
+            "               steps, 10 by default, or 'sleep <seconds>'.\n"
+            "               Cannot be combined with -P, -t, -z or -u.\n"
+            "\n"
+            "  -A           Adaptive console output: write serial input to\n"
+            "               the console up to 60 times per second, without\n"
+            "               ever waiting for it. If the console falls\n"
+            "               behind, show only a marker with the number of\n"
+            "               bytes elided and the latest data once it has\n"
+            "               caught up. Captures and session logs still get\n"
+            "               all data. Cannot be combined with -P, -t, -z,\n"
+            "               -u or -d, whose hex dump is always adaptive.\n"
+            "\n"
+            "  -B <addr>    Serve the serial port to raw TCP clients on\n"
+            "               <addr>, given as '[<host>:]<port>'. Serial input\n"
+            "               goes to every client, each with its own queue of\n"
+            "               2 * <size> bytes, dropping data for clients that\n"
+            "               fall behind. The client that sent data last holds\n"
+            "               serial output for a second, and data from other\n"
+            "               clients is discarded meanwhile. Cannot be\n"
+            "               combined with -P, -t, -z or -u.\n"
+            "\n"
+            "  -N <addr>    Like -B, for RFC 2217 clients, which may set the\n"
+            "               baud rate, character frame, flow control, break\n"
+            "               and the DTR and RTS lines.\n"
             "\n",
-            argv[0]
+            argv[0], argv[0], argv[0]
         );
         exit(EXIT_SUCCESS);
     }
 
-    // Assert that path to serial port is specified.
-    status = option_assert_param('p');
+    // If requested, print session log records and exit.
+    if (range != NULL) {
+        status = option_assert_param('L');
+        if (status < 0) {
+            // On error, exit with failure.
+            fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        status = session_read_log(logfile, range);
+        exit((status < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    // If requested, attach to the broadcast ring of another serial terminal
+    // and exit once it closes.
+    if (attach != NULL) {
+        status = broadcast_attach(attach, stats);
+        exit((status < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    // Assert that either path to serial port or port list is specified.
+    _multi = (ports != NULL);
+    if (_multi && port != NULL) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-P' cannot be combined with option '-p'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    status = _multi ? 0 : option_assert_param('p');
     if (status < 0) {
         // On error, exit with failure.
         fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
@@ -114,89 +846,613 @@ void main (int argc, char ** argv) {
         exit(EXIT_FAILURE);
     }
 
-    // Register interrupt signal handler.
-    if (signal(SIGINT, handler) == SIG_ERR) {
+    // Configure line terminations.
+    status = line_set_term(iterm, oterm);
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
+    line_reset_state(&_rxline);
+
+    // Assert that CPUs to pin threads to are only specified for threads.
+    if (cpus != NULL && !threads) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-a' requires option '-t'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Assert that zero-copy pass-through is not combined with threads.
+    if (zero && threads) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-z' cannot be combined with option '-t'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Assert that `io_uring` backend is not combined with threads or zero-copy
+    // pass-through.
+    if (uring && (threads || zero)) {
         // On error, exit with failure.
         fprintf(
-            stderr, "Failed to register signal handler (%s)\n",
-            strerror(errno)
+            stderr, "Option '-u' cannot be combined with option '-%c'\n",
+            threads ? 't' : 'z'
         );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Configure line terminations.
-    status = line_set_term(iterm, oterm);
-    if (status < 0) {
+    // Assert that multiplexed serial ports are only run in the event loop.
+    if (_multi && (threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-P' cannot be combined with option '-%c'\n",
+            threads ? 't' : (zero ? 'z' : 'u')
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Assert that session log and broadcast ring are not combined with
+    // zero-copy pass-through, which moves data past them.
+    if (logfile != NULL && zero) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-L' cannot be combined with option '-z'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (shmpath != NULL && zero) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-M' cannot be combined with option '-z'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Assert that newline flushing is only specified for coalescing, and that
+    // coalescing is only run in the event loop.
+    _coalesce = (delay != NULL);
+    if (_newline && !_coalesce) {
         // On error, exit with failure.
+        fprintf(stderr, "Option '-f' requires option '-w'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    if (_coalesce && (threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-w' cannot be combined with option '-%c'\n",
+            threads ? 't' : (zero ? 'z' : 'u')
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (_coalesce) {
+        status = coalesce_parse_delay(delay, &usec);
+        if (status < 0) {
+            // On error, exit with failure.
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Open serial port.
-    status = serial_open_port(port, baud);
+    // Assert that output queues are only used in the event loop, and set their
+    // overflow policy.
+    if (policy != NULL && (threads || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-q' cannot be combined with option '-%c'\n",
+            threads ? 't' : 'u'
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    status = outq_set_policy(
+        (policy != NULL) ? policy : "block", resume_console
+    );
     if (status < 0) {
         // On error, exit with failure.
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Assert that file transfers are only run in the event loop, on a single
+    // serial port, and set the file and protocol.
+    if (proto != NULL && sendfile == NULL) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-X' requires option '-x'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (sendfile != NULL && (_multi || threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-x' cannot be combined with option '-%c'\n",
+            _multi ? 'P' : (threads ? 't' : (zero ? 'z' : 'u'))
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Register serial wakeup event.
-    serial_get_wakeup_evt(&evt);
-    sleep_register_wakeup_evt(evt);
+    // Assert that hex dumps are only shown in the event loop, on a single
+    // serial port, and get display mode.
+    _hexdump = (display != NULL);
+    if (_hexdump && (_multi || threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-d' cannot be combined with option '-%c'\n",
+            _multi ? 'P' : (threads ? 't' : (zero ? 'z' : 'u'))
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (_hexdump) {
+        status = hexdump_parse_mode(display, &color);
+        if (status < 0) {
+            // On error, exit with failure.
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Reister console wakeup event.
-    console_get_wakeup_evt(&evt);
-    sleep_register_wakeup_evt(evt);
+    // Assert that adaptive output is only used in the event loop, on a single
+    // serial port, without hex dump.
+    _render = adaptive;
+    if (_render && (_multi || threads || zero || uring || _hexdump)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-A' cannot be combined with option '-%c'\n",
+            _multi ? 'P' : (
+                threads ? 't' : (zero ? 'z' : (uring ? 'u' : 'd'))
+            )
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
-    // Run serial terminal until interrupted.
-    while (!intr) {
-        // Wait for wakeup events.
-        status = sleep_wait_for_wakeup_evt();
+    // Assert that patterns are only matched in the event loop, on a single
+    // serial port, and compile them.
+    _triggers = (patfile != NULL);
+    if (hook != NULL && !_triggers) {
+        // On error, exit with failure.
+        fprintf(stderr, "Option '-k' requires option '-T'\n");
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (_triggers && (_multi || threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-T' cannot be combined with option '-%c'\n",
+            _multi ? 'P' : (threads ? 't' : (zero ? 'z' : 'u'))
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (_triggers) {
+        status = trigger_open(patfile, hook);
         if (status < 0) {
-            // On error, close serial port and exit with failure.
-            serial_close_port();
+            // On error, exit with failure.
             exit(EXIT_FAILURE);
         }
+    }
 
-        // Read serial data.
-        status = serial_read_data(&data);
+    // Assert that scripts are only run in the event loop, on a single serial
+    // port, and read the script.
+    _script = (scrfile != NULL);
+    if (_script && (_multi || threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-S' cannot be combined with option '-%c'\n",
+            _multi ? 'P' : (threads ? 't' : (zero ? 'z' : 'u'))
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (_script) {
+        status = script_open(scrfile, write_script, get_script_space);
         if (status < 0) {
-            // On error, close serial port and exit with failure.
-            serial_close_port();
+            // On error, exit with failure.
             exit(EXIT_FAILURE);
         }
+    }
 
-        // Translate line terminations.
-        line_process_input_data(&data);
+    // Assert that the serial port is only bridged in the event loop, on a
+    // single serial port.
+    _bridge = (rawaddr != NULL || rfcaddr != NULL);
+    if (_bridge && (_multi || threads || zero || uring)) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-%c' cannot be combined with option '-%c'\n",
+            (rawaddr != NULL) ? 'B' : 'N',
+            _multi ? 'P' : (threads ? 't' : (zero ? 'z' : 'u'))
+        );
+        fprintf(stderr, "Try '%s -h' for more information\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
-        // Write data to console.
-        status = console_write_data(data);
+    // Get flow control.
+    if (flowctl != NULL) {
+        status = serial_parse_flow(flowctl, &flow);
         if (status < 0) {
-            // On error, close serial port and exit with failure.
-            serial_close_port();
+            // On error, exit with failure.
             exit(EXIT_FAILURE);
         }
+    }
+
+    // Get ring buffer size. By default, buffer at least 100 ms of serial data
+    // at ten bits per byte, so that a briefly descheduled process does not
+    // make the link stall or overrun, in a power of two.
+    status = serial_parse_rate(baud, &rate);
+    if (status == 0 && bufsize != NULL) {
+        status = ring_parse_size(bufsize, &size);
+    } else {
+        while (status == 0 && size < rate / 100) {
+            size *= 2;
+        }
+    }
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
 
-        // Read console data.
-        status = console_read_data(&data);
+    // Prepare file transfers, whose packets must fit into the serial output
+    // queue.
+    if (sendfile != NULL && 2 * size < transfer_get_space()) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Option '-x' requires a ring buffer size of at least %zu\n",
+            transfer_get_space() / 2
+        );
+        exit(EXIT_FAILURE);
+    }
+    if (sendfile != NULL) {
+        status = transfer_open(
+            sendfile, (proto != NULL) ? proto : "zmodem", rate,
+            write_transfer, get_transfer_space
+        );
         if (status < 0) {
-            // On error, close serial port and exit with failure.
-            serial_close_port();
+            // On error, exit with failure.
             exit(EXIT_FAILURE);
         }
+    }
 
-        // Translate line terminations.
-        line_process_output_data(&data);
+    // Allocate ring buffers once, before any data flows.
+    status = ring_alloc(&_rx, size);
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
+    status = ring_alloc(&_tx, size);
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
 
-        // Write data to serial port.
-        status = serial_write_data(data);
+    // Allocate translation buffers large enough for any ring buffer contents.
+    status = buffer_alloc(&_rxbuf, line_get_buffer_size(size));
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
+    status = buffer_alloc(&_txbuf, line_get_buffer_size(size));
+    if (status < 0) {
+        // On error, exit with failure.
+        exit(EXIT_FAILURE);
+    }
+
+    // Open pass-through channel for serial input without translation. Serial
+    // input must pass through the program to be captured. Console input is
+    // not passed through, as splicing it into the serial port would bypass
+    // the serial output queue and wait for the port when it is backed up.
+    if (zero && !line_translates_input() && capfile == NULL) {
+        status = zerocopy_open(&_rxzc, size);
+        if (status < 0) {
+            // On error, exit with failure.
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Open session log, so that it records the opened serial ports, and
+    // broadcast ring.
+    if (logfile != NULL) {
+        status = session_open_log(logfile);
+        if (status < 0) {
+            // On error, exit with failure.
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (shmpath != NULL) {
+        status = broadcast_open(shmpath, 64 * size);
+        if (status < 0) {
+            // On error, close session log and exit with failure.
+            session_close_log();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Open serial port, or every listed serial port.
+    if (_multi) {
+        status = mux_open_ports(ports, baud, size, low, flow);
+    } else {
+        _serial.low_latency = low;
+        _serial.flow = flow;
+        status = serial_open_port(&_serial, port, baud);
+    }
+    if (status == 0 && !_multi) {
+        status = metrics_watch_port(&_serial, port);
+        if (status < 0) {
+            serial_close_port(&_serial);
+        }
+    }
+    if (status < 0) {
+        // On error, close session log and broadcast ring, and exit with
+        // failure.
+        metrics_clear_ports();
+        session_close_log();
+        broadcast_close();
+        exit(EXIT_FAILURE);
+    }
+
+    // Prepare console I/O, and hex dump display or adaptive output, which
+    // write the data of a whole ring buffer at once.
+    status = console_open_stdio(raw);
+    if (status == 0 && _hexdump) {
+        status = hexdump_open(color, size);
+    } else if (status == 0 && _render) {
+        status = render_open(size);
+    }
+    if (status < 0 && (_hexdump || _render)) {
+        console_close_stdio();
+    }
+    if (status < 0) {
+        // On error, close serial port and exit with failure.
+        close_serial();
+        exit(EXIT_FAILURE);
+    }
+
+    // Open event loop.
+    status = event_open_loop();
+    if (status < 0) {
+        // On error, close serial port and exit with failure.
+        close_console();
+        close_serial();
+        exit(EXIT_FAILURE);
+    }
+
+    // Dump metrics on signal, and write metrics file periodically. Signals
+    // must be registered before any thread is started.
+    status = event_register_signal(SIGUSR1, handle_dump, NULL);
+    if (status == 0) {
+        status = event_register_signal(SIGUSR2, handle_transfer, sendfile);
+    }
+    if (status == 0 && hook != NULL) {
+        status = event_register_signal(SIGCHLD, handle_hooks, NULL);
+    }
+    if (status == 0 && metfile != NULL) {
+        status = event_register_timer(1000, handle_metrics, metfile);
+        status = (status < 0) ? -1 : 0;
+    }
+    if (status < 0) {
+        // On error, close event loop and serial port and exit with failure.
+        event_close_loop();
+        close_console();
+        close_serial();
+        exit(EXIT_FAILURE);
+    }
+
+    // Open capture file. Its writer thread must inherit the signal mask set up
+    // by the event loop.
+    if (capfile != NULL) {
+        status = capture_open(capfile, size);
         if (status < 0) {
-            // On error, close serial port and exit with failure.
-            serial_close_port();
+            // On error, close event loop and serial port and exit with failure.
+            event_close_loop();
+            close_console();
+            close_serial();
             exit(EXIT_FAILURE);
         }
     }
 
-    // Close serial port.
-    serial_close_port();
+    // Open `io_uring` backend. If it is unsupported, fall back to the event
+    // loop.
+    if (uring) {
+        status = uring_open(&_serial, size);
+        if (status < 0) {
+            fprintf(stderr, "Falling back to event loop\n");
+            uring = false;
+        }
+    }
+
+    if (uring) {
+        // `io_uring` backend drives the event loop itself.
+        status = 0;
+    } else if (threads) {
+        // Start threaded pipeline, and register its failure event handler.
+        status = pipeline_start(&_serial, cpus, size);
+        if (status == 0) {
+            status = event_register_handler(
+                pipeline_get_fd(), EPOLLIN, false, handle_pipeline, NULL
+            );
+        }
+    } else {
+        // Allocate serial output queue, start coalescing serial output, and
+        // register serial and console input event handlers. Multiplexed serial
+        // ports have their own output queues. A script replaces console input,
+        // and is started once its output can be written. Bridge clients are
+        // accepted once serial data can be fanned out to them.
+        status = _multi ? 0 : outq_alloc(&_txq, &_serial, 2 * size);
+        if (status == 0 && _coalesce) {
+            status = coalesce_open(size, usec, write_serial);
+        }
+        if (status == 0 && _multi) {
+            status = mux_register_handlers(edge);
+        } else if (status == 0) {
+            status = event_register_handler(
+                serial_get_fd(&_serial), EPOLLIN, edge, handle_serial, NULL
+            );
+        }
+        if (status == 0 && !_script) {
+            status = event_register_handler(
+                console_get_fd(), EPOLLIN, false, handle_console, NULL
+            );
+        }
+        if (status == 0 && _script) {
+            status = script_start();
+        }
+        if (status == 0 && _bridge) {
+            status = bridge_open(
+                rawaddr, rfcaddr, &_serial, 2 * size, write_bridge,
+                get_bridge_space
+            );
+        }
+    }
+
+    // Run serial terminal until interrupted, counting the buffer allocations
+    // made while running apart from those made at startup.
+    allocs = metrics_get_count(METRICS_ALLOCS);
+    if (status == 0 && uring) {
+        status = uring_run_loop();
+    } else if (status == 0) {
+        status = event_run_loop();
+    }
+
+    // Stop threaded pipeline or close `io_uring` backend, write held serial
+    // output, check that a script has ended and write its queued output,
+    // disconnect bridge clients, write incomplete lines of multiplexed serial
+    // ports, write final metrics, close capture file, session log and
+    // broadcast ring, write the hex dump left, restore console I/O and close
+    // event loop.
+    if (threads) {
+        pipeline_stop();
+    }
+    if (_coalesce) {
+        if (coalesce_flush_data() < 0) {
+            status = -1;
+        }
+        coalesce_close();
+    }
+    if (_script && script_stop() < 0) {
+        status = -1;
+    } else if (_script && status == 0 && drain_serial() < 0) {
+        status = -1;
+    }
+    if (sendfile != NULL) {
+        transfer_close();
+    }
+    if (_bridge) {
+        bridge_close();
+    }
+    if (_multi && mux_flush_ports() < 0) {
+        status = -1;
+    }
+    if (metfile != NULL && metrics_write_file(metfile) < 0) {
+        status = -1;
+    }
+    if (uring) {
+        uring_close();
+    }
+    if (capfile != NULL && capture_close() < 0) {
+        status = -1;
+    }
+    if (session_close_log() < 0) {
+        status = -1;
+    }
+    broadcast_close();
+    if (close_console() < 0) {
+        status = -1;
+    }
+    event_close_loop();
+
+    // On error, close serial port and exit with failure.
+    if (status < 0) {
+        close_serial();
+        exit(EXIT_FAILURE);
+    }
+
+    // If requested, print I/O statistics.
+    if (stats && threads) {
+        pipeline_report();
+    } else if (stats && uring) {
+        uring_report();
+    } else if (stats && _multi) {
+        mux_report();
+        report("Console input", &_tx);
+    } else if (stats) {
+        report("Serial input", &_rx);
+        report("Console input", &_tx);
+        outq_report("Serial output", &_txq);
+        if (zero && !line_translates_input() && capfile == NULL) {
+            report_zerocopy("Serial pass-through", &_rxzc);
+        }
+    }
+    if (stats) {
+        report_writes(
+            "Serial writes", METRICS_SERIAL_OUT, METRICS_SERIAL_WRITES
+        );
+        report_writes(
+            "Console writes", METRICS_CONSOLE_OUT, METRICS_CONSOLE_WRITES
+        );
+        fprintf(
+            stderr, "Buffer allocations: %lu at startup, %lu while running\n",
+            allocs, metrics_get_count(METRICS_ALLOCS) - allocs
+        );
+    }
+    if (stats && capfile != NULL) {
+        capture_report();
+    }
+    if (stats && _coalesce) {
+        coalesce_report();
+    }
+    if (stats && sendfile != NULL) {
+        transfer_report();
+    }
+    if (stats && _hexdump) {
+        hexdump_report();
+    }
+    if (stats && _render) {
+        render_report();
+    }
+    if (_triggers) {
+        trigger_report(stats);
+    }
+    if (stats && _script) {
+        script_report();
+    }
+    if (stats && _bridge) {
+        bridge_report();
+    }
+    if (stats && logfile != NULL) {
+        session_report();
+    }
+    if (stats && shmpath != NULL) {
+        broadcast_report();
+    }
+
+    // Print errors counted by the serial port drivers, and close serial port.
+    if (_multi) {
+        mux_report_counts(stats);
+    } else {
+        serial_report_counts(&_serial, port, stats);
+    }
+    close_serial();
+
+    // Free ring and translation buffers, and serial output queue, discarding
+    // any output still queued.
+    ring_free(&_rx);
+    ring_free(&_tx);
+    outq_free(&_txq);
+    buffer_free(&_rxbuf);
+    buffer_free(&_txbuf);
+
+    // Free pattern list and script.
+    if (_triggers) {
+        trigger_close();
+    }
+    if (_script) {
+        script_close();
+    }
+
+    // Close pass-through channel.
+    if (zero && !line_translates_input() && capfile == NULL) {
+        zerocopy_close(&_rxzc);
+    }
 
     // Ensure that shell prompt string appears at the beginning of a new line.
     printf("\n");
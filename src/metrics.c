@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "serial.h"
+#include "metrics.h"
+
+// Maximum number of threads with their own counters. Further threads share
+// the last block, and may lose counts.
+enum {METRICS_THREAD_COUNT = 8};
+
+// Number of histogram buckets. Bucket i counts samples up to 2^i, and the last
+// bucket counts all larger samples too.
+enum {METRICS_BUCKET_COUNT = 36};
+
+// Counters of one thread, on their own cache lines.
+typedef struct {
+    _Alignas(64) atomic_ulong count[METRICS_COUNTERS];      // Counters.
+    atomic_ulong bucket[METRICS_HISTOGRAMS][METRICS_BUCKET_COUNT]; // Buckets.
+    atomic_ulong sum[METRICS_HISTOGRAMS];                   // Sample sums.
+} metrics_block_t;
+
+// Watched serial port.
+typedef struct {
+    const serial_t * serial;    // Serial port.
+    char * label;               // Path to serial port, escaped as label value.
+} metrics_port_t;
+
+// Names, help texts and labels of counters. Counters with the same name are
+// printed as one metric with different labels.
+static const struct {
+    const char * name;  // Metric name.
+    const char * help;  // Help text.
+    const char * label; // Label, or `NULL`.
+} _count_info[METRICS_COUNTERS] = {
+    {"bytes_total", "Bytes moved.", "stream=\"serial_in\""},
+    {"bytes_total", "Bytes moved.", "stream=\"serial_out\""},
+    {"bytes_total", "Bytes moved.", "stream=\"console_in\""},
+    {"bytes_total", "Bytes moved.", "stream=\"console_out\""},
+    {"serial_reads_total", "Serial read() calls.", NULL},
+    {"wakeups_total", "Event loop wakeups.", NULL},
+    {"write_stalls_total", "Writes that found output full.",
+        "stream=\"serial_out\""},
+    {"write_stalls_total", "Writes that found output full.",
+        "stream=\"console_out\""},
+    {"writes_total", "write() calls.", "stream=\"serial_out\""},
+    {"writes_total", "write() calls.", "stream=\"console_out\""},
+    {"allocations_total", "Buffer memory allocations.", NULL},
+};
+
+// Names, help texts and scales of histograms. Samples are multiplied by the
+// scale to print them in base units.
+static const struct {
+    const char * name;  // Metric name.
+    const char * help;  // Help text.
+    double scale;       // Scale of samples.
+} _hist_info[METRICS_HISTOGRAMS] = {
+    {"read_size_bytes", "Bytes read per serial read.", 1.0},
+    {"translate_seconds", "Line translation time per chunk.", 1e-9},
+    {"write_stall_seconds", "Time waited for output space.", 1e-9},
+};
+
+static metrics_block_t _block[METRICS_THREAD_COUNT];    // Thread counters.
+static atomic_int _threads;                             // Threads counting.
+static __thread metrics_block_t * _local;               // Own counters.
+
+static metrics_port_t * _port = NULL;   // Watched serial ports.
+static int _count = 0;                  // Watched serial port count.
+
+// Get counters of the calling thread, claiming a block on first use.
+static metrics_block_t * _get (void) {
+    int i;  // Position of claimed block.
+
+    if (_local == NULL) {
+        i = atomic_fetch_add_explicit(&_threads, 1, memory_order_relaxed);
+        if (i >= METRICS_THREAD_COUNT) {
+            i = METRICS_THREAD_COUNT - 1;
+        }
+        _local = &_block[i];
+    }
+    return _local;
+}
+
+// Add to a counter only updated by the calling thread.
+static void _add (atomic_ulong * counter, unsigned long n) {
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+        memory_order_relaxed
+    );
+}
+
+// Sum a counter over all threads, given the counter in the first block. The
+// same counter of the other blocks follows at a fixed stride.
+static unsigned long _sum (const atomic_ulong * counter) {
+    unsigned long sum = 0;  // Sum of counters.
+    const char * base;      // Counter in first block.
+
+    base = (const char *)counter;
+    for (int i = 0; i < METRICS_THREAD_COUNT; i++) {
+        sum += atomic_load_explicit(
+            (const atomic_ulong *)(base + i * sizeof(metrics_block_t)),
+            memory_order_relaxed
+        );
+    }
+    return sum;
+}
+
+void metrics_add_count (metrics_count_t count, unsigned long n) {
+    _add(&_get()->count[count], n);
+}
+
+unsigned long metrics_get_count (metrics_count_t count) {
+    return _sum(&_block[0].count[count]);
+}
+
+void metrics_add_sample (metrics_hist_t hist, uint64_t value) {
+    metrics_block_t * block = _get();   // Own counters.
+    int i;                              // Bucket.
+
+    i = (value <= 1) ? 0 : 64 - __builtin_clzll(value - 1);
+    if (i >= METRICS_BUCKET_COUNT) {
+        i = METRICS_BUCKET_COUNT - 1;
+    }
+    _add(&block->bucket[hist][i], 1);
+    _add(&block->sum[hist], value);
+}
+
+uint64_t metrics_get_time (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Escape a string as a label value of the text exposition format, in which a
+// backslash, double quote or line feed must be escaped with a backslash.
+static char * _escape (const char * str) {
+    char * label;   // Escaped string.
+    size_t len = 0; // Length of escaped string.
+
+    label = (char *)malloc(2 * strlen(str) + 1);
+    if (label == NULL) {
+        return NULL;
+    }
+    for (; *str != '\0'; str++) {
+        if (*str == '\\' || *str == '"') {
+            label[len++] = '\\';
+            label[len++] = *str;
+        } else if (*str == '\n') {
+            label[len++] = '\\';
+            label[len++] = 'n';
+        } else {
+            label[len++] = *str;
+        }
+    }
+    label[len] = '\0';
+    return label;
+}
+
+int metrics_watch_port (const serial_t * serial, const char * path) {
+    metrics_port_t * port;  // Reallocated ports.
+
+    port = (metrics_port_t *)realloc(
+        _port, (_count + 1) * sizeof(metrics_port_t)
+    );
+    if (port == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to watch serial port (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+    _port = port;
+    _port[_count].serial = serial;
+    _port[_count].label = _escape(path);
+    if (_port[_count].label == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to watch serial port (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+    _count++;
+
+    return 0;
+}
+
+void metrics_clear_ports (void) {
+    for (int i = 0; i < _count; i++) {
+        free(_port[i].label);
+    }
+    free(_port);
+    _port = NULL;
+    _count = 0;
+}
+
+// Print all metrics to a file.
+static void _print (FILE * file) {
+    const char * name = "";     // Name of last metric printed.
+    unsigned long sum;          // Cumulative bucket count.
+    serial_counts_t counts;     // Serial port driver counters.
+
+    // Print counters, with a header for every metric name.
+    for (int i = 0; i < METRICS_COUNTERS; i++) {
+        if (strcmp(name, _count_info[i].name) != 0) {
+            name = _count_info[i].name;
+            fprintf(
+                file, "# HELP serial_terminal_%s %s\n"
+                "# TYPE serial_terminal_%s counter\n",
+                name, _count_info[i].help, name
+            );
+        }
+        fprintf(
+            file, "serial_terminal_%s%s%s%s %lu\n", name,
+            _count_info[i].label ? "{" : "",
+            _count_info[i].label ? _count_info[i].label : "",
+            _count_info[i].label ? "}" : "", _sum(&_block[0].count[i])
+        );
+    }
+
+    // Print histograms with cumulative buckets.
+    for (int h = 0; h < METRICS_HISTOGRAMS; h++) {
+        name = _hist_info[h].name;
+        fprintf(
+            file, "# HELP serial_terminal_%s %s\n"
+            "# TYPE serial_terminal_%s histogram\n",
+            name, _hist_info[h].help, name
+        );
+        sum = 0;
+        for (int i = 0; i < METRICS_BUCKET_COUNT - 1; i++) {
+            sum += _sum(&_block[0].bucket[h][i]);
+            fprintf(
+                file, "serial_terminal_%s_bucket{le=\"%g\"} %lu\n",
+                name, (double)(1ULL << i) * _hist_info[h].scale, sum
+            );
+        }
+        sum += _sum(&_block[0].bucket[h][METRICS_BUCKET_COUNT - 1]);
+        fprintf(
+            file, "serial_terminal_%s_bucket{le=\"+Inf\"} %lu\n"
+            "serial_terminal_%s_sum %g\n"
+            "serial_terminal_%s_count %lu\n",
+            name, sum, name,
+            _sum(&_block[0].sum[h]) * _hist_info[h].scale, name, sum
+        );
+    }
+
+    // Print serial port driver counters, where the driver keeps them.
+    name = "uart_events_total";
+    fprintf(
+        file, "# HELP serial_terminal_%s Serial port driver counters.\n"
+        "# TYPE serial_terminal_%s counter\n", name, name
+    );
+    for (int i = 0; i < _count; i++) {
+        if (serial_get_counts(_port[i].serial, &counts) < 0) {
+            continue;
+        }
+        fprintf(
+            file,
+            "serial_terminal_%s{port=\"%s\",event=\"rx\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"tx\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"frame\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"overrun\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"parity\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"break\"} %lu\n"
+            "serial_terminal_%s{port=\"%s\",event=\"buf_overrun\"} %lu\n",
+            name, _port[i].label, counts.rx,
+            name, _port[i].label, counts.tx,
+            name, _port[i].label, counts.frame,
+            name, _port[i].label, counts.overrun,
+            name, _port[i].label, counts.parity,
+            name, _port[i].label, counts.brk,
+            name, _port[i].label, counts.buf_overrun
+        );
+    }
+}
+
+void metrics_print_stats (void) {
+    _print(stderr);
+}
+
+int metrics_write_file (const char * path) {
+    FILE * file;    // Temporary metrics file.
+    char * tmp;     // Path to temporary metrics file.
+    int status;     // Return status for API calls.
+
+    // Write metrics to a temporary file next to the metrics file.
+    if (asprintf(&tmp, "%s.tmp", path) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to write metrics file (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+    file = fopen(tmp, "w");
+    if (file == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open metrics file '%s' (%s)\n",
+            tmp, strerror(errno)
+        );
+        free(tmp);
+        return -1;
+    }
+    _print(file);
+    status = fclose(file);
+
+    // Replace metrics file with temporary file.
+    if (status == 0) {
+        status = rename(tmp, path);
+    }
+    if (status != 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to write metrics file '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+
+    return 0;
+}
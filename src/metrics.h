@@ -0,0 +1,155 @@
+/** @defgroup   metrics Metrics
+ *
+ *  @brief      Runtime metrics.
+ *
+ *  This module contains functions to count bytes, calls and stalls, and to
+ *  record samples such as read sizes and translation times in histograms with
+ *  power-of-two buckets, while the program runs. Every thread updates its own
+ *  block of counters with relaxed atomic loads and stores, so that counting
+ *  takes no locks and no read-modify-write instructions. Printing the metrics
+ *  only reads the blocks, and never holds up the threads updating them.
+ *
+ *  Metrics are printed in the Prometheus text exposition format, together with
+ *  the counters kept by the kernel driver of every watched serial port.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+
+#include "serial.h"
+
+/** @ingroup    metrics
+ *
+ *  @brief      Counter.
+ */
+
+typedef enum {
+    METRICS_SERIAL_IN,      /**< Bytes read from serial ports. */
+    METRICS_SERIAL_OUT,     /**< Bytes written to serial ports. */
+    METRICS_CONSOLE_IN,     /**< Bytes read from console input. */
+    METRICS_CONSOLE_OUT,    /**< Bytes written to console output. */
+    METRICS_SERIAL_READS,   /**< Serial `read()` calls. */
+    METRICS_WAKEUPS,        /**< Event loop wakeups. */
+    METRICS_SERIAL_STALLS,  /**< Serial writes that found output full. */
+    METRICS_CONSOLE_STALLS, /**< Console writes that found output full. */
+    METRICS_SERIAL_WRITES,  /**< Serial `write()` calls. */
+    METRICS_CONSOLE_WRITES, /**< Console `write()` calls. */
+    METRICS_ALLOCS,         /**< Buffer memory allocations. */
+    METRICS_COUNTERS        /**< Number of counters. */
+} metrics_count_t;
+
+/** @ingroup    metrics
+ *
+ *  @brief      Histogram.
+ */
+
+typedef enum {
+    METRICS_READ_SIZE,      /**< Bytes read per serial read, in bytes. */
+    METRICS_TRANSLATE_TIME, /**< Line translation time, in ns. */
+    METRICS_STALL_TIME,     /**< Time waited for output space, in ns. */
+    METRICS_HISTOGRAMS      /**< Number of histograms. */
+} metrics_hist_t;
+
+/** @ingroup    metrics
+ *
+ *  @brief      Add to counter.
+ *
+ *  Adds the specified amount to a counter of the calling thread.
+ *
+ *  @param      count   Counter.
+ *  @param      n       Amount to be added.
+ */
+
+void metrics_add_count (metrics_count_t count, unsigned long n);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Get counter.
+ *
+ *  Sums a counter over all threads.
+ *
+ *  @param      count   Counter.
+ *
+ *  @return     Sum of counter.
+ */
+
+unsigned long metrics_get_count (metrics_count_t count);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Add sample to histogram.
+ *
+ *  Counts the specified sample in the histogram bucket of the calling thread
+ *  with the smallest power-of-two bound not below it.
+ *
+ *  @param      hist    Histogram.
+ *  @param      value   Sample value.
+ */
+
+void metrics_add_sample (metrics_hist_t hist, uint64_t value);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Get time for samples.
+ *
+ *  Gets the monotonic time in ns, for timing samples.
+ *
+ *  @return     Monotonic time in ns.
+ */
+
+uint64_t metrics_get_time (void);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Watch serial port.
+ *
+ *  Adds the kernel driver counters of the specified serial port, such as
+ *  overruns and framing errors, to the printed metrics, labeled with its path.
+ *  The path is escaped as the text exposition format requires.
+ *
+ *  @param      serial  Pointer to open serial port.
+ *  @param      path    Path to serial port.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int metrics_watch_port (const serial_t * serial, const char * path);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Stop watching serial ports.
+ *
+ *  Removes all serial ports added with metrics_watch_port(). This function
+ *  must be called before the serial ports are closed.
+ */
+
+void metrics_clear_ports (void);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Print metrics.
+ *
+ *  Writes all metrics to `stderr`.
+ */
+
+void metrics_print_stats (void);
+
+/** @ingroup    metrics
+ *
+ *  @brief      Write metrics file.
+ *
+ *  Writes all metrics to the file with the specified path, replacing it
+ *  atomically, so that a collector never reads a partly written file.
+ *
+ *  @param      path    Path to metrics file.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int metrics_write_file (const char * path);
+
+#endif
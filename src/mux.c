@@ -0,0 +1,494 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "ring.h"
+#include "line.h"
+#include "serial.h"
+#include "console.h"
+#include "event.h"
+#include "capture.h"
+#include "metrics.h"
+#include "outq.h"
+#include "mux.h"
+
+// Time in ms after which an incomplete line that was not extended is shown, so
+// that prompts without line termination appear.
+enum {MUX_HOLD = 50};
+
+// Multiplexed serial port.
+typedef struct {
+    char * path;            // Path to serial port.
+    char * tag;             // Tag prefixed to every line.
+    size_t len;             // Tag length.
+    serial_t serial;        // Serial port.
+    bool open;              // Flag indicating if port was opened.
+    bool stopped;           // Flag indicating if port was stopped.
+    ring_t ring;            // Serial input ring buffer.
+    buffer_t buf;           // Translation buffer.
+    line_state_t line;      // Translation state.
+    buffer_t part;          // Incomplete line held back.
+    uint64_t held;          // Time incomplete line was last extended in ms.
+    outq_t queue;           // Serial output queue.
+} mux_port_t;
+
+static mux_port_t * _port = NULL;   // Serial ports.
+static int _count = 0;              // Serial port count.
+static buffer_t _out;               // Tagged serial input.
+static mux_port_t * _shown = NULL;  // Port whose incomplete line ends output.
+static int _timer_fd = -1;          // Timer showing incomplete lines.
+
+// Get monotonic time in ms.
+static uint64_t _now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Stop using a port after it failed.
+static void _stop (mux_port_t * port) {
+    event_remove_handler(serial_get_fd(&port->serial));
+    port->stopped = true;
+    fprintf(stderr, "Stopped serial port '%s'\n", port->path);
+}
+
+// Append a line to the tagged serial input, made up of the tag of a port, its
+// held back incomplete line and the specified data, optionally terminated with
+// a forced LF. If the start of the line was already shown, and no other port
+// wrote since, the line is continued without tag. If another port's incomplete
+// line was shown last, it is ended first. The line is left incomplete if `end`
+// is false.
+static int _put (
+    mux_port_t * port, const char * seg, size_t len, bool lf, bool end
+) {
+    int status; // Return status for API calls.
+
+    status = buffer_reserve(
+        &_out, _out.count + port->len + port->part.count + len + 2
+    );
+    if (status < 0) {
+        return -1;
+    }
+
+    if (_shown != NULL && _shown != port) {
+        _out.data[_out.count++] = '\n';
+        _shown = NULL;
+    }
+    if (_shown != port) {
+        memcpy(_out.data + _out.count, port->tag, port->len);
+        _out.count += port->len;
+    }
+    memcpy(_out.data + _out.count, port->part.data, port->part.count);
+    _out.count += port->part.count;
+    memcpy(_out.data + _out.count, seg, len);
+    _out.count += len;
+    if (lf) {
+        _out.data[_out.count++] = '\n';
+    }
+    port->part.count = 0;
+    _shown = end ? NULL : port;
+
+    return 0;
+}
+
+// Append a complete line to the tagged serial input.
+static int _emit (mux_port_t * port, const char * seg, size_t len, bool lf) {
+    return _put(port, seg, len, lf, true);
+}
+
+// Capture tagged lines and write them to console.
+static int _write (void) {
+    int status; // Return status for API calls.
+
+    if (_out.count == 0) {
+        return 0;
+    }
+    capture_write_data(&_out);
+    status = console_write_data(&_out);
+    _out.count = 0;
+    return status;
+}
+
+// Incomplete line timer event handler. Shows the incomplete lines that were
+// not extended for a while, and stops once no port holds one.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    uint64_t now = _now();  // Current time.
+    bool held = false;      // Flag indicating if a line is still held back.
+
+    for (int i = 0; i < _count; i++) {
+        if (_port[i].part.count == 0) {
+            continue;
+        }
+        if (now - _port[i].held < MUX_HOLD) {
+            held = true;
+        } else if (_put(&_port[i], "", 0, false, false) < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+    if (!held) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+    return _write();
+}
+
+// Append translated serial input of a port to the tagged serial input, one
+// complete line at a time. An incomplete line is held back until it is
+// completed, or until it no longer fits, in which case it is ended early.
+static int _tag (mux_port_t * port, const buffer_t * data) {
+    int status;         // Return status for API calls.
+    size_t pos = 0;     // Current position in data.
+    size_t next;        // Position after next LF.
+    const char * lf;    // Next LF.
+
+    while (pos < data->count) {
+        lf = memchr(data->data + pos, '\n', data->count - pos);
+        if (lf != NULL) {
+            // Emit completed line.
+            next = lf - data->data + 1;
+            status = _emit(port, data->data + pos, next - pos, false);
+            pos = next;
+        } else if (
+            port->part.count + data->count - pos <= port->part.size
+        ) {
+            // Hold back incomplete line.
+            memcpy(
+                port->part.data + port->part.count, data->data + pos,
+                data->count - pos
+            );
+            port->part.count += data->count - pos;
+            port->held = _now();
+            status = 0;
+            pos = data->count;
+        } else {
+            // End incomplete line that no longer fits.
+            status = _emit(port, data->data + pos, data->count - pos, true);
+            pos = data->count;
+        }
+        if (status < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Serial input event handler of a port.
+static int _handle_port (int fd, uint32_t events, void * arg) {
+    mux_port_t * port = (mux_port_t *)arg;  // Port ready for input.
+    int status;                             // Return status for API calls.
+    bool full;                              // Flag if ring buffer was filled.
+    buffer_t data;                          // Data buffer.
+    size_t count;                           // Data buffer size.
+
+    // Write queued serial output once there is space for it.
+    if (events & EPOLLOUT) {
+        status = outq_flush_data(&port->queue);
+        if (status < 0) {
+            // On error, stop port, but keep the others running.
+            _stop(port);
+            return 0;
+        }
+        if (!(events & ~EPOLLOUT)) {
+            return 0;
+        }
+    }
+
+    // Read and tag serial data until the ring buffer is no longer filled up
+    // entirely, as for a single serial port.
+    do {
+        status = serial_read_data(&port->serial, &port->ring);
+        if (status < 0) {
+            // On error, stop port, but keep the others running.
+            _stop(port);
+            break;
+        }
+        full = (port->ring.count == port->ring.size);
+
+        for (
+            ring_get_data(&port->ring, &data); data.count > 0;
+            ring_get_data(&port->ring, &data)
+        ) {
+            count = data.count;
+            line_process_input_data(&port->line, &data, &port->buf);
+            status = _tag(port, &data);
+            if (status < 0) {
+                // On error, exit with failure.
+                return -1;
+            }
+            ring_drop_data(&port->ring, count);
+        }
+    } while (full);
+
+    // Capture tagged lines and write them to console, and show a held back
+    // incomplete line unless it is extended soon.
+    if (_write() < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    if (port->part.count > 0 && _timer_fd < 0) {
+        _timer_fd = event_register_timer(MUX_HOLD, _handle_timer, NULL);
+        if (_timer_fd < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Open a serial port, and allocate its buffers.
+static int _open (
+    mux_port_t * port, unsigned short id, const char * path, const char * baud,
+    size_t size, bool low, serial_flow_t flow
+) {
+    int status;         // Return status for API calls.
+    const char * name;  // Name of port.
+
+    // Tag lines with the file name of the port.
+    name = strrchr(path, '/');
+    name = (name == NULL) ? path : name + 1;
+    memset(port, 0, sizeof(mux_port_t));
+    port->path = strdup(path);
+    if (port->path == NULL || asprintf(&port->tag, "[%s] ", name) < 0) {
+        fprintf(
+            stderr, "Failed to allocate serial port (%s)\n",
+            strerror(errno)
+        );
+        port->tag = NULL;
+        return -1;
+    }
+    port->len = strlen(port->tag);
+
+    // Allocate buffers.
+    if (
+        ring_alloc(&port->ring, size) < 0 ||
+        buffer_alloc(&port->buf, line_get_buffer_size(size)) < 0 ||
+        buffer_alloc(&port->part, size) < 0
+    ) {
+        return -1;
+    }
+    line_reset_state(&port->line);
+
+    // Open serial port, identified by its position in the port list.
+    port->serial.id = id;
+    port->serial.low_latency = low;
+    port->serial.flow = flow;
+    status = serial_open_port(&port->serial, path, baud);
+    if (status < 0) {
+        return -1;
+    }
+    port->open = true;
+
+    return 0;
+}
+
+int mux_open_ports (
+    const char * list, const char * baud, size_t size, bool low,
+    serial_flow_t flow
+) {
+    int status;                 // Return status for API calls.
+    FILE * file;                // Port list file.
+    char * line = NULL;         // Line of port list file.
+    size_t cap = 0;             // Capacity of line.
+    char * path;                // Path in line.
+    size_t len;                 // Length of path.
+    mux_port_t * port;          // Reallocated ports.
+
+    // Open port list file.
+    file = fopen(list, "r");
+    if (file == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open port list '%s' (%s)\n",
+            list, strerror(errno)
+        );
+        return -1;
+    }
+
+    // Open every listed port.
+    status = 0;
+    while (status == 0 && getline(&line, &cap, file) >= 0) {
+        // Skip surrounding whitespace, empty lines and comments.
+        for (path = line; isspace((unsigned char)*path); path++);
+        for (
+            len = strlen(path);
+            len > 0 && isspace((unsigned char)path[len - 1]); len--
+        );
+        path[len] = '\0';
+        if (len == 0 || path[0] == '#') {
+            continue;
+        }
+
+        // Allocate space for new port.
+        port = (mux_port_t *)realloc(
+            _port, (_count + 1) * sizeof(mux_port_t)
+        );
+        if (port == NULL) {
+            fprintf(
+                stderr, "Failed to allocate serial port (%s)\n",
+                strerror(errno)
+            );
+            status = -1;
+            break;
+        }
+        _port = port;
+
+        // Open port.
+        status = _open(
+            &_port[_count], _count, path, baud, size, low, flow
+        );
+        _count++;
+    }
+    free(line);
+    fclose(file);
+
+    // Allocate tagged serial input buffer.
+    if (status == 0 && _count == 0) {
+        fprintf(stderr, "No serial ports listed in '%s'\n", list);
+        status = -1;
+    }
+    if (status == 0) {
+        status = buffer_alloc(&_out, 2 * size);
+    }
+
+    // Allocate output queues and watch driver counters of every port, now
+    // that ports no longer move.
+    for (int i = 0; status == 0 && i < _count; i++) {
+        status = outq_alloc(&_port[i].queue, &_port[i].serial, 2 * size);
+        if (status == 0) {
+            status = metrics_watch_port(&_port[i].serial, _port[i].path);
+        }
+    }
+    if (status < 0) {
+        // On error, close opened ports and exit with failure.
+        metrics_clear_ports();
+        mux_close_ports();
+        return -1;
+    }
+
+    return 0;
+}
+
+int mux_flush_ports (void) {
+    int status = 0; // Return status for API calls.
+
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+    for (int i = 0; status == 0 && i < _count; i++) {
+        if (_port[i].part.count > 0) {
+            status = _emit(&_port[i], "", 0, true);
+        }
+    }
+    if (status == 0 && _shown != NULL) {
+        status = buffer_reserve(&_out, _out.count + 1);
+        if (status == 0) {
+            _out.data[_out.count++] = '\n';
+            _shown = NULL;
+        }
+    }
+    if (status == 0) {
+        status = _write();
+    }
+    return status;
+}
+
+void mux_close_ports (void) {
+    // Write incomplete lines left, once the event loop, which closes the timer
+    // showing them, is closed.
+    _timer_fd = -1;
+    mux_flush_ports();
+    for (int i = 0; i < _count; i++) {
+        if (_port[i].open) {
+            serial_close_port(&_port[i].serial);
+        }
+        free(_port[i].path);
+        free(_port[i].tag);
+        ring_free(&_port[i].ring);
+        buffer_free(&_port[i].buf);
+        buffer_free(&_port[i].part);
+        outq_free(&_port[i].queue);
+    }
+    free(_port);
+    _port = NULL;
+    _count = 0;
+    buffer_free(&_out);
+}
+
+int mux_register_handlers (bool edge) {
+    int status; // Return status for API calls.
+
+    for (int i = 0; i < _count; i++) {
+        status = event_register_handler(
+            serial_get_fd(&_port[i].serial), EPOLLIN, edge, _handle_port,
+            &_port[i]
+        );
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void mux_write_data (const buffer_t * data) {
+    int status; // Return status for API calls.
+
+    for (int i = 0; i < _count; i++) {
+        if (_port[i].stopped) {
+            continue;
+        }
+        status = outq_write_data(&_port[i].queue, data);
+        if (status < 0) {
+            // On error, stop port, but keep the others running.
+            _stop(&_port[i]);
+        }
+    }
+}
+
+size_t mux_get_space (void) {
+    size_t space = SIZE_MAX;    // Smallest free space of output queues.
+
+    for (int i = 0; i < _count; i++) {
+        if (!_port[i].stopped && outq_get_space(&_port[i].queue) < space) {
+            space = outq_get_space(&_port[i].queue);
+        }
+    }
+    return space;
+}
+
+void mux_report_counts (bool always) {
+    for (int i = 0; i < _count; i++) {
+        if (_port[i].open) {
+            serial_report_counts(&_port[i].serial, _port[i].path, always);
+        }
+    }
+}
+
+void mux_report (void) {
+    double mb;  // Megabytes read.
+
+    for (int i = 0; i < _count; i++) {
+        mb = _port[i].ring.bytes / (1024.0 * 1024.0);
+        fprintf(
+            stderr, "%s: %lu bytes, %lu reads (%.1f per MB)%s\n",
+            _port[i].path, _port[i].ring.bytes, _port[i].ring.reads,
+            mb > 0 ? _port[i].ring.reads / mb : 0.0,
+            _port[i].stopped ? ", stopped" : ""
+        );
+        outq_report(_port[i].path, &_port[i].queue);
+    }
+}
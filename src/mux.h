@@ -0,0 +1,135 @@
+/** @defgroup   mux     Multiplexer
+ *
+ *  @brief      Multi-port serial I/O.
+ *
+ *  This module contains functions to run many serial ports in one event loop.
+ *  Every port has its own serial input ring buffer and translation state.
+ *  Serial input is printed one complete line at a time, with every line tagged
+ *  with the name of its port, so that lines from different ports never
+ *  interleave. An incomplete line, such as a prompt, is shown once no more of
+ *  it arrives for a moment, and is continued on the same line unless another
+ *  port prints meanwhile. Console input is sent to every port.
+ */
+
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffer.h"
+#include "serial.h"
+
+/** @ingroup    mux
+ *
+ *  @brief      Open serial ports.
+ *
+ *  Opens every serial port listed in the specified file at the specified baud
+ *  rate and flow control, optionally tuned for low latency, and allocates its
+ *  buffers. The file lists one path per line. Empty lines and lines beginning
+ *  with `#` are ignored.
+ *
+ *  @note       The line terminations must be configured with line_set_term()
+ *              before calling this function.
+ *
+ *  @param      list    Path to port list file.
+ *  @param      baud    String representation of baud rate for communication.
+ *  @param      size    Capacity of the serial input ring buffer of each port.
+ *  @param      low     Flag indicating if ports are tuned for low latency.
+ *  @param      flow    Flow control of every port.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int mux_open_ports (
+    const char * list, const char * baud, size_t size, bool low,
+    serial_flow_t flow
+);
+
+/** @ingroup    mux
+ *
+ *  @brief      Write incomplete lines.
+ *
+ *  Captures and writes the incomplete lines held back for every serial port
+ *  to the console, each with its tag and terminated with LF.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int mux_flush_ports (void);
+
+/** @ingroup    mux
+ *
+ *  @brief      Close serial ports.
+ *
+ *  Writes the incomplete lines left, closes every serial port, restoring its
+ *  original configuration, and frees its buffers.
+ */
+
+void mux_close_ports (void);
+
+/** @ingroup    mux
+ *
+ *  @brief      Register serial input event handlers.
+ *
+ *  Registers the serial input event handler of every port with
+ *  event_register_handler(). A port that fails, for example because its
+ *  device was unplugged, is stopped without affecting the other ports.
+ *
+ *  @param      edge    Flag indicating if wakeups are edge-triggered.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int mux_register_handlers (bool edge);
+
+/** @ingroup    mux
+ *
+ *  @brief      Write serial output data to every port.
+ *
+ *  Writes the specified buffer to the serial output of every port that has
+ *  not been stopped, through its output queue, without blocking. A port that
+ *  fails is stopped.
+ *
+ *  @param      data    Pointer to buffer to be written to serial output.
+ */
+
+void mux_write_data (const buffer_t * data);
+
+/** @ingroup    mux
+ *
+ *  @brief      Get free space in output queues.
+ *
+ *  @return     Smallest number of bytes that fit into the output queue of any
+ *              port that has not been stopped.
+ */
+
+size_t mux_get_space (void);
+
+/** @ingroup    mux
+ *
+ *  @brief      Print serial port error counts.
+ *
+ *  Writes the overruns, framing and parity errors, and breaks counted by the
+ *  driver of every open port since it was opened to `stderr`, if there were
+ *  any or if always requested.
+ *
+ *  @param      always  Flag indicating if counts are printed without errors.
+ */
+
+void mux_report_counts (bool always);
+
+/** @ingroup    mux
+ *
+ *  @brief      Print multi-port statistics.
+ *
+ *  Writes the number of bytes read, `read()` calls per MB, and output queue
+ *  statistics of every port to `stderr`.
+ */
+
+void mux_report (void);
+
+#endif
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "buffer.h"
+#include "ring.h"
+#include "serial.h"
+#include "event.h"
+#include "outq.h"
+
+static outq_policy_t _policy = OUTQ_BLOCK;  // Overflow policy.
+static outq_drain_t _drain = NULL;          // Drain handler.
+
+// Start or stop waiting for output space.
+static int _arm (outq_t * queue, bool armed) {
+    int status; // Return status for API calls.
+
+    if (queue->armed == armed) {
+        return 0;
+    }
+    status = event_modify_handler(
+        serial_get_fd(queue->serial), EPOLLIN | (armed ? EPOLLOUT : 0)
+    );
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    queue->armed = armed;
+    return 0;
+}
+
+int outq_set_policy (const char * policy, outq_drain_t drain) {
+    // Get overflow policy.
+    if (strcmp(policy, "block") == 0) {
+        _policy = OUTQ_BLOCK;
+    } else if (strcmp(policy, "drop") == 0) {
+        _policy = OUTQ_DROP;
+    } else if (strcmp(policy, "report") == 0) {
+        _policy = OUTQ_REPORT;
+    } else {
+        // If unsupported, exit with failure.
+        fprintf(stderr, "Unsupported overflow policy '%s'\n", policy);
+        return -1;
+    }
+    _drain = drain;
+
+    return 0;
+}
+
+outq_policy_t outq_get_policy (void) {
+    return _policy;
+}
+
+int outq_alloc (outq_t * queue, serial_t * serial, size_t size) {
+    memset(queue, 0, sizeof(outq_t));
+    queue->serial = serial;
+    return ring_alloc(&queue->ring, size);
+}
+
+void outq_free (outq_t * queue) {
+    ring_free(&queue->ring);
+}
+
+size_t outq_get_space (const outq_t * queue) {
+    return queue->ring.size - queue->ring.count;
+}
+
+int outq_write_data (outq_t * queue, const buffer_t * data) {
+    int status;         // Return status for API calls.
+    size_t count = 0;   // Number of bytes written at once.
+    size_t space;       // Free space in queue.
+    buffer_t rest;      // Data left to be queued.
+
+    // If nothing is queued, write directly, without copying.
+    if (queue->ring.count == 0) {
+        status = serial_try_write_data(queue->serial, data, &count);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+    rest.data = data->data + count;
+    rest.count = data->count - count;
+    rest.size = 0;
+    if (rest.count == 0) {
+        return 0;
+    }
+
+    // Apply overflow policy to data that does not fit.
+    space = outq_get_space(queue);
+    if (rest.count > space) {
+        if (_policy == OUTQ_REPORT) {
+            // On overflow, exit with failure.
+            fprintf(
+                stderr, "Serial output queue overflowed by %zu bytes\n",
+                rest.count - space
+            );
+            return -1;
+        }
+        queue->dropped += rest.count - space;
+        queue->overflows++;
+        rest.count = space;
+    }
+
+    // Queue rest of data, and wait for output space.
+    ring_put_data(&queue->ring, &rest);
+    if (queue->ring.count > queue->peak) {
+        queue->peak = queue->ring.count;
+    }
+    return _arm(queue, true);
+}
+
+int outq_flush_data (outq_t * queue) {
+    int status;         // Return status for API calls.
+    buffer_t data;      // Queued data.
+    size_t count;       // Number of bytes written.
+    bool drained;       // Flag indicating if any data was written.
+
+    // Write queued data until none is left or no output space is available.
+    drained = false;
+    for (
+        ring_get_data(&queue->ring, &data); data.count > 0;
+        ring_get_data(&queue->ring, &data)
+    ) {
+        status = serial_try_write_data(queue->serial, &data, &count);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+        if (count == 0) {
+            break;
+        }
+        ring_drop_data(&queue->ring, count);
+        drained = true;
+    }
+
+    // Stop waiting for output space once empty, and pass on the room made.
+    if (queue->ring.count == 0) {
+        status = _arm(queue, false);
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+    if (drained && _drain != NULL) {
+        return _drain();
+    }
+
+    return 0;
+}
+
+void outq_report (const char * name, const outq_t * queue) {
+    fprintf(
+        stderr, "%s queue: peak %zu of %zu bytes, %lu bytes dropped in %lu "
+        "overflows\n", name, queue->peak, queue->ring.size, queue->dropped,
+        queue->overflows
+    );
+}
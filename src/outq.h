@@ -0,0 +1,180 @@
+/** @defgroup   outq    Output queue
+ *
+ *  @brief      Non-blocking serial output.
+ *
+ *  This module contains functions to write serial output without ever blocking
+ *  the event loop. Data that the serial port does not take at once, because
+ *  the device applies flow control or the link is slow, is held in a bounded
+ *  queue, and written whenever the event loop reports output space. Serial
+ *  input is thus read on time no matter how far output falls behind.
+ *
+ *  When data does not fit into a queue, an overflow policy decides what
+ *  happens: console input is paused until the queue drains, the excess data is
+ *  dropped and counted, or the overflow is reported as an error.
+ */
+
+#ifndef __OUTQ_H__
+#define __OUTQ_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+#include "ring.h"
+#include "serial.h"
+
+/** @ingroup    outq
+ *
+ *  @brief      Overflow policy.
+ */
+
+typedef enum {
+    OUTQ_BLOCK,     /**< Pause console input until the queue drains. */
+    OUTQ_DROP,      /**< Drop data that does not fit, and count it. */
+    OUTQ_REPORT     /**< Fail with an error message. */
+} outq_policy_t;
+
+/** @ingroup    outq
+ *
+ *  @brief      Drain handler.
+ *
+ *  Called whenever queued data has been written, making room in a queue.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+typedef int (* outq_drain_t) (void);
+
+/** @ingroup    outq
+ *
+ *  @brief      Output queue.
+ *
+ *  Holds serial output data waiting for a serial port to accept it.
+ */
+
+typedef struct {
+    ring_t ring;                /**< Queued data. */
+    serial_t * serial;          /**< Serial port written to. */
+    bool armed;                 /**< Flag indicating if waiting for space. */
+    size_t peak;                /**< Largest number of bytes queued. */
+    unsigned long dropped;      /**< Number of bytes dropped. */
+    unsigned long overflows;    /**< Number of writes that overflowed. */
+} outq_t;
+
+/** @ingroup    outq
+ *
+ *  @brief      Set overflow policy.
+ *
+ *  Sets the overflow policy of all queues from its name, `block`, `drop` or
+ *  `report`, and the handler to be called when queues drain.
+ *
+ *  @param      policy  Name of overflow policy.
+ *  @param      drain   Drain handler, or `NULL`.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int outq_set_policy (const char * policy, outq_drain_t drain);
+
+/** @ingroup    outq
+ *
+ *  @brief      Get overflow policy.
+ *
+ *  @return     Overflow policy of all queues.
+ */
+
+outq_policy_t outq_get_policy (void);
+
+/** @ingroup    outq
+ *
+ *  @brief      Allocate output queue.
+ *
+ *  Allocates an empty output queue for the specified serial port.
+ *
+ *  @note       The serial port must be registered in the event loop for
+ *              `EPOLLIN`, as the queue adds and removes `EPOLLOUT` to wait for
+ *              output space.
+ *
+ *  @param      queue   Pointer to output queue to be allocated.
+ *  @param      serial  Pointer to open serial port.
+ *  @param      size    Capacity in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int outq_alloc (outq_t * queue, serial_t * serial, size_t size);
+
+/** @ingroup    outq
+ *
+ *  @brief      Free output queue.
+ *
+ *  Frees the output queue, discarding any data still queued.
+ *
+ *  @param      queue   Pointer to output queue to be freed.
+ */
+
+void outq_free (outq_t * queue);
+
+/** @ingroup    outq
+ *
+ *  @brief      Get free space in output queue.
+ *
+ *  @param      queue   Pointer to output queue.
+ *
+ *  @return     Number of bytes that fit into the output queue.
+ */
+
+size_t outq_get_space (const outq_t * queue);
+
+/** @ingroup    outq
+ *
+ *  @brief      Write serial output data.
+ *
+ *  Writes as much of the specified buffer to the serial port as is possible
+ *  without blocking, if nothing is queued before it, and queues the rest.
+ *  Data that does not fit into the queue is dropped and counted, or, with the
+ *  report policy, the overflow is reported as a failure. With the block
+ *  policy, callers must check for space before writing.
+ *
+ *  @param      queue   Pointer to output queue.
+ *  @param      data    Pointer to buffer to be written to serial output.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int outq_write_data (outq_t * queue, const buffer_t * data);
+
+/** @ingroup    outq
+ *
+ *  @brief      Write queued data.
+ *
+ *  Writes as much queued data as possible without blocking, and stops waiting
+ *  for output space once the queue is empty. Calls the drain handler if any
+ *  data was written. Must be called when the serial port reports `EPOLLOUT`.
+ *
+ *  @param      queue   Pointer to output queue.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int outq_flush_data (outq_t * queue);
+
+/** @ingroup    outq
+ *
+ *  @brief      Print output queue statistics.
+ *
+ *  Writes the peak number of bytes queued, and the number of bytes dropped in
+ *  overflows, to `stderr`.
+ *
+ *  @param      name    Name of output queue.
+ *  @param      queue   Pointer to output queue.
+ */
+
+void outq_report (const char * name, const outq_t * queue);
+
+#endif
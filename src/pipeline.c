@@ -0,0 +1,475 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#include "buffer.h"
+#include "queue.h"
+#include "line.h"
+#include "serial.h"
+#include "console.h"
+#include "capture.h"
+#include "metrics.h"
+#include "pipeline.h"
+
+// Pipeline thread.
+typedef enum {
+    PIPELINE_THREAD_SERIAL,         // Serial thread.
+    PIPELINE_THREAD_LINE,           // Translation thread.
+    PIPELINE_THREAD_CONSOLE,        // Console thread.
+    PIPELINE_THREAD_COUNT           // Number of threads.
+} pipeline_thread_t;
+
+static queue_t _rx_in;                          // Untranslated serial input.
+static queue_t _rx_out;                         // Translated serial input.
+static queue_t _tx_in;                          // Untranslated serial output.
+static queue_t _tx_out;                         // Translated serial output.
+
+static buffer_t _rxbuf, _txbuf;                 // Translation buffers.
+static line_state_t _rxline;                    // Input translation state.
+static serial_t * _serial;                      // Serial port.
+
+static atomic_bool _stop;                       // Flag to stop threads.
+static int _stop_fd = -1;                       // Signalled to stop threads.
+static int _fail_fd = -1;                       // Signalled by failed thread.
+
+static int _cpu[PIPELINE_THREAD_COUNT];         // CPUs to pin threads to.
+static pthread_t _thread[PIPELINE_THREAD_COUNT];// Running threads.
+static int _count = 0;                          // Running thread count.
+
+// Signal failure of calling thread to main thread.
+static void * _fail (void) {
+    uint64_t val = 1;   // Value added to event counter.
+
+    write(_fail_fd, &val, sizeof(val));
+    return NULL;
+}
+
+// Add a file descriptor to a poll set.
+static void _watch (struct pollfd * evt, int * count, int fd, short events) {
+    evt[*count].fd = fd;
+    evt[*count].events = events;
+    evt[*count].revents = 0;
+    (*count)++;
+}
+
+// Serial thread. Drains serial input into the untranslated serial input queue,
+// and feeds the translated serial output queue to serial output.
+static void * _run_serial (void * arg) {
+    int status;             // Return status for API calls.
+    buffer_t buf;           // Queue space or data.
+    size_t count;           // Number of bytes written.
+    bool busy;              // Flag indicating if progress was made.
+    bool full, empty;       // Flags indicating state of queues.
+    struct pollfd evt[4];   // Wakeup event structures.
+    int n;                  // Wakeup event count.
+
+    while (!atomic_load_explicit(&_stop, memory_order_relaxed)) {
+        busy = false;
+
+        // Read serial input into queue.
+        queue_get_space(&_rx_in, &buf);
+        full = (buf.size == 0);
+        if (!full) {
+            status = serial_read_buffer(_serial, &buf);
+            if (status < 0) {
+                return _fail();
+            }
+            queue_commit(&_rx_in, buf.count);
+            busy = busy || (buf.count > 0);
+        }
+
+        // Write queued serial output.
+        queue_get_data(&_tx_out, &buf);
+        empty = (buf.count == 0);
+        if (!empty) {
+            status = serial_try_write_data(_serial, &buf, &count);
+            if (status < 0) {
+                return _fail();
+            }
+            queue_release(&_tx_out, count);
+            busy = busy || (count > 0);
+        }
+
+        if (busy) {
+            continue;
+        }
+
+        // Sleep until serial port or queues become ready, or until stopped.
+        if (full && queue_arm_space(&_rx_in, 1)) {
+            continue;
+        }
+        if (empty && queue_arm_data(&_tx_out)) {
+            if (full) {
+                queue_disarm(&_rx_in, false);
+            }
+            continue;
+        }
+        n = 0;
+        _watch(evt, &n, _stop_fd, POLLIN);
+        _watch(
+            evt, &n, serial_get_fd(_serial),
+            (full ? 0 : POLLIN) | (empty ? 0 : POLLOUT)
+        );
+        if (full) {
+            _watch(evt, &n, _rx_in.space_fd, POLLIN);
+        }
+        if (empty) {
+            _watch(evt, &n, _tx_out.data_fd, POLLIN);
+        }
+        poll(evt, n, -1);
+        metrics_add_count(METRICS_WAKEUPS, 1);
+        if (full) {
+            queue_disarm(&_rx_in, false);
+        }
+        if (empty) {
+            queue_disarm(&_tx_out, true);
+        }
+    }
+
+    return NULL;
+}
+
+// Translate data from one queue into another, as serial input if a
+// translation state is given, and otherwise as serial output. Returns `true`
+// if progress was made, and otherwise arms the queue that must be waited for,
+// and adds its wakeup descriptor to the poll set.
+static bool _translate (
+    queue_t * in, queue_t * out, buffer_t * buf, line_state_t * state,
+    struct pollfd * evt, int * n, queue_t ** armed, bool * data
+) {
+    buffer_t chunk; // Chunk of data to be translated.
+    size_t space;   // Free space in output queue.
+    size_t count;   // Number of untranslated bytes in chunk.
+
+    // Limit chunk so that its translation is certain to fit into the output
+    // queue.
+    queue_get_data(in, &chunk);
+    space = queue_get_free(out);
+    if (chunk.count > 0 && space >= 3) {
+        if (chunk.count > (space - 1) / 2) {
+            chunk.count = (space - 1) / 2;
+        }
+        count = chunk.count;
+        if (state != NULL) {
+            line_process_input_data(state, &chunk, buf);
+        } else {
+            line_process_output_data(&chunk, buf);
+        }
+        queue_write(out, &chunk);
+        queue_release(in, count);
+        return true;
+    }
+
+    // Arm the queue holding up translation.
+    if (chunk.count == 0) {
+        if (queue_arm_data(in)) {
+            return true;
+        }
+        _watch(evt, n, in->data_fd, POLLIN);
+        *armed = in;
+        *data = true;
+    } else {
+        if (queue_arm_space(out, 3)) {
+            return true;
+        }
+        _watch(evt, n, out->space_fd, POLLIN);
+        *armed = out;
+        *data = false;
+    }
+
+    return false;
+}
+
+// Translation thread. Translates line terminations of serial input and serial
+// output between their untranslated and translated queues.
+static void * _run_line (void * arg) {
+    bool busy;              // Flag indicating if progress was made.
+    struct pollfd evt[3];   // Wakeup event structures.
+    int n;                  // Wakeup event count.
+    queue_t * armed[2];     // Queues armed for wakeup.
+    bool data[2];           // Flags indicating if armed for data.
+
+    while (!atomic_load_explicit(&_stop, memory_order_relaxed)) {
+        n = 0;
+        armed[0] = NULL;
+        armed[1] = NULL;
+        _watch(evt, &n, _stop_fd, POLLIN);
+
+        // Translate serial input and serial output.
+        busy = _translate(
+            &_rx_in, &_rx_out, &_rxbuf, &_rxline,
+            evt, &n, &armed[0], &data[0]
+        );
+        busy = _translate(
+            &_tx_in, &_tx_out, &_txbuf, NULL,
+            evt, &n, &armed[1], &data[1]
+        ) || busy;
+
+        // Sleep until queues become ready, or until stopped.
+        if (!busy) {
+            poll(evt, n, -1);
+            metrics_add_count(METRICS_WAKEUPS, 1);
+        }
+        for (int i = 0; i < 2; i++) {
+            if (armed[i] != NULL) {
+                queue_disarm(armed[i], data[i]);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Console thread. Feeds the translated serial input queue to console output,
+// and drains console input into the untranslated serial output queue.
+static void * _run_console (void * arg) {
+    int status;             // Return status for API calls.
+    buffer_t buf;           // Queue space or data.
+    size_t count;           // Number of bytes written.
+    bool busy;              // Flag indicating if progress was made.
+    bool full, empty;       // Flags indicating state of queues.
+    bool eof = false;       // Flag indicating if console input has ended.
+    struct pollfd evt[5];   // Wakeup event structures.
+    int n;                  // Wakeup event count.
+
+    while (!atomic_load_explicit(&_stop, memory_order_relaxed)) {
+        busy = false;
+
+        // Write queued console output.
+        queue_get_data(&_rx_out, &buf);
+        empty = (buf.count == 0);
+        if (!empty) {
+            status = console_try_write_data(&buf, &count);
+            if (status < 0) {
+                return _fail();
+            }
+
+            // Capture data written to console.
+            buf.count = count;
+            capture_write_data(&buf);
+            queue_release(&_rx_out, count);
+            busy = busy || (count > 0);
+        }
+
+        // Read console input into queue. Once console input has ended for
+        // good, stop reading it. A terminal reports end of input each time
+        // the user enters an end-of-file character.
+        queue_get_space(&_tx_in, &buf);
+        full = (buf.size == 0);
+        if (!full && !eof) {
+            status = console_read_buffer(&buf);
+            if (status < 0) {
+                return _fail();
+            }
+            eof = (status > 0) && !isatty(console_get_fd());
+            queue_commit(&_tx_in, buf.count);
+            busy = busy || (buf.count > 0);
+        }
+
+        if (busy) {
+            continue;
+        }
+
+        // Sleep until console or queues become ready, or until stopped.
+        full = full && !eof;
+        if (full && queue_arm_space(&_tx_in, 1)) {
+            continue;
+        }
+        if (empty && queue_arm_data(&_rx_out)) {
+            if (full) {
+                queue_disarm(&_tx_in, false);
+            }
+            continue;
+        }
+        n = 0;
+        _watch(evt, &n, _stop_fd, POLLIN);
+        if (!full && !eof) {
+            _watch(evt, &n, console_get_fd(), POLLIN);
+        }
+        if (!empty) {
+            _watch(evt, &n, fileno(stdout), POLLOUT);
+        }
+        if (full) {
+            _watch(evt, &n, _tx_in.space_fd, POLLIN);
+        }
+        if (empty) {
+            _watch(evt, &n, _rx_out.data_fd, POLLIN);
+        }
+        poll(evt, n, -1);
+        metrics_add_count(METRICS_WAKEUPS, 1);
+        if (full) {
+            queue_disarm(&_tx_in, false);
+        }
+        if (empty) {
+            queue_disarm(&_rx_out, true);
+        }
+    }
+
+    return NULL;
+}
+
+// Parse list of CPUs to pin threads to.
+static int _parse_cpus (const char * cpus) {
+    const char * str = cpus;    // Current position in list.
+    char * end;                 // End of parsed number.
+    long val;                   // Parsed number.
+
+    for (int i = 0; i < PIPELINE_THREAD_COUNT; i++) {
+        _cpu[i] = -1;
+    }
+    if (cpus == NULL) {
+        return 0;
+    }
+
+    for (int i = 0; i < PIPELINE_THREAD_COUNT; i++) {
+        // Parse CPU number, leaving thread unpinned if entry is empty.
+        if (*str != ',' && *str != '\0') {
+            val = strtol(str, &end, 10);
+            if (end == str || val < 0 || val >= CPU_SETSIZE) {
+                break;
+            }
+            _cpu[i] = val;
+            str = end;
+        }
+
+        // Move on to next entry.
+        if (*str == '\0') {
+            return 0;
+        } else if (*str != ',' || i == PIPELINE_THREAD_COUNT - 1) {
+            break;
+        }
+        str++;
+    }
+
+    // If list is malformed, exit with failure.
+    fprintf(stderr, "Invalid CPU list '%s'\n", cpus);
+    return -1;
+}
+
+int pipeline_start (serial_t * serial, const char * cpus, size_t size) {
+    int status;                 // Return status for API calls.
+    pthread_attr_t attr;        // Thread attributes.
+    cpu_set_t set;              // CPU set of pinned thread.
+    void * (* run[PIPELINE_THREAD_COUNT]) (void *) = {
+        _run_serial, _run_line, _run_console
+    };                          // Thread functions.
+
+    // Get CPUs to pin threads to.
+    status = _parse_cpus(cpus);
+    if (status < 0) {
+        return -1;
+    }
+
+    // Reset translation state.
+    _serial = serial;
+    line_reset_state(&_rxline);
+
+    // Allocate queues and translation buffers.
+    if (
+        queue_alloc(&_rx_in, size) < 0 || queue_alloc(&_rx_out, size) < 0 ||
+        queue_alloc(&_tx_in, size) < 0 || queue_alloc(&_tx_out, size) < 0 ||
+        buffer_alloc(&_rxbuf, line_get_buffer_size(_rx_in.size)) < 0 ||
+        buffer_alloc(&_txbuf, line_get_buffer_size(_tx_in.size)) < 0
+    ) {
+        // On error, exit with failure.
+        return -1;
+    }
+
+    // Create stop and failure descriptors.
+    atomic_init(&_stop, false);
+    _stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _fail_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_stop_fd < 0 || _fail_fd < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to create pipeline descriptor (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Start threads.
+    for (int i = 0; i < PIPELINE_THREAD_COUNT; i++) {
+        pthread_attr_init(&attr);
+        if (_cpu[i] >= 0) {
+            CPU_ZERO(&set);
+            CPU_SET(_cpu[i], &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+        }
+        status = pthread_create(&_thread[i], &attr, run[i], NULL);
+        pthread_attr_destroy(&attr);
+        if (status != 0) {
+            // On error, stop running threads and exit with failure.
+            fprintf(
+                stderr, "Failed to start pipeline thread (%s)\n",
+                strerror(status)
+            );
+            pipeline_stop();
+            return -1;
+        }
+        _count++;
+    }
+
+    return 0;
+}
+
+void pipeline_stop (void) {
+    uint64_t val = 1;   // Value added to event counter.
+
+    // Stop threads and wait for them to finish.
+    atomic_store(&_stop, true);
+    if (_stop_fd >= 0) {
+        write(_stop_fd, &val, sizeof(val));
+    }
+    for (int i = 0; i < _count; i++) {
+        pthread_join(_thread[i], NULL);
+    }
+    _count = 0;
+
+    // Free queues, translation buffers and descriptors.
+    queue_free(&_rx_in);
+    queue_free(&_rx_out);
+    queue_free(&_tx_in);
+    queue_free(&_tx_out);
+    buffer_free(&_rxbuf);
+    buffer_free(&_txbuf);
+    if (_stop_fd >= 0) {
+        close(_stop_fd);
+        _stop_fd = -1;
+    }
+    if (_fail_fd >= 0) {
+        close(_fail_fd);
+        _fail_fd = -1;
+    }
+}
+
+int pipeline_get_fd (void) {
+    return _fail_fd;
+}
+
+void pipeline_report (void) {
+    const char * name[] = {
+        "Serial input queue", "Console output queue",
+        "Console input queue", "Serial output queue"
+    };                                                  // Queue names.
+    queue_t * queue[] = {&_rx_in, &_rx_out, &_tx_in, &_tx_out}; // Queues.
+
+    for (int i = 0; i < 4; i++) {
+        fprintf(
+            stderr,
+            "%s: %zu bytes, high-water mark %zu, found full %lu times\n",
+            name[i], queue[i]->size, queue[i]->hwm, queue[i]->full
+        );
+    }
+}
@@ -0,0 +1,83 @@
+/** @defgroup   pipeline    Pipeline
+ *
+ *  @brief      Threaded serial I/O pipeline.
+ *
+ *  This module contains functions to run the serial terminal as a pipeline of
+ *  three threads. The serial thread drains serial input and feeds serial
+ *  output, the translation thread translates line terminations in both
+ *  directions, and the console thread feeds console output and drains console
+ *  input. The threads are connected by lock-free queues, so that slow console
+ *  output or serial output never holds up serial input.
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <stddef.h>
+
+#include "serial.h"
+
+/** @ingroup    pipeline
+ *
+ *  @brief      Start pipeline.
+ *
+ *  Allocates the queues of the pipeline and starts its threads, optionally
+ *  pinning them to CPUs.
+ *
+ *  @note       The serial port and console I/O must be opened with successful
+ *              calls to serial_open_port() and console_open_stdio(), and the
+ *              line terminations configured with line_set_term(), before
+ *              calling this function. Signals that must be handled by the main
+ *              thread should be blocked beforehand, as the threads inherit the
+ *              signal mask.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      cpus    Comma-separated list of up to three CPU numbers to pin
+ *                      the serial, translation and console threads to, in that
+ *                      order, or `NULL` for no pinning. An empty entry leaves
+ *                      the corresponding thread unpinned.
+ *  @param      size    Capacity of each queue in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int pipeline_start (serial_t * serial, const char * cpus, size_t size);
+
+/** @ingroup    pipeline
+ *
+ *  @brief      Stop pipeline.
+ *
+ *  Stops the threads of the pipeline, waits for them to finish and frees its
+ *  queues.
+ */
+
+void pipeline_stop (void);
+
+/** @ingroup    pipeline
+ *
+ *  @brief      Get failure file descriptor.
+ *
+ *  Gets a file descriptor that becomes readable when any thread of the
+ *  pipeline fails. Its handler can be registered with event_register_handler()
+ *  to wake up the main thread.
+ *
+ *  @return     Failure file descriptor.
+ */
+
+int pipeline_get_fd (void);
+
+/** @ingroup    pipeline
+ *
+ *  @brief      Print pipeline statistics.
+ *
+ *  Writes the capacity, high-water mark and number of times found full of
+ *  every queue to `stderr`. A serial input queue that was never found full
+ *  shows that serial input was never held up.
+ *
+ *  @note       This function must be called after pipeline_stop().
+ */
+
+void pipeline_report (void);
+
+#endif
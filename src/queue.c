@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#include "buffer.h"
+#include "queue.h"
+
+// Signal wakeup descriptor.
+static void _signal (int fd) {
+    uint64_t val = 1;   // Value added to event counter.
+
+    write(fd, &val, sizeof(val));
+}
+
+// Clear wakeup descriptor.
+static void _clear (int fd) {
+    uint64_t val;       // Value of event counter.
+
+    read(fd, &val, sizeof(val));
+}
+
+int queue_alloc (queue_t * queue, size_t size) {
+    // Mark wakeup descriptors as not yet created.
+    queue->data_fd = -1;
+    queue->space_fd = -1;
+
+    // Round capacity up to a power of two, so that positions can be wrapped
+    // with a mask.
+    queue->size = 1;
+    while (queue->size < size) {
+        queue->size *= 2;
+    }
+
+    // Allocate storage.
+    queue->buf = (char *)malloc(queue->size * sizeof(char));
+    if (queue->buf == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to allocate queue (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Create wakeup descriptors.
+    queue->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    queue->space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->data_fd < 0 || queue->space_fd < 0) {
+        // On error, free queue and exit with failure.
+        fprintf(
+            stderr, "Failed to create queue wakeup descriptor (%s)\n",
+            strerror(errno)
+        );
+        queue_free(queue);
+        return -1;
+    }
+
+    // Reset positions and statistics.
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->data_wait, false);
+    atomic_init(&queue->space_wait, false);
+    queue->hwm = 0;
+    queue->full = 0;
+
+    return 0;
+}
+
+void queue_free (queue_t * queue) {
+    free(queue->buf);
+    queue->buf = NULL;
+    if (queue->data_fd >= 0) {
+        close(queue->data_fd);
+        queue->data_fd = -1;
+    }
+    if (queue->space_fd >= 0) {
+        close(queue->space_fd);
+        queue->space_fd = -1;
+    }
+}
+
+void queue_get_space (queue_t * queue, buffer_t * buf) {
+    size_t head;    // Write position.
+    size_t tail;    // Read position.
+    size_t pos;     // Write position within storage.
+
+    // The producer owns the write position, and acquires the read position, so
+    // that the consumer is done with the space before it is reused.
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    pos = head & (queue->size - 1);
+
+    // Free space ends either at the read position or at the end of storage.
+    buf->data = queue->buf + pos;
+    buf->count = 0;
+    buf->size = queue->size - (head - tail);
+    if (buf->size > queue->size - pos) {
+        buf->size = queue->size - pos;
+    }
+    if (buf->size == 0) {
+        queue->full++;
+    }
+}
+
+size_t queue_get_free (queue_t * queue) {
+    size_t head;    // Write position.
+    size_t tail;    // Read position.
+
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    return queue->size - (head - tail);
+}
+
+void queue_commit (queue_t * queue, size_t count) {
+    size_t head;    // Write position.
+    size_t tail;    // Read position.
+
+    if (count == 0) {
+        return;
+    }
+
+    // Publish data with a sequentially consistent store, so that it is ordered
+    // against the check of the consumer's wakeup request below.
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed) + count;
+    atomic_store(&queue->head, head);
+
+    // Update high-water mark.
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (head - tail > queue->hwm) {
+        queue->hwm = head - tail;
+    }
+
+    // Wake up consumer if it is waiting.
+    if (atomic_load(&queue->data_wait)) {
+        atomic_store(&queue->data_wait, false);
+        _signal(queue->data_fd);
+    }
+}
+
+void queue_write (queue_t * queue, const buffer_t * data) {
+    size_t head;    // Write position.
+    size_t pos;     // Write position within storage.
+    size_t first;   // Number of bytes before end of storage.
+
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    pos = head & (queue->size - 1);
+
+    // Copy data, wrapping around end of storage if necessary.
+    first = queue->size - pos;
+    if (first > data->count) {
+        first = data->count;
+    }
+    memcpy(queue->buf + pos, data->data, first);
+    memcpy(queue->buf, data->data + first, data->count - first);
+
+    queue_commit(queue, data->count);
+}
+
+void queue_get_data (queue_t * queue, buffer_t * data) {
+    size_t head;    // Write position.
+    size_t tail;    // Read position.
+    size_t pos;     // Read position within storage.
+
+    // The consumer owns the read position, and acquires the write position, so
+    // that the producer is done with the data before it is read.
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    pos = tail & (queue->size - 1);
+
+    // Data ends either at the write position or at the end of storage.
+    data->data = queue->buf + pos;
+    data->count = head - tail;
+    data->size = 0;
+    if (data->count > queue->size - pos) {
+        data->count = queue->size - pos;
+    }
+}
+
+void queue_release (queue_t * queue, size_t count) {
+    size_t tail;    // Read position.
+
+    if (count == 0) {
+        return;
+    }
+
+    // Release space with a sequentially consistent store, so that it is
+    // ordered against the check of the producer's wakeup request below.
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed) + count;
+    atomic_store(&queue->tail, tail);
+
+    // Wake up producer if it is waiting.
+    if (atomic_load(&queue->space_wait)) {
+        atomic_store(&queue->space_wait, false);
+        _signal(queue->space_fd);
+    }
+}
+
+bool queue_arm_data (queue_t * queue) {
+    // Request wakeup before checking for data, so that data committed after
+    // the check is guaranteed to signal the wakeup descriptor.
+    atomic_store(&queue->data_wait, true);
+    if (atomic_load(&queue->head) != atomic_load(&queue->tail)) {
+        atomic_store(&queue->data_wait, false);
+        return true;
+    }
+
+    return false;
+}
+
+bool queue_arm_space (queue_t * queue, size_t count) {
+    // Request wakeup before checking for space, so that space released after
+    // the check is guaranteed to signal the wakeup descriptor.
+    atomic_store(&queue->space_wait, true);
+    if (
+        queue->size - (atomic_load(&queue->head) - atomic_load(&queue->tail))
+        >= count
+    ) {
+        atomic_store(&queue->space_wait, false);
+        return true;
+    }
+
+    return false;
+}
+
+void queue_disarm (queue_t * queue, bool data) {
+    if (data) {
+        atomic_store(&queue->data_wait, false);
+        _clear(queue->data_fd);
+    } else {
+        atomic_store(&queue->space_wait, false);
+        _clear(queue->space_fd);
+    }
+}
@@ -0,0 +1,204 @@
+/** @defgroup   queue   Queue
+ *
+ *  @brief      Lock-free single-producer single-consumer byte queues.
+ *
+ *  This module contains functions for passing a stream of bytes from one
+ *  thread to another without locks. Exactly one thread may produce data into a
+ *  queue and exactly one other thread may consume data from it. The read and
+ *  write positions live on separate cache lines, so that the two threads do not
+ *  contend for them.
+ *
+ *  A thread that cannot make progress on a queue arms it with
+ *  queue_arm_data() or queue_arm_space(), and then sleeps in `poll()` on the
+ *  corresponding event file descriptor, which is signalled by the other thread
+ *  only while armed.
+ */
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "buffer.h"
+
+/** @ingroup    queue
+ *
+ *  @brief      Byte queue.
+ *
+ *  Holds the storage, positions, wakeup descriptors and statistics of a queue.
+ *  The statistics may be read directly once both threads have finished.
+ */
+
+typedef struct {
+    _Alignas(64) atomic_size_t head;    /**< Write position, by producer. */
+    _Alignas(64) atomic_size_t tail;    /**< Read position, by consumer. */
+    _Alignas(64) atomic_bool data_wait; /**< Consumer waits for data. */
+    atomic_bool space_wait;             /**< Producer waits for space. */
+    char * buf;                         /**< Storage. */
+    size_t size;                        /**< Capacity, a power of two. */
+    int data_fd;                        /**< Signalled when data arrives. */
+    int space_fd;                       /**< Signalled when space frees up. */
+    size_t hwm;                         /**< High-water mark in bytes. */
+    unsigned long full;                 /**< Number of times found full. */
+} queue_t;
+
+/** @ingroup    queue
+ *
+ *  @brief      Allocate queue.
+ *
+ *  Allocates storage and wakeup descriptors for a queue whose capacity is the
+ *  specified size rounded up to a power of two.
+ *
+ *  @param      queue   Pointer to queue to be allocated.
+ *  @param      size    Minimum capacity of queue in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int queue_alloc (queue_t * queue, size_t size);
+
+/** @ingroup    queue
+ *
+ *  @brief      Free queue.
+ *
+ *  Frees the storage and wakeup descriptors allocated with queue_alloc().
+ *
+ *  @param      queue   Pointer to queue to be freed.
+ */
+
+void queue_free (queue_t * queue);
+
+/** @ingroup    queue
+ *
+ *  @brief      Get free space in queue.
+ *
+ *  Points the specified buffer at the contiguous free space at the write
+ *  position of the queue. The buffer's byte count is zero and its capacity is
+ *  the size of the free space. May only be called by the producer.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      buf     Pointer to buffer to be pointed at the free space.
+ */
+
+void queue_get_space (queue_t * queue, buffer_t * buf);
+
+/** @ingroup    queue
+ *
+ *  @brief      Get total free space in queue.
+ *
+ *  May only be called by the producer.
+ *
+ *  @param      queue   Pointer to queue.
+ *
+ *  @return     Number of free bytes, whether contiguous or not.
+ */
+
+size_t queue_get_free (queue_t * queue);
+
+/** @ingroup    queue
+ *
+ *  @brief      Commit data to queue.
+ *
+ *  Publishes the specified number of bytes written into the free space
+ *  obtained with queue_get_space() to the consumer. May only be called by the
+ *  producer.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      count   Number of bytes to publish.
+ */
+
+void queue_commit (queue_t * queue, size_t count);
+
+/** @ingroup    queue
+ *
+ *  @brief      Write data to queue.
+ *
+ *  Copies the specified buffer into the free space of the queue, wrapping
+ *  around its end if necessary, and publishes it to the consumer. The buffer
+ *  must fit into the free space reported by queue_get_free(). May only be
+ *  called by the producer.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      data    Pointer to buffer to be copied.
+ */
+
+void queue_write (queue_t * queue, const buffer_t * data);
+
+/** @ingroup    queue
+ *
+ *  @brief      Get data held in queue.
+ *
+ *  Points the specified buffer at the oldest contiguous run of data held in
+ *  the queue. The data remains in the queue until it is released with
+ *  queue_release(). May only be called by the consumer.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      data    Pointer to buffer to be pointed at the data. Its byte
+ *                      count is zero if the queue is empty.
+ */
+
+void queue_get_data (queue_t * queue, buffer_t * data);
+
+/** @ingroup    queue
+ *
+ *  @brief      Release data held in queue.
+ *
+ *  Releases the specified number of bytes from the start of the data held in
+ *  the queue, making room for the producer. May only be called by the
+ *  consumer.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      count   Number of bytes to release.
+ */
+
+void queue_release (queue_t * queue, size_t count);
+
+/** @ingroup    queue
+ *
+ *  @brief      Arm queue for data wakeup.
+ *
+ *  Requests that the producer signals the data wakeup descriptor when it next
+ *  commits data. May only be called by the consumer, before sleeping.
+ *
+ *  @param      queue   Pointer to queue.
+ *
+ *  @return     `true` if data is already available and the consumer must not
+ *              sleep, and `false` otherwise.
+ */
+
+bool queue_arm_data (queue_t * queue);
+
+/** @ingroup    queue
+ *
+ *  @brief      Arm queue for space wakeup.
+ *
+ *  Requests that the consumer signals the space wakeup descriptor when it next
+ *  releases data. May only be called by the producer, before sleeping.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      count   Number of free bytes that the producer needs.
+ *
+ *  @return     `true` if enough space is already free and the producer must not
+ *              sleep, and `false` otherwise.
+ */
+
+bool queue_arm_space (queue_t * queue, size_t count);
+
+/** @ingroup    queue
+ *
+ *  @brief      Disarm queue after wakeup.
+ *
+ *  Cancels any wakeup requests of the calling thread and clears the
+ *  corresponding wakeup descriptors.
+ *
+ *  @param      queue   Pointer to queue.
+ *  @param      data    `true` if called by the consumer, `false` if called by
+ *                      the producer.
+ */
+
+void queue_disarm (queue_t * queue, bool data);
+
+#endif
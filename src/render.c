@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "buffer.h"
+#include "ring.h"
+#include "event.h"
+#include "console.h"
+#include "render.h"
+
+// Minimum size of output buffer.
+enum {RENDER_MIN_SIZE = 1048576};
+
+// Period of frame timer in milliseconds, for about 60 frames per second.
+enum {RENDER_PERIOD = 16};
+
+// Size of latest data kept while following the data.
+enum {RENDER_TAIL_SIZE = 8192};
+
+// Maximum length of marker of elided data.
+enum {RENDER_MARK_SIZE = 64};
+
+static ring_t _out;                     // Output buffer.
+static buffer_t _tail;                  // Latest data kept while following.
+static bool _follow;                    // Flag indicating if data is followed.
+static bool _newline;                   // Flag indicating if output ends line.
+static unsigned long _elided;           // Bytes elided since falling behind.
+static int _flags_old;                  // Old console output status flags.
+static int _timer_fd = -1;              // Frame timer.
+
+static unsigned long _shown;            // Number of bytes written.
+static unsigned long _lost;             // Number of bytes elided.
+static unsigned long _lags;             // Number of times console fell behind.
+static unsigned long _writes;           // Number of writes made.
+
+// Add data to output buffer, which must have room for it.
+static void _put (const char * data, size_t count) {
+    buffer_t buf;   // Data to be added.
+
+    if (count == 0) {
+        return;
+    }
+    buf.data = (char *)data;
+    buf.count = count;
+    buf.size = 0;
+    ring_put_data(&_out, &buf);
+    _newline = (data[count - 1] == '\n');
+}
+
+// Keep latest data while following, eliding the oldest data once more is kept
+// than fits.
+static void _keep (const char * data, size_t count) {
+    size_t drop;    // Number of bytes elided.
+
+    if (count >= _tail.size) {
+        _elided += _tail.count + count - _tail.size;
+        memcpy(_tail.data, data + count - _tail.size, _tail.size);
+        _tail.count = _tail.size;
+        return;
+    }
+    if (_tail.count + count > _tail.size) {
+        drop = _tail.count + count - _tail.size;
+        memmove(_tail.data, _tail.data + drop, _tail.count - drop);
+        _tail.count -= drop;
+        _elided += drop;
+    }
+    memcpy(_tail.data + _tail.count, data, count);
+    _tail.count += count;
+}
+
+// Stop following the data, once the output buffer has been written, by
+// adding the marker of elided data and the latest data to it, from its first
+// full line on if it holds one.
+static void _catch_up (void) {
+    char mark[RENDER_MARK_SIZE];    // Marker of elided data.
+    const char * end;               // End of first line of latest data.
+    size_t skip = 0;                // Bytes of latest data skipped.
+    int len;                        // Length of marker.
+
+    end = memchr(_tail.data, '\n', _tail.count);
+    if (end != NULL && (size_t)(end + 1 - _tail.data) < _tail.count) {
+        skip = end + 1 - _tail.data;
+    }
+    _elided += skip;
+    len = snprintf(
+        mark, sizeof(mark), "%s[%lu bytes elided]\n",
+        _newline ? "" : "\n", _elided
+    );
+    _put(mark, len);
+    _put(_tail.data + skip, _tail.count - skip);
+    _lost += _elided;
+    _elided = 0;
+    _tail.count = 0;
+    _follow = false;
+}
+
+// Get output buffer contents, which may wrap around the end of storage, as up
+// to two buffers. Returns the number of buffers.
+static int _segments (buffer_t * seg) {
+    size_t part;    // Number of bytes before end of storage.
+
+    part = _out.size - _out.tail;
+    part = (_out.count < part) ? _out.count : part;
+    seg[0].data = _out.buf + _out.tail;
+    seg[0].count = part;
+    seg[0].size = 0;
+    seg[1].data = _out.buf;
+    seg[1].count = _out.count - part;
+    seg[1].size = 0;
+    return (seg[1].count > 0) ? 2 : 1;
+}
+
+// Write as much output as the console takes at once, with a single write.
+static int _frame (void) {
+    buffer_t seg[2];    // Output not written yet.
+    int num;            // Number of output buffers.
+    size_t count;       // Number of bytes written.
+
+    if (_out.count == 0 && _follow) {
+        _catch_up();
+    }
+    if (_out.count == 0) {
+        return 0;
+    }
+    num = _segments(seg);
+    if (console_try_write_vector(seg, num, &count) < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    ring_drop_data(&_out, count);
+    _shown += count;
+    _writes++;
+    return 0;
+}
+
+// Frame timer event handler. Writes output left, and stops once a frame
+// period has passed without output.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    if (_out.count == 0 && !_follow) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+        return 0;
+    }
+    return _frame();
+}
+
+int render_open (size_t size) {
+    int status; // Return status for API calls.
+
+    // Allocate output buffer, and buffer of latest data.
+    size = (4 * size > RENDER_MIN_SIZE) ? 4 * size : RENDER_MIN_SIZE;
+    status = ring_alloc(&_out, size);
+    if (status == 0) {
+        status = buffer_alloc(&_tail, RENDER_TAIL_SIZE);
+        if (status < 0) {
+            ring_free(&_out);
+        }
+    }
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _follow = false;
+    _newline = true;
+    _elided = 0;
+
+    // Make console output non-blocking, so that a slow console never holds up
+    // serial input.
+    _flags_old = fcntl(console_get_output_fd(), F_GETFL);
+    status = (_flags_old < 0) ? -1 : fcntl(
+        console_get_output_fd(), F_SETFL, _flags_old | O_NONBLOCK
+    );
+    if (status < 0) {
+        // On error, free buffers and exit with failure.
+        fprintf(
+            stderr, "Failed to apply console configuration (%s)\n",
+            strerror(errno)
+        );
+        ring_free(&_out);
+        buffer_free(&_tail);
+        return -1;
+    }
+
+    return 0;
+}
+
+int render_close (void) {
+    int status = 0;     // Return status for API calls.
+    buffer_t seg[2];    // Output not written yet.
+    int num;            // Number of output buffers.
+
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+
+    // Write output left, and the latest data if data was elided, waiting for
+    // the console.
+    while (status == 0 && (_out.count > 0 || _follow)) {
+        if (_out.count == 0) {
+            _catch_up();
+        }
+        num = _segments(seg);
+        for (int i = 0; status == 0 && i < num; i++) {
+            status = console_write_data(&seg[i]);
+            _shown += seg[i].count;
+        }
+        ring_drop_data(&_out, _out.count);
+    }
+
+    // Set old console output file status flags, and free buffers.
+    if (fcntl(console_get_output_fd(), F_SETFL, _flags_old) < 0) {
+        fprintf(
+            stderr, "Failed to revert console configuration (%s)\n",
+            strerror(errno)
+        );
+    }
+    ring_free(&_out);
+    buffer_free(&_tail);
+
+    return status;
+}
+
+void render_write_data (const buffer_t * data) {
+    if (!_follow && _out.size - _out.count >= data->count) {
+        _put(data->data, data->count);
+        return;
+    }
+    if (!_follow) {
+        _follow = true;
+        _lags++;
+    }
+    _keep(data->data, data->count);
+}
+
+int render_flush_data (void) {
+    // While a frame timer runs, leave output to it.
+    if (_timer_fd >= 0 || (_out.count == 0 && !_follow)) {
+        return 0;
+    }
+
+    // Write output at once, and start frame timer, so that further output is
+    // written at most once per frame.
+    if (_frame() < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _timer_fd = event_register_timer(RENDER_PERIOD, _handle_timer, NULL);
+    if (_timer_fd < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+
+    return 0;
+}
+
+void render_report (void) {
+    fprintf(
+        stderr, "Console output: %lu bytes shown, %lu bytes elided, console "
+        "behind %lu times, %lu writes\n", _shown, _lost, _lags, _writes
+    );
+}
@@ -0,0 +1,94 @@
+/** @defgroup   render  Render
+ *
+ *  @brief      Adaptive console output.
+ *
+ *  This module contains functions to show serial input on a console that may
+ *  not keep up with it, without ever holding up serial input. Output is
+ *  gathered in one large ring buffer and written to the console without
+ *  blocking, with a single vectored write per frame, at most 60 frames per
+ *  second while data keeps arriving, and at once when the console is idle.
+ *
+ *  If the console falls so far behind that the buffer fills up, it switches to
+ *  following the data: incoming data is no longer shown in full, but only its
+ *  latest part is kept. Once the console has written the buffered output, a
+ *  marker with the number of bytes elided and the latest data, from its first
+ *  full line on, are shown, and data is shown in full again until the buffer
+ *  next fills up.
+ */
+
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** @ingroup    render
+ *
+ *  @brief      Start adaptive console output.
+ *
+ *  Allocates the output buffer, of at least 1 MiB and four times the largest
+ *  write, and makes console output non-blocking.
+ *
+ *  @param      size    Largest number of bytes written at once.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int render_open (size_t size);
+
+/** @ingroup    render
+ *
+ *  @brief      Stop adaptive console output.
+ *
+ *  Writes the output left, waiting for the console, followed by the marker
+ *  and latest data if data was elided, restores the console output status
+ *  flags and frees the buffers.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int render_close (void);
+
+/** @ingroup    render
+ *
+ *  @brief      Buffer console output.
+ *
+ *  Adds the specified data to the output, or, while following the data,
+ *  keeps its latest part. Nothing is written to the console.
+ *
+ *  @param      data    Pointer to data to be shown.
+ */
+
+void render_write_data (const buffer_t * data);
+
+/** @ingroup    render
+ *
+ *  @brief      Write console output.
+ *
+ *  Writes as much output as the console takes at once, unless a frame was
+ *  written less than a frame period ago, and writes the rest on a timer.
+ *  This function must be called after data has been added, once per wakeup.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int render_flush_data (void);
+
+/** @ingroup    render
+ *
+ *  @brief      Print console output statistics.
+ *
+ *  Writes the number of bytes shown and elided, of times the console fell
+ *  behind, and of writes made to `stderr`.
+ */
+
+void render_report (void);
+
+#endif
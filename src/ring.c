@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "metrics.h"
+
+int ring_parse_size (const char * str, size_t * size) {
+    char * end;             // End of parsed number.
+    unsigned long long val; // Parsed number.
+
+    // Parse number and optional unit suffix.
+    errno = 0;
+    val = strtoull(str, &end, 10);
+    if (errno == 0 && end != str && str[0] != '-') {
+        if (strcmp(end, "k") == 0) {
+            val *= 1024;
+            end++;
+        } else if (strcmp(end, "M") == 0) {
+            val *= 1024 * 1024;
+            end++;
+        }
+    }
+
+    // If size is malformed or out of range, exit with failure.
+    if (
+        errno != 0 || end == str || str[0] == '-' || *end != '\0' ||
+        val < 16 || val > 1024 * 1024 * 1024
+    ) {
+        fprintf(stderr, "Invalid buffer size '%s'\n", str);
+        return -1;
+    }
+
+    *size = val;
+
+    return 0;
+}
+
+int ring_alloc (ring_t * ring, size_t size) {
+    // Allocate storage.
+    ring->buf = (char *)malloc(size * sizeof(char));
+    if (ring->buf == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to allocate ring buffer (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Count allocation, and reset positions and counters.
+    metrics_add_count(METRICS_ALLOCS, 1);
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->count = 0;
+    ring->reads = 0;
+    ring->bytes = 0;
+
+    return 0;
+}
+
+void ring_free (ring_t * ring) {
+    free(ring->buf);
+    ring->buf = NULL;
+}
+
+int ring_fill (ring_t * ring, int fd) {
+    ssize_t status; // Return status for API calls.
+    size_t space;   // Contiguous free space at write position.
+
+    // Read input recursively until none is left or ring buffer is full.
+    while (ring->count < ring->size) {
+        // Get contiguous free space, which ends either at the read position or
+        // at the end of storage.
+        if (ring->head >= ring->tail) {
+            space = ring->size - ring->head;
+        } else {
+            space = ring->tail - ring->head;
+        }
+
+        // Read input.
+        status = read(fd, ring->buf + ring->head, space);
+        ring->reads++;
+        if (status < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // If no input is left, exit with success.
+                break;
+            } else if (errno == EINTR) {
+                // If interrupted, try again.
+                continue;
+            }
+            // On other errors, exit with failure.
+            return -1;
+        } else if (status == 0) {
+            // On end of file, exit with success, indicating end of file.
+            return 1;
+        }
+
+        // Update write position and counters.
+        ring->head += status;
+        if (ring->head == ring->size) {
+            ring->head = 0;
+        }
+        ring->count += status;
+        ring->bytes += status;
+
+        // If read came up short, no input is left.
+        if ((size_t)status < space) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void ring_put_data (ring_t * ring, const buffer_t * data) {
+    size_t part;    // Number of bytes copied before end of storage.
+
+    // Copy data up to end of storage, and the rest to start of storage.
+    part = ring->size - ring->head;
+    part = (data->count < part) ? data->count : part;
+    memcpy(ring->buf + ring->head, data->data, part);
+    memcpy(ring->buf, data->data + part, data->count - part);
+
+    // Update write position and counters.
+    ring->head += data->count;
+    if (ring->head >= ring->size) {
+        ring->head -= ring->size;
+    }
+    ring->count += data->count;
+    ring->bytes += data->count;
+}
+
+void ring_get_data (ring_t * ring, buffer_t * data) {
+    // Get contiguous run, which ends either at the write position or at the end
+    // of storage.
+    data->data = ring->buf + ring->tail;
+    data->size = 0;
+    if (ring->count == 0) {
+        data->count = 0;
+    } else if (ring->tail < ring->head) {
+        data->count = ring->head - ring->tail;
+    } else {
+        data->count = ring->size - ring->tail;
+    }
+}
+
+void ring_drop_data (ring_t * ring, size_t count) {
+    // Update read position.
+    ring->tail += count;
+    if (ring->tail >= ring->size) {
+        ring->tail -= ring->size;
+    }
+    ring->count -= count;
+
+    // Rewind empty ring buffer, so that data runs are as long as possible.
+    if (ring->count == 0) {
+        ring->head = 0;
+        ring->tail = 0;
+    }
+}
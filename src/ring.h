@@ -0,0 +1,141 @@
+/** @defgroup   ring    Ring
+ *
+ *  @brief      Fixed-capacity ring buffers.
+ *
+ *  This module contains functions for managing fixed-capacity ring buffers
+ *  into which serial and console input is read directly. Each ring buffer is
+ *  allocated once at startup, so that no memory is allocated while data flows
+ *  through it.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** @ingroup    ring
+ *
+ *  @brief      Ring buffer.
+ *
+ *  Holds the storage, read and write positions, and usage counters of a ring
+ *  buffer. The counters may be read directly but must not be modified.
+ */
+
+typedef struct {
+    char * buf;             /**< Storage. */
+    size_t size;            /**< Capacity in bytes. */
+    size_t head;            /**< Position of next byte to be written. */
+    size_t tail;            /**< Position of next byte to be read. */
+    size_t count;           /**< Number of bytes held. */
+    unsigned long reads;    /**< Number of `read()` calls made. */
+    unsigned long bytes;    /**< Number of bytes read in total. */
+} ring_t;
+
+/** @ingroup    ring
+ *
+ *  @brief      Parse ring buffer size.
+ *
+ *  Parses the specified string representation of a ring buffer size in bytes.
+ *  The size may be suffixed with `k` or `M` to denote kibibytes or mebibytes.
+ *
+ *  @param      str     String representation of ring buffer size.
+ *  @param      size    Pointer to variable into which the size will be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int ring_parse_size (const char * str, size_t * size);
+
+/** @ingroup    ring
+ *
+ *  @brief      Allocate ring buffer.
+ *
+ *  Allocates storage for a ring buffer of the specified capacity and resets
+ *  its positions and counters.
+ *
+ *  @param      ring    Pointer to ring buffer to be allocated.
+ *  @param      size    Capacity of ring buffer in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int ring_alloc (ring_t * ring, size_t size);
+
+/** @ingroup    ring
+ *
+ *  @brief      Free ring buffer.
+ *
+ *  Frees the storage allocated to a ring buffer with ring_alloc().
+ *
+ *  @param      ring    Pointer to ring buffer to be freed.
+ */
+
+void ring_free (ring_t * ring);
+
+/** @ingroup    ring
+ *
+ *  @brief      Fill ring buffer from file descriptor.
+ *
+ *  Reads from the specified non-blocking file descriptor directly into the free
+ *  space of the ring buffer, until the descriptor has no more data available or
+ *  the ring buffer is full.
+ *
+ *  @param      ring    Pointer to ring buffer to be filled.
+ *  @param      fd      Non-blocking file descriptor to read from.
+ *
+ *  @retval     0       Success.
+ *  @retval     1       Success, and end of file was reached.
+ *  @retval     -1      Failure. `errno` is set to indicate the error.
+ */
+
+int ring_fill (ring_t * ring, int fd);
+
+/** @ingroup    ring
+ *
+ *  @brief      Append data to ring buffer.
+ *
+ *  Copies the specified data into the ring buffer behind the data already
+ *  held, wrapping around the end of storage if needed.
+ *
+ *  @note       The ring buffer must have room for all of the data.
+ *
+ *  @param      ring    Pointer to ring buffer.
+ *  @param      data    Pointer to data to be appended.
+ */
+
+void ring_put_data (ring_t * ring, const buffer_t * data);
+
+/** @ingroup    ring
+ *
+ *  @brief      Get data held in ring buffer.
+ *
+ *  Points the specified data buffer at the oldest contiguous run of data held
+ *  in the ring buffer. The data buffer does not own the memory it refers to,
+ *  and the data remains in the ring buffer until it is released with
+ *  ring_drop_data().
+ *
+ *  @param      ring    Pointer to ring buffer.
+ *  @param      data    Pointer to data buffer to be pointed at the data. Its
+ *                      byte count is zero if the ring buffer is empty.
+ */
+
+void ring_get_data (ring_t * ring, buffer_t * data);
+
+/** @ingroup    ring
+ *
+ *  @brief      Release data held in ring buffer.
+ *
+ *  Releases the specified number of bytes from the start of the data held in
+ *  the ring buffer, making room for new data.
+ *
+ *  @param      ring    Pointer to ring buffer.
+ *  @param      count   Number of bytes to release.
+ */
+
+void ring_drop_data (ring_t * ring, size_t count);
+
+#endif
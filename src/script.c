@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "escape.h"
+#include "event.h"
+#include "script.h"
+
+// Default timeout of `expect` steps in ms.
+enum {SCRIPT_TIMEOUT = 10000};
+
+// Size of received data kept while no `expect` step is waiting.
+enum {SCRIPT_HISTORY_SIZE = 65536};
+
+// Step kinds.
+typedef enum {
+    SCRIPT_SEND,            // Write text.
+    SCRIPT_EXPECT,          // Wait for text.
+    SCRIPT_SET_TIMEOUT,     // Set timeout of `expect` steps.
+    SCRIPT_SLEEP            // Wait for time.
+} script_kind_t;
+
+// Step.
+typedef struct {
+    script_kind_t kind;     // Step kind.
+    char * text;            // Text as written in script file.
+    char * data;            // Text bytes.
+    size_t len;             // Number of text bytes.
+    size_t * fail;          // Length of longest proper border of every prefix.
+    unsigned long ms;       // Time in ms.
+    int line;               // Line number in script file.
+} script_step_t;
+
+static char * _path;                    // Path to script file.
+static script_step_t * _step;           // Steps.
+static int _count = 0;                  // Number of steps.
+static script_writer_t _writer;         // Writer of serial output.
+static script_space_t _space;           // Getter of free serial output space.
+
+static int _pos;                        // Current step.
+static size_t _sent;                    // Bytes of current step written.
+static size_t _matched;                 // Bytes of current step matched.
+static bool _waiting;                   // Flag indicating if text is awaited.
+static bool _failed;                    // Flag indicating if script failed.
+static unsigned long _timeout;          // Timeout of `expect` steps in ms.
+static int _timer_fd = -1;              // Timeout or sleep timer.
+static buffer_t _history;               // Received data kept.
+
+static uint64_t _started;               // Time script started in ms.
+static uint64_t _expect_start;          // Time `expect` step started in ms.
+static uint64_t _expect_time;           // Time waited for `expect` steps.
+static unsigned long _bytes;            // Number of bytes sent.
+
+// Get monotonic time in ms.
+static uint64_t _now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Parse time in seconds, with up to ms precision, to ms. Returns -1 if the
+// time is invalid.
+static int _parse_time (const char * str, unsigned long * ms) {
+    char * end;     // End of number.
+    double secs;    // Time in seconds.
+
+    errno = 0;
+    secs = strtod(str, &end);
+    if (
+        errno != 0 || end == str || *end != '\0' ||
+        !(secs >= 0 && secs <= 86400)
+    ) {
+        return -1;
+    }
+    *ms = (unsigned long)(secs * 1000 + 0.5);
+    return 0;
+}
+
+// Build table of the longest proper border of every prefix of the text of a
+// step, which tells how much of a partial match is kept on a mismatch.
+static int _build_fail (script_step_t * step) {
+    size_t k = 0;   // Length of current border.
+
+    step->fail = (size_t *)malloc(step->len * sizeof(size_t));
+    if (step->fail == NULL) {
+        return -1;
+    }
+    step->fail[0] = 0;
+    for (size_t i = 1; i < step->len; i++) {
+        while (k > 0 && step->data[i] != step->data[k]) {
+            k = step->fail[k - 1];
+        }
+        if (step->data[i] == step->data[k]) {
+            k++;
+        }
+        step->fail[i] = k;
+    }
+    return 0;
+}
+
+// Parse command and argument of a step.
+static int _parse_step (
+    script_step_t * step, const char * cmd, const char * arg, int num
+) {
+    if (strcmp(cmd, "send") == 0) {
+        step->kind = SCRIPT_SEND;
+    } else if (strcmp(cmd, "expect") == 0) {
+        step->kind = SCRIPT_EXPECT;
+    } else if (strcmp(cmd, "timeout") == 0) {
+        step->kind = SCRIPT_SET_TIMEOUT;
+    } else if (strcmp(cmd, "sleep") == 0) {
+        step->kind = SCRIPT_SLEEP;
+    } else {
+        fprintf(
+            stderr, "Invalid step '%s' in '%s' line %d\n", cmd, _path, num
+        );
+        return -1;
+    }
+
+    // Parse time.
+    if (step->kind == SCRIPT_SET_TIMEOUT || step->kind == SCRIPT_SLEEP) {
+        if (_parse_time(arg, &step->ms) < 0) {
+            fprintf(
+                stderr, "Invalid time '%s' in '%s' line %d\n", arg, _path, num
+            );
+            return -1;
+        }
+        return 0;
+    }
+
+    // Keep text as written for messages, and parse its bytes.
+    step->text = strdup(arg);
+    step->data = strdup(arg);
+    if (step->text == NULL || step->data == NULL) {
+        fprintf(stderr, "Failed to read script file (%s)\n", strerror(errno));
+        return -1;
+    }
+    if (escape_parse_text(step->data, &step->len) < 0) {
+        fprintf(
+            stderr, "Invalid escape sequence in '%s' line %d\n", _path, num
+        );
+        return -1;
+    }
+    if (step->kind == SCRIPT_EXPECT && _build_fail(step) < 0) {
+        fprintf(stderr, "Failed to read script file (%s)\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Read script file.
+static int _read (void) {
+    FILE * file;            // Script file.
+    char * line = NULL;     // Line of script file.
+    size_t size = 0;        // Capacity of line.
+    ssize_t len;            // Length of line.
+    int num = 0;            // Line number.
+    char * arg;             // Argument in line.
+    script_step_t * step;   // Reallocated steps.
+
+    file = fopen(_path, "r");
+    if (file == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open script file '%s' (%s)\n",
+            _path, strerror(errno)
+        );
+        return -1;
+    }
+
+    while ((len = getline(&line, &size, file)) >= 0) {
+        num++;
+
+        // Strip line termination, and skip empty lines and comments.
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        // Split command from argument.
+        arg = strchr(line, ' ');
+        if (arg == NULL || arg[1] == '\0') {
+            fprintf(stderr, "Missing argument in '%s' line %d\n", _path, num);
+            break;
+        }
+        *arg++ = '\0';
+
+        // Add step.
+        step = (script_step_t *)realloc(
+            _step, (_count + 1) * sizeof(script_step_t)
+        );
+        if (step == NULL) {
+            fprintf(
+                stderr, "Failed to read script file (%s)\n", strerror(errno)
+            );
+            break;
+        }
+        _step = step;
+        step = &_step[_count++];
+        memset(step, 0, sizeof(script_step_t));
+        step->line = num;
+        if (_parse_step(step, line, arg, num) < 0) {
+            break;
+        }
+    }
+
+    // Check that the whole file was read, and that it held any steps.
+    len = (len < 0 && ferror(file)) ? -2 : len;
+    free(line);
+    fclose(file);
+    if (len == -2) {
+        fprintf(stderr, "Failed to read script file (%s)\n", strerror(errno));
+        return -1;
+    } else if (len >= 0) {
+        return -1;
+    } else if (_count == 0) {
+        fprintf(stderr, "No steps in script file '%s'\n", _path);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop timer of step waiting.
+static void _stop_timer (void) {
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+}
+
+// Keep received data for the next `expect` step, dropping the oldest data
+// once more is kept than fits.
+static void _keep (const char * data, size_t count) {
+    size_t drop;    // Number of bytes dropped.
+
+    if (count >= _history.size) {
+        memcpy(_history.data, data + count - _history.size, _history.size);
+        _history.count = _history.size;
+        return;
+    }
+    if (_history.count + count > _history.size) {
+        drop = _history.count + count - _history.size;
+        memmove(_history.data, _history.data + drop, _history.count - drop);
+        _history.count -= drop;
+    }
+    memcpy(_history.data + _history.count, data, count);
+    _history.count += count;
+}
+
+// Match data against the text of the `expect` step waiting. Returns the
+// number of bytes up to the end of the match, or 0 if there was none.
+static size_t _match (const char * data, size_t count) {
+    const script_step_t * step = &_step[_pos];  // Step waiting.
+    size_t k = _matched;                        // Bytes matched.
+
+    for (size_t i = 0; i < count; i++) {
+        while (k > 0 && data[i] != step->data[k]) {
+            k = step->fail[k - 1];
+        }
+        if (data[i] == step->data[k]) {
+            k++;
+        }
+        if (k == step->len) {
+            _matched = 0;
+            return i + 1;
+        }
+    }
+    _matched = k;
+    return 0;
+}
+
+static int _handle_timer (int fd, uint32_t events, void * arg);
+
+// Run steps until one has to wait, or the script ends.
+static int _run (void) {
+    script_step_t * step;   // Current step.
+    buffer_t data;          // Data to be written.
+    size_t count;           // Bytes matched in kept data.
+
+    while (_pos < _count) {
+        step = &_step[_pos];
+        switch (step->kind) {
+            case SCRIPT_SEND:
+                // Write as much as fits, and wait for the output to drain for
+                // the rest.
+                while (_sent < step->len) {
+                    data.data = step->data + _sent;
+                    data.count = step->len - _sent;
+                    data.size = 0;
+                    count = _space();
+                    if (count == 0) {
+                        return 0;
+                    }
+                    data.count = (data.count < count) ? data.count : count;
+                    if (_writer(&data) < 0) {
+                        // On error, exit with failure.
+                        _failed = true;
+                        return -1;
+                    }
+                    _sent += data.count;
+                    _bytes += data.count;
+                }
+                _sent = 0;
+                _pos++;
+                break;
+            case SCRIPT_EXPECT:
+                // Match data kept first, and keep what follows the match.
+                _expect_start = _now();
+                _matched = 0;
+                count = _match(_history.data, _history.count);
+                if (count > 0) {
+                    memmove(
+                        _history.data, _history.data + count,
+                        _history.count - count
+                    );
+                    _history.count -= count;
+                    _expect_time += _now() - _expect_start;
+                    _pos++;
+                    break;
+                }
+                _history.count = 0;
+                _waiting = true;
+                if (_timeout == 0) {
+                    return 0;
+                }
+                _timer_fd = event_register_timer(
+                    _timeout, _handle_timer, NULL
+                );
+                if (_timer_fd < 0) {
+                    // On error, exit with failure.
+                    _failed = true;
+                    return -1;
+                }
+                return 0;
+            case SCRIPT_SET_TIMEOUT:
+                _timeout = step->ms;
+                _pos++;
+                break;
+            case SCRIPT_SLEEP:
+                if (step->ms == 0) {
+                    _pos++;
+                    break;
+                }
+                _timer_fd = event_register_timer(
+                    step->ms, _handle_timer, NULL
+                );
+                if (_timer_fd < 0) {
+                    // On error, exit with failure.
+                    _failed = true;
+                    return -1;
+                }
+                return 0;
+        }
+    }
+
+    // Script has ended.
+    event_stop_loop();
+    return 0;
+}
+
+// Timer event handler. Ends a sleep, or fails the `expect` step waiting.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    _stop_timer();
+    if (_waiting) {
+        // On timeout, exit with failure.
+        fprintf(
+            stderr, "Timed out waiting for '%s' in '%s' line %d\n",
+            _step[_pos].text, _path, _step[_pos].line
+        );
+        _failed = true;
+        return -1;
+    }
+    _pos++;
+    return _run();
+}
+
+int script_open (
+    const char * path, script_writer_t writer, script_space_t space
+) {
+    int status; // Return status for API calls.
+
+    _path = (char *)path;
+    _writer = writer;
+    _space = space;
+    status = _read();
+    if (status == 0) {
+        status = buffer_alloc(&_history, SCRIPT_HISTORY_SIZE);
+    }
+    if (status < 0) {
+        // On error, free steps and exit with failure.
+        script_close();
+        return -1;
+    }
+
+    _pos = 0;
+    _sent = 0;
+    _matched = 0;
+    _waiting = false;
+    _failed = false;
+    _timeout = SCRIPT_TIMEOUT;
+    _expect_time = 0;
+    _bytes = 0;
+
+    return 0;
+}
+
+void script_close (void) {
+    for (int s = 0; s < _count; s++) {
+        free(_step[s].text);
+        free(_step[s].data);
+        free(_step[s].fail);
+    }
+    free(_step);
+    _step = NULL;
+    _count = 0;
+    buffer_free(&_history);
+}
+
+int script_start (void) {
+    _started = _now();
+    return _run();
+}
+
+int script_stop (void) {
+    _stop_timer();
+    if (_pos == _count) {
+        return 0;
+    } else if (!_failed) {
+        fprintf(
+            stderr, "Script interrupted in '%s' line %d\n",
+            _path, _step[_pos].line
+        );
+    }
+    return -1;
+}
+
+int script_process_data (const buffer_t * data) {
+    size_t count;   // Bytes up to end of match.
+
+    if (_pos == _count) {
+        return 0;
+    } else if (!_waiting) {
+        _keep(data->data, data->count);
+        return 0;
+    }
+
+    // Keep data following the match for the next `expect` step.
+    count = _match(data->data, data->count);
+    if (count == 0) {
+        return 0;
+    }
+    _stop_timer();
+    _waiting = false;
+    _expect_time += _now() - _expect_start;
+    _pos++;
+    _keep(data->data + count, data->count - count);
+    return _run();
+}
+
+int script_resume_data (void) {
+    if (_pos == _count || _step[_pos].kind != SCRIPT_SEND) {
+        return 0;
+    }
+    return _run();
+}
+
+void script_report (void) {
+    fprintf(
+        stderr, "Script: %d of %d steps run in %.3f s, %lu bytes sent, "
+        "%.3f s waiting for input\n", _pos, _count,
+        (_now() - _started) / 1e3, _bytes, _expect_time / 1e3
+    );
+}
@@ -0,0 +1,159 @@
+/** @defgroup   script  Script
+ *
+ *  @brief      Send/expect scripts.
+ *
+ *  This module contains functions to run a script of steps against the serial
+ *  port without user input, for batch automation such as logging into a
+ *  device, running a command and waiting for its prompt. Every line of the
+ *  script file holds one step:
+ *
+ *  - `send <text>` writes the text to the serial port, translated as console
+ *    input is, without adding a line termination.
+ *  - `expect <text>` waits until the text is received, or fails once the
+ *    timeout has passed.
+ *  - `timeout <seconds>` sets the timeout of the following `expect` steps,
+ *    10 seconds by default, or none if zero.
+ *  - `sleep <seconds>` waits for the specified time.
+ *
+ *  Texts may contain the escape sequences `\t`, `\r`, `\n`, `\\` and `\xHH`.
+ *  Empty lines and lines starting with `#` are ignored.
+ *
+ *  The script runs in the event loop. Received data is matched incrementally
+ *  as it arrives, with the Knuth-Morris-Pratt algorithm, so that a text split
+ *  over several reads is found without buffering, and timeouts and sleeps
+ *  are event loop timers. Data received while no `expect` step is waiting is
+ *  kept, up to 64 KiB, and matched by the next one. Once the last step has
+ *  run, the event loop is stopped.
+ */
+
+#ifndef __SCRIPT_H__
+#define __SCRIPT_H__
+
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** @ingroup    script
+ *
+ *  @brief      Script writer.
+ *
+ *  Writes script data to the serial port without blocking, queueing what
+ *  cannot be written at once.
+ *
+ *  @param      data    Pointer to buffer to be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+typedef int (* script_writer_t) (const buffer_t * data);
+
+/** @ingroup    script
+ *
+ *  @brief      Script output space getter.
+ *
+ *  Gets the number of bytes the writer takes at once without dropping any.
+ *
+ *  @return     Free output space in bytes.
+ */
+
+typedef size_t (* script_space_t) (void);
+
+/** @ingroup    script
+ *
+ *  @brief      Read script.
+ *
+ *  Reads and checks the script file with the specified path. The script is
+ *  only run once it is started.
+ *
+ *  @param      path    Path to script file.
+ *  @param      writer  Writer of serial output.
+ *  @param      space   Getter of free serial output space.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int script_open (
+    const char * path, script_writer_t writer, script_space_t space
+);
+
+/** @ingroup    script
+ *
+ *  @brief      Free script.
+ *
+ *  Frees the steps of the script and the received data kept.
+ */
+
+void script_close (void);
+
+/** @ingroup    script
+ *
+ *  @brief      Start script.
+ *
+ *  Runs the steps of the script until one has to wait.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int script_start (void);
+
+/** @ingroup    script
+ *
+ *  @brief      Stop script.
+ *
+ *  Stops the timer of the step waiting, and checks that the script has run to
+ *  its end.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as the script failed or was interrupted.
+ *                      Error message is written to `stderr`.
+ */
+
+int script_stop (void);
+
+/** @ingroup    script
+ *
+ *  @brief      Match serial input.
+ *
+ *  Matches the specified serial input data against the text of the `expect`
+ *  step waiting, continuing the match from the previous call, and runs the
+ *  following steps once it is found. Data not matched is kept for the next
+ *  `expect` step.
+ *
+ *  @param      data    Pointer to serial input data.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int script_process_data (const buffer_t * data);
+
+/** @ingroup    script
+ *
+ *  @brief      Resume script.
+ *
+ *  Continues a `send` step that was waiting for output space. This function
+ *  must be called whenever the serial output queue drains.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int script_resume_data (void);
+
+/** @ingroup    script
+ *
+ *  @brief      Print script statistics.
+ *
+ *  Writes the number of steps run, bytes sent and time spent waiting for
+ *  `expect` steps to `stderr`.
+ */
+
+void script_report (void);
+
+#endif
@@ -2,110 +2,293 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include <poll.h>
 #include <termios.h>
+#include <linux/serial.h>
 
-static int _fd = 0;             // Serial port file descriptor.
-
-static struct termios _cnf_old; // Old serial port configuration.
-static struct termios _cnf_new; // New serial port configuration.
-
-int serial_open_port (const char * port, const char * baud) {
-    int status;     // Return status for API calls.
-    speed_t speed;  // Buad rate specifier.
-
-    // Get baud rate specifier.
-    if (strcmp(baud, "50") == 0) {
-        speed = B50;
-    } else if (strcmp(baud, "75") == 0) {
-        speed = B75;
-    } else if (strcmp(baud, "110") == 0) {
-        speed = B110;
-    } else if (strcmp(baud, "134") == 0) {
-        speed = B134;
-    } else if (strcmp(baud, "150") == 0) {
-        speed = B150;
-    } else if (strcmp(baud, "200") == 0) {
-        speed = B200;
-    } else if (strcmp(baud, "300") == 0) {
-        speed = B300;
-    } else if (strcmp(baud, "600") == 0) {
-        speed = B600;
-    } else if (strcmp(baud, "1200") == 0) {
-        speed = B1200;
-    } else if (strcmp(baud, "1800") == 0) {
-        speed = B1800;
-    } else if (strcmp(baud, "2400") == 0) {
-        speed = B2400;
-    } else if (strcmp(baud, "4800") == 0) {
-        speed = B4800;
-    } else if (strcmp(baud, "9600") == 0) {
-        speed = B9600;
-    } else if (strcmp(baud, "19200") == 0) {
-        speed = B19200;
-    } else if (strcmp(baud, "38400") == 0) {
-        speed = B38400;
-    } else if (strcmp(baud, "57600") == 0) {
-        speed = B57600;
-    } else if (strcmp(baud, "115200") == 0) {
-        speed = B115200;
-    } else if (strcmp(baud, "230400") == 0) {
-        speed = B230400;
-    } else if (strcmp(baud, "460800") == 0) {
-        speed = B460800;
-    } else if (strcmp(baud, "500000") == 0) {
-        speed = B500000;
-    } else if (strcmp(baud, "576000") == 0) {
-        speed = B576000;
-    } else if (strcmp(baud, "921600") == 0) {
-        speed = B921600;
-    } else if (strcmp(baud, "1000000") == 0) {
-        speed = B1000000;
-    } else if (strcmp(baud, "1152000") == 0) {
-        speed = B1152000;
-    } else if (strcmp(baud, "1500000") == 0) {
-        speed = B1500000;
-    } else if (strcmp(baud, "2000000") == 0) {
-        speed = B2000000;
-    } else if (strcmp(baud, "2500000") == 0) {
-        speed = B2500000;
-    } else if (strcmp(baud, "3000000") == 0) {
-        speed = B3000000;
-    } else if (strcmp(baud, "3500000") == 0) {
-        speed = B3500000;
-    } else if (strcmp(baud, "4000000") == 0) {
-        speed = B4000000;
+#include "buffer.h"
+#include "ring.h"
+#include "serial.h"
+#include "baud.h"
+#include "session.h"
+#include "broadcast.h"
+#include "metrics.h"
+
+// Baud rates with `termios` speed constants. Other baud rates are set through
+// the `termios2` interface.
+static const struct {
+    unsigned long rate; // Baud rate in bits per second.
+    speed_t speed;      // Baud rate specifier.
+} _speed[] = {
+    {50, B50},
+    {75, B75},
+    {110, B110},
+    {134, B134},
+    {150, B150},
+    {200, B200},
+    {300, B300},
+    {600, B600},
+    {1200, B1200},
+    {1800, B1800},
+    {2400, B2400},
+    {4800, B4800},
+    {9600, B9600},
+    {19200, B19200},
+    {38400, B38400},
+    {57600, B57600},
+    {115200, B115200},
+    {230400, B230400},
+    {460800, B460800},
+    {500000, B500000},
+    {576000, B576000},
+    {921600, B921600},
+    {1000000, B1000000},
+    {1152000, B1152000},
+    {1500000, B1500000},
+    {2000000, B2000000},
+    {2500000, B2500000},
+    {3000000, B3000000},
+    {3500000, B3500000},
+    {4000000, B4000000},
+};
+
+// Look up the `termios` specifier of a baud rate, or `B0` if it has none.
+static speed_t _find_speed (unsigned long rate) {
+    for (size_t i = 0; i < sizeof(_speed) / sizeof(_speed[0]); i++) {
+        if (_speed[i].rate == rate) {
+            return _speed[i].speed;
+        }
+    }
+    return B0;
+}
+
+// Apply flow control to a serial port configuration. With XON/XOFF, the
+// driver stops output on XOFF and sends XOFF itself when its receive buffer
+// fills up.
+static void _set_flow (struct termios * cnf, serial_flow_t flow) {
+    cnf->c_cflag &= ~CRTSCTS;
+    cnf->c_iflag &= ~(IXON | IXOFF);
+    if (flow == SERIAL_FLOW_RTSCTS) {
+        cnf->c_cflag |= CRTSCTS;
+    } else if (flow == SERIAL_FLOW_XONXOFF) {
+        cnf->c_iflag |= IXON | IXOFF;
+        cnf->c_cc[VSTART] = 0x11;
+        cnf->c_cc[VSTOP] = 0x13;
+    }
+}
+
+// Apply configuration to an open serial port, and keep it as its new
+// configuration once applied, keeping a baud rate without specifier, which the
+// configuration cannot hold.
+static int _apply (serial_t * serial, const struct termios * cnf) {
+    unsigned long rate;     // Baud rate before applying configuration.
+    unsigned long actual;   // Baud rate after applying configuration.
+    int status;             // Return status for API calls.
+
+    status = baud_get_rate(serial->fd, &rate);
+    if (tcsetattr(serial->fd, TCSANOW, cnf) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to apply serial port configuration (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+    serial->cnf_new = *cnf;
+    if (
+        status == 0 && baud_get_rate(serial->fd, &actual) == 0 &&
+        actual != rate
+    ) {
+        return baud_set_rate(serial->fd, rate);
+    }
+    return 0;
+}
+
+// Get path to the latency timer of a USB serial adapter in sysfs, from the
+// device number of its serial port.
+static int _get_timer_path (int fd, char * path, size_t size) {
+    struct stat st; // Serial port status.
+
+    if (fstat(fd, &st) < 0 || !S_ISCHR(st.st_mode)) {
+        return -1;
+    }
+    snprintf(
+        path, size, "/sys/dev/char/%u:%u/device/latency_timer",
+        major(st.st_rdev), minor(st.st_rdev)
+    );
+    return 0;
+}
+
+// Read latency timer in ms, or -1 if the serial port has none.
+static int _read_timer (const char * path) {
+    FILE * file;    // Latency timer file.
+    int ms;         // Latency timer in ms.
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if (fscanf(file, "%d", &ms) != 1) {
+        ms = -1;
+    }
+    fclose(file);
+    return ms;
+}
+
+// Write latency timer in ms.
+static int _write_timer (const char * path, int ms) {
+    FILE * file;    // Latency timer file.
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    fprintf(file, "%d\n", ms);
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+// Make the serial driver pass on received data at once. Sets the low latency
+// flag of the driver, and the latency timer of a USB serial adapter to its
+// minimum, remembering their old values. Neither is supported by every
+// driver, so failing to set them only prints a warning.
+static void _set_low_latency (serial_t * serial) {
+    struct serial_struct info;  // Driver configuration.
+    int flags;                  // Old driver flags.
+    char path[64];              // Path to latency timer.
+    int ms;                     // Old latency timer in ms.
+
+    if (
+        ioctl(serial->fd, TIOCGSERIAL, &info) == 0 &&
+        !(info.flags & ASYNC_LOW_LATENCY)
+    ) {
+        flags = info.flags;
+        info.flags |= ASYNC_LOW_LATENCY;
+        if (ioctl(serial->fd, TIOCSSERIAL, &info) == 0) {
+            serial->flags_old = flags;
+        } else {
+            fprintf(
+                stderr, "Failed to set low latency flag (%s)\n",
+                strerror(errno)
+            );
+        }
+    }
+
+    if (_get_timer_path(serial->fd, path, sizeof(path)) < 0) {
+        return;
+    }
+    ms = _read_timer(path);
+    if (ms > 1) {
+        if (_write_timer(path, 1) == 0) {
+            serial->timer_old = ms;
+        } else {
+            fprintf(
+                stderr, "Failed to set latency timer '%s' (%s)\n",
+                path, strerror(errno)
+            );
+        }
+    }
+}
+
+// Restore the driver settings changed by _set_low_latency().
+static void _reset_low_latency (serial_t * serial) {
+    struct serial_struct info;  // Driver configuration.
+    char path[64];              // Path to latency timer.
+
+    if (
+        serial->flags_old >= 0 && ioctl(serial->fd, TIOCGSERIAL, &info) == 0
+    ) {
+        info.flags = serial->flags_old;
+        ioctl(serial->fd, TIOCSSERIAL, &info);
+    }
+    if (
+        serial->timer_old >= 0 &&
+        _get_timer_path(serial->fd, path, sizeof(path)) == 0
+    ) {
+        _write_timer(path, serial->timer_old);
+    }
+    serial->flags_old = -1;
+    serial->timer_old = -1;
+}
+
+int serial_parse_rate (const char * baud, unsigned long * rate) {
+    char * end; // End of baud rate number.
+
+    errno = 0;
+    *rate = strtoul(baud, &end, 10);
+    if (
+        !isdigit((unsigned char)*baud) || *end != '\0' || errno != 0 ||
+        *rate == 0
+    ) {
+        // If invalid, exit with failure.
+        fprintf(stderr, "Unsupported baud rate '%s'\n", baud);
+        return -1;
+    }
+
+    return 0;
+}
+
+int serial_parse_flow (const char * str, serial_flow_t * flow) {
+    if (strcmp(str, "none") == 0) {
+        *flow = SERIAL_FLOW_NONE;
+    } else if (strcmp(str, "rtscts") == 0) {
+        *flow = SERIAL_FLOW_RTSCTS;
+    } else if (strcmp(str, "xonxoff") == 0) {
+        *flow = SERIAL_FLOW_XONXOFF;
     } else {
         // If unsupported, exit with failure.
-        fprintf(stderr, "Unsupported baud rate '%s'\n", baud);
+        fprintf(stderr, "Unsupported flow control '%s'\n", str);
         return -1;
     }
 
+    return 0;
+}
+
+int serial_open_port (
+    serial_t * serial, const char * port, const char * baud
+) {
+    int status;             // Return status for API calls.
+    speed_t speed;          // Baud rate specifier, or `B0` if it has none.
+    unsigned long rate;     // Baud rate in bits per second.
+    unsigned long actual;   // Baud rate set by serial driver.
+
+    // Parse baud rate, and look up its specifier. Without one, the baud rate
+    // is set through the `termios2` interface after configuring the port.
+    status = serial_parse_rate(baud, &rate);
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    speed = _find_speed(rate);
+
     // Open serial port.
-    _fd = open(port, O_NOCTTY | O_RDWR);
-    if (_fd < 0) {
+    serial->flags_old = -1;
+    serial->timer_old = -1;
+    serial->fd = open(port, O_NOCTTY | O_NONBLOCK | O_RDWR);
+    if (serial->fd < 0) {
         // On error, exit with failure.
         fprintf(
-            stderr, "Failed to open serial port (%s)\n",
-            strerror(errno)
+            stderr, "Failed to open serial port '%s' (%s)\n",
+            port, strerror(errno)
         );
         return -1;
     }
 
     // Get old serial port configuration.
-    status = tcgetattr(_fd, &_cnf_old);
+    status = tcgetattr(serial->fd, &serial->cnf_old);
     if (status < 0) {
         // On error, close serial port and exit with failure.
         fprintf(
             stderr, "Failed to obtain serial port configuration (%s)\n",
             strerror(errno)
         );
-        status = close(_fd);
+        status = close(serial->fd);
         if (status < 0) {
             fprintf(
                 stderr, "Closed serial port but error occurred (%s)\n",
@@ -117,46 +300,64 @@ int serial_open_port (const char * port, const char * baud) {
 
     // Prepare new serial port configuration structure.
 
-    _cnf_new.c_iflag = _cnf_old.c_iflag;
-    _cnf_new.c_oflag = _cnf_old.c_oflag;
-    _cnf_new.c_cflag = _cnf_old.c_cflag;
-    _cnf_new.c_lflag = _cnf_old.c_lflag;
+    serial->cnf_new.c_iflag = serial->cnf_old.c_iflag;
+    serial->cnf_new.c_oflag = serial->cnf_old.c_oflag;
+    serial->cnf_new.c_cflag = serial->cnf_old.c_cflag;
+    serial->cnf_new.c_lflag = serial->cnf_old.c_lflag;
 
     for (int i = 0; i < NCCS; i++) {
-        _cnf_new.c_cc[i] = _cnf_old.c_cc[i];
+        serial->cnf_new.c_cc[i] = serial->cnf_old.c_cc[i];
     }
 
-    _cnf_new.c_iflag &= ~(
+    serial->cnf_new.c_iflag &= ~(
         INPCK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY
     );
-    _cnf_new.c_iflag |= (
+    serial->cnf_new.c_iflag |= (
         IGNBRK | IGNPAR
     );
-    _cnf_new.c_oflag &= ~(
+    serial->cnf_new.c_oflag &= ~(
         OPOST | ONLCR | OCRNL | ONOCR | ONLRET | OFILL
     );
-    _cnf_new.c_cflag &= ~(
+    serial->cnf_new.c_cflag &= ~(
         CSIZE | CSTOPB | PARENB
     );
-    _cnf_new.c_cflag |= (
+    serial->cnf_new.c_cflag |= (
         CS8 | CREAD | CLOCAL
     );
-    _cnf_new.c_lflag &= ~(
+    serial->cnf_new.c_lflag &= ~(
         ISIG | ICANON | ECHO
     );
 
-    cfsetispeed(&_cnf_new, speed);
-    cfsetospeed(&_cnf_new, speed);
+    // Apply flow control.
+    _set_flow(&serial->cnf_new, serial->flow);
+
+    // In low latency mode, make reads and wakeups return as soon as a single
+    // byte is available, rather than whatever minimum was inherited.
+    if (serial->low_latency) {
+        serial->cnf_new.c_cc[VMIN] = 1;
+        serial->cnf_new.c_cc[VTIME] = 0;
+    }
+
+    if (speed != B0) {
+        cfsetispeed(&serial->cnf_new, speed);
+        cfsetospeed(&serial->cnf_new, speed);
+    }
+
+    // Remember old baud rate, which `cnf_old` cannot hold if it has no
+    // specifier.
+    if (baud_get_rate(serial->fd, &serial->rate_old) < 0) {
+        serial->rate_old = 0;
+    }
 
     // Set new serial port configuration.
-    status = tcsetattr(_fd, TCSAFLUSH, &_cnf_new);
+    status = tcsetattr(serial->fd, TCSAFLUSH, &serial->cnf_new);
     if (status < 0) {
         // On error, close serial port and exit with failure.
         fprintf(
             stderr, "Failed to apply serial port configuration (%s)\n",
             strerror(errno)
         );
-        status = close(_fd);
+        status = close(serial->fd);
         if (status < 0) {
             fprintf(
                 stderr, "Closed serial port but error occurred (%s)\n",
@@ -166,23 +367,58 @@ int serial_open_port (const char * port, const char * baud) {
         return -1;
     }
 
+    // Set baud rate without specifier.
+    if (speed == B0 && baud_set_rate(serial->fd, rate) < 0) {
+        // On error, close serial port and exit with failure.
+        serial_close_port(serial);
+        return -1;
+    }
+
+    // Report baud rate actually set, if serial driver rounded it.
+    if (baud_get_rate(serial->fd, &actual) == 0 && actual != rate) {
+        fprintf(
+            stderr, "Serial port '%s' runs at %lu baud instead of %lu baud\n",
+            port, actual, rate
+        );
+    }
+
+    // Tune serial driver for low latency.
+    if (serial->low_latency) {
+        _set_low_latency(serial);
+    }
+
+    // Take driver counters as baseline for those of this session.
+    serial->counted = (serial_get_counts(serial, &serial->counts_old) == 0);
+
+    // Record path of serial port in session log.
+    session_write_record(SESSION_PORT, serial->id, port, strlen(port));
+
     return 0;
 }
 
-void serial_close_port (void) {
-    int status; // Return status for API calls.
+void serial_close_port (serial_t * serial) {
+    int status;             // Return status for API calls.
+    unsigned long rate;     // Current baud rate.
 
-    // Set old serial port configuration.
-    status = tcsetattr(_fd, TCSAFLUSH, &_cnf_old);
+    // Set old driver settings, old serial port configuration, and old baud
+    // rate if it had no specifier.
+    _reset_low_latency(serial);
+    status = tcsetattr(serial->fd, TCSAFLUSH, &serial->cnf_old);
     if (status < 0) {
         fprintf(
             stderr, "Failed to revert serial port configuration (%s)\n",
             strerror(errno)
         );
     }
+    if (
+        serial->rate_old != 0 && baud_get_rate(serial->fd, &rate) == 0 &&
+        rate != serial->rate_old
+    ) {
+        baud_set_rate(serial->fd, serial->rate_old);
+    }
 
     // Close serial port.
-    status = close(_fd);
+    status = close(serial->fd);
     if (status < 0) {
         fprintf(
             stderr, "Closed serial port but error occurred (%s)\n",
@@ -191,69 +427,364 @@ void serial_close_port (void) {
     }
 }
 
-void serial_get_wakeup_evt (struct pollfd * evt) {
-    // Initialize wakeup event structure with zeros.
-    memset(evt, 0, sizeof(struct pollfd));
+int serial_set_rate (serial_t * serial, unsigned long rate) {
+    struct termios cnf = serial->cnf_new;   // New configuration.
+    speed_t speed;                          // Baud rate specifier, or `B0`.
 
-    // Configure wakeup event to trigger when input arrives on serial port.
-    evt->fd = _fd;
-    evt->events = POLLIN;
+    speed = _find_speed(rate);
+    if (speed == B0) {
+        return baud_set_rate(serial->fd, rate);
+    }
+    cfsetispeed(&cnf, speed);
+    cfsetospeed(&cnf, speed);
+    if (tcsetattr(serial->fd, TCSANOW, &cnf) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to apply serial port configuration (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+    serial->cnf_new = cnf;
+    return 0;
 }
 
-int serial_read_data (char ** data) {
-    ssize_t status; // Return status for API calls.
-    char * buf;     // Pointer to current location in buffer.
-    int count;      // Number of characters to read.
+int serial_get_rate (const serial_t * serial, unsigned long * rate) {
+    speed_t speed;  // Baud rate specifier.
 
-    // Get serial input queue size.
-    status = ioctl(_fd, FIONREAD, &count);
+    // Without `termios2`, look up the specifier of the configuration.
+    if (baud_get_rate(serial->fd, rate) == 0) {
+        return 0;
+    }
+    speed = cfgetospeed(&serial->cnf_new);
+    for (size_t i = 0; i < sizeof(_speed) / sizeof(_speed[0]); i++) {
+        if (_speed[i].speed == speed) {
+            *rate = _speed[i].rate;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int serial_set_frame (serial_t * serial, const serial_frame_t * frame) {
+    static const tcflag_t size[] = {CS5, CS6, CS7, CS8};    // Data bits.
+    struct termios cnf = serial->cnf_new;                   // Configuration.
+    tcflag_t cflag;                                         // Control flags.
+
+    if (frame->bits < 5 || frame->bits > 8) {
+        // If unsupported, exit with failure.
+        fprintf(stderr, "Unsupported number of data bits %u\n", frame->bits);
+        return -1;
+    }
+    cflag = serial->cnf_new.c_cflag;
+    cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CMSPAR);
+    cflag |= size[frame->bits - 5];
+    cflag |= (frame->stop == 2) ? CSTOPB : 0;
+    switch (frame->parity) {
+        case SERIAL_PARITY_ODD:
+            cflag |= PARENB | PARODD;
+            break;
+        case SERIAL_PARITY_EVEN:
+            cflag |= PARENB;
+            break;
+        case SERIAL_PARITY_MARK:
+            cflag |= PARENB | CMSPAR | PARODD;
+            break;
+        case SERIAL_PARITY_SPACE:
+            cflag |= PARENB | CMSPAR;
+            break;
+        default:
+            break;
+    }
+    cnf.c_cflag = cflag;
+    return _apply(serial, &cnf);
+}
+
+void serial_get_frame (const serial_t * serial, serial_frame_t * frame) {
+    tcflag_t cflag = serial->cnf_new.c_cflag;   // Control flags.
+
+    switch (cflag & CSIZE) {
+        case CS5:
+            frame->bits = 5;
+            break;
+        case CS6:
+            frame->bits = 6;
+            break;
+        case CS7:
+            frame->bits = 7;
+            break;
+        default:
+            frame->bits = 8;
+            break;
+    }
+    frame->stop = (cflag & CSTOPB) ? 2 : 1;
+    if (!(cflag & PARENB)) {
+        frame->parity = SERIAL_PARITY_NONE;
+    } else if (cflag & CMSPAR) {
+        frame->parity = (cflag & PARODD) ?
+            SERIAL_PARITY_MARK : SERIAL_PARITY_SPACE;
+    } else {
+        frame->parity = (cflag & PARODD) ?
+            SERIAL_PARITY_ODD : SERIAL_PARITY_EVEN;
+    }
+}
+
+int serial_set_flow (serial_t * serial, serial_flow_t flow) {
+    struct termios cnf = serial->cnf_new;   // New configuration.
+
+    _set_flow(&cnf, flow);
+    if (_apply(serial, &cnf) < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    serial->flow = flow;
+    return 0;
+}
+
+int serial_set_lines (serial_t * serial, int set, int clear) {
+    if (
+        (set != 0 && ioctl(serial->fd, TIOCMBIS, &set) < 0) ||
+        (clear != 0 && ioctl(serial->fd, TIOCMBIC, &clear) < 0)
+    ) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to set modem control lines (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+    return 0;
+}
+
+int serial_get_lines (const serial_t * serial, int * lines) {
+    return (ioctl(serial->fd, TIOCMGET, lines) < 0) ? -1 : 0;
+}
+
+int serial_set_break (serial_t * serial, bool on) {
+    if (ioctl(serial->fd, on ? TIOCSBRK : TIOCCBRK) < 0) {
+        // On error, exit with failure.
+        fprintf(stderr, "Failed to set break (%s)\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int serial_purge_data (serial_t * serial, int queue) {
+    if (tcflush(serial->fd, queue) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to discard serial data (%s)\n", strerror(errno)
+        );
+        return -1;
+    }
+    return 0;
+}
+
+int serial_get_fd (const serial_t * serial) {
+    return serial->fd;
+}
+
+int serial_get_counts (const serial_t * serial, serial_counts_t * counts) {
+    int status;                             // Return status for API calls.
+    struct serial_icounter_struct icount;   // Driver counters.
+
+    status = ioctl(serial->fd, TIOCGICOUNT, &icount);
+    if (status < 0) {
+        return -1;
+    }
+
+    counts->rx = icount.rx;
+    counts->tx = icount.tx;
+    counts->frame = icount.frame;
+    counts->overrun = icount.overrun;
+    counts->parity = icount.parity;
+    counts->brk = icount.brk;
+    counts->buf_overrun = icount.buf_overrun;
+
+    return 0;
+}
+
+void serial_report_counts (
+    const serial_t * serial, const char * name, bool always
+) {
+    serial_counts_t counts; // Driver counters.
+
+    if (!serial->counted || serial_get_counts(serial, &counts) < 0) {
+        return;
+    }
+    counts.overrun -= serial->counts_old.overrun;
+    counts.buf_overrun -= serial->counts_old.buf_overrun;
+    counts.frame -= serial->counts_old.frame;
+    counts.parity -= serial->counts_old.parity;
+    counts.brk -= serial->counts_old.brk;
+    if (
+        always || counts.overrun > 0 || counts.buf_overrun > 0 ||
+        counts.frame > 0 || counts.parity > 0
+    ) {
+        fprintf(
+            stderr, "%s: %lu overruns, %lu buffer overruns, %lu framing "
+            "errors, %lu parity errors, %lu breaks\n", name, counts.overrun,
+            counts.buf_overrun, counts.frame, counts.parity, counts.brk
+        );
+    }
+}
+
+int serial_read_data (serial_t * serial, ring_t * ring) {
+    int status;             // Return status for API calls.
+    size_t head;            // Write position before reading.
+    size_t count;           // Number of bytes read.
+    unsigned long reads;    // Number of `read()` calls before reading.
+
+    // Read available input directly into ring buffer, count it, and record it
+    // in the session log and broadcast ring, in two parts if it wrapped around
+    // the end of storage.
+    head = ring->head;
+    count = ring->bytes;
+    reads = ring->reads;
+    status = ring_fill(ring, serial->fd);
+    count = ring->bytes - count;
+    metrics_add_count(METRICS_SERIAL_IN, count);
+    metrics_add_count(METRICS_SERIAL_READS, ring->reads - reads);
+    if (count > 0) {
+        metrics_add_sample(METRICS_READ_SIZE, count);
+    }
+    if (head + count > ring->size) {
+        session_write_record(
+            SESSION_RX, serial->id, ring->buf + head, ring->size - head
+        );
+        broadcast_write_record(
+            SHMRING_RX, serial->id, ring->buf + head, ring->size - head
+        );
+        count -= ring->size - head;
+        head = 0;
+    }
+    session_write_record(SESSION_RX, serial->id, ring->buf + head, count);
+    broadcast_write_record(SHMRING_RX, serial->id, ring->buf + head, count);
     if (status < 0) {
         // On error, exit with failure.
         fprintf(
-            stderr, "Failed to obtain serial input queue size (%s)\n",
+            stderr, "Failed to read serial data (%s)\n",
             strerror(errno)
         );
         return -1;
+    } else if (status > 0) {
+        // If serial port was hung up, exit with failure.
+        fprintf(stderr, "Serial port was hung up\n");
+        return -1;
     }
 
-    // Allocate buffer to fit input data and terminating null byte.
-    *data = (char *)realloc(*data, (count + 1) * sizeof(char));
-    (*data)[count] = '\0';
+    return 0;
+}
 
-    // Read input recursively until buffer is full.
-    buf = *data;
-    while (count > 0) {
-        // Read input.
-        status = read(_fd, buf, count);
-        if (status < 0) {
-            // On error, exit with failure.
-            fprintf(
-                stderr, "Failed to read serial data (%s)\n",
-                strerror(errno)
-            );
-            return -1;
+int serial_read_buffer (serial_t * serial, buffer_t * buf) {
+    ssize_t status; // Return status for API calls.
+
+    // Read available input into free space of buffer.
+    do {
+        status = read(
+            serial->fd, buf->data + buf->count, buf->size - buf->count
+        );
+    } while (status < 0 && errno == EINTR);
+    metrics_add_count(METRICS_SERIAL_READS, 1);
+    if (status < 0) {
+        // If no input is available, exit with success.
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
         }
-        // Update current location in buffer, and number of remaining input
-        // characters to read.
-        buf += status;
-        count -= status;
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to read serial data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    } else if (status == 0) {
+        // If serial port was hung up, exit with failure.
+        fprintf(stderr, "Serial port was hung up\n");
+        return -1;
     }
 
+    // Count input, record it in session log and broadcast ring, and update
+    // buffer size.
+    metrics_add_count(METRICS_SERIAL_IN, status);
+    metrics_add_sample(METRICS_READ_SIZE, status);
+    session_write_record(
+        SESSION_RX, serial->id, buf->data + buf->count, status
+    );
+    broadcast_write_record(
+        SHMRING_RX, serial->id, buf->data + buf->count, status
+    );
+    buf->count += status;
+
     return 0;
 }
 
-int serial_write_data (const char * data) {
+int serial_try_write_data (
+    serial_t * serial, const buffer_t * data, size_t * count
+) {
     ssize_t status; // Return status for API calls.
-    size_t count;   // Number of characters to write.
 
-    // Get buffer size.
-    count = strlen(data);
+    // Write as much output as possible without blocking.
+    do {
+        status = write(serial->fd, data->data, data->count);
+        metrics_add_count(METRICS_SERIAL_WRITES, 1);
+    } while (status < 0 && errno == EINTR);
+    if (status < 0) {
+        // If no output space is available, exit with success.
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            metrics_add_count(METRICS_SERIAL_STALLS, 1);
+            *count = 0;
+            return 0;
+        }
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to write serial data (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Count output, and record it in session log and broadcast ring.
+    metrics_add_count(METRICS_SERIAL_OUT, status);
+    session_write_record(SESSION_TX, serial->id, data->data, status);
+    broadcast_write_record(SHMRING_TX, serial->id, data->data, status);
+    *count = status;
+
+    return 0;
+}
+
+int serial_write_data (serial_t * serial, const buffer_t * data) {
+    ssize_t status;     // Return status for API calls.
+    const char * buf;   // Pointer to current location in buffer.
+    size_t count;       // Number of characters to write.
+    struct pollfd evt;  // Output space event structure.
+    uint64_t start;     // Start time of stall.
+
+    // Start at beginning of buffer.
+    buf = data->data;
+    count = data->count;
 
     // Write output recursively until buffer is empty.
     while (count > 0) {
         // Write output.
-        status = write(_fd, data, count);
+        status = write(serial->fd, buf, count);
+        metrics_add_count(METRICS_SERIAL_WRITES, 1);
         if (status < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // If serial output queue is full, wait until there is space,
+                // timing the stall.
+                metrics_add_count(METRICS_SERIAL_STALLS, 1);
+                start = metrics_get_time();
+                evt.fd = serial->fd;
+                evt.events = POLLOUT;
+                poll(&evt, 1, -1);
+                metrics_add_sample(
+                    METRICS_STALL_TIME, metrics_get_time() - start
+                );
+                continue;
+            } else if (errno == EINTR) {
+                // If interrupted, try again.
+                continue;
+            }
             // On error, exit with failure.
             fprintf(
                 stderr, "Failed to write serial data (%s)\n",
@@ -261,9 +792,13 @@ int serial_write_data (const char * data) {
             );
             return -1;
         }
-        // Update current location in buffer, and number of remaining output
+        // Count output, record it in session log and broadcast ring, and
+        // update current location in buffer, and number of remaining output
         // characters to write.
-        data += status;
+        metrics_add_count(METRICS_SERIAL_OUT, status);
+        session_write_record(SESSION_TX, serial->id, buf, status);
+        broadcast_write_record(SHMRING_TX, serial->id, buf, status);
+        buf += status;
         count -= status;
     }
 
@@ -8,7 +8,118 @@
 #ifndef __SERIAL_H__
 #define __SERIAL_H__
 
-#include <poll.h>
+#include <stdbool.h>
+#include <termios.h>
+
+#include "buffer.h"
+#include "ring.h"
+
+/** @ingroup    serial
+ *
+ *  @brief      Flow control.
+ */
+
+typedef enum {
+    SERIAL_FLOW_NONE,       /**< No flow control. */
+    SERIAL_FLOW_RTSCTS,     /**< Hardware flow control with RTS and CTS. */
+    SERIAL_FLOW_XONXOFF     /**< Software flow control with XON and XOFF. */
+} serial_flow_t;
+
+/** @ingroup    serial
+ *
+ *  @brief      Parity.
+ */
+
+typedef enum {
+    SERIAL_PARITY_NONE,     /**< No parity bit. */
+    SERIAL_PARITY_ODD,      /**< Odd parity. */
+    SERIAL_PARITY_EVEN,     /**< Even parity. */
+    SERIAL_PARITY_MARK,     /**< Parity bit always set. */
+    SERIAL_PARITY_SPACE     /**< Parity bit always clear. */
+} serial_parity_t;
+
+/** @ingroup    serial
+ *
+ *  @brief      Character frame.
+ */
+
+typedef struct {
+    unsigned int bits;          /**< Data bits, from 5 to 8. */
+    serial_parity_t parity;     /**< Parity. */
+    unsigned int stop;          /**< Stop bits, 1 or 2. */
+} serial_frame_t;
+
+/** @ingroup    serial
+ *
+ *  @brief      Serial port driver counters.
+ *
+ *  Holds the counters kept by the kernel driver of a serial port since it was
+ *  loaded.
+ */
+
+typedef struct {
+    unsigned long rx;           /**< Bytes received by the UART. */
+    unsigned long tx;           /**< Bytes transmitted by the UART. */
+    unsigned long frame;        /**< Framing errors. */
+    unsigned long overrun;      /**< UART receive FIFO overruns. */
+    unsigned long parity;       /**< Parity errors. */
+    unsigned long brk;          /**< Breaks received. */
+    unsigned long buf_overrun;  /**< Driver receive buffer overruns. */
+} serial_counts_t;
+
+/** @ingroup    serial
+ *
+ *  @brief      Serial port.
+ *
+ *  Holds the file descriptor and configurations of an open serial port. Every
+ *  serial port in use has its own instance, which must not be modified
+ *  directly, except for its port ID, low latency flag and flow control, which
+ *  may be set before opening it.
+ */
+
+typedef struct {
+    int fd;                     /**< Serial port file descriptor. */
+    unsigned short id;          /**< Port ID in session logs. */
+    bool low_latency;           /**< Flag indicating if tuned for latency. */
+    serial_flow_t flow;         /**< Flow control. */
+    struct termios cnf_old;     /**< Old serial port configuration. */
+    struct termios cnf_new;     /**< New serial port configuration. */
+    unsigned long rate_old;     /**< Old baud rate, or 0 if unknown. */
+    int flags_old;              /**< Old driver flags, or -1 if unchanged. */
+    int timer_old;              /**< Old latency timer, or -1 if unchanged. */
+    bool counted;               /**< Flag indicating if counters are kept. */
+    serial_counts_t counts_old; /**< Driver counters when opened. */
+} serial_t;
+
+/** @ingroup    serial
+ *
+ *  @brief      Parse baud rate.
+ *
+ *  Parses a baud rate given as a positive number of bits per second.
+ *
+ *  @param      baud    String representation of baud rate.
+ *  @param      rate    Pointer to baud rate in bits per second to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_parse_rate (const char * baud, unsigned long * rate);
+
+/** @ingroup    serial
+ *
+ *  @brief      Parse flow control.
+ *
+ *  Parses flow control given as `none`, `rtscts` or `xonxoff`.
+ *
+ *  @param      str     String representation of flow control.
+ *  @param      flow    Pointer to flow control to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_parse_flow (const char * str, serial_flow_t * flow);
 
 /** @ingroup    serial
  *
@@ -16,75 +127,309 @@
  *
  *  Opens the serial port with the specified path and configures it to operate
  *  at the specified baud rate.
+ *  The path of the serial port is recorded in the session log, if one is open.
+ *
+ *  Any baud rate is accepted. Standard baud rates are set with their `termios`
+ *  specifier, and others through `termios2`. If the serial driver rounds the
+ *  baud rate, the baud rate actually set is written to `stderr`.
+ *
+ *  If the low latency flag of the serial port is set, reads return as soon as
+ *  a single byte is received, the low latency flag of the serial driver is
+ *  set, and the latency timer of a USB serial adapter is set to 1 ms. Driver
+ *  settings are restored when the serial port is closed.
  *
- *  @note       The specified baud rate must be supported by the system.
+ *  The flow control of the serial port is applied. Without flow control,
+ *  neither RTS/CTS nor XON/XOFF are used, whatever the port used before.
  *
+ *  @param      serial  Pointer to serial port to be opened.
  *  @param      port    Path to the serial port.
- *  @param      baud    String representation of baud rate for communication.
+ *  @param      baud    String representation of baud rate for communication,
+ *                      in bits per second.
  *
  *  @retval     0       Success.
  *  @retval     -1      Failure. Error message is written to `stderr`.
  */
 
-int serial_open_port (const char * port, const char * baud);
+int serial_open_port (
+    serial_t * serial, const char * port, const char * baud
+);
 
 /** @ingroup    serial
  *
  *  @brief      Close serial port.
  *
  *  Closes the serial port and restores its original configuration.
+ *
+ *  @param      serial  Pointer to serial port to be closed.
+ */
+
+void serial_close_port (serial_t * serial);
+
+/** @ingroup    serial
+ *
+ *  @brief      Set baud rate.
+ *
+ *  Sets the baud rate of the open serial port, with its `termios` specifier if
+ *  it has one, and through `termios2` otherwise. The serial driver may round
+ *  the baud rate.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      rate    Baud rate in bits per second.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_set_rate (serial_t * serial, unsigned long rate);
+
+/** @ingroup    serial
+ *
+ *  @brief      Get baud rate.
+ *
+ *  Gets the baud rate that the open serial port actually runs at.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      rate    Pointer to baud rate in bits per second to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as the baud rate cannot be read.
+ */
+
+int serial_get_rate (const serial_t * serial, unsigned long * rate);
+
+/** @ingroup    serial
+ *
+ *  @brief      Set character frame.
+ *
+ *  Sets the number of data bits, the parity and the number of stop bits of
+ *  the open serial port, keeping its baud rate.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      frame   Pointer to character frame.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_set_frame (serial_t * serial, const serial_frame_t * frame);
+
+/** @ingroup    serial
+ *
+ *  @brief      Get character frame.
+ *
+ *  Gets the character frame the open serial port is configured with.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      frame   Pointer to character frame to be filled in.
  */
 
-void serial_close_port (void);
+void serial_get_frame (const serial_t * serial, serial_frame_t * frame);
 
 /** @ingroup    serial
  *
- *  @brief      Get wakeup event structure.
+ *  @brief      Set flow control.
  *
- *  Writes the serial wakeup event into the specified buffer. This event can be
- *  registered with sleep_register_wakeup_evt() to wake up the program from a
- *  sleep when input becomes available on the serial port.
+ *  Sets the flow control of the open serial port, keeping its baud rate.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      flow    Flow control.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_set_flow (serial_t * serial, serial_flow_t flow);
+
+/** @ingroup    serial
+ *
+ *  @brief      Set modem control lines.
+ *
+ *  Sets and clears modem control lines of the open serial port, such as DTR
+ *  and RTS, given as `TIOCM_*` bit masks. Pseudo-terminals have none.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      set     Bit mask of lines to be set.
+ *  @param      clear   Bit mask of lines to be cleared.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_set_lines (serial_t * serial, int set, int clear);
+
+/** @ingroup    serial
+ *
+ *  @brief      Get modem lines.
+ *
+ *  Gets the state of the modem control and status lines of the open serial
+ *  port, as a `TIOCM_*` bit mask.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      lines   Pointer to bit mask of lines set to be set.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as the serial port has no modem lines.
+ */
+
+int serial_get_lines (const serial_t * serial, int * lines);
+
+/** @ingroup    serial
+ *
+ *  @brief      Set break condition.
+ *
+ *  Starts or stops sending a break on the open serial port.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      on      Flag indicating if a break is sent.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_set_break (serial_t * serial, bool on);
+
+/** @ingroup    serial
+ *
+ *  @brief      Discard data held by the driver.
+ *
+ *  Discards data received but not read, or written but not sent, or both, as
+ *  selected by `TCIFLUSH`, `TCOFLUSH` or `TCIOFLUSH`.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      queue   Queue selector.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_purge_data (serial_t * serial, int queue);
+
+/** @ingroup    serial
+ *
+ *  @brief      Get serial port file descriptor.
+ *
+ *  Gets the file descriptor of the serial port. Its handler can be registered
+ *  with event_register_handler() to wake up the program from a sleep when
+ *  input becomes available on the serial port.
  *
  *  @note       The serial port must be opened with a successful call to
  *              serial_open_port() before calling this function.
  *
- *  @param      evt     Pointer to wakeup event structure to be filled in.
+ *  @param      serial  Pointer to serial port.
+ *
+ *  @return     Serial port file descriptor.
+ */
+
+int serial_get_fd (const serial_t * serial);
+
+/** @ingroup    serial
+ *
+ *  @brief      Get serial port driver counters.
+ *
+ *  Gets the counters kept by the kernel driver of the serial port with the
+ *  `TIOCGICOUNT` request. Not every driver supports it, and pseudo-terminals
+ *  never do.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      counts  Pointer to structure to be filled in with the counters.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as the driver does not keep counters.
  */
 
-void serial_get_wakeup_evt (struct pollfd * evt);
+int serial_get_counts (const serial_t * serial, serial_counts_t * counts);
+
+/** @ingroup    serial
+ *
+ *  @brief      Print serial port error counters.
+ *
+ *  Writes the number of overruns, framing and parity errors and breaks that
+ *  the kernel driver of the serial port counted since it was opened to
+ *  `stderr`, if the driver keeps counters. Unless requested always, they are
+ *  only written if any data was lost or corrupted.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      name    Name of serial port.
+ *  @param      always  Flag indicating if counters are written even if zero.
+ */
+
+void serial_report_counts (
+    const serial_t * serial, const char * name, bool always
+);
 
 /** @ingroup    serial
  *
  *  @brief      Read serial input data.
  *
- *  Reads the available serial input data into the specified buffer. The size of
- *  the buffer is reallocated to exactly fit all the available input data and a
- *  terminating null byte. Thus, it is recommended to initialize the buffer to
- *  `NULL` and subsequently pass a pointer to this buffer to read serial input.
- *  The buffer need not be freed before the next call to this function.
+ *  Reads the available serial input data directly into the free space of the
+ *  specified ring buffer, with as few `read()` calls as possible. Reading stops
+ *  when no more input is available or when the ring buffer is full, in which
+ *  case the remaining input is left for the next call to this function.
+ *  A hangup of the serial port is treated as a failure.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      ring    Pointer to ring buffer to be filled in with available
+ *                      serial input data.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_read_data (serial_t * serial, ring_t * ring);
+
+/** @ingroup    serial
+ *
+ *  @brief      Read serial input data into buffer.
+ *
+ *  Reads the available serial input data into the free space of the specified
+ *  buffer, between its byte count and its capacity, with a single `read()`
+ *  call. If no input is available, the buffer is left unchanged.
+ *  A hangup of the serial port is treated as a failure.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      buf     Pointer to buffer to be filled in. Its byte count is
+ *                      increased by the number of bytes read.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int serial_read_buffer (serial_t * serial, buffer_t * buf);
+
+/** @ingroup    serial
+ *
+ *  @brief      Write serial output data without blocking.
+ *
+ *  Writes as much of the specified buffer to serial output as is possible
+ *  without blocking, with a single `write()` call.
  *
- *  @param      data    Pointer to buffer that must be reallocated and filled in
- *                      with available serial input data.
+ *  @param      serial  Pointer to serial port.
+ *  @param      data    Pointer to buffer to be written to serial output.
+ *  @param      count   Pointer to variable into which the number of bytes
+ *                      written will be written.
  *
  *  @retval     0       Success.
  *  @retval     -1      Failure. Error message is written to `stderr`.
  */
 
-int serial_read_data (char ** data);
+int serial_try_write_data (
+    serial_t * serial, const buffer_t * data, size_t * count
+);
 
 /** @ingroup    serial
  *
  *  @brief      Write serial output data.
  *
- *  Writes the specified buffer to serial output. The buffer must be a
- *  null-terminated string.
+ *  Writes the specified buffer to serial output. The buffer may contain any
+ *  byte value, including null bytes.
  *
- *  @param      data    Null-terminated buffer to be written to serial output.
+ *  @param      serial  Pointer to serial port.
+ *  @param      data    Pointer to buffer to be written to serial output.
  *
  *  @retval     0       Success.
  *  @retval     -1      Failure. Error message is written to `stderr`.
  */
 
-int serial_write_data (const char * data);
+int serial_write_data (serial_t * serial, const buffer_t * data);
 
 #endif
@@ -0,0 +1,685 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "session.h"
+
+// Session log header.
+typedef struct {
+    char magic[8];          // Magic number.
+    uint64_t start;         // Wall-clock start time in ns since the epoch.
+    uint64_t reserved[2];   // Reserved, zero.
+} session_header_t;
+
+// Record header, followed by its data, padded to a multiple of 8 bytes.
+typedef struct {
+    uint64_t time;          // Monotonic time in ns since start.
+    uint32_t count;         // Number of data bytes.
+    uint16_t port;          // Port ID.
+    uint8_t dir;            // Record kind.
+    uint8_t reserved;       // Reserved, zero.
+} session_record_t;
+
+// Time index entry.
+typedef struct {
+    uint64_t time;          // Time of record.
+    uint64_t offset;        // File offset of record.
+} session_index_t;
+
+// Session log footer.
+typedef struct {
+    char magic[8];          // Magic number.
+    uint64_t offset;        // File offset of time index, and end of records.
+    uint64_t count;         // Number of time index entries.
+    uint64_t reserved;      // Reserved, zero.
+} session_footer_t;
+
+static const char _magic[8] = "SERLOG1";    // Header magic number.
+static const char _magic_index[8] = "SERIDX1"; // Footer magic number.
+
+// Number of record blocks. One block is filled while up to two full blocks
+// wait to be written.
+enum {SESSION_BLOCK_COUNT = 3};
+
+// Number of record bytes between time index entries.
+static const uint64_t _interval = 65536;
+
+// Size of the blocks in which records are collected before writing them.
+static const size_t _size = 1 << 20;
+
+static int _fd = -1;                // Session log file descriptor.
+static char * _block[SESSION_BLOCK_COUNT]; // Record blocks.
+static size_t _fill;                // Number of bytes in block being filled.
+
+static atomic_size_t _head;         // Number of blocks handed to writer.
+static atomic_size_t _tail;         // Number of blocks written by writer.
+static atomic_bool _stop;           // Flag to stop writer thread.
+static atomic_int _error;           // Error number of failed write, or zero.
+static int _wake_fd = -1;           // Signalled to wake up writer thread.
+static pthread_t _thread;           // Writer thread.
+static bool _running = false;       // Flag indicating if writer is running.
+
+static struct timespec _start;      // Monotonic start time.
+static uint64_t _offset;            // File offset of next record.
+static uint64_t _mark;              // File offset of next time index entry.
+static session_index_t * _index;    // Time index.
+static size_t _entries;             // Number of time index entries.
+static size_t _cap;                 // Capacity of time index.
+
+static unsigned long _records;      // Number of records written.
+static unsigned long _bytes;        // Number of data bytes written.
+static unsigned long _dropped;      // Number of records dropped.
+
+// Write data to session log.
+static int _write (const char * data, size_t count) {
+    ssize_t status; // Return status for API calls.
+
+    while (count > 0) {
+        status = write(_fd, data, count);
+        if (status < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += status;
+        count -= status;
+    }
+
+    return 0;
+}
+
+// Writer thread. Writes out every block handed to it, in order.
+static void * _run (void * arg) {
+    uint64_t val;   // Value of event counter.
+    size_t head;    // Number of blocks handed to writer.
+    size_t tail;    // Number of blocks written.
+
+    tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+    while (true) {
+        // Write out all blocks handed over so far. After a failed write, keep
+        // releasing blocks, so that recording carries on.
+        head = atomic_load_explicit(&_head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            if (
+                atomic_load_explicit(&_error, memory_order_relaxed) == 0 &&
+                _write(_block[tail % SESSION_BLOCK_COUNT], _size) < 0
+            ) {
+                atomic_store_explicit(&_error, errno, memory_order_relaxed);
+            }
+            atomic_store_explicit(&_tail, tail + 1, memory_order_release);
+        }
+
+        // Once all blocks are written out after a stop request, exit.
+        if (atomic_load(&_stop)) {
+            if (tail == atomic_load_explicit(&_head, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+
+        // Sleep until another block is handed over, or until stopped.
+        read(_wake_fd, &val, sizeof(val));
+    }
+
+    return NULL;
+}
+
+// Check if the blocks not waiting to be written have room for the specified
+// number of bytes.
+static bool _fits (size_t count) {
+    size_t head;    // Number of blocks handed to writer.
+    size_t tail;    // Number of blocks written by writer.
+
+    head = atomic_load_explicit(&_head, memory_order_relaxed);
+    tail = atomic_load_explicit(&_tail, memory_order_acquire);
+    return count <= (SESSION_BLOCK_COUNT - 1 - (head - tail)) * _size +
+        _size - _fill;
+}
+
+// Append data to the block being filled, handing every block filled to the
+// writer thread. The data must fit.
+static void _append (const void * data, size_t count) {
+    uint64_t val = 1;   // Value added to event counter.
+    const char * src = (const char *)data;  // Data left to append.
+    size_t head;        // Number of blocks handed to writer.
+    size_t len;         // Number of bytes copied into block.
+
+    head = atomic_load_explicit(&_head, memory_order_relaxed);
+    while (count > 0) {
+        len = (_size - _fill < count) ? _size - _fill : count;
+        memcpy(_block[head % SESSION_BLOCK_COUNT] + _fill, src, len);
+        _fill += len;
+        src += len;
+        count -= len;
+        if (_fill == _size) {
+            head++;
+            atomic_store_explicit(&_head, head, memory_order_release);
+            write(_wake_fd, &val, sizeof(val));
+            _fill = 0;
+        }
+    }
+}
+
+// Add a time index entry. If the index cannot grow, the entry is left out,
+// which only makes the index sparser.
+static void _add_index (uint64_t time) {
+    session_index_t * index;    // Reallocated time index.
+    size_t cap;                 // Capacity of reallocated time index.
+
+    if (_entries == _cap) {
+        cap = (_cap == 0) ? 1024 : 2 * _cap;
+        index = (session_index_t *)realloc(
+            _index, cap * sizeof(session_index_t)
+        );
+        if (index == NULL) {
+            return;
+        }
+        _index = index;
+        _cap = cap;
+    }
+    _index[_entries].time = time;
+    _index[_entries].offset = _offset;
+    _entries++;
+}
+
+int session_open_log (const char * path) {
+    int status;             // Return status for API calls.
+    session_header_t head;  // Session log header.
+    struct timespec now;    // Wall-clock start time.
+    sigset_t mask, old;     // Signal masks of writer thread and caller.
+
+    // Allocate record blocks.
+    for (size_t i = 0; i < SESSION_BLOCK_COUNT; i++) {
+        _block[i] = (char *)malloc(_size);
+        if (_block[i] == NULL) {
+            // On error, free blocks and exit with failure.
+            fprintf(
+                stderr, "Failed to allocate session log block (%s)\n",
+                strerror(errno)
+            );
+            session_close_log();
+            return -1;
+        }
+    }
+
+    // Create session log.
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (_fd < 0) {
+        // On error, free blocks and exit with failure.
+        fprintf(
+            stderr, "Failed to open session log '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        session_close_log();
+        return -1;
+    }
+
+    // Create wakeup descriptor. Reads from it block the writer thread.
+    _wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (_wake_fd < 0) {
+        // On error, close session log and exit with failure.
+        fprintf(
+            stderr, "Failed to create session log wakeup descriptor (%s)\n",
+            strerror(errno)
+        );
+        session_close_log();
+        return -1;
+    }
+
+    // Reset state and counters.
+    _fill = 0;
+    atomic_init(&_head, 0);
+    atomic_init(&_tail, 0);
+    atomic_init(&_stop, false);
+    atomic_init(&_error, 0);
+    _entries = 0;
+    _records = 0;
+    _bytes = 0;
+    _dropped = 0;
+
+    // Start writer thread with all signals blocked, as the session log is
+    // opened before the event loop sets up its signal mask.
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old);
+    status = pthread_create(&_thread, NULL, _run, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (status != 0) {
+        // On error, close session log and exit with failure.
+        fprintf(
+            stderr, "Failed to start session log writer thread (%s)\n",
+            strerror(status)
+        );
+        session_close_log();
+        return -1;
+    }
+    _running = true;
+
+    // Write header with wall-clock start time. Records are stamped relative
+    // to the monotonic start time, so that they stay ordered.
+    clock_gettime(CLOCK_MONOTONIC, &_start);
+    clock_gettime(CLOCK_REALTIME, &now);
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, _magic, sizeof(head.magic));
+    head.start = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    _append(&head, sizeof(head));
+    _offset = sizeof(head);
+    _mark = _offset;
+
+    return 0;
+}
+
+int session_close_log (void) {
+    int status = 0;         // Return status for API calls.
+    uint64_t val = 1;       // Value added to event counter.
+    int error;              // Error number of failed write.
+    char * block;           // Partly filled block.
+    session_footer_t foot;  // Session log footer.
+
+    // Stop writer thread once it has written out all full blocks, and then
+    // write out the partly filled block, time index and footer.
+    if (_running) {
+        atomic_store(&_stop, true);
+        write(_wake_fd, &val, sizeof(val));
+        pthread_join(_thread, NULL);
+        _running = false;
+
+        memset(&foot, 0, sizeof(foot));
+        memcpy(foot.magic, _magic_index, sizeof(foot.magic));
+        foot.offset = _offset;
+        foot.count = _entries;
+        block = _block[atomic_load(&_head) % SESSION_BLOCK_COUNT];
+        error = atomic_load(&_error);
+        if (
+            error == 0 && (
+                _write(block, _fill) < 0 ||
+                _write(
+                    (const char *)_index, _entries * sizeof(session_index_t)
+                ) < 0 ||
+                _write((const char *)&foot, sizeof(foot)) < 0
+            )
+        ) {
+            error = errno;
+        }
+        if (error != 0) {
+            fprintf(
+                stderr, "Failed to write session log (%s)\n", strerror(error)
+            );
+            status = -1;
+        }
+        if (_dropped > 0) {
+            fprintf(
+                stderr, "Session log dropped %lu records, as the disk fell "
+                "behind\n", _dropped
+            );
+        }
+    }
+
+    // Close descriptors and free blocks and time index.
+    if (_wake_fd >= 0) {
+        close(_wake_fd);
+        _wake_fd = -1;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    for (size_t i = 0; i < SESSION_BLOCK_COUNT; i++) {
+        free(_block[i]);
+        _block[i] = NULL;
+    }
+    free(_index);
+    _index = NULL;
+    _cap = 0;
+
+    return status;
+}
+
+void session_write_record (
+    session_dir_t dir, unsigned short port, const char * data, size_t count
+) {
+    static const char pad[8] = {0}; // Padding after data.
+    session_record_t rec;           // Record header.
+    struct timespec now;            // Current monotonic time.
+    size_t len;                     // Number of bytes in record.
+
+    if (!_running || count == 0) {
+        return;
+    }
+
+    // Stamp records with time since start.
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rec.time = (uint64_t)(now.tv_sec - _start.tv_sec) * 1000000000 +
+        now.tv_nsec - _start.tv_nsec;
+    rec.port = port;
+    rec.dir = (uint8_t)dir;
+    rec.reserved = 0;
+
+    // Append data in records of at most a quarter of a block. If the writer
+    // has fallen so far behind that a record does not fit into the free
+    // blocks, drop the whole record rather than waiting for the disk, so that
+    // the session log stays readable.
+    while (count > 0) {
+        rec.count = (count < _size / 4) ? count : _size / 4;
+        len = sizeof(rec) + (rec.count + 7) / 8 * 8;
+        if (!_fits(len)) {
+            _dropped++;
+            data += rec.count;
+            count -= rec.count;
+            continue;
+        }
+
+        // Add a time index entry once enough records were written since the
+        // last one.
+        if (_offset >= _mark) {
+            _add_index(rec.time);
+            _mark = _offset + _interval;
+        }
+
+        // Append record header, data and padding.
+        _append(&rec, sizeof(rec));
+        _append(data, rec.count);
+        _append(pad, len - sizeof(rec) - rec.count);
+        _offset += len;
+        _records++;
+        _bytes += rec.count;
+        data += rec.count;
+        count -= rec.count;
+    }
+}
+
+// Parse a time range end into ns since the start of the session. An empty
+// string stands for the default time.
+static int _parse_time (
+    const char * str, uint64_t start, uint64_t def, uint64_t * time
+) {
+    static const char * formats[] = {   // Accepted wall-clock time formats.
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%H:%M:%S", "%H:%M"
+    };
+    char * end;     // End of parsed string.
+    double sec;     // Seconds since start.
+    struct tm tm;   // Broken-down wall-clock time.
+    struct tm day;  // Broken-down start time.
+    time_t base;    // Start time in seconds since the epoch.
+    time_t wall;    // Parsed time in seconds since the epoch.
+
+    // Use default time for empty string.
+    if (*str == '\0') {
+        *time = def;
+        return 0;
+    }
+
+    // Parse time relative to start.
+    if (*str == '+') {
+        sec = strtod(str + 1, &end);
+        if (end == str + 1 || *end != '\0' || sec < 0) {
+            fprintf(stderr, "Invalid session log time '%s'\n", str);
+            return -1;
+        }
+        *time = (uint64_t)(sec * 1e9);
+        return 0;
+    }
+
+    // Parse local wall-clock time. A time without date is taken on the start
+    // date, or on the day after if that is before the start.
+    base = (time_t)(start / 1000000000);
+    localtime_r(&base, &day);
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        tm = day;
+        tm.tm_sec = 0;
+        end = strptime(str, formats[i], &tm);
+        if (end == NULL || *end != '\0') {
+            continue;
+        }
+        tm.tm_isdst = -1;
+        wall = mktime(&tm);
+        if (i >= 2 && wall < base) {
+            tm.tm_mday++;
+            tm.tm_isdst = -1;
+            wall = mktime(&tm);
+        }
+        if ((uint64_t)wall * 1000000000 <= start) {
+            *time = 0;
+        } else {
+            *time = (uint64_t)wall * 1000000000 - start;
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "Invalid session log time '%s'\n", str);
+    return -1;
+}
+
+// Print a record as one line.
+static void _print (
+    const session_header_t * head, const session_record_t * rec,
+    char ** names, size_t count
+) {
+    static const char * dirs[] = {"RX", "TX"};  // Direction names.
+    const unsigned char * data;                 // Record data.
+    uint64_t ns;                                // Record wall-clock time.
+    time_t sec;                                 // Record time in seconds.
+    struct tm tm;                               // Broken-down record time.
+    char stamp[32];                             // Formatted record time.
+
+    ns = head->start + rec->time;
+    sec = (time_t)(ns / 1000000000);
+    localtime_r(&sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%06lu ", stamp, (unsigned long)(ns % 1000000000 / 1000));
+    if (rec->port < count && names[rec->port] != NULL) {
+        printf("%s ", names[rec->port]);
+    } else {
+        printf("port%u ", rec->port);
+    }
+    printf("%s \"", dirs[rec->dir]);
+
+    // Escape data, so that every record fits on one line.
+    data = (const unsigned char *)(rec + 1);
+    for (uint32_t i = 0; i < rec->count; i++) {
+        if (data[i] == '\r') {
+            fputs("\\r", stdout);
+        } else if (data[i] == '\n') {
+            fputs("\\n", stdout);
+        } else if (data[i] == '\t') {
+            fputs("\\t", stdout);
+        } else if (data[i] == '"' || data[i] == '\\') {
+            putchar('\\');
+            putchar(data[i]);
+        } else if (data[i] < 0x20 || data[i] >= 0x7f) {
+            printf("\\x%02x", data[i]);
+        } else {
+            putchar(data[i]);
+        }
+    }
+    fputs("\"\n", stdout);
+}
+
+int session_read_log (const char * path, const char * range) {
+    int status = 0;                     // Return status for API calls.
+    int fd;                             // Session log file descriptor.
+    struct stat st;                     // Session log file status.
+    const char * map;                   // Session log mapping.
+    const session_header_t * head;      // Session log header.
+    const session_footer_t * foot;      // Session log footer.
+    const session_index_t * index;      // Time index.
+    const session_record_t * rec;       // Current record.
+    uint64_t entries = 0;               // Number of time index entries.
+    uint64_t end;                       // End of records.
+    uint64_t pos;                       // Offset of current record.
+    uint64_t len;                       // Length of current record.
+    uint64_t from, to;                  // Time range.
+    size_t lo, hi, mid;                 // Binary search bounds.
+    char * str, * sep;                  // Copy of time range, and separator.
+    char ** names = NULL;               // Port paths by port ID.
+    char ** grown;                      // Reallocated port paths.
+    size_t count = 0;                   // Number of port paths.
+
+    // Open and map session log.
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open session log '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(session_header_t)) {
+        fprintf(stderr, "Invalid session log '%s'\n", path);
+        close(fd);
+        return -1;
+    }
+    map = (const char *)mmap(
+        NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0
+    );
+    close(fd);
+    if (map == MAP_FAILED) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to map session log '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        return -1;
+    }
+
+    // Check header.
+    head = (const session_header_t *)map;
+    if (memcmp(head->magic, _magic, sizeof(head->magic)) != 0) {
+        fprintf(stderr, "Invalid session log '%s'\n", path);
+        munmap((void *)map, st.st_size);
+        return -1;
+    }
+
+    // Locate time index from footer. Without footer, all records are scanned.
+    end = st.st_size;
+    foot = (const session_footer_t *)(map + st.st_size - sizeof(*foot));
+    if (
+        (size_t)st.st_size >= sizeof(*head) + sizeof(*foot) &&
+        memcmp(foot->magic, _magic_index, sizeof(foot->magic)) == 0 &&
+        foot->offset >= sizeof(*head) &&
+        foot->offset + foot->count * sizeof(session_index_t) ==
+            st.st_size - sizeof(*foot)
+    ) {
+        end = foot->offset;
+        entries = foot->count;
+    } else {
+        fprintf(stderr, "Session log has no index, scanning all records\n");
+    }
+    index = (const session_index_t *)(map + end);
+
+    // Parse time range.
+    str = strdup(range);
+    sep = (str == NULL) ? NULL : strchr(str, ',');
+    if (sep == NULL) {
+        fprintf(stderr, "Invalid session log range '%s'\n", range);
+        free(str);
+        munmap((void *)map, st.st_size);
+        return -1;
+    }
+    *sep = '\0';
+    if (
+        _parse_time(str, head->start, 0, &from) < 0 ||
+        _parse_time(sep + 1, head->start, UINT64_MAX, &to) < 0
+    ) {
+        free(str);
+        munmap((void *)map, st.st_size);
+        return -1;
+    }
+    free(str);
+
+    // Collect port paths, recorded before any data.
+    pos = sizeof(*head);
+    while (pos + sizeof(*rec) <= end) {
+        rec = (const session_record_t *)(map + pos);
+        if (rec->dir != SESSION_PORT || pos + sizeof(*rec) + rec->count > end) {
+            break;
+        }
+        if (rec->port >= count) {
+            grown = (char **)realloc(names, (rec->port + 1) * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            names = grown;
+            for (; count <= rec->port; count++) {
+                names[count] = NULL;
+            }
+        }
+        free(names[rec->port]);
+        names[rec->port] = strndup((const char *)(rec + 1), rec->count);
+        pos += sizeof(*rec) + (rec->count + 7) / 8 * 8;
+    }
+
+    // Find the last index entry before the start of the range by binary
+    // search, and scan records from there.
+    lo = 0;
+    hi = entries;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index[mid].time < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && index[lo - 1].offset >= pos && index[lo - 1].offset < end) {
+        pos = index[lo - 1].offset;
+    }
+
+    // Print records of the range.
+    while (pos + sizeof(*rec) <= end) {
+        rec = (const session_record_t *)(map + pos);
+        len = sizeof(*rec) + ((uint64_t)rec->count + 7) / 8 * 8;
+        if (pos + len > end || rec->dir > SESSION_PORT) {
+            fprintf(stderr, "Session log is truncated\n");
+            break;
+        }
+        if (rec->time >= to) {
+            break;
+        }
+        if (rec->time >= from && rec->dir != SESSION_PORT) {
+            _print(head, rec, names, count);
+        }
+        pos += len;
+    }
+    if (fflush(stdout) != 0) {
+        fprintf(
+            stderr, "Failed to write session log records (%s)\n",
+            strerror(errno)
+        );
+        status = -1;
+    }
+
+    // Free port paths and unmap session log.
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    munmap((void *)map, st.st_size);
+
+    return status;
+}
+
+void session_report (void) {
+    fprintf(
+        stderr, "Session log: %lu records, %lu bytes, %zu index entries, %lu "
+        "records dropped\n", _records, _bytes, _entries, _dropped
+    );
+}
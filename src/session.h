@@ -0,0 +1,125 @@
+/** @defgroup   session Session
+ *
+ *  @brief      Binary session log.
+ *
+ *  This module contains functions to record the data moved through serial
+ *  ports to a compact binary session log, and to extract a time range from
+ *  it. Every record holds a monotonic timestamp, the direction and port ID of
+ *  its data, and the raw bytes as read from or written to the serial port, so
+ *  that received and transmitted data are interleaved faithfully.
+ *
+ *  A session log consists of a header, the records, a sparse time index and a
+ *  footer locating the index. An index entry is added about every 64 KiB of
+ *  records, so that the reader finds the start of a time range by binary
+ *  search, and only scans the records of the range itself. A session log
+ *  without footer, for example after a crash, is read by scanning it from the
+ *  start.
+ *
+ *  Records are collected in a small number of large blocks, and full blocks
+ *  are handed to a background writer thread, so that recording never waits
+ *  for the disk. If the writer falls behind so far that a record does not fit
+ *  into the free blocks, the record is dropped and counted, instead of holding
+ *  up the caller.
+ */
+
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <stddef.h>
+
+/** @ingroup    session
+ *
+ *  @brief      Record kind.
+ */
+
+typedef enum {
+    SESSION_RX,     /**< Data read from a serial port. */
+    SESSION_TX,     /**< Data written to a serial port. */
+    SESSION_PORT    /**< Path of a serial port, recorded when it is opened. */
+} session_dir_t;
+
+/** @ingroup    session
+ *
+ *  @brief      Open session log.
+ *
+ *  Creates the session log with the specified path, starts the writer thread,
+ *  and writes the header, which records the wall-clock time at which the
+ *  session started.
+ *
+ *  @param      path    Path to session log.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int session_open_log (const char * path);
+
+/** @ingroup    session
+ *
+ *  @brief      Close session log.
+ *
+ *  Stops the writer thread once it has written out all full blocks, writes
+ *  out the records left, the time index and the footer, and closes the
+ *  session log. Does nothing if the session log is not open.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as writing the session log failed. Error
+ *                      message is written to `stderr`.
+ */
+
+int session_close_log (void);
+
+/** @ingroup    session
+ *
+ *  @brief      Record data in session log.
+ *
+ *  Appends records holding the specified data to the session log, stamped
+ *  with the current monotonic time. Data larger than a quarter of a block is
+ *  split into several records. Records are buffered, and written out in large
+ *  blocks by the writer thread. A record that does not fit into the free
+ *  blocks is dropped. Does nothing if the session log is not open.
+ *
+ *  @param      dir     Record kind.
+ *  @param      port    Port ID of serial port.
+ *  @param      data    Pointer to data to be recorded.
+ *  @param      count   Number of bytes to be recorded.
+ */
+
+void session_write_record (
+    session_dir_t dir, unsigned short port, const char * data, size_t count
+);
+
+/** @ingroup    session
+ *
+ *  @brief      Print records of a time range.
+ *
+ *  Maps the specified session log into memory, and writes every record of the
+ *  specified time range to `stdout`, one line per record, with its wall-clock
+ *  time, port, direction and escaped data.
+ *
+ *  The time range has the form `<from>,<to>`, where either end may be left
+ *  empty for the start or end of the session. Each end is either `+<seconds>`,
+ *  relative to the start of the session, or a local time `[YYYY-MM-DD ]HH:MM
+ *  [:SS]`. A time without date refers to its first occurrence after the start
+ *  of the session.
+ *
+ *  @param      path    Path to session log.
+ *  @param      range   Time range.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int session_read_log (const char * path, const char * range);
+
+/** @ingroup    session
+ *
+ *  @brief      Print session log statistics.
+ *
+ *  Writes the number of records, bytes and index entries written to the
+ *  session log to `stderr`.
+ */
+
+void session_report (void);
+
+#endif
@@ -0,0 +1,162 @@
+/** @defgroup   shmring Shared memory ring
+ *
+ *  @brief      Layout and reader of the broadcast ring of a serial port.
+ *
+ *  This header describes the shared memory ring to which a serial terminal
+ *  started with `-M <path>` publishes the data read from and written to its
+ *  serial ports, and reads records from it. It only depends on the standard
+ *  library, so that other programs can include it on their own.
+ *
+ *  A reader opens `<path>`, maps its first page to find the size of the ring,
+ *  maps the whole file with `PROT_READ` and `MAP_SHARED`, sets its position to
+ *  the write cursor, and calls shmring_read_record() until it returns 0. It
+ *  then polls the wakeup counter, or sleeps on it with `FUTEX_WAIT` until it
+ *  changes. The writer only calls `FUTEX_WAKE` while readers are sleeping, so
+ *  a sleeping reader opens `<path>` read-write, maps the header page writable,
+ *  and increments the sleeper count before `FUTEX_WAIT` and decrements it
+ *  after. Readers never write to the ring otherwise, so that any number of
+ *  them consume at their own pace and never hold up the writer.
+ *
+ *  The ring holds records of a header and the data padded to 16 bytes. A
+ *  record never wraps around the end of the ring, which is padded with a
+ *  record of kind SHMRING_PAD instead. The write cursor counts the bytes
+ *  written since the ring was created and only ever grows, and so does the
+ *  oldest intact record, which the writer advances before overwriting records.
+ *  A reader copies a record, and then checks that the oldest intact record is
+ *  not past it, as with a sequence lock. If it is, the record was overwritten
+ *  while being copied, and the reader has fallen behind.
+ */
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/** @ingroup    shmring
+ *
+ *  @brief      Magic number of a broadcast ring, "STBR" in memory.
+ */
+
+#define SHMRING_MAGIC 0x52425453u
+
+/** @ingroup    shmring
+ *
+ *  @brief      Version of the broadcast ring layout.
+ */
+
+#define SHMRING_VERSION 2u
+
+/** @ingroup    shmring
+ *
+ *  @brief      Offset of the records from the start of the ring.
+ */
+
+#define SHMRING_OFFSET 4096u
+
+/** @ingroup    shmring
+ *
+ *  @brief      Record kind.
+ */
+
+typedef enum {
+    SHMRING_RX,     /**< Data read from a serial port. */
+    SHMRING_TX,     /**< Data written to a serial port. */
+    SHMRING_PAD     /**< Padding up to the end of the ring, without data. */
+} shmring_dir_t;
+
+/** @ingroup    shmring
+ *
+ *  @brief      Broadcast ring header.
+ *
+ *  Held at the start of the ring. The cursors are byte positions since the
+ *  ring was created, and the records lie at their position modulo the size of
+ *  the ring, after the offset.
+ */
+
+typedef struct {
+    uint32_t magic;                 /**< Magic number, #SHMRING_MAGIC. */
+    uint32_t version;               /**< Layout version. */
+    uint64_t size;                  /**< Size of records area, power of two. */
+    uint64_t offset;                /**< Offset of records area. */
+    _Alignas(64) _Atomic uint64_t head;     /**< Write cursor. */
+    _Atomic uint64_t tail;                  /**< Oldest intact record. */
+    _Atomic uint32_t wake;                  /**< Wakeup counter. */
+    _Atomic uint32_t closed;                /**< Nonzero once writer quit. */
+    _Atomic uint32_t sleepers;              /**< Readers in `FUTEX_WAIT`. */
+} shmring_header_t;
+
+/** @ingroup    shmring
+ *
+ *  @brief      Record header.
+ *
+ *  Followed by the data, padded to 16 bytes.
+ */
+
+typedef struct {
+    uint64_t time;      /**< Monotonic time in ns since the ring was created. */
+    uint32_t count;     /**< Number of data bytes. */
+    uint16_t port;      /**< Port ID of serial port. */
+    uint8_t dir;        /**< Record kind. */
+    uint8_t reserved;   /**< Zero. */
+} shmring_record_t;
+
+/** @ingroup    shmring
+ *
+ *  @brief      Read record from broadcast ring.
+ *
+ *  Copies the record at the specified position and its data, and advances the
+ *  position past it. Padding records are skipped. If the reader has fallen
+ *  behind, the position is advanced to the oldest intact record instead, and
+ *  the number of bytes of the ring skipped is returned as a negative number.
+ *
+ *  @param      ring    Pointer to mapped ring.
+ *  @param      pos     Pointer to position of reader.
+ *  @param      rec     Pointer to header of record read.
+ *  @param      data    Pointer to data of record read, which has room for at
+ *                      least a quarter of the size of the records area.
+ *
+ *  @retval     >0      Record was read.
+ *  @retval     0       No record was written since.
+ *  @retval     <0      Records were skipped, as the reader fell behind.
+ */
+
+static inline long shmring_read_record (
+    const shmring_header_t * ring, uint64_t * pos, shmring_record_t * rec,
+    void * data
+) {
+    const char * base = (const char *)ring + ring->offset;  // Records.
+    uint64_t mask = ring->size - 1;                         // Position mask.
+    uint64_t tail;                                          // Oldest record.
+    int valid;                                              // Record is sane.
+
+    for (;;) {
+        if (*pos == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+            return 0;
+        }
+
+        // Copy record, and then check that it was not overwritten meanwhile.
+        memcpy(rec, base + (*pos & mask), sizeof(*rec));
+        valid = (rec->dir == SHMRING_PAD || rec->count <= ring->size / 4) &&
+            (*pos & mask) + sizeof(*rec) + rec->count <= ring->size;
+        if (valid && rec->dir != SHMRING_PAD) {
+            memcpy(data, base + (*pos & mask) + sizeof(*rec), rec->count);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        if (tail > *pos) {
+            tail -= *pos;
+            *pos += tail;
+            return -(long)tail;
+        }
+
+        *pos += (sizeof(*rec) + rec->count + 15) / 16 * 16;
+        if (rec->dir != SHMRING_PAD) {
+            return 1;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,1075 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+#include "event.h"
+#include "transfer.h"
+
+// Control characters of XMODEM and YMODEM.
+enum {
+    TRANSFER_SOH = 0x01,            // Start of 128-byte block.
+    TRANSFER_STX = 0x02,            // Start of 1024-byte block.
+    TRANSFER_EOT = 0x04,            // End of file.
+    TRANSFER_ACK = 0x06,            // Block received.
+    TRANSFER_BS = 0x08,             // Backspace, ending cancel sequence.
+    TRANSFER_NAK = 0x15,            // Block not received.
+    TRANSFER_CAN = 0x18,            // Cancel.
+    TRANSFER_SUB = 0x1a,            // Padding of last block.
+    TRANSFER_CRC = 'C'              // Start request with CRC.
+};
+
+// Framing characters of ZMODEM.
+enum {
+    TRANSFER_ZPAD = '*',            // Header padding.
+    TRANSFER_ZDLE = 0x18,           // Escape.
+    TRANSFER_ZBIN = 'A',            // Binary header with 16-bit CRC.
+    TRANSFER_ZHEX = 'B',            // Hex header.
+    TRANSFER_ZBIN32 = 'C',          // Binary header with 32-bit CRC.
+    TRANSFER_ZCRCE = 'h',           // Subpacket ending frame.
+    TRANSFER_ZCRCG = 'i',           // Subpacket continuing frame.
+    TRANSFER_ZCRCQ = 'j',           // Subpacket asking for `ZACK`.
+    TRANSFER_ZCRCW = 'k',           // Subpacket ending frame, asking `ZACK`.
+    TRANSFER_ZRUB0 = 'l',           // Escaped 0x7f.
+    TRANSFER_ZRUB1 = 'm',           // Escaped 0xff.
+    TRANSFER_XON = 0x11             // Resume output after hex header.
+};
+
+// Header types of ZMODEM.
+enum {
+    TRANSFER_ZRQINIT = 0,           // Request receiver to start.
+    TRANSFER_ZRINIT = 1,            // Receiver ready.
+    TRANSFER_ZACK = 3,              // Position acknowledged.
+    TRANSFER_ZFILE = 4,             // File information follows.
+    TRANSFER_ZSKIP = 5,             // File skipped by receiver.
+    TRANSFER_ZNAK = 6,              // Header not received.
+    TRANSFER_ZABORT = 7,            // Session aborted.
+    TRANSFER_ZFIN = 8,              // Session finished.
+    TRANSFER_ZRPOS = 9,             // Send data from position.
+    TRANSFER_ZDATA = 10,            // Data subpackets follow.
+    TRANSFER_ZEOF = 11,             // End of file.
+    TRANSFER_ZFERR = 12,            // File error of receiver.
+    TRANSFER_ZCAN = 16              // Session cancelled.
+};
+
+// Receiver capabilities in `ZRINIT` header.
+enum {
+    TRANSFER_CANOVIO = 0x02,        // Receives while writing to disk.
+    TRANSFER_ESCCTL = 0x40          // Needs all control characters escaped.
+};
+
+// Sizes and timing.
+enum {
+    TRANSFER_BLOCK_SIZE = 1024,     // Largest block or subpacket payload.
+    TRANSFER_PACKET_SIZE = 2112,    // Largest escaped packet with headers.
+    TRANSFER_TRIES = 10,            // Attempts per packet.
+    TRANSFER_TICK = 250,            // Progress timer period in ms.
+    TRANSFER_START_WAIT = 60000,    // Time for receiver to start in ms.
+    TRANSFER_WAIT = 10000           // Time for receiver to respond in ms.
+};
+
+// Protocol.
+typedef enum {
+    TRANSFER_XMODEM,                // XMODEM-1K.
+    TRANSFER_YMODEM,                // YMODEM batch with a single file.
+    TRANSFER_ZMODEM                 // ZMODEM.
+} transfer_proto_t;
+
+// Transfer state.
+typedef enum {
+    TRANSFER_IDLE,                  // No transfer running.
+    TRANSFER_WAIT_START,            // Waiting for receiver to start.
+    TRANSFER_WAIT_HEADER,           // Waiting for file header to be received.
+    TRANSFER_WAIT_DATA,             // Waiting for receiver to ask for data.
+    TRANSFER_WAIT_BLOCK,            // Waiting for block to be received.
+    TRANSFER_WAIT_EOT,              // Waiting for end of file to be received.
+    TRANSFER_WAIT_CLOSE,            // Waiting for receiver to ask for end.
+    TRANSFER_WAIT_END,              // Waiting for end of batch to be received.
+    TRANSFER_WAIT_RINIT,            // Waiting for `ZRINIT`.
+    TRANSFER_WAIT_RPOS,             // Waiting for `ZRPOS` after `ZFILE`.
+    TRANSFER_SEND_DATA,             // Streaming data subpackets.
+    TRANSFER_WAIT_ACK,              // Waiting for `ZACK` after `ZCRCW`.
+    TRANSFER_WAIT_EOF,              // Waiting for `ZRINIT` after `ZEOF`.
+    TRANSFER_WAIT_FIN               // Waiting for `ZFIN`.
+} transfer_state_t;
+
+// State of ZMODEM header parser.
+typedef enum {
+    TRANSFER_PARSE_SEEK,            // Looking for padding.
+    TRANSFER_PARSE_PAD,             // Padding found.
+    TRANSFER_PARSE_FORMAT,          // Escape found.
+    TRANSFER_PARSE_HEX,             // Reading hex header.
+    TRANSFER_PARSE_BIN              // Reading binary header.
+} transfer_parse_t;
+
+// Names of protocols.
+static const char * const _proto_name[] = {"XMODEM", "YMODEM", "ZMODEM"};
+
+static const char * _path;              // Path to file.
+static const char * _name;              // Name of file sent to receiver.
+static transfer_proto_t _proto;         // Protocol.
+static unsigned long _rate;             // Baud rate.
+static transfer_writer_t _writer;       // Writer of serial output.
+static transfer_space_t _space;         // Getter of serial output space.
+static char _packet[2 * TRANSFER_PACKET_SIZE];  // Packet storage.
+static buffer_t _out;                   // Packets to be written.
+static uint16_t _crc16[256];            // CRC-16 lookup table.
+static uint8_t _escape[256];            // ZMODEM escape kind of each byte.
+static size_t _window;                  // Unacknowledged data limit.
+static unsigned long _wait;             // Response timeout in ms.
+
+static transfer_state_t _state;         // Transfer state.
+static char * _map = NULL;              // Mapped file.
+static size_t _size;                    // File size.
+static struct stat _stat;               // File status.
+static int _timer_fd = -1;              // Progress timer.
+static size_t _pos;                     // Position of next data to send.
+static size_t _acked;                   // Position acknowledged.
+static size_t _len;                     // Payload of block sent.
+static size_t _ask;                     // Position to ask for `ZACK` at.
+static size_t _rxbuf;                   // Receiver buffer, or 0 if none.
+static unsigned char _block;            // Number of block sent.
+static bool _crc;                       // Flag indicating if blocks use CRC.
+static bool _skipped;                   // Flag indicating if file skipped.
+static unsigned char _last;             // Last byte written escaped.
+static int _cans;                       // Consecutive cancel bytes received.
+static int _tries;                      // Attempts of current packet.
+static uint64_t _deadline;              // Response deadline, or 0 if none.
+static uint64_t _sent;                  // Time block was sent.
+static uint64_t _started;               // Time data started to flow.
+static bool _shown;                     // Flag indicating if progress shown.
+
+static transfer_parse_t _parse;         // Header parser state.
+static unsigned char _hdr[9];           // Header bytes parsed.
+static int _hcount;                     // Header nibbles or bytes parsed.
+static int _hsize;                      // Header bytes with CRC.
+static bool _hzdle;                     // Flag indicating if escape parsed.
+
+static unsigned long _files;            // Number of files sent.
+static unsigned long _failed;           // Number of failed transfers.
+static unsigned long _bytes;            // Number of file bytes sent.
+static unsigned long _resent;           // Number of packets sent again.
+
+// Get monotonic time in ms.
+static uint64_t _now (void) {
+    struct timespec ts; // Current time.
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Update CRC-16 as used by XMODEM and ZMODEM with data.
+static uint16_t _update_crc16 (
+    uint16_t crc, const unsigned char * data, size_t count
+) {
+    for (size_t i = 0; i < count; i++) {
+        crc = (crc << 8) ^ _crc16[((crc >> 8) ^ data[i]) & 0xff];
+    }
+    return crc;
+}
+
+// Get CRC-32 as used by ZMODEM binary headers.
+static uint32_t _get_crc32 (const unsigned char * data, size_t count) {
+    uint32_t crc = 0xffffffff;  // CRC.
+
+    for (size_t i = 0; i < count; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+// Set up which bytes ZMODEM escapes: 1 always, 2 after `@`, 0 never.
+static void _set_escape (bool ctl) {
+    for (int c = 0; c < 256; c++) {
+        _escape[c] = (ctl && (c & 0x60) == 0) ? 1 : 0;
+    }
+    _escape[TRANSFER_ZDLE] = _escape[TRANSFER_ZDLE | 0x80] = 1;
+    _escape[0x10] = _escape[0x90] = 1;
+    _escape[0x11] = _escape[0x91] = 1;
+    _escape[0x13] = _escape[0x93] = 1;
+    if (!ctl) {
+        _escape['\r'] = _escape['\r' | 0x80] = 2;
+    }
+}
+
+// Append byte to packets to be written.
+static void _put (unsigned char c) {
+    _out.data[_out.count++] = c;
+}
+
+// Append byte to packets to be written, escaped for ZMODEM.
+static void _put_escaped (unsigned char c) {
+    if (_escape[c] == 1 || (_escape[c] == 2 && (_last & 0x7f) == '@')) {
+        _put(TRANSFER_ZDLE);
+        c ^= 0x40;
+    }
+    _put(c);
+    _last = c;
+}
+
+// Append ZMODEM hex header. Its four bytes hold the position or flags, least
+// significant first.
+static void _put_hex_header (int type, uint32_t val) {
+    static const char hex[] = "0123456789abcdef";  // Hex digits.
+    unsigned char hdr[7];                           // Type, value and CRC.
+    uint16_t crc;                                   // CRC.
+
+    hdr[0] = type;
+    for (int i = 0; i < 4; i++) {
+        hdr[1 + i] = (val >> (8 * i)) & 0xff;
+    }
+    crc = _update_crc16(0, hdr, 5);
+    hdr[5] = crc >> 8;
+    hdr[6] = crc & 0xff;
+    _put(TRANSFER_ZPAD);
+    _put(TRANSFER_ZPAD);
+    _put(TRANSFER_ZDLE);
+    _put(TRANSFER_ZHEX);
+    for (int i = 0; i < 7; i++) {
+        _put(hex[hdr[i] >> 4]);
+        _put(hex[hdr[i] & 0x0f]);
+    }
+    _put('\r');
+    _put('\n' | 0x80);
+    if (type != TRANSFER_ZFIN && type != TRANSFER_ZACK) {
+        _put(TRANSFER_XON);
+    }
+}
+
+// Append ZMODEM binary header with 16-bit CRC.
+static void _put_bin_header (int type, uint32_t val) {
+    unsigned char hdr[5];   // Type and value.
+    uint16_t crc;           // CRC.
+
+    hdr[0] = type;
+    for (int i = 0; i < 4; i++) {
+        hdr[1 + i] = (val >> (8 * i)) & 0xff;
+    }
+    crc = _update_crc16(0, hdr, 5);
+    _put(TRANSFER_ZPAD);
+    _put(TRANSFER_ZDLE);
+    _put(TRANSFER_ZBIN);
+    for (int i = 0; i < 5; i++) {
+        _put_escaped(hdr[i]);
+    }
+    _put_escaped(crc >> 8);
+    _put_escaped(crc & 0xff);
+}
+
+// Append ZMODEM data subpacket, ended by the specified frame end.
+static void _put_subpacket (const char * data, size_t count, int end) {
+    const unsigned char * buf = (const unsigned char *)data;    // Payload.
+    unsigned char fe = end;                                     // Frame end.
+    uint16_t crc;                                               // CRC.
+
+    for (size_t i = 0; i < count; i++) {
+        _put_escaped(buf[i]);
+    }
+    _put(TRANSFER_ZDLE);
+    _put(fe);
+    crc = _update_crc16(_update_crc16(0, buf, count), &fe, 1);
+    _put_escaped(crc >> 8);
+    _put_escaped(crc & 0xff);
+    if (end == TRANSFER_ZCRCW) {
+        _put(TRANSFER_XON);
+    }
+}
+
+// Write packets, once there is space for all of them. Packets that do not fit
+// yet are written when output space is made.
+static int _send (void) {
+    int status; // Return status for API calls.
+
+    if (_out.count == 0 || _space() < _out.count) {
+        return 0;
+    }
+    status = _writer(&_out);
+    _out.count = 0;
+    return status;
+}
+
+// Wait for a response until the specified time has passed.
+static void _arm (unsigned long ms) {
+    _deadline = _now() + ms;
+}
+
+// Print progress of transfer.
+static void _show (void) {
+    double secs;    // Time since data started to flow.
+    double rate;    // File bytes sent per second.
+
+    secs = (_now() - _started) / 1e3;
+    rate = (secs > 0) ? _acked / secs : 0;
+    fprintf(
+        stderr, "\r%s: %zu of %zu bytes (%d%%), %.1f kB/s, %.0f%% of line "
+        "rate ", _name, _acked, _size,
+        _size ? (int)(_acked * 100 / _size) : 100, rate / 1e3,
+        rate * 1e3 / _rate
+    );
+    _shown = true;
+}
+
+// End transfer, print its outcome, and unmap file.
+static int _finish (bool ok, const char * reason) {
+    double secs;    // Time since data started to flow.
+
+    if (_shown) {
+        _acked = ok ? _size : _acked;
+        _show();
+        fprintf(stderr, "\n");
+    }
+    secs = _started ? (_now() - _started) / 1e3 : 0;
+    if (ok && _skipped) {
+        fprintf(stderr, "Receiver skipped '%s'\n", _name);
+    } else if (ok) {
+        fprintf(
+            stderr, "Sent '%s' by %s: %zu bytes in %.1f s, %.1f kB/s, "
+            "%.0f%% of %lu baud line rate\n", _name, _proto_name[_proto],
+            _size, secs, (secs > 0) ? _size / secs / 1e3 : 0.0,
+            (secs > 0) ? _size / secs * 1e3 / _rate : 0.0, _rate
+        );
+        _files++;
+        _bytes += _size;
+    } else {
+        fprintf(
+            stderr, "Failed to send '%s' by %s (%s)\n", _name,
+            _proto_name[_proto], reason
+        );
+        _failed++;
+    }
+
+    // Stop progress timer, and unmap file.
+    _state = TRANSFER_IDLE;
+    if (_timer_fd >= 0) {
+        event_remove_handler(_timer_fd);
+        _timer_fd = -1;
+    }
+    if (_map != NULL) {
+        munmap(_map, _size);
+        _map = NULL;
+    }
+    return 0;
+}
+
+// Send XMODEM or YMODEM block, padded to its size.
+static int _send_block (
+    unsigned char num, const char * data, size_t count, size_t size, char pad
+) {
+    unsigned char * block;  // Block payload.
+    uint16_t crc;           // CRC.
+    unsigned char sum;      // Checksum.
+
+    _out.count = 0;
+    _put((size == 128) ? TRANSFER_SOH : TRANSFER_STX);
+    _put(num);
+    _put(~num & 0xff);
+    block = (unsigned char *)_out.data + _out.count;
+    memcpy(block, data, count);
+    memset(block + count, pad, size - count);
+    _out.count += size;
+    if (_crc) {
+        crc = _update_crc16(0, block, size);
+        _put(crc >> 8);
+        _put(crc & 0xff);
+    } else {
+        sum = 0;
+        for (size_t i = 0; i < size; i++) {
+            sum += block[i];
+        }
+        _put(sum);
+    }
+    _sent = _now();
+    _arm(_wait);
+    return _send();
+}
+
+// Send YMODEM header block with file name, size, time and mode, or the empty
+// one ending the batch.
+static int _send_header (bool end) {
+    char info[TRANSFER_BLOCK_SIZE]; // Header payload.
+    size_t count = 0;               // Header payload length.
+
+    memset(info, 0, sizeof(info));
+    if (!end) {
+        count = strlen(_name);
+        count = (count < 900) ? count : 900;
+        memcpy(info, _name, count);
+        count++;
+        count += snprintf(
+            info + count, sizeof(info) - count, "%zu %lo %o", _size,
+            (unsigned long)_stat.st_mtime, (unsigned)_stat.st_mode
+        ) + 1;
+    }
+    return _send_block(0, info, count, (count <= 128) ? 128 : 1024, 0);
+}
+
+// Send XMODEM or YMODEM data block at the current position, or end of file
+// once all data was sent.
+static int _send_data (void) {
+    size_t rest = _size - _pos; // Data left to send.
+    size_t size;                // Block size.
+
+    if (rest == 0) {
+        _state = TRANSFER_WAIT_EOT;
+        _out.count = 0;
+        _put(TRANSFER_EOT);
+        _arm(_wait);
+        return _send();
+    }
+    _state = TRANSFER_WAIT_BLOCK;
+    size = (_crc && rest > 128) ? TRANSFER_BLOCK_SIZE : 128;
+    _len = (rest < size) ? rest : size;
+    return _send_block(_block, _map + _pos, _len, size, TRANSFER_SUB);
+}
+
+// Send ZMODEM file information.
+static int _send_file (void) {
+    char info[TRANSFER_BLOCK_SIZE]; // File information.
+    size_t count;                   // File information length.
+
+    count = strlen(_name);
+    count = (count < 900) ? count : 900;
+    memcpy(info, _name, count);
+    info[count++] = '\0';
+    count += snprintf(
+        info + count, sizeof(info) - count, "%zu %lo %o 0 1 %zu", _size,
+        (unsigned long)_stat.st_mtime, (unsigned)_stat.st_mode, _size
+    ) + 1;
+    _out.count = 0;
+    _put_bin_header(TRANSFER_ZFILE, 0);
+    _put_subpacket(info, count, TRANSFER_ZCRCW);
+    _arm(_wait);
+    return _send();
+}
+
+// Stream ZMODEM data subpackets while output space is available and the
+// unacknowledged data stays within the window. Asks for acknowledgement four
+// times per window, and ends the frame when the receiver buffer is full, or
+// with the end of file.
+static int _pump (void) {
+    int status;     // Return status for API calls.
+    size_t count;   // Payload of subpacket.
+    int end;        // Frame end of subpacket.
+
+    while (_state == TRANSFER_SEND_DATA && _out.count == 0) {
+        if (_pos < _size && _pos - _acked >= _window) {
+            // Wait for acknowledgement.
+            if (_deadline == 0) {
+                _arm(_wait);
+            }
+            return 0;
+        }
+        if (_space() < TRANSFER_PACKET_SIZE) {
+            // Wait for output space.
+            return 0;
+        }
+
+        // Choose frame end of next subpacket.
+        count = _size - _pos;
+        count = (count < TRANSFER_BLOCK_SIZE) ? count : TRANSFER_BLOCK_SIZE;
+        if (_pos + count == _size) {
+            end = TRANSFER_ZCRCE;
+        } else if (_rxbuf > 0 && _pos + count - _acked >= _rxbuf) {
+            end = TRANSFER_ZCRCW;
+        } else if (_pos + count >= _ask) {
+            end = TRANSFER_ZCRCQ;
+            _ask = _pos + count + _window / 4;
+        } else {
+            end = TRANSFER_ZCRCG;
+        }
+
+        // Send subpacket, and end of file after the last one.
+        _put_subpacket(_map + _pos, count, end);
+        _pos += count;
+        if (end == TRANSFER_ZCRCE) {
+            _put_bin_header(TRANSFER_ZEOF, _pos);
+            _state = TRANSFER_WAIT_EOF;
+            _arm(_wait);
+        } else if (end == TRANSFER_ZCRCW) {
+            _state = TRANSFER_WAIT_ACK;
+            _arm(_wait);
+        }
+        status = _send();
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Start ZMODEM data frame at the specified position, discarding packets not
+// written yet.
+static int _send_frame (size_t pos) {
+    int status; // Return status for API calls.
+
+    _pos = _acked = pos;
+    _ask = pos + _window / 4;
+    _deadline = 0;
+    _state = TRANSFER_SEND_DATA;
+    _out.count = 0;
+    _put_bin_header(TRANSFER_ZDATA, pos);
+    status = _send();
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    return _pump();
+}
+
+// Send again what the receiver missed, unless out of attempts.
+static int _resend (void) {
+    if (++_tries > TRANSFER_TRIES) {
+        return _finish(false, "no response from receiver");
+    }
+    _resent++;
+    switch (_state) {
+        case TRANSFER_WAIT_HEADER:
+        case TRANSFER_WAIT_DATA:
+            _state = TRANSFER_WAIT_HEADER;
+            return _send_header(false);
+        case TRANSFER_WAIT_BLOCK:
+        case TRANSFER_WAIT_EOT:
+        case TRANSFER_WAIT_CLOSE:
+            return _send_data();
+        case TRANSFER_WAIT_END:
+            return _send_header(true);
+        case TRANSFER_WAIT_RINIT:
+            _out.count = 0;
+            _put_hex_header(TRANSFER_ZRQINIT, 0);
+            _arm(_wait);
+            return _send();
+        case TRANSFER_WAIT_RPOS:
+            return _send_file();
+        case TRANSFER_SEND_DATA:
+        case TRANSFER_WAIT_ACK:
+            return _send_frame(_acked);
+        case TRANSFER_WAIT_EOF:
+            _out.count = 0;
+            _put_bin_header(TRANSFER_ZEOF, _size);
+            _arm(_wait);
+            return _send();
+        case TRANSFER_WAIT_FIN:
+            _out.count = 0;
+            _put_hex_header(TRANSFER_ZFIN, 0);
+            _arm(_wait);
+            return _send();
+        default:
+            return _finish(false, "receiver did not start");
+    }
+}
+
+// Check if a receiver asking to start again has missed the first block. Start
+// requests sent before the block could arrive are ignored.
+static bool _restart (unsigned char c) {
+    return c == TRANSFER_CRC && _now() - _sent >= 1000;
+}
+
+// Handle XMODEM or YMODEM response byte.
+static int _handle_byte (unsigned char c) {
+    // Two cancel bytes in a row cancel the transfer.
+    if (c == TRANSFER_CAN) {
+        _cans++;
+        return (_cans < 2) ? 0 : _finish(false, "cancelled by receiver");
+    }
+    _cans = 0;
+
+    switch (_state) {
+        case TRANSFER_WAIT_START:
+            // Start with header block or first data block, in CRC mode if
+            // asked for. Only XMODEM falls back to checksums.
+            if (
+                c != TRANSFER_CRC &&
+                (c != TRANSFER_NAK || _proto != TRANSFER_XMODEM)
+            ) {
+                return 0;
+            }
+            _crc = (c == TRANSFER_CRC);
+            _started = _now();
+            _tries = 0;
+            _block = 1;
+            _pos = _acked = 0;
+            if (_proto == TRANSFER_YMODEM) {
+                _state = TRANSFER_WAIT_HEADER;
+                return _send_header(false);
+            }
+            return _send_data();
+        case TRANSFER_WAIT_HEADER:
+            if (c == TRANSFER_ACK) {
+                _tries = 0;
+                _state = TRANSFER_WAIT_DATA;
+                return 0;
+            }
+            return (c == TRANSFER_NAK || _restart(c)) ? _resend() : 0;
+        case TRANSFER_WAIT_DATA:
+            if (c != TRANSFER_CRC) {
+                return 0;
+            }
+            _tries = 0;
+            return _send_data();
+        case TRANSFER_WAIT_BLOCK:
+            // Send next block once acknowledged.
+            if (c == TRANSFER_ACK) {
+                _tries = 0;
+                _pos += _len;
+                _acked = _pos;
+                _block++;
+                return _send_data();
+            } else if (c == TRANSFER_NAK || (_restart(c) && _pos == 0)) {
+                return _resend();
+            }
+            return 0;
+        case TRANSFER_WAIT_EOT:
+            // Many receivers refuse the first end of file, to make sure.
+            if (c == TRANSFER_ACK && _proto == TRANSFER_YMODEM) {
+                _tries = 0;
+                _state = TRANSFER_WAIT_CLOSE;
+                _arm(_wait);
+                return 0;
+            } else if (c == TRANSFER_ACK) {
+                return _finish(true, NULL);
+            } else if (c == TRANSFER_NAK && _tries == 0) {
+                _tries++;
+                return _send_data();
+            }
+            return (c == TRANSFER_NAK) ? _resend() : 0;
+        case TRANSFER_WAIT_CLOSE:
+            if (c != TRANSFER_CRC) {
+                return 0;
+            }
+            _tries = 0;
+            _state = TRANSFER_WAIT_END;
+            return _send_header(true);
+        case TRANSFER_WAIT_END:
+            if (c == TRANSFER_ACK) {
+                return _finish(true, NULL);
+            }
+            return (c == TRANSFER_NAK || c == TRANSFER_CRC) ? _resend() : 0;
+        default:
+            return 0;
+    }
+}
+
+// Parse ZMODEM header byte. Returns 1 once a complete header with a valid CRC
+// was parsed.
+static int _parse_header (unsigned char c) {
+    int digit;      // Hex digit value.
+    uint16_t crc;   // CRC.
+
+    switch (_parse) {
+        case TRANSFER_PARSE_SEEK:
+            _parse = (c == TRANSFER_ZPAD) ? TRANSFER_PARSE_PAD : _parse;
+            return 0;
+        case TRANSFER_PARSE_PAD:
+            if (c == TRANSFER_ZDLE) {
+                _parse = TRANSFER_PARSE_FORMAT;
+            } else if (c != TRANSFER_ZPAD) {
+                _parse = TRANSFER_PARSE_SEEK;
+            }
+            return 0;
+        case TRANSFER_PARSE_FORMAT:
+            _hcount = 0;
+            _hzdle = false;
+            if (c == TRANSFER_ZHEX) {
+                _parse = TRANSFER_PARSE_HEX;
+                _hsize = 7;
+            } else if (c == TRANSFER_ZBIN || c == TRANSFER_ZBIN32) {
+                _parse = TRANSFER_PARSE_BIN;
+                _hsize = (c == TRANSFER_ZBIN) ? 7 : 9;
+            } else {
+                _parse = TRANSFER_PARSE_SEEK;
+            }
+            return 0;
+        case TRANSFER_PARSE_HEX:
+            // Read two hex digits per byte.
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                _parse = TRANSFER_PARSE_SEEK;
+                return 0;
+            }
+            if (_hcount % 2 == 0) {
+                _hdr[_hcount / 2] = digit << 4;
+            } else {
+                _hdr[_hcount / 2] |= digit;
+            }
+            if (++_hcount < 2 * _hsize) {
+                return 0;
+            }
+            break;
+        case TRANSFER_PARSE_BIN:
+            // Read escaped bytes.
+            if (!_hzdle && c == TRANSFER_ZDLE) {
+                _hzdle = true;
+                return 0;
+            } else if (_hzdle) {
+                _hzdle = false;
+                if (c == TRANSFER_ZRUB0) {
+                    c = 0x7f;
+                } else if (c == TRANSFER_ZRUB1) {
+                    c = 0xff;
+                } else {
+                    c ^= 0x40;
+                }
+            }
+            _hdr[_hcount++] = c;
+            if (_hcount < _hsize) {
+                return 0;
+            }
+            break;
+    }
+
+    // Check CRC of complete header.
+    _parse = TRANSFER_PARSE_SEEK;
+    if (_hsize == 9) {
+        return _get_crc32(_hdr, 5) == (
+            (uint32_t)_hdr[5] | (uint32_t)_hdr[6] << 8 |
+            (uint32_t)_hdr[7] << 16 | (uint32_t)_hdr[8] << 24
+        );
+    }
+    crc = _update_crc16(0, _hdr, 5);
+    return crc == ((_hdr[5] << 8) | _hdr[6]);
+}
+
+// Handle ZMODEM header of receiver.
+static int _handle_header (void) {
+    uint32_t val;   // Position or flags, least significant byte first.
+
+    val = (uint32_t)_hdr[1] | (uint32_t)_hdr[2] << 8 |
+        (uint32_t)_hdr[3] << 16 | (uint32_t)_hdr[4] << 24;
+    switch (_hdr[0]) {
+        case TRANSFER_ZRINIT:
+            // Once the receiver is ready, send file information, adapting to
+            // its buffer and escaping needs. Once it has the whole file, end
+            // the session.
+            if (_state == TRANSFER_WAIT_RINIT) {
+                _rxbuf = val & 0xffff;
+                if (_rxbuf == 0 && !(_hdr[4] & TRANSFER_CANOVIO)) {
+                    _rxbuf = _window;
+                }
+                _set_escape(_hdr[4] & TRANSFER_ESCCTL);
+                _started = _now();
+                _tries = 0;
+                _state = TRANSFER_WAIT_RPOS;
+                return _send_file();
+            } else if (_state == TRANSFER_WAIT_RPOS) {
+                return _resend();
+            } else if (_state == TRANSFER_WAIT_EOF) {
+                _tries = 0;
+                _acked = _size;
+                _state = TRANSFER_WAIT_FIN;
+                _out.count = 0;
+                _put_hex_header(TRANSFER_ZFIN, 0);
+                _arm(_wait);
+                return _send();
+            }
+            return 0;
+        case TRANSFER_ZRPOS:
+            // Send data from the position the receiver asks for.
+            if (
+                _state != TRANSFER_WAIT_RPOS && _state != TRANSFER_SEND_DATA &&
+                _state != TRANSFER_WAIT_ACK && _state != TRANSFER_WAIT_EOF
+            ) {
+                return 0;
+            } else if (val > _size) {
+                return _finish(false, "receiver asked for invalid position");
+            }
+            if (_state != TRANSFER_WAIT_RPOS) {
+                if (++_tries > TRANSFER_TRIES) {
+                    return _finish(false, "too many errors");
+                }
+                _resent++;
+            }
+            return _send_frame(val);
+        case TRANSFER_ZACK:
+            // Move window on, and start new frame once a full receiver buffer
+            // was acknowledged.
+            if (
+                (_state != TRANSFER_SEND_DATA && _state != TRANSFER_WAIT_ACK) ||
+                val <= _acked || val > _pos
+            ) {
+                return 0;
+            }
+            _acked = val;
+            _tries = 0;
+            _deadline = 0;
+            if (_state == TRANSFER_WAIT_ACK && _acked == _pos) {
+                return _send_frame(_pos);
+            }
+            return _pump();
+        case TRANSFER_ZSKIP:
+            _skipped = true;
+            _state = TRANSFER_WAIT_FIN;
+            _out.count = 0;
+            _put_hex_header(TRANSFER_ZFIN, 0);
+            _arm(_wait);
+            return _send();
+        case TRANSFER_ZNAK:
+            return (_state == TRANSFER_SEND_DATA) ? 0 : _resend();
+        case TRANSFER_ZFIN:
+            if (_state != TRANSFER_WAIT_FIN) {
+                return 0;
+            }
+            _out.count = 0;
+            _put('O');
+            _put('O');
+            _writer(&_out);
+            _out.count = 0;
+            return _finish(true, NULL);
+        case TRANSFER_ZABORT:
+        case TRANSFER_ZFERR:
+        case TRANSFER_ZCAN:
+            return _finish(false, "cancelled by receiver");
+        default:
+            return 0;
+    }
+}
+
+// Progress timer event handler. Shows progress, and sends again what the
+// receiver did not respond to in time.
+static int _handle_timer (int fd, uint32_t events, void * arg) {
+    if (_state == TRANSFER_IDLE) {
+        return 0;
+    }
+    if (_started != 0) {
+        _show();
+    }
+    if (_deadline != 0 && _now() >= _deadline) {
+        _deadline = 0;
+        return _resend();
+    }
+    return 0;
+}
+
+int transfer_open (
+    const char * path, const char * proto, unsigned long rate,
+    transfer_writer_t writer, transfer_space_t space
+) {
+    uint16_t crc;   // CRC of table entry.
+
+    // Get protocol.
+    if (strcmp(proto, "xmodem") == 0) {
+        _proto = TRANSFER_XMODEM;
+    } else if (strcmp(proto, "ymodem") == 0) {
+        _proto = TRANSFER_YMODEM;
+    } else if (strcmp(proto, "zmodem") == 0) {
+        _proto = TRANSFER_ZMODEM;
+    } else {
+        // If unsupported, exit with failure.
+        fprintf(stderr, "Unsupported transfer protocol '%s'\n", proto);
+        return -1;
+    }
+    _path = path;
+    _name = basename(path);
+    _rate = rate;
+    _writer = writer;
+    _space = space;
+
+    // Stream about 125 ms of data per window, but at least 16k, and allow for
+    // a window and a packet to be sent before expecting a response.
+    _window = rate / 80;
+    _window = (_window > 16384) ? _window : 16384;
+    _window = (_window < 65536) ? _window : 65536;
+    _wait = TRANSFER_WAIT + (_window + TRANSFER_PACKET_SIZE) * 10000 / rate;
+
+    // Set up CRC lookup table.
+    for (int i = 0; i < 256; i++) {
+        crc = i << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        _crc16[i] = crc;
+    }
+
+    // Use packet storage, with room for a header and a packet.
+    _out.data = _packet;
+    _out.size = sizeof(_packet);
+    _out.count = 0;
+
+    return 0;
+}
+
+void transfer_close (void) {
+    transfer_cancel();
+}
+
+size_t transfer_get_space (void) {
+    return sizeof(_packet);
+}
+
+int transfer_start (void) {
+    int fd;     // File descriptor of file.
+    int status; // Return status for API calls.
+
+    if (_state != TRANSFER_IDLE) {
+        return 0;
+    }
+
+    // Map file into memory. An empty file cannot be mapped, and has no data.
+    fd = open(_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &_stat) < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open file '%s' (%s)\n", _path, strerror(errno)
+        );
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    _size = _stat.st_size;
+    _map = NULL;
+    if (_size > 0) {
+        _map = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (_map == MAP_FAILED) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to map file '%s' (%s)\n", _path,
+                strerror(errno)
+            );
+            _map = NULL;
+            close(fd);
+            return -1;
+        }
+        madvise(_map, _size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // Show progress, and keep track of response deadlines.
+    _timer_fd = event_register_timer(TRANSFER_TICK, _handle_timer, NULL);
+    if (_timer_fd < 0) {
+        // On error, unmap file and exit with failure.
+        if (_map != NULL) {
+            munmap(_map, _size);
+            _map = NULL;
+        }
+        return -1;
+    }
+
+    // Wait for receiver to start. A ZMODEM receiver is asked to start, and a
+    // terminal program running on the other side may start one on `rz`.
+    _pos = _acked = 0;
+    _tries = _cans = 0;
+    _started = 0;
+    _shown = false;
+    _skipped = false;
+    _last = 0;
+    _parse = TRANSFER_PARSE_SEEK;
+    _set_escape(false);
+    fprintf(
+        stderr, "Sending '%s' by %s, %zu bytes, start the receiver now\n",
+        _name, _proto_name[_proto], _size
+    );
+    _out.count = 0;
+    if (_proto == TRANSFER_ZMODEM) {
+        _state = TRANSFER_WAIT_RINIT;
+        memcpy(_out.data, "rz\r", 3);
+        _out.count = 3;
+        _put_hex_header(TRANSFER_ZRQINIT, 0);
+        _arm(_wait);
+    } else {
+        _state = TRANSFER_WAIT_START;
+        _arm(TRANSFER_START_WAIT);
+    }
+    status = _send();
+    if (status < 0) {
+        // On error, end transfer and exit with failure.
+        _finish(false, "failed to write");
+        return -1;
+    }
+
+    return 0;
+}
+
+int transfer_cancel (void) {
+    int status; // Return status for API calls.
+
+    if (_state == TRANSFER_IDLE) {
+        return 0;
+    }
+
+    // Send cancel sequence, understood by all protocols, and erase it from
+    // the screen of a receiver that was never started.
+    _out.count = 0;
+    for (int i = 0; i < 8; i++) {
+        _put(TRANSFER_CAN);
+    }
+    for (int i = 0; i < 8; i++) {
+        _put(TRANSFER_BS);
+    }
+    status = _writer(&_out);
+    _out.count = 0;
+    _finish(false, "cancelled");
+    return status;
+}
+
+bool transfer_is_active (void) {
+    return _state != TRANSFER_IDLE;
+}
+
+int transfer_process_data (const buffer_t * data) {
+    int status;         // Return status for API calls.
+    unsigned char c;    // Received byte.
+
+    for (size_t i = 0; i < data->count && _state != TRANSFER_IDLE; i++) {
+        c = data->data[i];
+        if (_proto != TRANSFER_ZMODEM) {
+            status = _handle_byte(c);
+        } else {
+            // Five cancel bytes in a row cancel the session.
+            _cans = (c == TRANSFER_CAN) ? _cans + 1 : 0;
+            if (_cans >= 5) {
+                status = _finish(false, "cancelled by receiver");
+            } else if (_parse_header(c)) {
+                status = _handle_header();
+            } else {
+                status = 0;
+            }
+        }
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int transfer_resume_data (void) {
+    int status; // Return status for API calls.
+
+    if (_state == TRANSFER_IDLE) {
+        return 0;
+    }
+    status = _send();
+    if (status < 0) {
+        // On error, exit with failure.
+        return -1;
+    }
+    return _pump();
+}
+
+void transfer_report (void) {
+    fprintf(
+        stderr, "File transfer: %lu files sent, %lu failed, %lu bytes, "
+        "%lu packets sent again\n", _files, _failed, _bytes, _resent
+    );
+}
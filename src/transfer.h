@@ -0,0 +1,180 @@
+/** @defgroup   transfer Transfer
+ *
+ *  @brief      In-session file transfer.
+ *
+ *  This module contains functions to send a file over the open serial port
+ *  without leaving the session, with XMODEM-1K, YMODEM or ZMODEM. The file is
+ *  memory-mapped when a transfer starts, so that a file rebuilt between two
+ *  transfers is sent anew, and packets are built straight from the mapping.
+ *
+ *  XMODEM-1K and YMODEM send one block at a time, and wait for it to be
+ *  acknowledged, as legacy bootloaders expect. ZMODEM streams data subpackets
+ *  without waiting, and asks the receiver to acknowledge its position four
+ *  times per window, so that the line stays busy while at most a window of
+ *  data is unacknowledged. Whenever the receiver reports an error, sending
+ *  resumes from the position it asks for.
+ *
+ *  The transfer runs in the event loop. Its output is written through a writer
+ *  that never blocks, which is only given as much as it has space for, and its
+ *  progress and effective throughput against the line rate are written to
+ *  `stderr`.
+ */
+
+#ifndef __TRANSFER_H__
+#define __TRANSFER_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+
+/** @ingroup    transfer
+ *
+ *  @brief      Transfer writer.
+ *
+ *  Writes transfer data to the serial port without blocking, queueing what
+ *  cannot be written at once.
+ *
+ *  @param      data    Pointer to buffer to be written.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+typedef int (* transfer_writer_t) (const buffer_t * data);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Transfer output space getter.
+ *
+ *  Gets the number of bytes the writer takes without dropping any.
+ *
+ *  @return     Free output space in bytes.
+ */
+
+typedef size_t (* transfer_space_t) (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Prepare file transfers.
+ *
+ *  Sets the file to be sent and the protocol to send it with. The file is only
+ *  opened once a transfer is started.
+ *
+ *  @param      path    Path to file to be sent.
+ *  @param      proto   Protocol, `xmodem`, `ymodem` or `zmodem`.
+ *  @param      rate    Baud rate in bits per second, to compare throughput to.
+ *  @param      writer  Writer of serial output.
+ *  @param      space   Getter of free serial output space.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int transfer_open (
+    const char * path, const char * proto, unsigned long rate,
+    transfer_writer_t writer, transfer_space_t space
+);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Stop file transfers.
+ *
+ *  Cancels a running transfer, telling the receiver.
+ */
+
+void transfer_close (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Get minimum output space.
+ *
+ *  Gets the free output space a transfer waits for before writing a packet.
+ *  The writer must be able to take at least this much.
+ *
+ *  @return     Output space in bytes.
+ */
+
+size_t transfer_get_space (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Start file transfer.
+ *
+ *  Maps the file into memory, and starts sending it once the receiver asks
+ *  for it. A progress timer is registered in the event loop until the
+ *  transfer ends.
+ *
+ *  @note       The event loop must be opened with a successful call to
+ *              event_open_loop() before calling this function.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, and no transfer was started. Error message
+ *                      is written to `stderr`.
+ */
+
+int transfer_start (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Cancel file transfer.
+ *
+ *  Cancels a running transfer, and sends the receiver the cancel sequence.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int transfer_cancel (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Check if file transfer is running.
+ *
+ *  While a transfer is running, all serial input must be passed to
+ *  transfer_process_data(), and no other data written to the serial port.
+ *
+ *  @return     `true` if a transfer is running, `false` otherwise.
+ */
+
+bool transfer_is_active (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Process serial input of file transfer.
+ *
+ *  Handles the acknowledgements and requests of the receiver held in the
+ *  specified serial input data, and sends what they ask for.
+ *
+ *  @param      data    Pointer to serial input data.
+ *
+ *  @retval     0       Success, whether or not the transfer went on.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int transfer_process_data (const buffer_t * data);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Resume file transfer.
+ *
+ *  Writes packets held back for lack of output space, and streams further
+ *  data. This function must be called whenever output space is made.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int transfer_resume_data (void);
+
+/** @ingroup    transfer
+ *
+ *  @brief      Print file transfer statistics.
+ *
+ *  Writes the number of files sent and failed, the bytes sent, and the number
+ *  of packets sent again to `stderr`.
+ */
+
+void transfer_report (void);
+
+#endif
@@ -0,0 +1,578 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "buffer.h"
+#include "escape.h"
+#include "trigger.h"
+
+// Actions taken on match, as bits of a mask.
+enum {
+    TRIGGER_COLOR = 1,      // Highlight match.
+    TRIGGER_COUNT = 2,      // Print number of matches on exit.
+    TRIGGER_TIME = 4,       // Print time of match.
+    TRIGGER_EXEC = 8        // Run hook command.
+};
+
+// Maximum number of automaton states, which are 16-bit numbers.
+enum {TRIGGER_STATE_COUNT = 65536};
+
+// Maximum number of hook commands running at once. Further matches run none.
+enum {TRIGGER_HOOK_COUNT = 8};
+
+// Escape sequences that start and end highlighting.
+static const char _color_on[] = "\033[1;31m";
+static const char _color_off[] = "\033[0m";
+
+// Pattern.
+typedef struct {
+    char * text;            // Pattern as written in pattern file.
+    char * data;            // Pattern bytes.
+    size_t len;             // Number of pattern bytes.
+    int actions;            // Bit mask of actions.
+    int same;               // Next pattern with the same bytes, or -1.
+    unsigned long count;    // Number of matches.
+} trigger_pattern_t;
+
+// Span of input data to be highlighted.
+typedef struct {
+    size_t start;           // Position of first byte.
+    size_t end;             // Position after last byte.
+} trigger_span_t;
+
+static trigger_pattern_t * _pattern;    // Patterns.
+static int _count = 0;                  // Number of patterns.
+static int _actions;                    // Actions of any pattern.
+static char * _hook;                    // Hook command, or `NULL`.
+
+static uint16_t _class[256];            // Byte class of every byte.
+static int _classes;                    // Number of byte classes.
+static uint16_t * _next;                // Transitions by state and byte class.
+static int * _out;                      // First pattern ending in state.
+static uint16_t * _dict;                // Next state with output on suffixes.
+static uint8_t * _hit;                  // Flag indicating if state matches.
+static int _states;                     // Number of states.
+
+static uint16_t _state;                 // Current state.
+static unsigned long _bytes;            // Number of bytes processed.
+static trigger_span_t * _span;          // Spans to be highlighted.
+static size_t _spans;                   // Number of spans to be highlighted.
+static size_t _span_size;               // Capacity of span array.
+static buffer_t _buf;                   // Highlighted data.
+
+static int _running;                    // Number of hook commands running.
+static unsigned long _hooks;            // Number of hook commands run.
+static unsigned long _skipped;          // Number of hook commands not run.
+
+// Parse comma-separated list of actions in place. Returns bit mask of
+// actions, or -1 if an action is invalid.
+static int _parse_actions (char * str) {
+    int actions = 0;    // Bit mask of actions.
+    char * save;        // State of tokenizer.
+
+    for (
+        char * tok = strtok_r(str, ",", &save); tok != NULL;
+        tok = strtok_r(NULL, ",", &save)
+    ) {
+        if (strcmp(tok, "color") == 0) {
+            actions |= TRIGGER_COLOR;
+        } else if (strcmp(tok, "count") == 0) {
+            actions |= TRIGGER_COUNT;
+        } else if (strcmp(tok, "time") == 0) {
+            actions |= TRIGGER_TIME;
+        } else if (strcmp(tok, "exec") == 0) {
+            actions |= TRIGGER_EXEC;
+        } else {
+            return -1;
+        }
+    }
+
+    return (actions == 0) ? -1 : actions;
+}
+
+// Read patterns from pattern file.
+static int _read (const char * path) {
+    FILE * file;                // Pattern file.
+    char * line = NULL;         // Line of pattern file.
+    size_t size = 0;            // Capacity of line.
+    ssize_t len;                // Length of line.
+    int num = 0;                // Line number.
+    char * text;                // Pattern in line.
+    trigger_pattern_t * pat;    // Reallocated patterns.
+    int actions;                // Bit mask of actions.
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to open pattern file '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        return -1;
+    }
+
+    while ((len = getline(&line, &size, file)) >= 0) {
+        num++;
+
+        // Strip line termination, and skip empty lines and comments.
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        // Split actions from pattern, and parse them.
+        text = strchr(line, ' ');
+        if (text == NULL || text[1] == '\0') {
+            fprintf(
+                stderr, "Missing pattern in '%s' line %d\n", path, num
+            );
+            break;
+        }
+        *text++ = '\0';
+        actions = _parse_actions(line);
+        if (actions < 0) {
+            fprintf(
+                stderr, "Invalid actions '%s' in '%s' line %d\n",
+                line, path, num
+            );
+            break;
+        } else if ((actions & TRIGGER_EXEC) && _hook == NULL) {
+            fprintf(
+                stderr, "Action 'exec' requires a hook command, in '%s' "
+                "line %d\n", path, num
+            );
+            break;
+        }
+
+        // Add pattern, keeping it as written for messages.
+        pat = (trigger_pattern_t *)realloc(
+            _pattern, (_count + 1) * sizeof(trigger_pattern_t)
+        );
+        if (pat == NULL) {
+            fprintf(
+                stderr, "Failed to read pattern file (%s)\n", strerror(errno)
+            );
+            break;
+        }
+        _pattern = pat;
+        pat = &_pattern[_count];
+        pat->text = strdup(text);
+        pat->data = strdup(text);
+        if (pat->text == NULL || pat->data == NULL) {
+            fprintf(
+                stderr, "Failed to read pattern file (%s)\n", strerror(errno)
+            );
+            free(pat->text);
+            free(pat->data);
+            break;
+        }
+        _count++;
+        if (escape_parse_text(pat->data, &pat->len) < 0) {
+            fprintf(
+                stderr, "Invalid escape sequence in '%s' line %d\n",
+                path, num
+            );
+            break;
+        }
+        pat->actions = actions;
+        pat->same = -1;
+        pat->count = 0;
+        _actions |= actions;
+    }
+
+    // Check that the whole file was read, and that it held any patterns.
+    len = (len < 0 && ferror(file)) ? -2 : len;
+    free(line);
+    fclose(file);
+    if (len == -2) {
+        fprintf(
+            stderr, "Failed to read pattern file '%s' (%s)\n",
+            path, strerror(errno)
+        );
+        return -1;
+    } else if (len >= 0) {
+        return -1;
+    } else if (_count == 0) {
+        fprintf(stderr, "No patterns in pattern file '%s'\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Compile patterns into an automaton, whose every state has a transition for
+// every byte class.
+static int _compile (const char * path) {
+    size_t total = 1;   // Upper bound of number of states.
+    int * fail;         // Failure transition of every state.
+    int * queue;        // States in breadth-first order.
+    int head, tail;     // Positions in queue.
+    int s, t, f;        // States.
+    uint16_t * row;     // Transitions of state.
+
+    // Give every byte that occurs in a pattern its own class, and all other
+    // bytes class 0. Patterns using all 256 bytes make 257 classes.
+    memset(_class, 0, sizeof(_class));
+    _classes = 1;
+    for (int p = 0; p < _count; p++) {
+        total += _pattern[p].len;
+        for (size_t i = 0; i < _pattern[p].len; i++) {
+            if (_class[(uint8_t)_pattern[p].data[i]] == 0) {
+                _class[(uint8_t)_pattern[p].data[i]] = _classes++;
+            }
+        }
+    }
+    if (total > TRIGGER_STATE_COUNT) {
+        fprintf(
+            stderr, "Patterns in pattern file '%s' are too long, %zu bytes "
+            "of at most %d\n", path, total - 1, TRIGGER_STATE_COUNT - 1
+        );
+        return -1;
+    }
+
+    // Allocate automaton.
+    _next = (uint16_t *)calloc(total * _classes, sizeof(uint16_t));
+    _out = (int *)malloc(total * sizeof(int));
+    _dict = (uint16_t *)calloc(total, sizeof(uint16_t));
+    _hit = (uint8_t *)calloc(total, sizeof(uint8_t));
+    fail = (int *)calloc(total, sizeof(int));
+    queue = (int *)malloc(total * sizeof(int));
+    if (
+        _next == NULL || _out == NULL || _dict == NULL || _hit == NULL ||
+        fail == NULL || queue == NULL
+    ) {
+        fprintf(
+            stderr, "Failed to compile patterns (%s)\n", strerror(errno)
+        );
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    // Build trie of patterns. No trie edge leads back to the root, so a zero
+    // transition stands for a missing edge. Patterns with the same bytes end
+    // in the same state, and are chained.
+    for (size_t i = 0; i < total; i++) {
+        _out[i] = -1;
+    }
+    _states = 1;
+    for (int p = 0; p < _count; p++) {
+        s = 0;
+        for (size_t i = 0; i < _pattern[p].len; i++) {
+            row = &_next[s * _classes];
+            t = row[_class[(uint8_t)_pattern[p].data[i]]];
+            if (t == 0) {
+                t = _states++;
+                row[_class[(uint8_t)_pattern[p].data[i]]] = t;
+            }
+            s = t;
+        }
+        _pattern[p].same = _out[s];
+        _out[s] = p;
+    }
+
+    // Visit states in breadth-first order, so that the failure state of every
+    // state, which is shallower, is complete when the state is visited. Trie
+    // edges lead to children, whose failure state follows the failure state
+    // of their parent, and missing edges are replaced by the transition of
+    // the failure state.
+    head = 0;
+    tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        s = queue[head++];
+        row = &_next[s * _classes];
+        for (int c = 0; c < _classes; c++) {
+            t = row[c];
+            f = (s == 0) ? 0 : _next[fail[s] * _classes + c];
+            if (t == 0) {
+                row[c] = f;
+                continue;
+            }
+            fail[t] = f;
+            _dict[t] = (_out[f] >= 0) ? f : _dict[f];
+            _hit[t] = (_out[t] >= 0 || _dict[t] != 0);
+            queue[tail++] = t;
+        }
+    }
+
+    free(fail);
+    free(queue);
+
+    return 0;
+}
+
+// Run hook command for a match, unless too many are running already. The
+// command gets the pattern and the offset of the match in its environment,
+// and no console input.
+static void _spawn (const trigger_pattern_t * pat, unsigned long offset) {
+    char * argv[] = {"sh", "-c", _hook, NULL};  // Command arguments.
+    char ** envp;                               // Command environment.
+    int n = 0;                                  // Number of variables.
+    posix_spawn_file_actions_t files;           // Command file descriptors.
+    posix_spawnattr_t attr;                     // Command attributes.
+    sigset_t mask;                              // Command signal mask.
+    pid_t pid;                                  // Command process.
+    int status;                                 // Return status for API calls.
+
+    if (_running >= TRIGGER_HOOK_COUNT) {
+        _skipped++;
+        return;
+    }
+
+    // Add pattern and offset to environment.
+    while (environ[n] != NULL) {
+        n++;
+    }
+    envp = (char **)calloc(n + 3, sizeof(char *));
+    if (envp == NULL) {
+        fprintf(stderr, "Failed to run hook command (%s)\n", strerror(errno));
+        return;
+    }
+    memcpy(envp, environ, n * sizeof(char *));
+    if (
+        asprintf(&envp[n], "SERIAL_TERMINAL_PATTERN=%s", pat->text) < 0 ||
+        asprintf(&envp[n + 1], "SERIAL_TERMINAL_OFFSET=%lu", offset) < 0
+    ) {
+        fprintf(stderr, "Failed to run hook command (%s)\n", strerror(errno));
+        envp[n] = envp[n + 1] = NULL;
+        free(envp);
+        return;
+    }
+
+    // Run command with standard input from `/dev/null`, and with the signals
+    // unblocked that the event loop receives through its `signalfd`.
+    posix_spawn_file_actions_init(&files);
+    posix_spawn_file_actions_addopen(
+        &files, STDIN_FILENO, "/dev/null", O_RDONLY, 0
+    );
+    posix_spawnattr_init(&attr);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    status = posix_spawn(&pid, "/bin/sh", &files, &attr, argv, envp);
+    if (status != 0) {
+        fprintf(stderr, "Failed to run hook command (%s)\n", strerror(status));
+    } else {
+        _running++;
+        _hooks++;
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&files);
+    free(envp[n]);
+    free(envp[n + 1]);
+    free(envp);
+}
+
+// Print time of a match.
+static void _stamp (const trigger_pattern_t * pat, unsigned long offset) {
+    struct timespec ts; // Current time.
+    struct tm tm;       // Current local time.
+    char str[32];       // Formatted time.
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localtime_r(&ts.tv_sec, &tm);
+    strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(
+        stderr, "[%s.%06ld] Matched '%s' at byte %lu\n", str,
+        ts.tv_nsec / 1000, pat->text, offset
+    );
+}
+
+// Act on every pattern matched in a state, ending at the specified position
+// of the input data.
+static void _match (int s, size_t pos, bool color) {
+    trigger_pattern_t * pat;    // Matched pattern.
+    size_t start;               // Position of first byte of match in data.
+    unsigned long offset;       // Offset of first byte of match in input.
+
+    for (s = (_out[s] >= 0) ? s : _dict[s]; s != 0; s = _dict[s]) {
+        for (int p = _out[s]; p >= 0; p = _pattern[p].same) {
+            pat = &_pattern[p];
+            pat->count++;
+            offset = _bytes + pos + 1 - pat->len;
+            if (pat->actions & TRIGGER_TIME) {
+                _stamp(pat, offset);
+            }
+            if (pat->actions & TRIGGER_EXEC) {
+                _spawn(pat, offset);
+            }
+            if (!color || !(pat->actions & TRIGGER_COLOR)) {
+                continue;
+            }
+
+            // Highlight the part of the match in this data, merging it with
+            // the spans it overlaps or adjoins.
+            start = (pos + 1 > pat->len) ? pos + 1 - pat->len : 0;
+            while (_spans > 0 && start <= _span[_spans - 1].end) {
+                if (_span[_spans - 1].start < start) {
+                    start = _span[_spans - 1].start;
+                }
+                _spans--;
+            }
+            _span[_spans].start = start;
+            _span[_spans].end = pos + 1;
+            _spans++;
+        }
+    }
+}
+
+int trigger_open (const char * path, const char * hook) {
+    int status; // Return status for API calls.
+
+    _hook = (char *)hook;
+    _actions = 0;
+    status = _read(path);
+    if (status == 0) {
+        status = _compile(path);
+    }
+    if (status < 0) {
+        // On error, free patterns and exit with failure.
+        trigger_close();
+        return -1;
+    }
+
+    _state = 0;
+    _bytes = 0;
+    _spans = 0;
+    _span_size = 0;
+    _running = 0;
+
+    return 0;
+}
+
+void trigger_close (void) {
+    for (int p = 0; p < _count; p++) {
+        free(_pattern[p].text);
+        free(_pattern[p].data);
+    }
+    free(_pattern);
+    _pattern = NULL;
+    _count = 0;
+    free(_next);
+    free(_out);
+    free(_dict);
+    free(_hit);
+    _next = NULL;
+    _out = NULL;
+    _dict = NULL;
+    _hit = NULL;
+    free(_span);
+    _span = NULL;
+    buffer_free(&_buf);
+}
+
+int trigger_process_data (buffer_t * data, bool color) {
+    const uint8_t * src = (const uint8_t *)data->data;  // Input data.
+    const uint16_t * next = _next;                      // Transitions.
+    const uint8_t * hit = _hit;                         // Matching states.
+    int classes = _classes;                             // Byte classes.
+    uint16_t s = _state;                                // Current state.
+    trigger_span_t * span;                              // Reallocated spans.
+    size_t pos = 0;                                     // Position in output.
+
+    // Make room for the most spans the data can hold, which are separated by
+    // at least one byte.
+    color = color && (_actions & TRIGGER_COLOR);
+    if (color && _span_size < data->count / 2 + 1) {
+        span = (trigger_span_t *)realloc(
+            _span, (data->count / 2 + 1) * sizeof(trigger_span_t)
+        );
+        if (span == NULL) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to allocate trigger spans (%s)\n",
+                strerror(errno)
+            );
+            return -1;
+        }
+        _span = span;
+        _span_size = data->count / 2 + 1;
+    }
+
+    // Run automaton over data, one table lookup per byte, with the table in
+    // local variables, so that they stay in registers.
+    _spans = 0;
+    for (size_t i = 0; i < data->count; i++) {
+        s = next[s * classes + _class[src[i]]];
+        if (__builtin_expect(hit[s], 0)) {
+            _match(s, i, color);
+        }
+    }
+    _state = s;
+    _bytes += data->count;
+    if (_spans == 0) {
+        return 0;
+    }
+
+    // Copy data with highlighted spans.
+    if (
+        buffer_reserve(
+            &_buf, data->count + _spans * (
+                sizeof(_color_on) + sizeof(_color_off) - 2
+            )
+        ) < 0
+    ) {
+        // On error, exit with failure.
+        return -1;
+    }
+    _buf.count = 0;
+    for (size_t i = 0; i < _spans; i++) {
+        memcpy(_buf.data + _buf.count, data->data + pos, _span[i].start - pos);
+        _buf.count += _span[i].start - pos;
+        memcpy(_buf.data + _buf.count, _color_on, sizeof(_color_on) - 1);
+        _buf.count += sizeof(_color_on) - 1;
+        memcpy(
+            _buf.data + _buf.count, data->data + _span[i].start,
+            _span[i].end - _span[i].start
+        );
+        _buf.count += _span[i].end - _span[i].start;
+        memcpy(_buf.data + _buf.count, _color_off, sizeof(_color_off) - 1);
+        _buf.count += sizeof(_color_off) - 1;
+        pos = _span[i].end;
+    }
+    memcpy(_buf.data + _buf.count, data->data + pos, data->count - pos);
+    _buf.count += data->count - pos;
+    data->data = _buf.data;
+    data->count = _buf.count;
+
+    return 0;
+}
+
+void trigger_reap_hooks (void) {
+    while (_running > 0 && waitpid(-1, NULL, WNOHANG) > 0) {
+        _running--;
+    }
+}
+
+void trigger_report (bool all) {
+    for (int p = 0; p < _count; p++) {
+        if (all || (_pattern[p].actions & TRIGGER_COUNT)) {
+            fprintf(
+                stderr, "Trigger '%s': %lu matches\n", _pattern[p].text,
+                _pattern[p].count
+            );
+        }
+    }
+    if (all && _hook != NULL) {
+        fprintf(
+            stderr, "Trigger hooks: %lu run, %lu skipped\n", _hooks, _skipped
+        );
+    }
+}
@@ -0,0 +1,101 @@
+/** @defgroup   trigger Trigger
+ *
+ *  @brief      Pattern triggers on serial input.
+ *
+ *  This module contains functions to find a list of patterns, such as
+ *  `panic`, `ASSERT` or a boot banner, in serial input as it arrives, and to
+ *  act on every match: highlight it on the console, count it, print the time
+ *  it was seen, or run a hook command.
+ *
+ *  The pattern list is compiled into an Aho-Corasick automaton, whose
+ *  transitions are all resolved in advance into one table, indexed by state
+ *  and by byte class, bytes that occur in no pattern sharing one class. Every
+ *  byte of input thus costs one table lookup, however many patterns there
+ *  are, and the state carried over between chunks finds matches that span
+ *  them.
+ */
+
+#ifndef __TRIGGER_H__
+#define __TRIGGER_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "buffer.h"
+
+/** @ingroup    trigger
+ *
+ *  @brief      Compile pattern list.
+ *
+ *  Reads the pattern file with the specified path, and compiles its patterns.
+ *  Every line of the pattern file holds a comma-separated list of actions,
+ *  `color`, `count`, `time` or `exec`, followed by a space and the pattern,
+ *  which extends to the end of the line. Patterns may contain the escape
+ *  sequences `\t`, `\r`, `\n`, `\\` and `\xHH`. Empty lines and lines
+ *  starting with `#` are ignored.
+ *
+ *  @param      path    Path to pattern file.
+ *  @param      hook    Hook command run by `/bin/sh` on `exec` matches, or
+ *                      `NULL`. It gets the pattern as written, and the offset
+ *                      of the match in serial input, in the environment
+ *                      variables `SERIAL_TERMINAL_PATTERN` and
+ *                      `SERIAL_TERMINAL_OFFSET`.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int trigger_open (const char * path, const char * hook);
+
+/** @ingroup    trigger
+ *
+ *  @brief      Free pattern list.
+ *
+ *  Frees the automaton and the highlighting buffer. Hook commands still
+ *  running are left to finish.
+ */
+
+void trigger_close (void);
+
+/** @ingroup    trigger
+ *
+ *  @brief      Find patterns in serial input.
+ *
+ *  Finds the patterns in the specified serial input data, continuing matches
+ *  from the previous call, and acts on every match. If requested, and matches
+ *  are to be highlighted, the data is replaced by a highlighted copy, which
+ *  is valid until the next call.
+ *
+ *  @param      data    Pointer to serial input data.
+ *  @param      color   Flag indicating if matches may be highlighted.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int trigger_process_data (buffer_t * data, bool color);
+
+/** @ingroup    trigger
+ *
+ *  @brief      Reap hook commands.
+ *
+ *  Collects the exit status of hook commands that have finished. This
+ *  function must be called whenever `SIGCHLD` is received.
+ */
+
+void trigger_reap_hooks (void);
+
+/** @ingroup    trigger
+ *
+ *  @brief      Print match counts.
+ *
+ *  Writes the number of matches of every pattern with the `count` action to
+ *  `stderr`, or of every pattern, and the number of hook commands run and
+ *  skipped, if requested.
+ *
+ *  @param      all     Flag indicating if all counts are printed.
+ */
+
+void trigger_report (bool all);
+
+#endif
@@ -0,0 +1,743 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "serial.h"
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "buffer.h"
+#include "line.h"
+#include "console.h"
+#include "event.h"
+#include "capture.h"
+#include "session.h"
+#include "broadcast.h"
+#include "metrics.h"
+
+// Opcode of multishot reads, which kernel headers before Linux 6.7 lack.
+enum {URING_OP_READ_MULTISHOT = 49};
+
+// Number of submission queue entries, which is ample for the at most five
+// requests pending at a time.
+enum {URING_DEPTH = 32};
+
+// Number of provided buffers in each direction. Must be a power of two.
+enum {URING_BUFFER_COUNT = 16};
+
+// Registered file.
+typedef enum {
+    URING_FILE_SERIAL,              // Serial port.
+    URING_FILE_INPUT,               // Console input.
+    URING_FILE_OUTPUT,              // Console output.
+    URING_FILE_EVENT,               // Event loop.
+    URING_FILE_COUNT                // Number of registered files.
+} uring_file_t;
+
+// Request kind, stored in the low byte of the user data of a request, above
+// which the direction is stored.
+typedef enum {
+    URING_REQ_READ,                 // Read input.
+    URING_REQ_READ_POLL,            // Wait for input.
+    URING_REQ_WRITE,                // Write output.
+    URING_REQ_WRITE_POLL,           // Wait for output space.
+    URING_REQ_EVENT                 // Wait for event loop.
+} uring_req_t;
+
+// Data direction.
+typedef struct {
+    const char * name;              // Name of input, for error messages.
+    uring_file_t in;                // Input file.
+    uring_file_t out;               // Output file.
+    line_state_t line;              // Input translation state.
+    bool capture;                   // Flag indicating if data is captured.
+    char * base;                    // Provided buffers.
+    size_t size;                    // Size of each provided buffer.
+    struct io_uring_buf_ring * br;  // Provided buffer ring.
+    unsigned short tail;            // Provided buffer ring tail.
+    int free;                       // Number of provided buffers available.
+    buffer_t buf;                   // Translation buffer.
+    int bid[URING_BUFFER_COUNT];    // IDs of buffers read, in order.
+    size_t len[URING_BUFFER_COUNT]; // Number of bytes in buffers read.
+    int first;                      // Position of first buffer read.
+    int count;                      // Number of buffers read, not written.
+    int wbid;                       // ID of buffer being written.
+    buffer_t data;                  // Data remaining to be written.
+    bool reading;                   // Flag indicating if read is pending.
+    bool multishot;                 // Flag indicating if reads are multishot.
+    bool eof;                       // Flag indicating if input has ended.
+    bool writing;                   // Flag indicating if write is pending.
+    unsigned long bytes;            // Number of bytes read.
+} uring_dir_t;
+
+static int _fd = -1;                        // `io_uring` instance.
+static int _file[URING_FILE_COUNT];         // File descriptors.
+static bool _fixed_files;                   // Flag if files are registered.
+static bool _fixed_bufs;                    // Flag if buffers are registered.
+
+static void * _sq_ptr = MAP_FAILED;         // Submission queue mapping.
+static size_t _sq_len;                      // Submission queue mapping size.
+static void * _cq_ptr = MAP_FAILED;         // Completion queue mapping.
+static size_t _cq_len;                      // Completion queue mapping size.
+static struct io_uring_sqe * _sqes = MAP_FAILED;    // Submission entries.
+static size_t _sqes_len;                    // Submission entries size.
+
+static unsigned * _sq_head;                 // Submission queue head.
+static unsigned * _sq_tail;                 // Submission queue tail.
+static unsigned _sq_mask;                   // Submission queue index mask.
+static unsigned * _sq_array;                // Submission queue index array.
+static unsigned _sq_entries;                // Submission queue size.
+static unsigned * _cq_head;                 // Completion queue head.
+static unsigned * _cq_tail;                 // Completion queue tail.
+static unsigned _cq_mask;                   // Completion queue index mask.
+static struct io_uring_cqe * _cqes;         // Completion queue entries.
+static unsigned _pending;                   // Number of unsubmitted requests.
+
+static uring_dir_t _dir[2];                 // Serial and console input.
+static unsigned short _id;                  // Port ID of serial port.
+static bool _stop;                          // Flag to stop loop.
+
+static unsigned long _enters;               // Number of `io_uring_enter()`.
+static unsigned long _submits;              // Number of requests submitted.
+static unsigned long _reaps;                // Number of completions reaped.
+
+// Create `io_uring` instance, and map its queues.
+static int _setup (void) {
+    struct io_uring_params params;  // Instance parameters.
+    char * sq;                      // Submission queue mapping.
+    char * cq;                      // Completion queue mapping.
+
+    memset(&params, 0, sizeof(params));
+    _fd = syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+    if (_fd < 0) {
+        return -1;
+    }
+
+    // Map submission and completion queues, which share one mapping on
+    // kernels that support it.
+    _sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_len = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_len = (_sq_len > _cq_len) ? _sq_len : _cq_len;
+    }
+    _sq_ptr = mmap(
+        NULL, _sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        _fd, IORING_OFF_SQ_RING
+    );
+    if (_sq_ptr == MAP_FAILED) {
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        _cq_ptr = mmap(
+            NULL, _cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            _fd, IORING_OFF_CQ_RING
+        );
+        if (_cq_ptr == MAP_FAILED) {
+            return -1;
+        }
+    }
+    _sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(
+        NULL, _sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        _fd, IORING_OFF_SQES
+    );
+    if (_sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    // Locate queue fields.
+    sq = (char *)_sq_ptr;
+    cq = (char *)((_cq_ptr == MAP_FAILED) ? _sq_ptr : _cq_ptr);
+    _sq_head = (unsigned *)(sq + params.sq_off.head);
+    _sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    _sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    _sq_array = (unsigned *)(sq + params.sq_off.array);
+    _sq_entries = params.sq_entries;
+    _cq_head = (unsigned *)(cq + params.cq_off.head);
+    _cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    _cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    _pending = 0;
+
+    return 0;
+}
+
+// Allocate provided buffers and translation buffer of a direction, and
+// register its provided buffer ring as the buffer group numbered after it.
+static int _setup_dir (int dir, size_t size) {
+    uring_dir_t * d = &_dir[dir];   // Direction to be set up.
+    struct io_uring_buf_reg reg;    // Buffer ring registration.
+    int status;                     // Return status for API calls.
+
+    // Allocate provided buffers and page-aligned buffer ring.
+    d->size = size;
+    d->base = (char *)malloc(URING_BUFFER_COUNT * size);
+    if (d->base == NULL) {
+        return -1;
+    }
+    status = posix_memalign(
+        (void **)&d->br, sysconf(_SC_PAGESIZE),
+        URING_BUFFER_COUNT * sizeof(struct io_uring_buf)
+    );
+    if (status != 0) {
+        d->br = NULL;
+        errno = status;
+        return -1;
+    }
+    memset(d->br, 0, URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+    status = buffer_alloc(&d->buf, line_get_buffer_size(size));
+    if (status < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // Register buffer ring.
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)d->br;
+    reg.ring_entries = URING_BUFFER_COUNT;
+    reg.bgid = dir;
+    status = syscall(
+        __NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1
+    );
+    if (status < 0) {
+        return -1;
+    }
+
+    // Reset state.
+    d->tail = 0;
+    d->free = 0;
+    d->first = 0;
+    d->count = 0;
+    d->reading = false;
+    d->multishot = true;
+    d->eof = false;
+    d->writing = false;
+    d->bytes = 0;
+
+    return 0;
+}
+
+// Get a cleared submission queue entry for a request on a registered file.
+static struct io_uring_sqe * _get_sqe (
+    uint8_t op, uring_file_t file, int dir, uring_req_t req
+) {
+    unsigned tail = *_sq_tail;      // Submission queue tail.
+    unsigned head;                  // Submission queue head.
+    struct io_uring_sqe * sqe;      // Submission queue entry.
+
+    head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= _sq_entries) {
+        fprintf(stderr, "Failed to queue I/O request (Queue is full)\n");
+        return NULL;
+    }
+
+    sqe = &_sqes[tail & _sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = op;
+    if (_fixed_files) {
+        sqe->fd = file;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = _file[file];
+    }
+    sqe->user_data = ((uint64_t)dir << 8) | req;
+
+    // Publish entry. It is only submitted by the next `io_uring_enter()`.
+    _sq_array[tail & _sq_mask] = tail & _sq_mask;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _pending++;
+
+    return sqe;
+}
+
+// Give a buffer of a direction back to the kernel.
+static void _provide (uring_dir_t * d, int bid) {
+    struct io_uring_buf * buf;  // Buffer ring entry.
+
+    buf = &d->br->bufs[d->tail & (URING_BUFFER_COUNT - 1)];
+    buf->addr = (uintptr_t)(d->base + bid * d->size);
+    buf->len = d->size;
+    buf->bid = bid;
+    d->tail++;
+    __atomic_store_n(&d->br->tail, d->tail, __ATOMIC_RELEASE);
+    d->free++;
+}
+
+// Request input of a direction, if it is not already requested, and buffers
+// are available to read it into.
+static int _read (int dir) {
+    uring_dir_t * d = &_dir[dir];   // Direction to be read.
+    struct io_uring_sqe * sqe;      // Submission queue entry.
+
+    if (d->reading || d->eof || d->free == 0 || _stop) {
+        return 0;
+    }
+
+    // A multishot read keeps reading into provided buffers as input arrives,
+    // until it runs out of them.
+    sqe = _get_sqe(
+        d->multishot ? URING_OP_READ_MULTISHOT : IORING_OP_READ,
+        d->in, dir, URING_REQ_READ
+    );
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->off = (uint64_t)-1;
+    sqe->len = d->multishot ? 0 : d->size;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = dir;
+    d->reading = true;
+
+    return 0;
+}
+
+// Request output of the data remaining to be written in a direction.
+static int _write (int dir) {
+    uring_dir_t * d = &_dir[dir];   // Direction to be written.
+    struct io_uring_sqe * sqe;      // Submission queue entry.
+    bool own;                       // Flag if data is in translation buffer.
+
+    own = (d->data.data >= d->buf.data)
+        && (d->data.data < d->buf.data + d->buf.size);
+    sqe = _get_sqe(
+        _fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+        d->out, dir, URING_REQ_WRITE
+    );
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->off = (uint64_t)-1;
+    sqe->addr = (uintptr_t)d->data.data;
+    sqe->len = d->data.count;
+    sqe->buf_index = 2 * dir + (own ? 1 : 0);
+    d->writing = true;
+
+    return 0;
+}
+
+// Request a wakeup once a registered file becomes ready.
+static int _poll (int dir, uring_file_t file, uring_req_t req, bool multi) {
+    struct io_uring_sqe * sqe;      // Submission queue entry.
+
+    sqe = _get_sqe(IORING_OP_POLL_ADD, file, dir, req);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->poll32_events = (req == URING_REQ_WRITE_POLL) ? POLLOUT : POLLIN;
+    sqe->len = multi ? IORING_POLL_ADD_MULTI : 0;
+
+    return 0;
+}
+
+// Start writing the next buffer read in a direction, if no write is pending.
+static int _next (int dir) {
+    uring_dir_t * d = &_dir[dir];   // Direction to be written.
+
+    while (!d->writing && d->count > 0) {
+        // Take first buffer read.
+        d->wbid = d->bid[d->first];
+        d->data.data = d->base + d->wbid * d->size;
+        d->data.count = d->len[d->first];
+        d->data.size = 0;
+        d->first = (d->first + 1) % URING_BUFFER_COUNT;
+        d->count--;
+
+        // Translate line terminations, and capture data if required.
+        if (d->in == URING_FILE_SERIAL) {
+            line_process_input_data(&d->line, &d->data, &d->buf);
+        } else {
+            console_scan_input(&d->data);
+            line_process_output_data(&d->data, &d->buf);
+        }
+        if (d->capture) {
+            capture_write_data(&d->data);
+        }
+
+        // If nothing is left to write, give buffer back right away.
+        if (d->data.count == 0) {
+            _provide(d, d->wbid);
+            continue;
+        }
+
+        return _write(dir);
+    }
+
+    return 0;
+}
+
+// Handle completion of a read.
+static int _complete_read (int dir, int res, uint32_t flags) {
+    uring_dir_t * d = &_dir[dir];   // Direction read.
+    int bid;                        // ID of buffer read into.
+    int pos;                        // Position of buffer read.
+
+    // A multishot read only ends once its last completion is posted.
+    if (!(flags & IORING_CQE_F_MORE)) {
+        d->reading = false;
+    }
+
+    // Queue buffer read into for writing. A buffer may also be consumed by
+    // an empty read.
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        d->free--;
+        if (res > 0) {
+            pos = (d->first + d->count) % URING_BUFFER_COUNT;
+            d->bid[pos] = bid;
+            d->len[pos] = res;
+            d->count++;
+            d->bytes += res;
+            if (d->in == URING_FILE_SERIAL) {
+                metrics_add_count(METRICS_SERIAL_IN, res);
+                metrics_add_count(METRICS_SERIAL_READS, 1);
+                metrics_add_sample(METRICS_READ_SIZE, res);
+                session_write_record(
+                    SESSION_RX, _id, d->base + bid * d->size, res
+                );
+                broadcast_write_record(
+                    SHMRING_RX, _id, d->base + bid * d->size, res
+                );
+            } else {
+                metrics_add_count(METRICS_CONSOLE_IN, res);
+            }
+        } else {
+            _provide(d, bid);
+        }
+    }
+
+    if (res == 0 && d->in == URING_FILE_SERIAL) {
+        // If serial port was hung up, exit with failure.
+        fprintf(stderr, "Serial port was hung up\n");
+        return -1;
+    } else if (res == 0) {
+        // Once console input has ended for good, stop reading it. A terminal
+        // reports end of input each time the user enters an end-of-file
+        // character.
+        d->eof = !isatty(_file[d->in]);
+    } else if (res == -EAGAIN) {
+        // If no input was available, wait for it.
+        d->reading = true;
+        return _poll(dir, d->in, URING_REQ_READ_POLL, false);
+    } else if ((res == -EBADFD || res == -EINVAL) && d->multishot) {
+        // If the kernel or the file does not support multishot reads, fall
+        // back to single reads.
+        d->multishot = false;
+    } else if (res < 0 && res != -ENOBUFS && res != -EINTR) {
+        // On other errors than running out of buffers, exit with failure.
+        fprintf(
+            stderr, "Failed to read %s data (%s)\n",
+            d->name, strerror(-res)
+        );
+        return -1;
+    }
+
+    if (_next(dir) < 0) {
+        return -1;
+    }
+    return _read(dir);
+}
+
+// Handle completion of a write.
+static int _complete_write (int dir, int res) {
+    uring_dir_t * d = &_dir[dir];   // Direction written.
+
+    metrics_add_count(
+        (d->out == URING_FILE_SERIAL) ?
+        METRICS_SERIAL_WRITES : METRICS_CONSOLE_WRITES, 1
+    );
+    if (res == -EAGAIN || res == 0) {
+        // If output is full, wait until there is space.
+        metrics_add_count(
+            (d->out == URING_FILE_SERIAL) ?
+            METRICS_SERIAL_STALLS : METRICS_CONSOLE_STALLS, 1
+        );
+        return _poll(dir, d->out, URING_REQ_WRITE_POLL, false);
+    } else if (res == -EINTR) {
+        // If interrupted, try again.
+        return _write(dir);
+    } else if (res < 0) {
+        // On other errors, exit with failure.
+        fprintf(
+            stderr, "Failed to write %s data (%s)\n",
+            d->name, strerror(-res)
+        );
+        return -1;
+    }
+
+    // Count output, record serial output in session log and broadcast ring,
+    // and write remaining data, if any.
+    if (d->out == URING_FILE_SERIAL) {
+        metrics_add_count(METRICS_SERIAL_OUT, res);
+        session_write_record(SESSION_TX, _id, d->data.data, res);
+        broadcast_write_record(SHMRING_TX, _id, d->data.data, res);
+    } else {
+        metrics_add_count(METRICS_CONSOLE_OUT, res);
+    }
+    d->data.data += res;
+    d->data.count -= res;
+    if (d->data.count > 0) {
+        return _write(dir);
+    }
+
+    // Give buffer back, and write next buffer read. Reading may resume if it
+    // had run out of buffers.
+    d->writing = false;
+    _provide(d, d->wbid);
+    if (_next(dir) < 0) {
+        return -1;
+    }
+    return _read(dir);
+}
+
+// Handle a completion.
+static int _complete (const struct io_uring_cqe * cqe) {
+    int dir = cqe->user_data >> 8;  // Direction of request.
+    int status;                     // Return status for API calls.
+
+    switch (cqe->user_data & 0xff) {
+        case URING_REQ_READ:
+            return _complete_read(dir, cqe->res, cqe->flags);
+        case URING_REQ_READ_POLL:
+            _dir[dir].reading = false;
+            return _read(dir);
+        case URING_REQ_WRITE:
+            return _complete_write(dir, cqe->res);
+        case URING_REQ_WRITE_POLL:
+            return _write(dir);
+        case URING_REQ_EVENT:
+            // Call handlers of ready event loop file descriptors, and stop
+            // once the event loop is stopped.
+            status = event_poll_loop();
+            if (status < 0) {
+                return -1;
+            } else if (status > 0) {
+                _stop = true;
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                return _poll(0, URING_FILE_EVENT, URING_REQ_EVENT, true);
+            }
+            return 0;
+    }
+
+    return 0;
+}
+
+// Submit pending requests and wait for at least one completion.
+static int _enter (void) {
+    int status; // Return status for API calls.
+
+    status = syscall(
+        __NR_io_uring_enter, _fd, _pending, 1, IORING_ENTER_GETEVENTS, NULL, 0
+    );
+    _enters++;
+    metrics_add_count(METRICS_WAKEUPS, 1);
+    if (status < 0) {
+        // On errors other than interruption or a full completion queue, exit
+        // with failure.
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            return 0;
+        }
+        fprintf(
+            stderr, "Failed to submit I/O requests (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+    _pending -= status;
+    _submits += status;
+
+    return 0;
+}
+
+int uring_open (serial_t * serial, size_t size) {
+    int status;                         // Return status for API calls.
+    struct iovec iov[4];                // Buffers to be registered.
+
+    // Create `io_uring` instance.
+    status = _setup();
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to set up io_uring (%s)\n",
+            strerror(errno)
+        );
+        uring_close();
+        return -1;
+    }
+
+    // Set up directions. Each provided buffer holds an equal share of the
+    // buffered bytes.
+    _dir[0].name = "serial";
+    _dir[0].in = URING_FILE_SERIAL;
+    _dir[0].out = URING_FILE_OUTPUT;
+    line_reset_state(&_dir[0].line);
+    _dir[0].capture = true;
+    _dir[1].name = "console";
+    _dir[1].in = URING_FILE_INPUT;
+    _dir[1].out = URING_FILE_SERIAL;
+    _dir[1].capture = false;
+    size = (size + URING_BUFFER_COUNT - 1) / URING_BUFFER_COUNT;
+    for (int i = 0; i < 2; i++) {
+        status = _setup_dir(i, size);
+        if (status < 0) {
+            // On error, exit with failure.
+            fprintf(
+                stderr, "Failed to set up io_uring buffers (%s)\n",
+                strerror(errno)
+            );
+            uring_close();
+            return -1;
+        }
+        for (int bid = 0; bid < URING_BUFFER_COUNT; bid++) {
+            _provide(&_dir[i], bid);
+        }
+    }
+
+    // Register file descriptors and buffers. If the kernel refuses, for
+    // example as locked memory is limited, use them unregistered.
+    _file[URING_FILE_SERIAL] = serial_get_fd(serial);
+    _id = serial->id;
+    _file[URING_FILE_INPUT] = console_get_fd();
+    _file[URING_FILE_OUTPUT] = console_get_output_fd();
+    _file[URING_FILE_EVENT] = event_get_fd();
+    status = syscall(
+        __NR_io_uring_register, _fd, IORING_REGISTER_FILES,
+        _file, URING_FILE_COUNT
+    );
+    _fixed_files = (status == 0);
+    for (int i = 0; i < 2; i++) {
+        iov[2 * i].iov_base = _dir[i].base;
+        iov[2 * i].iov_len = URING_BUFFER_COUNT * _dir[i].size;
+        iov[2 * i + 1].iov_base = _dir[i].buf.data;
+        iov[2 * i + 1].iov_len = _dir[i].buf.size;
+    }
+    status = syscall(
+        __NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, iov, 4
+    );
+    _fixed_bufs = (status == 0);
+
+    _enters = 0;
+    _submits = 0;
+    _reaps = 0;
+
+    return 0;
+}
+
+void uring_close (void) {
+    // Close `io_uring` instance, which cancels pending requests and
+    // unregisters files and buffers.
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqes_len);
+        _sqes = MAP_FAILED;
+    }
+    if (_cq_ptr != MAP_FAILED) {
+        munmap(_cq_ptr, _cq_len);
+        _cq_ptr = MAP_FAILED;
+    }
+    if (_sq_ptr != MAP_FAILED) {
+        munmap(_sq_ptr, _sq_len);
+        _sq_ptr = MAP_FAILED;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+
+    // Free buffers.
+    for (int i = 0; i < 2; i++) {
+        free(_dir[i].base);
+        _dir[i].base = NULL;
+        free(_dir[i].br);
+        _dir[i].br = NULL;
+        buffer_free(&_dir[i].buf);
+    }
+}
+
+int uring_run_loop (void) {
+    int status;                     // Return status for API calls.
+    unsigned head;                  // Completion queue head.
+    unsigned tail;                  // Completion queue tail.
+
+    // Request event loop wakeups, and input in both directions.
+    _stop = false;
+    status = _poll(0, URING_FILE_EVENT, URING_REQ_EVENT, true);
+    if (status < 0 || _read(0) < 0 || _read(1) < 0) {
+        return -1;
+    }
+
+    // Run until stopped.
+    while (!_stop) {
+        // Submit requests and wait for completions.
+        status = _enter();
+        if (status < 0) {
+            // On error, exit with failure.
+            return -1;
+        }
+
+        // Handle all completions, which may queue further requests.
+        head = *_cq_head;
+        tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            status = _complete(&_cqes[head & _cq_mask]);
+            _reaps++;
+            if (status < 0) {
+                // On error, exit with failure.
+                __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+                return -1;
+            }
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+void uring_report (void) {
+    double enters = (_enters > 0) ? _enters : 1.0;  // Divisor for rate.
+
+    fprintf(
+        stderr, "Serial input: %lu bytes, Console input: %lu bytes\n",
+        _dir[0].bytes, _dir[1].bytes
+    );
+    fprintf(
+        stderr, "io_uring: %lu requests, %lu completions, %lu enters "
+        "(%.1f completions per enter)%s\n",
+        _submits, _reaps, _enters, _reaps / enters,
+        (_fixed_files && _fixed_bufs) ? "" : ", unregistered"
+    );
+}
+
+#else
+
+int uring_open (serial_t * serial, size_t size) {
+    fprintf(
+        stderr, "Failed to set up io_uring (Not supported by this build)\n"
+    );
+    return -1;
+}
+
+void uring_close (void) {
+}
+
+int uring_run_loop (void) {
+    return -1;
+}
+
+void uring_report (void) {
+}
+
+#endif
@@ -0,0 +1,82 @@
+/** @defgroup   uring   io_uring
+ *
+ *  @brief      `io_uring` I/O backend.
+ *
+ *  This module contains functions to run serial and console I/O on an
+ *  `io_uring` instance instead of the event loop. Serial input and console
+ *  input are read with multishot reads into provided buffers, translated, and
+ *  written to console output and serial output from registered buffers, with
+ *  registered file descriptors. All requests of one iteration are submitted,
+ *  and completions are waited for, with a single `io_uring_enter()` call.
+ *
+ *  The event loop is still used for signals, and is driven by this module
+ *  through its file descriptor. Where the build or the kernel lacks the
+ *  required `io_uring` support, uring_open() fails, and the caller must fall
+ *  back to the event loop.
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stddef.h>
+
+#include "serial.h"
+
+/** @ingroup    uring
+ *
+ *  @brief      Open `io_uring` backend.
+ *
+ *  Creates the `io_uring` instance, allocates its buffers, and registers its
+ *  buffers and the serial, console and event loop file descriptors with it.
+ *
+ *  @note       The serial port, console I/O and event loop must be opened with
+ *              successful calls to serial_open_port(), console_open_stdio() and
+ *              event_open_loop(), and the line terminations configured with
+ *              line_set_term(), before calling this function.
+ *
+ *  @param      serial  Pointer to serial port.
+ *  @param      size    Number of bytes buffered in each direction.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure, as `io_uring` is not supported. Error message
+ *                      is written to `stderr`.
+ */
+
+int uring_open (serial_t * serial, size_t size);
+
+/** @ingroup    uring
+ *
+ *  @brief      Close `io_uring` backend.
+ *
+ *  Closes the `io_uring` instance, cancelling pending requests, and frees its
+ *  buffers.
+ */
+
+void uring_close (void);
+
+/** @ingroup    uring
+ *
+ *  @brief      Run `io_uring` backend.
+ *
+ *  Moves data between the serial port and the console, capturing received
+ *  data with capture_write_data(), until the event loop is stopped or an
+ *  error occurs.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int uring_run_loop (void);
+
+/** @ingroup    uring
+ *
+ *  @brief      Print `io_uring` statistics.
+ *
+ *  Writes the number of requests submitted, completions reaped and
+ *  `io_uring_enter()` calls made, and the bytes moved in each direction, to
+ *  `stderr`.
+ */
+
+void uring_report (void);
+
+#endif
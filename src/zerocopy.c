@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "zerocopy.h"
+
+// Wait until a file descriptor has output space.
+static void _wait (int fd) {
+    struct pollfd evt;  // Output space event structure.
+
+    evt.fd = fd;
+    evt.events = POLLOUT;
+    poll(&evt, 1, -1);
+}
+
+// Write data held in internal pipe with `read()` and `write()`, for output file
+// descriptors that do not support `splice()`.
+static int _copy (zerocopy_t * zc, int out, size_t count) {
+    ssize_t status;     // Return status for API calls.
+    char buf[4096];     // Copy buffer.
+    size_t len;         // Number of bytes in copy buffer.
+    size_t pos;         // Number of bytes written from copy buffer.
+
+    while (count > 0) {
+        // Read data from internal pipe.
+        len = (count < sizeof(buf)) ? count : sizeof(buf);
+        status = read(zc->pipe[0], buf, len);
+        if (status <= 0) {
+            return -1;
+        }
+        len = status;
+        count -= len;
+
+        // Write data to output.
+        for (pos = 0; pos < len; ) {
+            status = write(out, buf + pos, len - pos);
+            if (status < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    _wait(out);
+                    continue;
+                } else if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            pos += status;
+        }
+    }
+
+    return 0;
+}
+
+int zerocopy_open (zerocopy_t * zc, size_t size) {
+    int status; // Return status for API calls.
+
+    // Create internal pipe.
+    status = pipe2(zc->pipe, O_NONBLOCK | O_CLOEXEC);
+    if (status < 0) {
+        // On error, exit with failure.
+        fprintf(
+            stderr, "Failed to create pass-through pipe (%s)\n",
+            strerror(errno)
+        );
+        return -1;
+    }
+
+    // Resize internal pipe. This may be refused beyond the system limit, in
+    // which case the default size is kept.
+    fcntl(zc->pipe[1], F_SETPIPE_SZ, (int)size);
+    status = fcntl(zc->pipe[1], F_GETPIPE_SZ);
+    if (status < 0) {
+        // On error, close pipe and exit with failure.
+        fprintf(
+            stderr, "Failed to obtain pass-through pipe size (%s)\n",
+            strerror(errno)
+        );
+        zerocopy_close(zc);
+        return -1;
+    }
+
+    // Reset state and counters.
+    zc->size = status;
+    zc->enabled = true;
+    zc->calls = 0;
+    zc->bytes = 0;
+
+    return 0;
+}
+
+void zerocopy_close (zerocopy_t * zc) {
+    close(zc->pipe[0]);
+    close(zc->pipe[1]);
+    zc->enabled = false;
+}
+
+int zerocopy_transfer (zerocopy_t * zc, int in, int out) {
+    ssize_t status; // Return status for API calls.
+    size_t moved;   // Number of bytes moved into internal pipe.
+    size_t count;   // Number of bytes held in internal pipe.
+
+    // Move input recursively until none is left.
+    while (zc->enabled) {
+        // Move input into internal pipe, which is always empty at this point.
+        status = splice(
+            in, NULL, zc->pipe[1], NULL, zc->size,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+        );
+        zc->calls++;
+        if (status < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // If no input is left, exit with success.
+                break;
+            } else if (errno == EINTR) {
+                // If interrupted, try again.
+                continue;
+            } else if (errno == EINVAL) {
+                // If input does not support `splice()`, disable pass-through.
+                zc->enabled = false;
+                break;
+            }
+            // On other errors, exit with failure.
+            return -1;
+        } else if (status == 0) {
+            // On end of file, exit with success, indicating end of file.
+            return 1;
+        }
+        moved = status;
+        count = moved;
+        zc->bytes += moved;
+
+        // Move internal pipe contents to output.
+        while (count > 0) {
+            status = splice(
+                zc->pipe[0], NULL, out, NULL, count,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+            );
+            zc->calls++;
+            if (status < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // If output is full, wait until there is space.
+                    _wait(out);
+                    continue;
+                } else if (errno == EINTR) {
+                    // If interrupted, try again.
+                    continue;
+                } else if (errno == EINVAL) {
+                    // If output does not support `splice()`, copy the data
+                    // held in internal pipe, and disable pass-through.
+                    zc->enabled = false;
+                    return _copy(zc, out, count);
+                }
+                // On other errors, exit with failure.
+                return -1;
+            }
+            count -= status;
+        }
+
+        // If input came up short, none is left.
+        if (moved < zc->size) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/** @defgroup   zerocopy    Zero-copy
+ *
+ *  @brief      Zero-copy pass-through.
+ *
+ *  This module contains functions to move data from one file descriptor to
+ *  another with `splice()`, through an internal pipe, without copying it into
+ *  userspace. This is only possible where no line termination translation is
+ *  required. Where the kernel does not support splicing a file descriptor,
+ *  pass-through is disabled and the caller must fall back to buffered I/O.
+ */
+
+#ifndef __ZEROCOPY_H__
+#define __ZEROCOPY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @ingroup    zerocopy
+ *
+ *  @brief      Zero-copy pass-through channel.
+ *
+ *  Holds the internal pipe and usage counters of a pass-through channel. The
+ *  counters may be read directly but must not be modified.
+ */
+
+typedef struct {
+    int pipe[2];            /**< Internal pipe read and write ends. */
+    size_t size;            /**< Capacity of internal pipe in bytes. */
+    bool enabled;           /**< Flag indicating if pass-through works. */
+    unsigned long calls;    /**< Number of `splice()` calls made. */
+    unsigned long bytes;    /**< Number of bytes passed through in total. */
+} zerocopy_t;
+
+/** @ingroup    zerocopy
+ *
+ *  @brief      Open pass-through channel.
+ *
+ *  Creates the internal pipe of a pass-through channel, sized as close to the
+ *  specified size as the system permits, and enables pass-through.
+ *
+ *  @param      zc      Pointer to pass-through channel to be opened.
+ *  @param      size    Desired capacity of internal pipe in bytes.
+ *
+ *  @retval     0       Success.
+ *  @retval     -1      Failure. Error message is written to `stderr`.
+ */
+
+int zerocopy_open (zerocopy_t * zc, size_t size);
+
+/** @ingroup    zerocopy
+ *
+ *  @brief      Close pass-through channel.
+ *
+ *  Closes the internal pipe of a pass-through channel.
+ *
+ *  @param      zc      Pointer to pass-through channel to be closed.
+ */
+
+void zerocopy_close (zerocopy_t * zc);
+
+/** @ingroup    zerocopy
+ *
+ *  @brief      Pass data through.
+ *
+ *  Moves all available data from the specified non-blocking input file
+ *  descriptor to the specified output file descriptor, waiting for output space
+ *  where necessary. If either file descriptor turns out not to support
+ *  `splice()`, any data already taken from the input is written out with
+ *  `write()`, and pass-through is disabled. The caller must then move further
+ *  data itself.
+ *
+ *  @param      zc      Pointer to pass-through channel.
+ *  @param      in      Non-blocking file descriptor to read from.
+ *  @param      out     File descriptor to write to.
+ *
+ *  @retval     0       Success.
+ *  @retval     1       Success, and end of file was reached on input.
+ *  @retval     -1      Failure. `errno` is set to indicate the error.
+ */
+
+int zerocopy_transfer (zerocopy_t * zc, int in, int out);
+
+#endif